@@ -2,24 +2,63 @@
 #define ACTUATOR_MANAGER_H
 
 #include <Arduino.h>
-#include <LiquidCrystal_I2C.h>
+#include "Hal.h"
 #include "StateManager.h"
 
+// LCD writes since boot: characters plus cursor moves, each one byte to
+// the HD44780
+struct DisplayStats {
+    unsigned long frames;
+    unsigned long characters;
+    unsigned long cursorMoves;
+};
+
+template <typename Hal = DefaultHal>
 class ActuatorManager {
+public:
+    static const int LCD_COLS = 20;
+    static const int LCD_ROWS = 4;
+    
 private:
-    LiquidCrystal_I2C lcd;
-    int ledPin;
-    StateManager* stateManager;
+    typename Hal::Display lcd;
+    StateManager<Hal>* stateManager;
+    
+    // One output per zone, indexed like StateManager's zones. ledStates is
+    // what each pin is driven to, so only changes reach the GPIO.
+    int ledPins[StateManager<Hal>::MAX_ZONES];
+    bool ledStates[StateManager<Hal>::MAX_ZONES];
+    int zoneCount;
+    int displayZone;
+    
+    // What the LCD currently shows and the frame being formatted. A push
+    // writes only the cells that differ, so the screen is never cleared.
+    char shown[LCD_ROWS][LCD_COLS];
+    char frame[LCD_ROWS][LCD_COLS];
+    DisplayStats displayStats;
+    
+    void setRow(int row, const char* text);
+    void pushFrame();
     
 public:
-    ActuatorManager(int ledPin = 32);
+    ActuatorManager(int ledPin = 32);       // Zone 0's output
+    
+    // Returns the new zone's index, -1 if the table is full
+    int addZone(int ledPin);
     
     void begin();
-    void setStateManager(StateManager* sm);
+    void setStateManager(StateManager<Hal>* sm);
+    void setDisplayZone(int zone);
+    int getDisplayZone() const;
     void updateDisplay();
-    void updateLED();
-    void controlDevice(bool activate);
+    void updateLEDs();
+    // Drives every zone's output from its state, switching off the zones
+    // outside their safety limits
+    void controlDevices();
     void displayServerInfo(const String& serverIP);
+    const DisplayStats& getDisplayStats() const;
 };
 
+// Instantiated in ActuatorManager.cpp
+extern template class ActuatorManager<DefaultHal>;
+
 #endif
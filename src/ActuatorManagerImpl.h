@@ -0,0 +1,216 @@
+#ifndef ACTUATOR_MANAGER_IMPL_H
+#define ACTUATOR_MANAGER_IMPL_H
+
+// Member definitions of ActuatorManager. ActuatorManager.cpp instantiates them for
+// DefaultHal; tests include this header to use a mock HAL instead.
+
+#include "ActuatorManager.h"
+#include "StateManagerImpl.h"
+#include <stdio.h>
+#include <string.h>
+#include "Log.h"
+
+template <typename Hal>
+ActuatorManager<Hal>::ActuatorManager(int ledPin)
+    : lcd(0x27, LCD_COLS, LCD_ROWS), stateManager(nullptr), zoneCount(0), displayZone(0) {
+    addZone(ledPin);
+    memset(shown, ' ', sizeof(shown));
+    memset(frame, ' ', sizeof(frame));
+    memset(&displayStats, 0, sizeof(displayStats));
+}
+
+template <typename Hal>
+void ActuatorManager<Hal>::begin() {
+    // init() clears the LCD, which matches the blank shadow buffer
+    lcd.init();
+    lcd.backlight();
+    
+    for (int zone = 0; zone < zoneCount; zone++) {
+        Hal::Gpio::configureOutput(ledPins[zone]);
+        Hal::Gpio::write(ledPins[zone], false);
+        ledStates[zone] = false;
+    }
+    
+    LOG_INFO("actuador", "ActuatorManager initialized (%d zonas)", zoneCount);
+}
+
+template <typename Hal>
+int ActuatorManager<Hal>::addZone(int ledPin) {
+    if (zoneCount >= StateManager<Hal>::MAX_ZONES) {
+        return -1;
+    }
+    ledPins[zoneCount] = ledPin;
+    ledStates[zoneCount] = false;
+    return zoneCount++;
+}
+
+template <typename Hal>
+void ActuatorManager<Hal>::setStateManager(StateManager<Hal>* sm) {
+    stateManager = sm;
+}
+
+template <typename Hal>
+void ActuatorManager<Hal>::setDisplayZone(int zone) {
+    if (zone >= 0 && zone < zoneCount) {
+        displayZone = zone;
+    }
+}
+
+template <typename Hal>
+int ActuatorManager<Hal>::getDisplayZone() const {
+    return displayZone;
+}
+
+template <typename Hal>
+void ActuatorManager<Hal>::setRow(int row, const char* text) {
+    // Truncated or padded with spaces to the full width. Counted by hand:
+    // strnlen on a shorter literal makes GCC warn of a read past its end.
+    size_t length = 0;
+    while (length < (size_t)LCD_COLS && text[length] != '\0') {
+        length++;
+    }
+    memcpy(frame[row], text, length);
+    memset(frame[row] + length, ' ', LCD_COLS - length);
+}
+
+template <typename Hal>
+void ActuatorManager<Hal>::pushFrame() {
+    displayStats.frames++;
+    
+    for (int row = 0; row < LCD_ROWS; row++) {
+        int col = 0;
+        while (col < LCD_COLS) {
+            if (frame[row][col] == shown[row][col]) {
+                col++;
+                continue;
+            }
+            
+            // A run of changed cells. Gaps of one unchanged cell are written
+            // through, since that costs the same byte as a cursor move.
+            int start = col;
+            int end = col + 1;
+            while (end < LCD_COLS) {
+                if (frame[row][end] != shown[row][end]) {
+                    end++;
+                } else if (end + 1 < LCD_COLS && frame[row][end + 1] != shown[row][end + 1]) {
+                    end += 2;
+                } else {
+                    break;
+                }
+            }
+            
+            lcd.setCursor(start, row);
+            lcd.write(frame[row] + start, end - start);
+            memcpy(shown[row] + start, frame[row] + start, end - start);
+            displayStats.cursorMoves++;
+            displayStats.characters += end - start;
+            col = end;
+        }
+    }
+}
+
+template <typename Hal>
+void ActuatorManager<Hal>::updateDisplay() {
+    if (!stateManager) return;
+    
+    ZoneStates<StateManager<Hal>::MAX_ZONES>& zones = stateManager->getZones();
+    int zone = displayZone;
+    const char* status;
+    char text[LCD_COLS + 1];
+    
+    if (!zones.estado_device[zone]) {
+        status = "Dispositivo OFF";
+    } else if (zones.active_device_type[zone][0] != '\0' &&
+               strcmp(zones.active_device_type[zone], "Deshumidificador") != 0) {
+        status = "Humidif. ON";
+    } else {
+        status = "Deshumidif. ON";
+    }
+    
+    // With several zones, the one shown is named on the first row
+    if (zoneCount > 1) {
+        snprintf(text, sizeof(text), "Z%d %s", zone, status);
+        setRow(0, text);
+    } else {
+        setRow(0, status);
+    }
+    
+    snprintf(text, sizeof(text), "T:%.1fC H:%.0f%%ICA:%d", zones.temperature[zone], zones.humidity[zone],
+             zones.ICA[zone]);
+    setRow(1, text);
+    
+    setRow(2, stateManager->getApiError());
+    
+    pushFrame();
+}
+
+template <typename Hal>
+void ActuatorManager<Hal>::updateLEDs() {
+    if (!stateManager) return;
+    
+    ZoneStates<StateManager<Hal>::MAX_ZONES>& zones = stateManager->getZones();
+    for (int zone = 0; zone < zoneCount; zone++) {
+        Hal::Gpio::write(ledPins[zone], zones.estado_device[zone]);
+        ledStates[zone] = zones.estado_device[zone];
+    }
+}
+
+template <typename Hal>
+void ActuatorManager<Hal>::controlDevices() {
+    if (!stateManager) return;
+    
+    ZoneStates<StateManager<Hal>::MAX_ZONES>& zones = stateManager->getZones();
+    
+    for (int zone = 0; zone < zoneCount; zone++) {
+        bool activate = zones.estado_device[zone];
+        
+        // ALWAYS check environment safety - turn off device if unsafe
+        if (!stateManager->isEnvironmentSafe(zone)) {
+            if (activate) {  // Only show message if device was on
+                LOG_WARN("actuador", ">>> ZONA %d APAGADA AUTOMÁTICAMENTE - FUERA DE UMBRALES DE SEGURIDAD <<<", zone);
+                
+                if (!stateManager->isTemperatureInRange(zone) && !stateManager->isHumidityInRange(zone)) {
+                    LOG_WARN("actuador", "ALERTA: Temperatura Y humedad fuera de rango de seguridad");
+                } else if (!stateManager->isTemperatureInRange(zone)) {
+                    LOG_WARN("actuador", "ALERTA: Temperatura fuera de rango de seguridad (%.2f-%.2f)",
+                             zones.Temp_min_device[zone], zones.Temp_max_device[zone]);
+                } else {
+                    LOG_WARN("actuador", "ALERTA: Humedad fuera de rango de seguridad (%.2f-%.2f)",
+                             zones.humidity_min_device[zone], zones.humidity_max_device[zone]);
+                }
+            }
+            
+            stateManager->setDeviceStatus(zone, false, "");
+            activate = false;
+        }
+        
+        // Outputs are only written, and logged, when they change
+        if (activate == ledStates[zone]) {
+            continue;
+        }
+        Hal::Gpio::write(ledPins[zone], activate);
+        ledStates[zone] = activate;
+        
+        if (activate) {
+            LOG_INFO("actuador", "Zona %d: %s ON por rutina/servidor (rutinas tienen prioridad)", zone,
+                     zones.active_device_type[zone][0] != '\0' ? zones.active_device_type[zone] : "Deshumidificador");
+        } else {
+            LOG_INFO("actuador", "Zona %d: dispositivo OFF (esperando rutina o activación manual)", zone);
+        }
+    }
+}
+
+template <typename Hal>
+void ActuatorManager<Hal>::displayServerInfo(const String& serverIP) {
+    char text[LCD_COLS + 1];
+    snprintf(text, sizeof(text), "IP: %s", serverIP.c_str());
+    setRow(3, text);
+    pushFrame();
+}
+
+template <typename Hal>
+const DisplayStats& ActuatorManager<Hal>::getDisplayStats() const {
+    return displayStats;
+}
+
+#endif
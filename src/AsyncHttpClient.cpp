@@ -0,0 +1,803 @@
+#include "AsyncHttpClient.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+namespace {
+
+// Offset of the first "\r\n" in buf[from, to), or -1
+long findCrlf(const char* buf, size_t from, size_t to) {
+    for (size_t i = from; i + 1 < to; i++) {
+        if (buf[i] == '\r' && buf[i + 1] == '\n') {
+            return (long)i;
+        }
+    }
+    return -1;
+}
+
+bool wouldBlock() {
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINPROGRESS;
+}
+
+bool headerNameEquals(const char* line, size_t lineLength, const char* name) {
+    size_t nameLength = strlen(name);
+    if (lineLength <= nameLength || line[nameLength] != ':') {
+        return false;
+    }
+    for (size_t i = 0; i < nameLength; i++) {
+        if (tolower((unsigned char)line[i]) != tolower((unsigned char)name[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Case-insensitive search for a token in a header value ("keep-alive, Upgrade")
+bool valueHasToken(const char* value, size_t length, const char* token) {
+    size_t tokenLength = strlen(token);
+    for (size_t i = 0; i + tokenLength <= length; i++) {
+        if (strncasecmp(value + i, token, tokenLength) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}
+
+bool httpFindHeader(const HttpResponse& response, const char* name, const char*& value, size_t& length) {
+    size_t pos = 0;
+    while (pos < response.headersLength) {
+        long lineEnd = findCrlf(response.headers, pos, response.headersLength);
+        size_t end = lineEnd < 0 ? response.headersLength : (size_t)lineEnd;
+        const char* line = response.headers + pos;
+
+        if (headerNameEquals(line, end - pos, name)) {
+            size_t start = pos + strlen(name) + 1;
+            while (start < end && (response.headers[start] == ' ' || response.headers[start] == '\t')) {
+                start++;
+            }
+            value = response.headers + start;
+            length = end - start;
+            return true;
+        }
+        pos = end + 2;
+    }
+    return false;
+}
+
+AsyncHttpClient::AsyncHttpClient(unsigned long (*clock)()) : inFlight(0), clock(clock) {
+    for (int i = 0; i < MAX_IN_FLIGHT; i++) {
+        slots[i].state = IDLE;
+        slots[i].connection = -1;
+    }
+    for (int i = 0; i < MAX_CONNECTIONS; i++) {
+        connections[i].state = CONN_CLOSED;
+        connections[i].fd = -1;
+        connections[i].generation = 0;
+        connections[i].pendingCount = 0;
+    }
+    memset(&stats, 0, sizeof(stats));
+    resolvedHost[0] = '\0';
+    resolvedPort = 0;
+    resolvedAddressLength = 0;
+    resolveFailed = false;
+    resolveFailedAt = 0;
+}
+
+bool AsyncHttpClient::submit(const char* host, uint16_t port, const char* method, const char* path,
+                             const char* extraHeaders, const char* body, size_t bodyLength,
+                             unsigned long timeoutMs, HttpCallback callback, void* context,
+                             HttpBodyCallback onBody) {
+    return start(host, port, method, path, extraHeaders, body, bodyLength, timeoutMs, 0,
+                 callback, context, onBody);
+}
+
+bool AsyncHttpClient::submitStream(const char* host, uint16_t port, const char* path, const char* extraHeaders,
+                                   unsigned long idleTimeoutMs, HttpCallback callback, void* context,
+                                   HttpBodyCallback onBody) {
+    return start(host, port, "GET", path, extraHeaders, nullptr, 0, idleTimeoutMs, idleTimeoutMs,
+                 callback, context, onBody);
+}
+
+bool AsyncHttpClient::cancel(HttpCallback callback, void* context) {
+    for (int i = 0; i < MAX_IN_FLIGHT; i++) {
+        Slot& slot = slots[i];
+        if (slot.state != ACTIVE || slot.callback != callback || slot.context != context) continue;
+
+        if (slot.connection < 0) {
+            finish(slot, HTTP_ERROR_CANCELLED);
+        } else {
+            // Not to be replayed; anything pipelined with it may be
+            slot.retried = true;
+            dropConnection(connections[slot.connection], HTTP_ERROR_CANCELLED);
+        }
+        return true;
+    }
+    return false;
+}
+
+bool AsyncHttpClient::start(const char* host, uint16_t port, const char* method, const char* path,
+                            const char* extraHeaders, const char* body, size_t bodyLength,
+                            unsigned long timeoutMs, unsigned long idleTimeoutMs, HttpCallback callback,
+                            void* context, HttpBodyCallback onBody) {
+    int index = -1;
+    for (int i = 0; i < MAX_IN_FLIGHT; i++) {
+        if (slots[i].state == IDLE) {
+            index = i;
+            break;
+        }
+    }
+    if (index < 0 || strlen(host) >= HOST_LENGTH) {
+        return false;
+    }
+    Slot& slot = slots[index];
+
+    int headerLength;
+    if (body) {
+        headerLength = snprintf(slot.request, REQUEST_BUFFER,
+            "%s %s HTTP/1.1\r\nHost: %s:%u\r\n%sContent-Length: %u\r\n\r\n",
+            method, path, host, (unsigned)port, extraHeaders ? extraHeaders : "", (unsigned)bodyLength);
+    } else {
+        headerLength = snprintf(slot.request, REQUEST_BUFFER,
+            "%s %s HTTP/1.1\r\nHost: %s:%u\r\n%s\r\n",
+            method, path, host, (unsigned)port, extraHeaders ? extraHeaders : "");
+    }
+    if (headerLength < 0 || (size_t)headerLength + bodyLength >= REQUEST_BUFFER) {
+        return false;
+    }
+    if (body) {
+        memcpy(slot.request + headerLength, body, bodyLength);
+    }
+
+    slot.requestLength = headerLength + bodyLength;
+    strcpy(slot.host, host);
+    slot.port = port;
+    slot.idempotent = strcmp(method, "POST") != 0 && strcmp(method, "PATCH") != 0;
+    slot.retried = false;
+    slot.idleTimeout = idleTimeoutMs;
+    slot.error = 0;
+    slot.callback = callback;
+    slot.onBody = onBody;
+    slot.context = context;
+    slot.startedAt = clock();
+    slot.deadline = slot.startedAt + timeoutMs;
+    slot.state = ACTIVE;
+    resetResponse(slot);
+    inFlight++;
+
+    // Failures are reported through the callback on the next poll()
+    assign(index);
+    return true;
+}
+
+void AsyncHttpClient::poll(unsigned long waitMs) {
+    if (inFlight == 0) {
+        return;
+    }
+
+    // Report requests that never got a connection, and expire deadlines
+    unsigned long now = clock();
+    for (int i = 0; i < MAX_IN_FLIGHT; i++) {
+        Slot& slot = slots[i];
+        if (slot.state != ACTIVE) continue;
+
+        if (slot.connection < 0) {
+            finish(slot, slot.error ? slot.error : HTTP_ERROR_CONNECT);
+        } else if ((long)(now - slot.deadline) >= 0) {
+            dropConnection(connections[slot.connection], HTTP_ERROR_TIMEOUT);
+        }
+    }
+
+    struct pollfd fds[MAX_CONNECTIONS];
+    int connectionOf[MAX_CONNECTIONS];
+    unsigned long generationOf[MAX_CONNECTIONS];
+    int count = 0;
+    for (int i = 0; i < MAX_CONNECTIONS; i++) {
+        Connection& connection = connections[i];
+        if (connection.state == CONN_CLOSED || connection.pendingCount == 0) continue;
+
+        fds[count].fd = connection.fd;
+        fds[count].events = POLLIN;
+        if (connection.state == CONN_CONNECTING || connection.sentCount < connection.pendingCount) {
+            fds[count].events |= POLLOUT;
+        }
+        fds[count].revents = 0;
+        connectionOf[count] = i;
+        generationOf[count] = connection.generation;
+        count++;
+    }
+    for (int i = 0; i < MAX_IN_FLIGHT; i++) {
+        if (slots[i].state == ACTIVE && slots[i].connection < 0) {
+            waitMs = 0;     // A failed request is waiting to be reported
+        }
+    }
+
+    if (count == 0) {
+        return;
+    }
+    ::poll(fds, count, (int)waitMs);
+
+    for (int i = 0; i < count; i++) {
+        Connection& connection = connections[connectionOf[i]];
+        short events = fds[i].revents;
+
+        // Callbacks may have closed or reopened it meanwhile
+        if (connection.generation != generationOf[i] || connection.state == CONN_CLOSED) continue;
+
+        if (connection.state == CONN_CONNECTING) {
+            stepConnect(connection, events);
+        }
+        if (connection.state == CONN_OPEN && connection.sentCount < connection.pendingCount) {
+            stepSend(connection);
+        }
+        if (connection.state == CONN_OPEN && (events & (POLLIN | POLLHUP | POLLERR))) {
+            stepReceive(connection);
+        }
+    }
+}
+
+bool AsyncHttpClient::canSubmit() const {
+    return inFlight < MAX_IN_FLIGHT;
+}
+
+int AsyncHttpClient::getInFlight() const {
+    return inFlight;
+}
+
+int AsyncHttpClient::getOpenConnections() const {
+    int open = 0;
+    for (int i = 0; i < MAX_CONNECTIONS; i++) {
+        if (connections[i].state != CONN_CLOSED) open++;
+    }
+    return open;
+}
+
+const HttpStats& AsyncHttpClient::getStats() const {
+    return stats;
+}
+
+bool AsyncHttpClient::resolve(const char* host, uint16_t port) {
+    if (resolvedPort == port && strcmp(resolvedHost, host) == 0) {
+        if (resolvedAddressLength > 0) {
+            return true;
+        }
+        if (resolveFailed && clock() - resolveFailedAt < RESOLVE_RETRY) {
+            return false;
+        }
+    }
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+
+    char portStr[6];
+    snprintf(portStr, sizeof(portStr), "%u", (unsigned)port);
+
+    struct addrinfo* result = nullptr;
+    if (getaddrinfo(host, portStr, &hints, &result) != 0 || !result) {
+        resolvedAddressLength = 0;
+        resolveFailed = true;
+        resolveFailedAt = clock();
+        strcpy(resolvedHost, host);
+        resolvedPort = port;
+        return false;
+    }
+
+    size_t length = result->ai_addrlen < sizeof(resolvedAddress) ? result->ai_addrlen : sizeof(resolvedAddress);
+    memcpy(resolvedAddress, result->ai_addr, length);
+    resolvedAddressLength = length;
+    freeaddrinfo(result);
+    resolveFailed = false;
+
+    strcpy(resolvedHost, host);
+    resolvedPort = port;
+    return true;
+}
+
+void AsyncHttpClient::assign(int slotIndex) {
+    Slot& slot = slots[slotIndex];
+    slot.connection = -1;
+
+    if (!resolve(slot.host, slot.port)) {
+        slot.error = HTTP_ERROR_RESOLVE;
+        return;
+    }
+
+    // Prefer an idle connection to the host, then pipelining behind requests
+    // already in flight, then a new connection
+    int idle = -1, pipeline = -1, closed = -1, spare = -1;
+    for (int i = 0; i < MAX_CONNECTIONS; i++) {
+        Connection& connection = connections[i];
+        if (connection.state != CONN_CLOSED && connection.pendingCount == 0 && !isReusable(connection)) {
+            closeConnection(connection);
+        }
+        if (connection.state == CONN_CLOSED) {
+            if (closed < 0) closed = i;
+            continue;
+        }
+
+        bool sameHost = connection.port == slot.port && strcmp(connection.host, slot.host) == 0;
+        if (connection.pendingCount == 0) {
+            if (sameHost && idle < 0) idle = i;
+            else if (!sameHost && spare < 0) spare = i;
+        } else if (sameHost && connection.persistent && pipeline < 0 &&
+                   connection.pendingCount < MAX_IN_FLIGHT) {
+            bool blocked = false;
+            for (int p = 0; p < connection.pendingCount; p++) {
+                const Slot& ahead = slots[connection.pending[p]];
+                if (!ahead.idempotent || ahead.idleTimeout > 0) blocked = true;
+            }
+            if (!blocked) pipeline = i;
+        }
+    }
+
+    int chosen = idle >= 0 ? idle : pipeline >= 0 ? pipeline : closed >= 0 ? closed : spare;
+    if (chosen < 0) {
+        slot.error = HTTP_ERROR_CONNECT;
+        return;
+    }
+
+    Connection& connection = connections[chosen];
+    if (chosen != idle && chosen != pipeline) {
+        if (connection.state != CONN_CLOSED) {
+            closeConnection(connection);
+        }
+        if (!openConnection(connection, slot.host, slot.port)) {
+            slot.error = HTTP_ERROR_CONNECT;
+            return;
+        }
+    }
+
+    connection.pending[connection.pendingCount++] = slotIndex;
+    slot.connection = chosen;
+}
+
+bool AsyncHttpClient::openConnection(Connection& connection, const char* host, uint16_t port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return false;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+
+    // Requests are written whole; do not hold pipelined ones back for ACKs
+    int noDelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+    int result = connect(fd, (const struct sockaddr*)resolvedAddress, resolvedAddressLength);
+    if (result < 0 && !wouldBlock()) {
+        close(fd);
+        return false;
+    }
+
+    stats.handshakes++;
+    connection.state = result == 0 ? CONN_OPEN : CONN_CONNECTING;
+    connection.fd = fd;
+    connection.generation++;
+    strcpy(connection.host, host);
+    connection.port = port;
+    connection.persistent = false;
+    connection.requests = 0;
+    connection.pendingCount = 0;
+    connection.sentCount = 0;
+    connection.sendOffset = 0;
+    return true;
+}
+
+bool AsyncHttpClient::isReusable(Connection& connection) {
+    if (connection.state != CONN_OPEN || (long)(clock() - connection.idleSince) >= (long)IDLE_TIMEOUT) {
+        return false;
+    }
+
+    // An idle keep-alive socket has nothing to read; EOF or stray bytes mean
+    // the server closed it or the stream is out of sync
+    struct pollfd fd = { connection.fd, POLLIN, 0 };
+    if (::poll(&fd, 1, 0) != 0) {
+        stats.reconnects++;
+        return false;
+    }
+    return true;
+}
+
+void AsyncHttpClient::closeConnection(Connection& connection) {
+    if (connection.fd >= 0) {
+        close(connection.fd);
+    }
+    connection.fd = -1;
+    connection.state = CONN_CLOSED;
+    connection.pendingCount = 0;
+    connection.sentCount = 0;
+    connection.sendOffset = 0;
+}
+
+void AsyncHttpClient::dropConnection(Connection& connection, int status) {
+    // Take the pending requests off the connection before any callback runs
+    int pending[MAX_IN_FLIGHT];
+    int count = connection.pendingCount;
+    int sentCount = connection.sentCount;
+    size_t sendOffset = connection.sendOffset;
+    bool established = connection.state == CONN_OPEN;
+    memcpy(pending, connection.pending, sizeof(pending));
+    closeConnection(connection);
+
+    unsigned long now = clock();
+    bool failed[MAX_IN_FLIGHT] = { false };
+
+    // Replay what can safely be replayed first, so request order is kept
+    for (int k = 0; k < count; k++) {
+        Slot& slot = slots[pending[k]];
+        slot.connection = -1;
+
+        bool unsent = k > sentCount || (k == sentCount && sendOffset == 0);
+        bool expired = (long)(now - slot.deadline) >= 0;
+        if (established && !expired && !slot.retried && slot.responseLength == 0 &&
+            (slot.idempotent || unsent)) {
+            slot.retried = true;
+            stats.retries++;
+            resetResponse(slot);
+            assign(pending[k]);
+        } else {
+            failed[k] = true;
+        }
+    }
+
+    for (int k = 0; k < count; k++) {
+        if (failed[k]) {
+            Slot& slot = slots[pending[k]];
+            finish(slot, (long)(now - slot.deadline) >= 0 ? HTTP_ERROR_TIMEOUT : status);
+        }
+    }
+}
+
+void AsyncHttpClient::stepConnect(Connection& connection, short events) {
+    if (!(events & (POLLOUT | POLLERR | POLLHUP))) {
+        return;
+    }
+
+    int error = 0;
+    socklen_t length = sizeof(error);
+    if (getsockopt(connection.fd, SOL_SOCKET, SO_ERROR, &error, &length) < 0 || error != 0) {
+        dropConnection(connection, HTTP_ERROR_CONNECT);
+        return;
+    }
+    connection.state = CONN_OPEN;
+}
+
+void AsyncHttpClient::stepSend(Connection& connection) {
+    while (connection.sentCount < connection.pendingCount) {
+        Slot& slot = slots[connection.pending[connection.sentCount]];
+        ssize_t sent = send(connection.fd, slot.request + connection.sendOffset,
+                            slot.requestLength - connection.sendOffset, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (!wouldBlock()) {
+                stats.reconnects++;
+                dropConnection(connection, HTTP_ERROR_SEND);
+            }
+            return;
+        }
+
+        connection.sendOffset += sent;
+        stats.bytesSent += sent;
+        if (connection.sendOffset == slot.requestLength) {
+            if (connection.requests > 0) stats.reuses++;
+            if (connection.sentCount > 0) stats.pipelined++;
+            connection.requests++;
+            connection.sentCount++;
+            connection.sendOffset = 0;
+        }
+    }
+}
+
+void AsyncHttpClient::stepReceive(Connection& connection) {
+    while (connection.state == CONN_OPEN && connection.pendingCount > 0) {
+        Slot& slot = slots[connection.pending[0]];
+
+        // Bytes left over from the previous response come first
+        ParseResult result = parseResponse(slot);
+        if (result == PARSE_DONE) {
+            completeHead(connection);
+            continue;
+        }
+        if (result == PARSE_ERROR) {
+            dropConnection(connection, HTTP_ERROR_PROTOCOL);
+            return;
+        }
+        if (slot.responseLength >= RESPONSE_BUFFER - 1) {
+            dropConnection(connection, HTTP_ERROR_TOO_LARGE);
+            return;
+        }
+
+        ssize_t received = recv(connection.fd, slot.response + slot.responseLength,
+                                RESPONSE_BUFFER - 1 - slot.responseLength, 0);
+        if (received < 0) {
+            if (!wouldBlock()) {
+                stats.reconnects++;
+                dropConnection(connection, HTTP_ERROR_RECEIVE);
+            }
+            return;
+        }
+        if (received == 0) {
+            if (slot.headerEnd > 0 && slot.bodyMode == BODY_UNTIL_CLOSE) {
+                completeHead(connection);
+            } else {
+                stats.reconnects++;
+                dropConnection(connection, HTTP_ERROR_RECEIVE);
+            }
+            return;
+        }
+        slot.responseLength += received;
+        stats.bytesReceived += received;
+        if (slot.idleTimeout > 0) {
+            slot.deadline = clock() + slot.idleTimeout;
+        }
+    }
+}
+
+void AsyncHttpClient::completeHead(Connection& connection) {
+    Slot& slot = slots[connection.pending[0]];
+    size_t end = responseEnd(slot);
+    size_t leftover = slot.responseLength - end;
+
+    // A server may answer before the request is fully sent; the rest of the
+    // stream is then unusable
+    bool keep = slot.keepAlive && slot.bodyMode != BODY_UNTIL_CLOSE && connection.sentCount > 0;
+
+    connection.pendingCount--;
+    memmove(connection.pending, connection.pending + 1, connection.pendingCount * sizeof(int));
+    if (connection.sentCount > 0) connection.sentCount--;
+    slot.connection = -1;
+
+    if (keep && leftover > 0) {
+        if (connection.pendingCount > 0) {
+            Slot& next = slots[connection.pending[0]];
+            memcpy(next.response, slot.response + end, leftover);
+            next.responseLength = leftover;
+        } else {
+            keep = false;   // Unsolicited bytes, the stream is out of sync
+        }
+    }
+
+    if (keep) {
+        connection.persistent = true;
+        connection.idleSince = clock();
+    } else if (connection.pendingCount > 0) {
+        dropConnection(connection, HTTP_ERROR_RECEIVE);
+    } else {
+        closeConnection(connection);
+    }
+
+    finish(slot, slot.status);
+}
+
+void AsyncHttpClient::resetResponse(Slot& slot) {
+    slot.responseLength = 0;
+    slot.headerScan = 0;
+    slot.headerEnd = 0;
+    slot.status = 0;
+    slot.keepAlive = false;
+    slot.bodyMode = BODY_UNTIL_CLOSE;
+    slot.contentLength = 0;
+    slot.bodyLength = 0;
+}
+
+AsyncHttpClient::ParseResult AsyncHttpClient::parseResponse(Slot& slot) {
+    if (slot.headerEnd == 0) {
+        size_t i = slot.headerScan;
+        for (; i + 3 < slot.responseLength; i++) {
+            if (memcmp(slot.response + i, "\r\n\r\n", 4) == 0) break;
+        }
+        if (i + 3 >= slot.responseLength) {
+            slot.headerScan = i;
+            return PARSE_MORE;
+        }
+
+        slot.headerEnd = i + 4;
+        if (!parseHeaders(slot)) {
+            return PARSE_ERROR;
+        }
+    }
+
+    size_t available = slot.responseLength - slot.headerEnd;
+    ParseResult result;
+    switch (slot.bodyMode) {
+        case BODY_CHUNKED:
+            if (!decodeChunked(slot)) return PARSE_ERROR;
+            result = slot.chunkState == CHUNK_DONE ? PARSE_DONE : PARSE_MORE;
+            break;
+
+        case BODY_LENGTH:
+            slot.bodyLength = available < slot.contentLength ? available : slot.contentLength;
+            result = slot.bodyLength == slot.contentLength ? PARSE_DONE : PARSE_MORE;
+            break;
+
+        default:
+            slot.bodyLength = available;
+            result = PARSE_MORE;
+            break;
+    }
+
+    if (slot.onBody) {
+        streamBody(slot);
+    }
+    return result;
+}
+
+bool AsyncHttpClient::parseHeaders(Slot& slot) {
+    // Status line: "HTTP/1.x SSS reason"
+    if (slot.headerEnd < 12 || strncmp(slot.response, "HTTP/1.", 7) != 0) {
+        return false;
+    }
+    slot.status = atoi(slot.response + 9);
+    if (slot.status < 100 || slot.status > 999) {
+        return false;
+    }
+
+    HttpResponse view;
+    long statusEnd = findCrlf(slot.response, 0, slot.headerEnd);
+    view.headers = slot.response + statusEnd + 2;
+    view.headersLength = slot.headerEnd - 2 - (statusEnd + 2);
+
+    // HTTP/1.1 is persistent unless told otherwise; HTTP/1.0 only on request
+    const char* value;
+    size_t length;
+    bool hasConnection = httpFindHeader(view, "Connection", value, length);
+    if (slot.response[7] == '1') {
+        slot.keepAlive = !(hasConnection && valueHasToken(value, length, "close"));
+    } else {
+        slot.keepAlive = hasConnection && valueHasToken(value, length, "keep-alive");
+    }
+
+    slot.bodyMode = BODY_UNTIL_CLOSE;
+    slot.contentLength = 0;
+    if (slot.status == 204 || slot.status == 304 || slot.status < 200) {
+        slot.bodyMode = BODY_LENGTH;
+    } else if (httpFindHeader(view, "Transfer-Encoding", value, length) && valueHasToken(value, length, "chunked")) {
+        slot.bodyMode = BODY_CHUNKED;
+        slot.chunkState = CHUNK_SIZE;
+        slot.chunkRemaining = 0;
+        slot.chunkScan = slot.headerEnd;
+    } else if (httpFindHeader(view, "Content-Length", value, length)) {
+        slot.bodyMode = BODY_LENGTH;
+        slot.contentLength = strtoul(value, nullptr, 10);
+        if (!slot.onBody && slot.headerEnd + slot.contentLength >= RESPONSE_BUFFER) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool AsyncHttpClient::decodeChunked(Slot& slot) {
+    // Decoded bytes are written back over the chunk framing, so the body
+    // stays contiguous right after the headers.
+    char* body = slot.response + slot.headerEnd;
+
+    while (slot.chunkScan < slot.responseLength && slot.chunkState != CHUNK_DONE) {
+        if (slot.chunkState == CHUNK_SIZE) {
+            long lineEnd = findCrlf(slot.response, slot.chunkScan, slot.responseLength);
+            if (lineEnd < 0) break;
+
+            char* end;
+            unsigned long size = strtoul(slot.response + slot.chunkScan, &end, 16);
+            if (end == slot.response + slot.chunkScan) {
+                return false;
+            }
+            slot.chunkScan = lineEnd + 2;
+            slot.chunkRemaining = size;
+            slot.chunkState = size == 0 ? CHUNK_TRAILER : CHUNK_DATA;
+        } else if (slot.chunkState == CHUNK_DATA) {
+            size_t available = slot.responseLength - slot.chunkScan;
+            size_t take = available < slot.chunkRemaining ? available : slot.chunkRemaining;
+            memmove(body + slot.bodyLength, slot.response + slot.chunkScan, take);
+            slot.bodyLength += take;
+            slot.chunkScan += take;
+            slot.chunkRemaining -= take;
+            if (slot.chunkRemaining == 0) {
+                slot.chunkState = CHUNK_DATA_END;
+            }
+        } else if (slot.chunkState == CHUNK_DATA_END) {
+            if (slot.responseLength - slot.chunkScan < 2) break;
+            slot.chunkScan += 2;
+            slot.chunkState = CHUNK_SIZE;
+        } else {
+            // Trailer lines up to the empty line that ends the message
+            long lineEnd = findCrlf(slot.response, slot.chunkScan, slot.responseLength);
+            if (lineEnd < 0) break;
+            if ((size_t)lineEnd == slot.chunkScan) {
+                slot.chunkState = CHUNK_DONE;
+            }
+            slot.chunkScan = lineEnd + 2;
+        }
+    }
+
+    // Reclaim the framing bytes already consumed
+    size_t pending = slot.responseLength - slot.chunkScan;
+    size_t decodedEnd = slot.headerEnd + slot.bodyLength;
+    memmove(slot.response + decodedEnd, slot.response + slot.chunkScan, pending);
+    slot.responseLength = decodedEnd + pending;
+    slot.chunkScan = decodedEnd;
+    return true;
+}
+
+void AsyncHttpClient::streamBody(Slot& slot) {
+    if (slot.bodyLength == 0) {
+        return;
+    }
+
+    // Hand over the decoded bytes and drop them; whatever follows (chunk
+    // framing, a pipelined response) moves down behind the headers
+    slot.onBody(slot.context, slot.status, slot.response + slot.headerEnd, slot.bodyLength);
+
+    size_t rest = slot.headerEnd + slot.bodyLength;
+    memmove(slot.response + slot.headerEnd, slot.response + rest, slot.responseLength - rest);
+    slot.responseLength -= slot.bodyLength;
+    if (slot.bodyMode == BODY_CHUNKED) {
+        slot.chunkScan -= slot.bodyLength;
+    } else if (slot.bodyMode == BODY_LENGTH) {
+        slot.contentLength -= slot.bodyLength;
+    }
+    slot.bodyLength = 0;
+}
+
+size_t AsyncHttpClient::responseEnd(const Slot& slot) const {
+    switch (slot.bodyMode) {
+        case BODY_LENGTH:
+            return slot.headerEnd + slot.contentLength;
+        case BODY_CHUNKED:
+            return slot.chunkScan;
+        default:
+            return slot.responseLength;
+    }
+}
+
+void AsyncHttpClient::finish(Slot& slot, int status) {
+    HttpResponse response;
+    response.status = status;
+    response.headers = "";
+    response.headersLength = 0;
+    response.body = "";
+    response.bodyLength = 0;
+    response.elapsedMs = clock() - slot.startedAt;
+
+    if (status > 0) {
+        long statusEnd = findCrlf(slot.response, 0, slot.headerEnd);
+        response.headers = slot.response + statusEnd + 2;
+        response.headersLength = slot.headerEnd - 2 - (statusEnd + 2);
+
+        slot.response[slot.headerEnd + slot.bodyLength] = '\0';
+        response.body = slot.response + slot.headerEnd;
+        response.bodyLength = slot.bodyLength;
+    }
+
+    // A stream's lifetime would swamp the request times
+    unsigned long elapsed = response.elapsedMs;
+    if (slot.idleTimeout > 0) {
+        stats.streams++;
+    } else {
+        stats.requests++;
+        stats.totalTimeMs += elapsed;
+        if (elapsed > stats.maxTimeMs) stats.maxTimeMs = elapsed;
+        if (status < 0) stats.failures++;
+    }
+
+    // The slot stays busy until the callback returns, so the response
+    // buffer cannot be reused underneath it
+    slot.connection = -1;
+    slot.callback(slot.context, response);
+    slot.state = IDLE;
+    inFlight--;
+}
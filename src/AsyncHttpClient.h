@@ -0,0 +1,228 @@
+#ifndef ASYNC_HTTP_CLIENT_H
+#define ASYNC_HTTP_CLIENT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Negative status codes reported instead of an HTTP status
+const int HTTP_ERROR_RESOLVE = -1;
+const int HTTP_ERROR_CONNECT = -2;
+const int HTTP_ERROR_SEND = -3;
+const int HTTP_ERROR_RECEIVE = -4;
+const int HTTP_ERROR_TIMEOUT = -5;
+const int HTTP_ERROR_TOO_LARGE = -6;
+const int HTTP_ERROR_PROTOCOL = -7;
+const int HTTP_ERROR_CANCELLED = -8;
+
+struct HttpResponse {
+    int status;             // HTTP status, or one of HTTP_ERROR_*
+    const char* headers;    // Raw header block, status line excluded
+    size_t headersLength;
+    const char* body;       // Decoded body, NUL-terminated
+    size_t bodyLength;
+    unsigned long elapsedMs;    // Submit -> completion
+};
+
+typedef void (*HttpCallback)(void* context, const HttpResponse& response);
+
+// Receives decoded body bytes as they arrive, with the response status
+typedef void (*HttpBodyCallback)(void* context, int status, const char* data, size_t length);
+
+// Connection pool counters, cumulative since boot
+struct HttpStats {
+    unsigned long requests;       // Completed, successfully or not; streams excluded
+    unsigned long failures;       // Completed with an HTTP_ERROR_* status
+    unsigned long handshakes;     // TCP connections opened
+    unsigned long reuses;         // Requests sent on an already open connection
+    unsigned long pipelined;      // Requests sent while another awaited its response
+    unsigned long reconnects;     // Broken connections detected
+    unsigned long retries;        // Requests replayed on a fresh connection
+    unsigned long bytesSent;
+    unsigned long bytesReceived;
+    unsigned long totalTimeMs;    // Submit -> callback, summed over requests
+    unsigned long maxTimeMs;
+    unsigned long streams;        // Streams ended, however they ended
+};
+
+// Finds a response header (case-insensitive name). Returns false if absent.
+bool httpFindHeader(const HttpResponse& response, const char* name, const char*& value, size_t& length);
+
+// HTTP/1.1 client on non-blocking BSD sockets (lwIP on the ESP32, POSIX on
+// the host). Each request walks connect -> send -> headers -> body across
+// calls to poll(), so no call ever waits on the server. Requests live in a
+// fixed number of slots with per-request deadlines; the callback runs from
+// poll() exactly once per accepted request.
+//
+// Connections are kept alive and pooled per host. Once a server has shown it
+// keeps connections open, further requests are pipelined behind the ones in
+// flight (never behind a non-idempotent one). A connection found closed or
+// reset is replaced transparently: requests that got no response bytes are
+// replayed once on a new connection, POSTs only if they were never sent.
+class AsyncHttpClient {
+public:
+    static const int MAX_IN_FLIGHT = 3;
+    static const int MAX_CONNECTIONS = MAX_IN_FLIGHT;
+    static const size_t REQUEST_BUFFER = 1536;
+    static const size_t RESPONSE_BUFFER = 4096;
+    static const size_t HOST_LENGTH = 64;
+    static const unsigned long IDLE_TIMEOUT = 30000;   // Close unused connections
+    static const unsigned long RESOLVE_RETRY = 10000;  // Before looking up a failed host again
+
+    // The clock is the millis() source used for request deadlines
+    explicit AsyncHttpClient(unsigned long (*clock)());
+
+    // Queues a request. extraHeaders is a block of "Name: value\r\n" lines
+    // (may be null). Returns false if every slot is busy or the request does
+    // not fit; the callback is not invoked in that case.
+    //
+    // With onBody, the body is streamed to it instead of being buffered, so
+    // its size is unbounded; the final callback then sees an empty body.
+    bool submit(const char* host, uint16_t port, const char* method, const char* path,
+                const char* extraHeaders, const char* body, size_t bodyLength,
+                unsigned long timeoutMs, HttpCallback callback, void* context,
+                HttpBodyCallback onBody = nullptr);
+
+    // Opens a long-lived GET whose body goes to onBody as it arrives, such
+    // as a server-sent event stream. Its deadline moves idleTimeoutMs past
+    // every byte received, so it lasts as long as the server keeps sending,
+    // and nothing is pipelined behind it. The callback runs when it ends.
+    bool submitStream(const char* host, uint16_t port, const char* path, const char* extraHeaders,
+                      unsigned long idleTimeoutMs, HttpCallback callback, void* context,
+                      HttpBodyCallback onBody);
+
+    // Ends the request with this callback and context, which then reports
+    // HTTP_ERROR_CANCELLED. Returns false if there is none.
+    bool cancel(HttpCallback callback, void* context);
+
+    // Advances every in-flight request. Waits up to waitMs for socket
+    // activity (0 = just step), returning early as soon as any socket is ready.
+    void poll(unsigned long waitMs);
+
+    bool canSubmit() const;
+    int getInFlight() const;
+    int getOpenConnections() const;
+    const HttpStats& getStats() const;
+
+private:
+    enum SlotState {
+        IDLE,
+        ACTIVE
+    };
+
+    enum ConnectionState {
+        CONN_CLOSED,
+        CONN_CONNECTING,
+        CONN_OPEN
+    };
+
+    enum BodyMode {
+        BODY_LENGTH,      // Content-Length
+        BODY_CHUNKED,     // Transfer-Encoding: chunked
+        BODY_UNTIL_CLOSE
+    };
+
+    enum ChunkState {
+        CHUNK_SIZE,
+        CHUNK_DATA,
+        CHUNK_DATA_END,
+        CHUNK_TRAILER,
+        CHUNK_DONE
+    };
+
+    enum ParseResult {
+        PARSE_MORE,
+        PARSE_DONE,
+        PARSE_ERROR
+    };
+
+    struct Slot {
+        SlotState state;
+        int connection;             // Pool index, -1 while unassigned
+        int error;                  // Failure to report on the next poll()
+        unsigned long startedAt;
+        unsigned long deadline;
+        HttpCallback callback;
+        HttpBodyCallback onBody;
+        void* context;
+        char host[HOST_LENGTH];
+        uint16_t port;
+        bool idempotent;
+        bool retried;
+        unsigned long idleTimeout;  // Streams only, 0 otherwise
+
+        char request[REQUEST_BUFFER];
+        size_t requestLength;
+
+        char response[RESPONSE_BUFFER];
+        size_t responseLength;      // Bytes received into response
+        size_t headerScan;          // Where to resume looking for "\r\n\r\n"
+        size_t headerEnd;           // Offset of the body, 0 until headers are in
+        int status;
+        bool keepAlive;             // Connection may carry another response
+
+        BodyMode bodyMode;
+        size_t contentLength;       // Still to come once streamed bytes are dropped
+        size_t bodyLength;          // Decoded body bytes at response + headerEnd
+        ChunkState chunkState;
+        size_t chunkRemaining;
+        size_t chunkScan;           // Next undecoded byte while chunked
+    };
+
+    struct Connection {
+        ConnectionState state;
+        int fd;
+        unsigned long generation;   // Bumped on every open, to match poll() results
+        char host[HOST_LENGTH];
+        uint16_t port;
+        bool persistent;            // Server has kept it open after a response
+        unsigned long idleSince;
+        unsigned long requests;     // Requests sent on this connection
+
+        // Slots in request order; pending[0] owns the next response bytes
+        int pending[MAX_IN_FLIGHT];
+        int pendingCount;
+        int sentCount;              // pending[0..sentCount) fully sent
+        size_t sendOffset;          // Bytes of pending[sentCount] already sent
+    };
+
+    Slot slots[MAX_IN_FLIGHT];
+    Connection connections[MAX_CONNECTIONS];
+    int inFlight;
+    unsigned long (*clock)();
+    HttpStats stats;
+
+    // Last resolved host, so periodic calls do not hit DNS every time. A
+    // failed lookup is remembered too, for RESOLVE_RETRY: every lookup
+    // allocates, and while the host is unknown requests would repeat it.
+    char resolvedHost[HOST_LENGTH];
+    uint16_t resolvedPort;
+    uint8_t resolvedAddress[16];
+    size_t resolvedAddressLength;
+    bool resolveFailed;
+    unsigned long resolveFailedAt;
+
+    bool start(const char* host, uint16_t port, const char* method, const char* path,
+               const char* extraHeaders, const char* body, size_t bodyLength,
+               unsigned long timeoutMs, unsigned long idleTimeoutMs, HttpCallback callback, void* context,
+               HttpBodyCallback onBody);
+    bool resolve(const char* host, uint16_t port);
+    void assign(int slotIndex);
+    bool openConnection(Connection& connection, const char* host, uint16_t port);
+    bool isReusable(Connection& connection);
+    void closeConnection(Connection& connection);
+    void dropConnection(Connection& connection, int status);
+
+    void stepConnect(Connection& connection, short events);
+    void stepSend(Connection& connection);
+    void stepReceive(Connection& connection);
+    void completeHead(Connection& connection);
+    void resetResponse(Slot& slot);
+    ParseResult parseResponse(Slot& slot);
+    bool parseHeaders(Slot& slot);
+    bool decodeChunked(Slot& slot);
+    void streamBody(Slot& slot);
+    size_t responseEnd(const Slot& slot) const;
+    void finish(Slot& slot, int status);
+};
+
+#endif
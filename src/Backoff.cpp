@@ -0,0 +1,23 @@
+#include "Backoff.h"
+
+Backoff::Backoff(unsigned long minMs, unsigned long maxMs)
+    : minMs(minMs), maxMs(maxMs > minMs ? maxMs : minMs), step(minMs), state(2463534242u) {
+}
+
+void Backoff::seed(uint32_t value) {
+    state = value != 0 ? value : 2463534242u;
+}
+
+unsigned long Backoff::next() {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+
+    unsigned long delay = step / 2 + state % (step - step / 2 + 1);
+    step = step < maxMs / 2 ? step * 2 : maxMs;
+    return delay;
+}
+
+void Backoff::reset() {
+    step = minMs;
+}
@@ -0,0 +1,30 @@
+#ifndef BACKOFF_H
+#define BACKOFF_H
+
+#include <stdint.h>
+
+// Exponential backoff with jitter for retry loops. Each delay handed out
+// doubles the next one, from minMs up to maxMs, and is drawn at random from
+// the upper half of its step ("equal jitter"), so devices that lost the
+// same access point or server do not all come back in lockstep.
+class Backoff {
+public:
+    Backoff(unsigned long minMs, unsigned long maxMs);
+
+    // Seeds the jitter; give each device its own seed
+    void seed(uint32_t value);
+
+    // The delay before the next attempt
+    unsigned long next();
+
+    // Back to minMs, once an attempt has succeeded
+    void reset();
+
+private:
+    unsigned long minMs;
+    unsigned long maxMs;
+    unsigned long step;       // Upper bound of the next delay
+    uint32_t state;           // xorshift32, never 0
+};
+
+#endif
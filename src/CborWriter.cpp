@@ -0,0 +1,106 @@
+#include "CborWriter.h"
+#include <string.h>
+
+namespace {
+
+const uint8_t MAJOR_UNSIGNED = 0;
+const uint8_t MAJOR_NEGATIVE = 1;
+const uint8_t MAJOR_TEXT = 3;
+const uint8_t MAJOR_ARRAY = 4;
+const uint8_t MAJOR_MAP = 5;
+
+const uint8_t SIMPLE_FALSE = 0xF4;
+const uint8_t SIMPLE_TRUE = 0xF5;
+const uint8_t FLOAT_32 = 0xFA;
+
+}
+
+CborWriter::CborWriter(uint8_t* buffer, size_t capacity)
+    : buffer(buffer), capacity(capacity), length(0), overflow(false) {}
+
+void CborWriter::beginMap(size_t pairs) {
+    writeHead(MAJOR_MAP, pairs);
+}
+
+void CborWriter::beginArray(size_t items) {
+    writeHead(MAJOR_ARRAY, items);
+}
+
+void CborWriter::writeUnsigned(uint64_t value) {
+    writeHead(MAJOR_UNSIGNED, value);
+}
+
+void CborWriter::writeInt(int64_t value) {
+    if (value < 0) {
+        writeHead(MAJOR_NEGATIVE, (uint64_t)(-1 - value));
+    } else {
+        writeHead(MAJOR_UNSIGNED, value);
+    }
+}
+
+void CborWriter::writeFloat(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint8_t out[5] = {
+        FLOAT_32, (uint8_t)(bits >> 24), (uint8_t)(bits >> 16), (uint8_t)(bits >> 8), (uint8_t)bits
+    };
+    writeBytes(out, sizeof(out));
+}
+
+void CborWriter::writeBool(bool value) {
+    uint8_t out = value ? SIMPLE_TRUE : SIMPLE_FALSE;
+    writeBytes(&out, 1);
+}
+
+void CborWriter::writeText(const char* text) {
+    writeText(text, strlen(text));
+}
+
+void CborWriter::writeText(const char* text, size_t count) {
+    writeHead(MAJOR_TEXT, count);
+    writeBytes(text, count);
+}
+
+bool CborWriter::ok() const {
+    return !overflow;
+}
+
+size_t CborWriter::size() const {
+    return length;
+}
+
+void CborWriter::writeHead(uint8_t major, uint64_t value) {
+    // Shortest form: the value itself up to 23, else 1, 2, 4 or 8 bytes
+    uint8_t out[9];
+    size_t count;
+    if (value < 24) {
+        out[0] = (major << 5) | (uint8_t)value;
+        count = 1;
+    } else if (value <= 0xFF) {
+        out[0] = (major << 5) | 24;
+        count = 2;
+    } else if (value <= 0xFFFF) {
+        out[0] = (major << 5) | 25;
+        count = 3;
+    } else if (value <= 0xFFFFFFFF) {
+        out[0] = (major << 5) | 26;
+        count = 5;
+    } else {
+        out[0] = (major << 5) | 27;
+        count = 9;
+    }
+    for (size_t i = count - 1; i > 0; i--) {
+        out[i] = (uint8_t)value;
+        value >>= 8;
+    }
+    writeBytes(out, count);
+}
+
+void CborWriter::writeBytes(const void* data, size_t count) {
+    if (overflow || capacity - length < count) {
+        overflow = true;
+        return;
+    }
+    memcpy(buffer + length, data, count);
+    length += count;
+}
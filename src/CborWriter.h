@@ -0,0 +1,37 @@
+#ifndef CBOR_WRITER_H
+#define CBOR_WRITER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Minimal CBOR (RFC 8949) encoder writing into a caller-provided buffer.
+// Containers are definite-length, so their item count is given up front.
+// Nothing is allocated; once the buffer is full further writes are dropped
+// and ok() turns false.
+class CborWriter {
+public:
+    CborWriter(uint8_t* buffer, size_t capacity);
+
+    void beginMap(size_t pairs);
+    void beginArray(size_t items);
+    void writeUnsigned(uint64_t value);
+    void writeInt(int64_t value);
+    void writeFloat(float value);           // Single precision
+    void writeBool(bool value);
+    void writeText(const char* text);
+    void writeText(const char* text, size_t length);
+
+    bool ok() const;
+    size_t size() const;
+
+private:
+    uint8_t* buffer;
+    size_t capacity;
+    size_t length;
+    bool overflow;
+
+    void writeHead(uint8_t major, uint64_t value);
+    void writeBytes(const void* data, size_t count);
+};
+
+#endif
@@ -2,31 +2,351 @@
 #define DEVICE_MANAGER_H
 
 #include <Arduino.h>
-#include <WiFi.h>
-#include <HTTPClient.h>
 #include <ArduinoJson.h>
-#include "DHT.h"
+#include "Hal.h"
 #include "StateManager.h"
 #include "ActuatorManager.h"
+#include "JobScheduler.h"
+#include "AsyncHttpClient.h"
+#include "JsonArena.h"
+#include "SpscQueue.h"
+#include "TaskMessages.h"
+#include "TelemetryLog.h"
+#include "JsonArrayStream.h"
+#include "EventStream.h"
+#include "CborWriter.h"
+#include "LatencyHistogram.h"
+#include "SensorPipeline.h"
+#include "ReportPolicy.h"
+#include "WifiManager.h"
+#include "Backoff.h"
+#include "Snapshot.h"
 
+template <typename Hal = DefaultHal>
 class DeviceManager {
 private:
     // Components
-    DHT dht;
-    StateManager stateManager;
-    ActuatorManager actuatorManager;
+    StateManager<Hal> stateManager;
+    ActuatorManager<Hal> actuatorManager;
     
-    // Network configuration
+    // Zones: each has its own sensor, output and device on the server. Zone 0
+    // comes from the constructor and addZone() adds the rest before setup().
+    // Like the state, per-zone data is kept as parallel arrays.
+    static const int MAX_ZONES = StateManager<Hal>::MAX_ZONES;
+    static const size_t DEVICE_ID_LENGTH = 32;
+    int zoneCount;
+    typename Hal::Sensor sensors[MAX_ZONES];
+    int sensorPins[MAX_ZONES];
+    int sensorTypes[MAX_ZONES];
+    SensorPipeline sensorPipelines[MAX_ZONES];
+    ReportPolicy reportPolicies[MAX_ZONES];     // Which readings are worth uploading
+    char zoneDeviceIds[MAX_ZONES][DEVICE_ID_LENGTH];
+    char zoneUbications[MAX_ZONES][UBICATION_LENGTH];   // Routines are matched by it
+    
+    // Network configuration. serverIP is the control task's copy (display,
+    // serial commands); networkServerIP is what the network task dials.
     String serverIP;
-    String deviceId;
+    String networkServerIP;
+    
+    // Control task timing
+    JobScheduler scheduler;
+    int sensorJob;
+    int routineJob;
+    int scheduleChangeJob;
+    int serialJob;
+    int updatesJob;
+    int heapJob;
+    unsigned long sensorInterval;       // Kept so they can be set before setup()
+    unsigned long routineInterval;
+    static const unsigned long sensorUpdateInterval = 5000;
+    static const unsigned long routineCheckInterval = 10000;
+    static const unsigned long serialPollInterval = 100;
+    static const unsigned long heapSampleInterval = 5000;
+    
+    // Network task timing
+    JobScheduler networkScheduler;
+    int apiJob;
+    int uploadJob;
+    int deviceInfoJob;
+    int routinesJob;
+    int pushJob;
+    int wifiJob;
+    unsigned long apiPollInterval;      // While the push channel is down
+    static const unsigned long apiUpdateInterval = 10000;
+    static const int networkTaskCore = 0;
+    static const int networkTaskPriority = 1;
+    static const unsigned long networkTaskStack = 8192;
+    bool networkStarted;                // Zone ids and ubications are fixed from then on
+    
+    // Log drain task: below both, so console output only uses idle time
+    static const int logTaskCore = 0;
+    static const int logTaskPriority = 0;
+    static const unsigned long logTaskStack = 3072;
+    static const unsigned long logDrainInterval = 20;
+    
+    // WiFi link, stepped by the network task. Until it is up, and while it
+    // is down, API traffic is paused and readings go to the flash log;
+    // sensing and control never wait for it.
+    WifiManager<Hal> wifi;
+    static const unsigned long wifiCheckInterval = 250;
+    
+    // Backend API, driven by the network task
+    AsyncHttpClient http;
+    JsonArena jsonArena;                // Backs the JsonDocuments parsed on the network task
+    static const uint16_t serverPort = 5000;
+    static const unsigned long httpTimeout = 5000;
+    static constexpr const char* apiKeyHeader = "X-API-Key: apichakiykey\r\n";
+    static constexpr const char* jsonHeaders = "Content-Type: application/json\r\nX-API-Key: apichakiykey\r\n";
+    static constexpr const char* cborHeaders = "Content-Type: application/cbor\r\nX-API-Key: apichakiykey\r\n";
+    static constexpr const char* eventStreamHeaders = "Accept: text/event-stream\r\nX-API-Key: apichakiykey\r\n";
+    
+    // Task communication. Each queue has exactly one producer and one
+    // consumer task, so the control path never blocks on the network.
+    SpscQueue<TelemetrySample, 32> telemetryQueue;   // control -> network
+    SpscQueue<NetworkCommand, 4> commandQueue;       // control -> network
+    SpscQueue<ControlUpdate, 32> updateQueue;        // network -> control
+    static const unsigned long queuePollInterval = 100;
+    unsigned long droppedSamples;                    // telemetryQueue full (control task)
+    unsigned long unloggedSamples;                   // telemetryLog refused them (network task)
+    
+    // Neither task waits on a full queue. Until there is room, the latest
+    // command of each kind waits on the control side, and the latest config
+    // of each zone and API status on the network side; older ones are
+    // replaced, since only the latest applies.
+    NetworkCommand pendingCommands[NETWORK_COMMAND_KINDS];   // control task
+    uint8_t pendingCommandMask;
+    unsigned long coalescedCommands;
+    ControlUpdate pendingConfigs[MAX_ZONES];                 // network task
+    uint32_t pendingConfigMask;
+    ControlUpdate pendingApiStatus;
+    bool apiStatusPending;
+    unsigned long coalescedUpdates;
+    static_assert(MAX_ZONES <= 32, "pendingConfigMask has a bit per zone");
+    
+    // Telemetry batching (network task). A batch goes out once batchSize
+    // samples are queued or the oldest one has waited flushInterval;
+    // batchSize 1 keeps the original one-POST-per-reading endpoint.
+    static const size_t MAX_TELEMETRY_BATCH = 16;
+    static const size_t MAX_ZONE_BATCH = 8;     // Default with zones; each record also names its device
+    size_t telemetryBatchSize;
+    unsigned long telemetryFlushInterval;
+    unsigned long uploadRequests;
+    unsigned long uploadSamples;
+    unsigned long uploadPayloadBytes;
+    
+    // Telemetry wire format. CBOR is opt-in; a 415 from the server switches
+    // back to JSON. Encoding cost is tracked per format for comparison.
+    TelemetryEncoding telemetryEncoding;
+    struct EncodingStats {
+        unsigned long samples;
+        unsigned long bytes;
+        unsigned long micros;
+    };
+    EncodingStats encodingStats[2];
+    
+    // A telemetry POST in flight. The records are kept until the server
+    // answers, so a failed upload can still go to the flash log.
+    struct TelemetryUpload {
+        DeviceManager* device;
+        TelemetryRecord records[MAX_TELEMETRY_BATCH];
+        size_t count;
+        bool replay;                // Records come from telemetryLog
+        TelemetryEncoding encoding; // Format it was sent in
+        uint32_t nextSequence;      // Log position to acknowledge on success
+        bool busy;
+    };
+    TelemetryUpload uploads[AsyncHttpClient::MAX_IN_FLIGHT];
+    
+    // Store-and-forward (network task). While the server is unreachable,
+    // readings go to flash; they are replayed oldest-first, one batch in
+    // flight at a time, once it answers again.
+    TelemetryLog<Hal> telemetryLog;
+    bool telemetryOffline;
+    bool replayInFlight;
+    unsigned long replayRetryAt;
+    static const unsigned long replayRetryInterval = 10000;
+    bool replayActive;
+    unsigned long replayStartedAt;
+    unsigned long replayDelivered;
+    unsigned long lastReplayRecords;
+    unsigned long lastReplayMs;
+    unsigned long unknownZoneRecords;   // Replayed for a zone no longer configured, dropped
+    
+    // Wall-clock time for records (network task). Before NTP sync time()
+    // counts from 1970, so samples wait in telemetryQueue, where they keep
+    // millis(), until CLOCK_HOLD_SAMPLES are queued. Past that they become
+    // records with timestamp 0, sent without one for the server to stamp.
+    bool clockSynced;
+    static const size_t CLOCK_HOLD_SAMPLES = 16;
+    unsigned long unsyncedRecords;
+    
+    // Conditional fetch (network task). The last ETag goes back as
+    // If-None-Match so an unchanged resource costs a 304; for servers without
+    // ETags, a hash of the last applied body skips the parse instead.
+    static const size_t ETAG_LENGTH = 64;
+    struct FetchState {
+        char etag[ETAG_LENGTH];
+        uint32_t bodyHash;          // 0 until a body has been applied
+    };
+    FetchState deviceInfoFetch[MAX_ZONES];
+    FetchState routinesFetch;
+    unsigned long fetchNotModified;
+    unsigned long fetchUnchanged;
     
-    // Timing control
-    unsigned long lastSensorUpdate;
-    unsigned long lastApiUpdate;
-    unsigned long lastRoutineCheck;
-    const unsigned long sensorUpdateInterval = 5000;
-    const unsigned long apiUpdateInterval = 10000;
-    const unsigned long routineCheckInterval = 10000;
+    // Device info is fetched for one zone after another, a couple of
+    // requests in flight at a time so uploads and the routine list still
+    // find a free connection; each response lets the next zone go. The
+    // routine list is fetched once for all zones.
+    struct ZoneRequest {
+        DeviceManager* device;
+        int zone;
+    };
+    ZoneRequest deviceInfoRequests[MAX_ZONES];
+    uint32_t deviceInfoPending;     // Zones still to fetch, one bit each
+    int deviceInfoInFlight;
+    static const int maxDeviceInfoInFlight = 2;
+    
+    // Routines the control task holds, by id and hash of their routine_data,
+    // so a changed list only sends the routines that differ
+    struct SyncedRoutine {
+        int32_t id;
+        uint32_t hash;
+        bool upserted;              // Sent to the control task by this sync
+    };
+    SyncedRoutine syncedRoutines[StateManager<Hal>::MAX_ROUTINES];
+    int syncedRoutineCount;
+    SyncedRoutine fetchedRoutines[StateManager<Hal>::MAX_ROUTINES];
+    unsigned long routinesUpserted;
+    unsigned long routinesRemoved;
+    unsigned long routineSetsPublished;
+    
+    // The routine list is streamed and synced one element at a time, so
+    // memory does not grow with the number of routines
+    JsonArrayStream routineStream;
+    bool routineSyncActive;
+    bool routineRefetch;            // Asked for again while a sync was under way
+    bool routineSyncDeferred;       // The control task held the spare set
+    static const unsigned long routineSyncRetryDelay = 500;
+    bool routineSyncIncomplete;     // Some routine did not fit; do not keep the ETag
+    int fetchedRoutineCount;
+    uint32_t routineBodyHash;
+    unsigned long routineSyncStartedAt;
+    unsigned long lastRoutineBytes;
+    unsigned long lastRoutineMicros;    // Spent parsing, waits excluded
+    unsigned long lastRoutineMs;        // First to last byte
+    
+    // Push channel (network task). The backend streams server-sent events
+    // naming what changed, and the matching fetch goes out right away;
+    // polling only backs it up every pushResyncInterval. While the channel
+    // is down the API is polled at apiPollInterval as before, and the
+    // channel is reopened with jittered exponential backoff.
+    enum PushState : uint8_t {
+        PUSH_DOWN,
+        PUSH_CONNECTING,
+        PUSH_UP
+    };
+    EventStream pushStream;
+    PushState pushState;
+    Backoff pushBackoff;
+    unsigned long pushUpSince;
+    unsigned long pushUpTimeMs;         // Over closed sessions
+    unsigned long pushConnects;         // Streams opened
+    unsigned long pushDrops;            // Streams lost after coming up
+    unsigned long pushEvents;
+    unsigned long pushDroppedEvents;    // Too large to parse
+    static const unsigned long pushIdleTimeout = 45000;         // Servers send a keep-alive every 15 s
+    static const unsigned long pushResyncInterval = 600000;
+    static const unsigned long pushRetryMin = 1000;
+    static const unsigned long pushRetryMax = 60000;
+    static const unsigned long pushUnsupportedRetry = 600000;   // Server without the endpoint
+    
+    // Per-stage latency, timed with the CPU cycle counter. API stages are
+    // submit to response. From STAGE_DEVICE_INFO_API on they are written by
+    // the network task, and STATS reads those from networkStats.
+    enum Stage {
+        STAGE_SENSOR,
+        STAGE_ROUTINE_CHECK,
+        STAGE_CONTROL,
+        STAGE_DISPLAY,
+        STAGE_DEVICE_INFO_API,
+        STAGE_ROUTINES_API,
+        STAGE_TELEMETRY_API,
+        STAGE_DEVICE_INFO_PARSE,
+        STAGE_ROUTINES_PARSE,
+        STAGE_COUNT
+    };
+    LatencyHistogram stageLatency[STAGE_COUNT];
+    unsigned long apiErrorResponses;    // 4xx/5xx; transport failures are in HttpStats
+    
+    // Heap low-water marks, sampled by the heap job. The minimum free heap
+    // is kept by the SDK; a shrinking largest block with plenty free is
+    // fragmentation, which the minimum alone does not show.
+    size_t minLargestFreeBlock;         // 0 until sampled
+    unsigned int maxFragmentation;      // %, 100 * (1 - largest block / free)
+    
+    // What JOBS and STATS show of the network task's state. The network task
+    // copies it out every networkStatsInterval and the printers, on the
+    // control task, only read the published copy.
+    static const int NETWORK_STAGES = STAGE_COUNT - STAGE_DEVICE_INFO_API;
+    struct NetworkStats {
+        unsigned long takenAt;
+        int jobCount;
+        const char* jobNames[JobScheduler::MAX_JOBS];
+        unsigned long jobPeriods[JobScheduler::MAX_JOBS];
+        JobStats jobStats[JobScheduler::MAX_JOBS];
+        HttpStats http;
+        int openConnections;
+        unsigned long unloggedSamples;
+        unsigned long coalescedUpdates;
+        
+        size_t batchSize;
+        unsigned long flushInterval;
+        unsigned long uploadRequests;
+        unsigned long uploadSamples;
+        unsigned long uploadPayloadBytes;
+        TelemetryEncoding encoding;
+        EncodingStats encodingStats[2];
+        size_t logPending;
+        TelemetryLogStats log;
+        unsigned long unsyncedRecords;
+        unsigned long unknownZoneRecords;
+        unsigned long lastReplayRecords;
+        unsigned long lastReplayMs;
+        
+        unsigned long fetchNotModified;
+        unsigned long fetchUnchanged;
+        int syncedRoutineCount;
+        unsigned long routinesUpserted;
+        unsigned long routinesRemoved;
+        unsigned long routineSetsPublished;
+        unsigned long lastRoutineBytes;
+        size_t routineElements;
+        size_t routineSkipped;
+        size_t routineMaxElement;
+        unsigned long lastRoutineMicros;
+        unsigned long lastRoutineMs;
+        
+        typename WifiManager<Hal>::State wifiState;
+        WifiStats wifi;
+        unsigned long wifiConnectedMs;      // Current connection included
+        unsigned long wifiRetryAt;
+        
+        PushState pushState;
+        unsigned long pushUpTimeMs;         // Current session included
+        unsigned long pushConnects;
+        unsigned long pushDrops;
+        unsigned long pushEvents;
+        unsigned long pushDroppedEvents;    // Parser drops included
+        unsigned long pollPeriod;
+        
+        LatencyHistogram stageLatency[NETWORK_STAGES];  // From STAGE_DEVICE_INFO_API on
+        unsigned long apiErrorResponses;
+        size_t jsonArenaPeak;
+        unsigned long jsonArenaOverflows;
+    };
+    Snapshot<NetworkStats> networkStats;
+    int statsJob;
+    static const unsigned long networkStatsInterval = 1000;
     
 public:
     DeviceManager(int dhtPin = 33, int dhtType = DHT22, int ledPin = 32);
@@ -37,24 +357,135 @@ public:
     // Network methods
     void connectWiFi(const char* ssid, const char* password);
     void setServerIP(const String& ip);
-    void setDeviceId(const String& id);
+    void setDeviceId(const String& id);           // Zone 0's, before setup()
+    void setUbication(const char* ubication);     // Zone 0's, before setup()
+    
+    // Zones. Returns the new zone's index, -1 if the table is full or
+    // setup() has already run.
+    int addZone(const char* deviceId, const char* ubication, int dhtPin, int ledPin, int dhtType = DHT22);
+    int getZoneCount() const;
     
-    // API methods
+    // Scheduling
+    void setSensorUpdateInterval(unsigned long ms);
+    void setApiUpdateInterval(unsigned long ms);
+    void setRoutineCheckInterval(unsigned long ms);
+    void setTelemetryBatch(size_t batchSize, unsigned long flushIntervalMs);
+    void setTelemetryEncoding(TelemetryEncoding encoding);
+    void setReportPolicy(const ReportSettings& settings);
+    void setReportByException(bool enabled);
+    
+    // API methods, run on the network task. They only submit the request;
+    // the response is handled when it arrives.
     void getDeviceInfoFromApi();
     void getRoutineDataFromApi();
-    void sendToEdgeApi(float temp, float hum, int ica);
-    String getCurrentTimeDevice();
+    bool sendToEdgeApi(TelemetryUpload& upload);
+    bool sendTelemetryBatch(TelemetryUpload& upload);
     
     // Sensor methods
     void updateSensorData();
     
     // Utility methods
     void printConnectionInfo();
+    void printJobStats();
+    void printZones();
     void processSerialCommands();
     
 private:
     void initializeTime();
-    void parseRoutineData(const String& routineDataStr, Routine& routine);
+    void printSchedulerStats(const JobScheduler& jobs);
+    void printJob(const char* name, unsigned long period, const JobStats& stats);
+    void printHttpStats(const NetworkStats& stats);
+    void printUploadStats(const NetworkStats& stats);
+    void printFetchStats(const NetworkStats& stats);
+    void printPushStats(const NetworkStats& stats);
+    void printWifiStats(const NetworkStats& stats);
+    void printRoutineCheckStats();
+    void printStageStats();
+    void printStageStatsJson();
+    const LatencyHistogram& stageHistogram(const NetworkStats& stats, int stage) const;
+    bool printJsonPiece(const char* piece, int length, size_t size);
+    void printSensorStats();
+    void recordStage(Stage stage, uint32_t startCycles);
+    void recordApiCall(Stage stage, const HttpResponse& response);
+    int zoneForUbication(const char* ubication) const;
+    int zoneForDeviceId(const char* deviceId) const;
+    const char* zoneDeviceId(uint8_t zone) const;
+    void printLogStats();
+    static void logTask(void* self);
+    
+    // Control task
+    void runRoutineCheck();
+    void sampleHeap();
+    void refreshDisplay();
+    void armScheduleChange();
+    void processUpdates();
+    void applyUpdate(const ControlUpdate& update);
+    void applyDeviceConfig(const DeviceConfigUpdate& config);
+    void sendCommand(const NetworkCommand& command);
+    void flushCommands();
+    
+    // Network task
+    static void networkTask(void* self);
+    void checkWifi();
+    void refreshFromApi();
+    void submitDeviceInfo();
+    void uploadTelemetry();
+    void replayTelemetry();
+    size_t dropUnknownZones(TelemetryRecord* records, size_t count);
+    bool isClockSynced();
+    TelemetryUpload* acquireUpload();
+    void submitUpload(TelemetryUpload& upload);
+    void storeUpload(TelemetryUpload& upload);
+    TelemetryRecord makeRecord(const TelemetrySample& sample);
+    int encodeTelemetry(TelemetryUpload& upload, bool single, char* payload, size_t capacity);
+    int encodeTelemetryJson(const TelemetryUpload& upload, bool single, char* payload, size_t capacity);
+    int encodeTelemetryCbor(const TelemetryUpload& upload, bool single, uint8_t* payload, size_t capacity);
+    void processCommands();
+    void publishUpdate(const ControlUpdate& update);
+    void flushUpdates();
+    void publishApiStatus(const char* message);
+    void publishNetworkStats();
+    bool submitFetch(FetchState& fetch, const char* path, HttpCallback callback, void* context,
+                     HttpBodyCallback onBody = nullptr);
+    bool isUnchanged(FetchState& fetch, const HttpResponse& response, uint32_t& bodyHash);
+    void storeFetch(FetchState& fetch, const HttpResponse& response, uint32_t bodyHash);
+    void handleRoutinesBody(int status, const char* data, size_t length);
+    void syncRoutine(const char* element, size_t length);
+    void finishRoutineSync(bool complete);
+    RoutineSet<StateManager<Hal>::MAX_ROUTINES>* beginRoutineSync();
+    void logRoutine(int index, const Routine& routine, const RoutineCondition& condition, const char* name);
+    static void onRoutinesBody(void* self, int status, const char* data, size_t length);
+    static void onRoutineElement(void* self, const char* element, size_t length);
+    void openPushChannel();
+    void handlePushBody(int status, const char* data, size_t length);
+    void handlePushEvent(const char* type, const char* data, size_t length);
+    void handlePushResponse(const HttpResponse& response);
+    static void onPushBody(void* self, int status, const char* data, size_t length);
+    static void onPushEvent(void* self, const char* type, const char* data, size_t length);
+    
+    static void onSensorJob(void* self);
+    static void onRoutineJob(void* self);
+    static void onUpdatesJob(void* self);
+    static void onSerialJob(void* self);
+    static void onHeapJob(void* self);
+    static void onApiJob(void* self);
+    static void onDeviceInfoJob(void* self);
+    static void onRoutinesJob(void* self);
+    static void onPushJob(void* self);
+    static void onWifiJob(void* self);
+    static void onUploadJob(void* self);
+    static void onStatsJob(void* self);
+    
+    void handleDeviceInfoResponse(int zone, const HttpResponse& response);
+    void handleRoutinesResponse(const HttpResponse& response);
+    void handleTelemetryResponse(TelemetryUpload& upload, const HttpResponse& response);
+    static void onDeviceInfoResponse(void* request, const HttpResponse& response);
+    static void onRoutinesResponse(void* self, const HttpResponse& response);
+    static void onPushResponse(void* self, const HttpResponse& response);
+    static void onTelemetryResponse(void* upload, const HttpResponse& response);
 };
 
+// Instantiated in DeviceManager.cpp
+extern template class DeviceManager<DefaultHal>;
+
 #endif
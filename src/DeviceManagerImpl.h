@@ -0,0 +1,2502 @@
+#ifndef DEVICE_MANAGER_IMPL_H
+#define DEVICE_MANAGER_IMPL_H
+
+// Member definitions of DeviceManager. DeviceManager.cpp instantiates them for
+// DefaultHal; tests include this header to use a mock HAL instead.
+
+#include "DeviceManager.h"
+#include "StateManagerImpl.h"
+#include "ActuatorManagerImpl.h"
+#include "TelemetryLogImpl.h"
+#include "WifiManagerImpl.h"
+#include <time.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include "Log.h"
+
+namespace {
+
+// FNV-1a, never 0 so 0 can mean "nothing applied yet"
+uint32_t hashBytes(const char* data, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (uint8_t)data[i]) * 16777619u;
+    }
+    return hash != 0 ? hash : 1;
+}
+
+// Indexed by DeviceManager::Stage
+const char* const STAGE_NAMES[] = {
+    "dht", "rutinas", "control", "pantalla",
+    "api_dispositivo", "api_rutinas", "api_telemetria",
+    "json_dispositivo", "json_rutinas"
+};
+
+// Two decimals, or null for NaN and infinities, which printf would write
+// as nan and inf. JSON_NUMBER_LENGTH fits any float.
+const int JSON_NUMBER_LENGTH = 48;
+
+const char* formatJsonNumber(char* out, size_t size, float value) {
+    if (isfinite(value)) {
+        snprintf(out, size, "%.2f", value);
+    } else {
+        snprintf(out, size, "null");
+    }
+    return out;
+}
+
+}
+
+template <typename Hal>
+DeviceManager<Hal>::DeviceManager(int dhtPin, int dhtType, int ledPin) 
+    : actuatorManager(ledPin), scheduler(&Hal::Clock::millis),
+      networkScheduler(&Hal::Clock::millis), http(&Hal::Clock::millis),
+      pushBackoff(pushRetryMin, pushRetryMax) {
+    
+    serverIP = "host.wokwi.internal";
+    networkServerIP = serverIP;
+    
+    // Zone 0; its state and output already exist in the managers
+    zoneCount = 1;
+    sensorPins[0] = dhtPin;
+    sensorTypes[0] = dhtType;
+    strcpy(zoneDeviceIds[0], "PruebaOtraVes");
+    zoneUbications[0][0] = '\0';
+    
+    sensorJob = -1;
+    routineJob = -1;
+    scheduleChangeJob = -1;
+    serialJob = -1;
+    updatesJob = -1;
+    heapJob = -1;
+    sensorInterval = sensorUpdateInterval;
+    routineInterval = routineCheckInterval;
+    apiJob = -1;
+    uploadJob = -1;
+    deviceInfoJob = -1;
+    routinesJob = -1;
+    pushJob = -1;
+    wifiJob = -1;
+    statsJob = -1;
+    networkStarted = false;
+    apiPollInterval = apiUpdateInterval;
+    
+    droppedSamples = 0;
+    unloggedSamples = 0;
+    pendingCommandMask = 0;
+    coalescedCommands = 0;
+    pendingConfigMask = 0;
+    apiStatusPending = false;
+    coalescedUpdates = 0;
+    unknownZoneRecords = 0;
+    clockSynced = false;
+    unsyncedRecords = 0;
+    
+    telemetryBatchSize = 1;
+    telemetryFlushInterval = 30000;
+    uploadRequests = 0;
+    uploadSamples = 0;
+    uploadPayloadBytes = 0;
+    telemetryEncoding = TELEMETRY_JSON;
+    memset(encodingStats, 0, sizeof(encodingStats));
+    
+    for (int i = 0; i < AsyncHttpClient::MAX_IN_FLIGHT; i++) {
+        uploads[i].device = this;
+        uploads[i].busy = false;
+    }
+    telemetryOffline = false;
+    replayInFlight = false;
+    replayRetryAt = 0;
+    replayActive = false;
+    replayStartedAt = 0;
+    replayDelivered = 0;
+    lastReplayRecords = 0;
+    lastReplayMs = 0;
+    
+    memset(deviceInfoFetch, 0, sizeof(deviceInfoFetch));
+    memset(&routinesFetch, 0, sizeof(routinesFetch));
+    fetchNotModified = 0;
+    fetchUnchanged = 0;
+    for (int i = 0; i < MAX_ZONES; i++) {
+        deviceInfoRequests[i].device = this;
+        deviceInfoRequests[i].zone = i;
+    }
+    deviceInfoPending = 0;
+    deviceInfoInFlight = 0;
+    syncedRoutineCount = 0;
+    routinesUpserted = 0;
+    routinesRemoved = 0;
+    routineSetsPublished = 0;
+    
+    routineSyncActive = false;
+    routineRefetch = false;
+    routineSyncDeferred = false;
+    routineSyncIncomplete = false;
+    fetchedRoutineCount = 0;
+    routineBodyHash = 0;
+    routineSyncStartedAt = 0;
+    lastRoutineBytes = 0;
+    lastRoutineMicros = 0;
+    lastRoutineMs = 0;
+    
+    pushState = PUSH_DOWN;
+    pushUpSince = 0;
+    pushUpTimeMs = 0;
+    pushConnects = 0;
+    pushDrops = 0;
+    pushEvents = 0;
+    pushDroppedEvents = 0;
+    
+    apiErrorResponses = 0;
+    minLargestFreeBlock = 0;
+    maxFragmentation = 0;
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::setup() {
+    Hal::console().begin(9600);
+    
+    // Initialize components
+    for (int zone = 0; zone < zoneCount; zone++) {
+        sensors[zone].begin(sensorPins[zone], sensorTypes[zone]);
+    }
+    actuatorManager.begin();
+    actuatorManager.setStateManager(&stateManager);
+    
+    // Readings of all zones go up together, one request per batch; the
+    // network task is not running yet, so its settings can be set here
+    if (zoneCount > 1 && telemetryBatchSize == 1) {
+        telemetryBatchSize = (size_t)zoneCount < MAX_ZONE_BATCH ? zoneCount : MAX_ZONE_BATCH;
+    }
+    
+    // Connect to WiFi; the network task brings the link up in the
+    // background, so control starts now even if the AP is out of reach
+    connectWiFi("Wokwi-GUEST", "");
+    pushBackoff.seed(Hal::Network::random());
+    
+    // Print connection info
+    printConnectionInfo();
+    
+    // Initialize time
+    initializeTime();
+    
+    // Readings left unsent by the previous boot are replayed first
+    telemetryLog.begin();
+    
+    // Control task (this one): sensing, routines and actuators
+    sensorJob = scheduler.addPeriodic("sensor", sensorInterval, &DeviceManager::onSensorJob, this, sensorInterval);
+    routineJob = scheduler.addPeriodic("routines", routineInterval, &DeviceManager::onRoutineJob, this, routineInterval);
+    scheduleChangeJob = scheduler.addOneShot("schedule", &DeviceManager::onRoutineJob, this);
+    updatesJob = scheduler.addPeriodic("updates", queuePollInterval, &DeviceManager::onUpdatesJob, this);
+    serialJob = scheduler.addPeriodic("serial", serialPollInterval, &DeviceManager::onSerialJob, this);
+    heapJob = scheduler.addPeriodic("heap", heapSampleInterval, &DeviceManager::onHeapJob, this, heapSampleInterval);
+    
+    // Network task: the WiFi job brings the link up; once it is, the
+    // initial fetch goes out right away, then periodic refresh and uploads,
+    // and the push channel opens once the first fetch is under way
+    wifiJob = networkScheduler.addPeriodic("wifi", wifiCheckInterval, &DeviceManager::onWifiJob, this);
+    apiJob = networkScheduler.addPeriodic("api", apiPollInterval, &DeviceManager::onApiJob, this);
+    networkScheduler.cancel(apiJob);
+    uploadJob = networkScheduler.addPeriodic("upload", queuePollInterval, &DeviceManager::onUploadJob, this);
+    deviceInfoJob = networkScheduler.addOneShot("zones", &DeviceManager::onDeviceInfoJob, this);
+    routinesJob = networkScheduler.addOneShot("routines", &DeviceManager::onRoutinesJob, this);
+    pushJob = networkScheduler.addOneShot("push", &DeviceManager::onPushJob, this);
+    statsJob = networkScheduler.addPeriodic("stats", networkStatsInterval, &DeviceManager::onStatsJob, this);
+    
+    networkStarted = true;
+    if (!Hal::Tasks::start("network", &DeviceManager::networkTask, this,
+                           networkTaskCore, networkTaskPriority, networkTaskStack)) {
+        Hal::console().println("ERROR: No se pudo iniciar la tarea de red");
+    }
+    if (!Hal::Tasks::start("log", &DeviceManager::logTask, this,
+                           logTaskCore, logTaskPriority, logTaskStack)) {
+        Hal::console().println("ERROR: No se pudo iniciar la tarea de registro");
+    }
+    
+    Hal::console().println("DeviceManager setup completed");
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::loop() {
+    // A routine set published by the network task is taken up here, and
+    // let go of before sleeping so the next one can be built in its buffer
+    if (stateManager.acquireRoutines()) {
+        LOG_INFO("rutinas", "Total de rutinas cargadas: %d (%lu bytes por rutina)", stateManager.getRoutineCount(),
+                 (unsigned long)StateManager<Hal>::getRoutineFootprint());
+        armScheduleChange();
+    }
+    
+    // Run whatever is due, then sleep (yielding to other tasks) until the
+    // next deadline instead of spinning on millis()
+    unsigned long wait = scheduler.runDue(Hal::Clock::millis(), serialPollInterval);
+    stateManager.releaseRoutines();
+    if (wait > 0) {
+        Hal::Clock::delay(wait);
+    }
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::networkTask(void* self) {
+    DeviceManager* device = static_cast<DeviceManager*>(self);
+    for (;;) {
+        // Updates left waiting by a full queue go out as it drains
+        device->flushUpdates();
+        
+        // Sleep in the HTTP client's socket wait while requests are in
+        // flight, so responses are handled as soon as they arrive
+        unsigned long wait = device->networkScheduler.runDue(Hal::Clock::millis(), queuePollInterval);
+        if (device->http.getInFlight() > 0) {
+            device->http.poll(wait);
+        } else if (wait > 0) {
+            Hal::Clock::delay(wait);
+        }
+    }
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::logTask(void* self) {
+    (void)self;
+    LogEntry entry;
+    for (;;) {
+        while (logRead(entry)) {
+            char prefix[24];
+            snprintf(prefix, sizeof(prefix), "[%c][%s] ", logLevelLetter(entry.level), entry.tag);
+            Hal::console().print(prefix);
+            Hal::console().println(entry.message);
+        }
+        Hal::Clock::delay(logDrainInterval);
+    }
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::checkWifi() {
+    typename WifiManager<Hal>::Event event = wifi.step();
+    
+    if (event == WifiManager<Hal>::CONNECTED) {
+        // Resume: catch up with the server, reopen the event stream and
+        // replay the readings logged while offline
+        LOG_INFO("wifi", "Reanudando comunicacion con el servidor");
+        networkScheduler.runIn(apiJob, 0);
+        pushBackoff.reset();
+        networkScheduler.runIn(pushJob, queuePollInterval);
+        replayRetryAt = Hal::Clock::millis();
+    } else if (event == WifiManager<Hal>::DISCONNECTED) {
+        // Pause: requests already in flight fail on their own and uploads
+        // among them go to the flash log
+        http.cancel(&DeviceManager::onPushResponse, this);
+        networkScheduler.cancel(apiJob);
+        networkScheduler.cancel(deviceInfoJob);
+        networkScheduler.cancel(routinesJob);
+        networkScheduler.cancel(pushJob);
+        deviceInfoPending = 0;
+        publishApiStatus("ERROR: Sin WiFi");
+    }
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::refreshFromApi() {
+    if (!wifi.isOnline()) {
+        // Nothing to poll until the link is back; CONNECTED restarts it
+        networkScheduler.cancel(apiJob);
+        return;
+    }
+    LOG_INFO("api", "Actualizando datos del servidor");
+    getDeviceInfoFromApi();
+    getRoutineDataFromApi();
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::runRoutineCheck() {
+    uint32_t started = Hal::Clock::cycles();
+    stateManager.checkActiveRoutines();
+    recordStage(STAGE_ROUTINE_CHECK, started);
+    
+    // Update actuators based on state
+    started = Hal::Clock::cycles();
+    actuatorManager.controlDevices();
+    recordStage(STAGE_CONTROL, started);
+    refreshDisplay();
+    
+    armScheduleChange();
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::refreshDisplay() {
+    // Only changed cells go to the LCD, so this is cheap at sensor rate
+    uint32_t started = Hal::Clock::cycles();
+    actuatorManager.updateDisplay();
+    actuatorManager.displayServerInfo(serverIP);
+    recordStage(STAGE_DISPLAY, started);
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::armScheduleChange() {
+    // Re-check exactly when the next routine window opens or closes
+    long untilChange = stateManager.getMillisUntilScheduleChange();
+    if (untilChange >= 0) {
+        scheduler.runIn(scheduleChangeJob, untilChange);
+    } else {
+        scheduler.cancel(scheduleChangeJob);
+    }
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::processUpdates() {
+    ControlUpdate update;
+    while (updateQueue.pop(update)) {
+        applyUpdate(update);
+    }
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::applyUpdate(const ControlUpdate& update) {
+    switch (update.kind) {
+        case ControlUpdate::DEVICE_CONFIG:
+            applyDeviceConfig(update.config);
+            break;
+            
+        case ControlUpdate::API_STATUS:
+            stateManager.setApiError(update.apiStatus);
+            break;
+    }
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::applyDeviceConfig(const DeviceConfigUpdate& config) {
+    int zone = config.zone;
+    stateManager.updateDeviceConfiguration(zone, config.icaMin, config.icaMax, config.tempMin, config.tempMax,
+                                           config.humMin, config.humMax);
+    
+    ZoneStates<MAX_ZONES>& zones = stateManager.getZones();
+    bool newEstadoDeviceOriginal = config.estado;
+    
+    if (newEstadoDeviceOriginal != zones.estado_device_original[zone]) {
+        LOG_INFO("config", "Zona %d, cambio manual del usuario: %s -> %s", zone,
+                 zones.estado_device_original[zone] ? "ACTIVO" : "INACTIVO", newEstadoDeviceOriginal ? "ACTIVO" : "INACTIVO");
+        
+        if (!newEstadoDeviceOriginal && zones.estado_device_original[zone]) {
+            LOG_INFO("config", ">>> ZONA %d APAGADA POR USUARIO <<<", zone);
+            stateManager.setDeviceStatus(zone, false, "");
+        }
+        else if (newEstadoDeviceOriginal && !zones.estado_device_original[zone]) {
+            LOG_INFO("config", ">>> ZONA %d ENCENDIDA POR USUARIO <<<", zone);
+            stateManager.setDeviceStatus(zone, true, "Deshumidificador");
+        }
+        
+        zones.estado_device_original[zone] = newEstadoDeviceOriginal;
+    } else {
+        if (!zones.estado_device[zone]) {
+            stateManager.setDeviceStatus(zone, zones.estado_device_original[zone], 
+                zones.estado_device_original[zone] ? "Deshumidificador" : "");
+        }
+    }
+    
+    LOG_INFO("config", "Zona %d: ICA %d-%d, Temp %.2f-%.2f, Humedad %.2f-%.2f", zone,
+             config.icaMin, config.icaMax, config.tempMin, config.tempMax, config.humMin, config.humMax);
+    LOG_INFO("config", "Zona %d: servidor %s, actual %s", zone,
+             zones.estado_device_original[zone] ? "ACTIVO" : "INACTIVO", zones.estado_device[zone] ? "ACTIVO" : "INACTIVO");
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::publishUpdate(const ControlUpdate& update) {
+    // Everything goes through the pending slots, so an update left waiting
+    // never overtakes a newer one of its kind
+    if (update.kind == ControlUpdate::DEVICE_CONFIG) {
+        uint32_t bit = 1UL << update.config.zone;
+        if (pendingConfigMask & bit) {
+            coalescedUpdates++;
+        }
+        pendingConfigs[update.config.zone] = update;
+        pendingConfigMask |= bit;
+    } else {
+        if (apiStatusPending) {
+            coalescedUpdates++;
+        }
+        pendingApiStatus = update;
+        apiStatusPending = true;
+    }
+    flushUpdates();
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::flushUpdates() {
+    // Configs before the status, as they were published
+    for (int zone = 0; zone < MAX_ZONES && pendingConfigMask != 0; zone++) {
+        uint32_t bit = 1UL << zone;
+        if (pendingConfigMask & bit) {
+            if (!updateQueue.push(pendingConfigs[zone])) {
+                return;
+            }
+            pendingConfigMask &= ~bit;
+        }
+    }
+    if (apiStatusPending && updateQueue.push(pendingApiStatus)) {
+        apiStatusPending = false;
+    }
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::publishApiStatus(const char* message) {
+    ControlUpdate update;
+    update.kind = ControlUpdate::API_STATUS;
+    strncpy(update.apiStatus, message, API_STATUS_LENGTH - 1);
+    update.apiStatus[API_STATUS_LENGTH - 1] = '\0';
+    publishUpdate(update);
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::publishNetworkStats() {
+    // Skipped while the control task is still printing the previous copy
+    NetworkStats* stats = networkStats.beginUpdate();
+    if (stats == nullptr) {
+        return;
+    }
+    stats->takenAt = Hal::Clock::millis();
+    stats->jobCount = networkScheduler.getJobCount();
+    for (int id = 0; id < stats->jobCount; id++) {
+        stats->jobNames[id] = networkScheduler.getJobName(id);
+        stats->jobPeriods[id] = networkScheduler.getPeriod(id);
+        stats->jobStats[id] = networkScheduler.getStats(id);
+    }
+    stats->http = http.getStats();
+    stats->openConnections = http.getOpenConnections();
+    stats->unloggedSamples = unloggedSamples;
+    stats->coalescedUpdates = coalescedUpdates;
+    
+    stats->batchSize = telemetryBatchSize;
+    stats->flushInterval = telemetryFlushInterval;
+    stats->uploadRequests = uploadRequests;
+    stats->uploadSamples = uploadSamples;
+    stats->uploadPayloadBytes = uploadPayloadBytes;
+    stats->encoding = telemetryEncoding;
+    memcpy(stats->encodingStats, encodingStats, sizeof(encodingStats));
+    stats->logPending = telemetryLog.getPending();
+    stats->log = telemetryLog.getStats();
+    stats->unsyncedRecords = unsyncedRecords;
+    stats->unknownZoneRecords = unknownZoneRecords;
+    stats->lastReplayRecords = lastReplayRecords;
+    stats->lastReplayMs = lastReplayMs;
+    
+    stats->fetchNotModified = fetchNotModified;
+    stats->fetchUnchanged = fetchUnchanged;
+    stats->syncedRoutineCount = syncedRoutineCount;
+    stats->routinesUpserted = routinesUpserted;
+    stats->routinesRemoved = routinesRemoved;
+    stats->routineSetsPublished = routineSetsPublished;
+    stats->lastRoutineBytes = lastRoutineBytes;
+    stats->routineElements = routineStream.getElements();
+    stats->routineSkipped = routineStream.getSkipped();
+    stats->routineMaxElement = routineStream.getMaxElement();
+    stats->lastRoutineMicros = lastRoutineMicros;
+    stats->lastRoutineMs = lastRoutineMs;
+    
+    stats->wifiState = wifi.getState();
+    stats->wifi = wifi.getStats();
+    stats->wifiConnectedMs = wifi.getConnectedMs();
+    stats->wifiRetryAt = wifi.getRetryAt();
+    
+    stats->pushState = pushState;
+    stats->pushUpTimeMs = pushUpTimeMs + (pushState == PUSH_UP ? stats->takenAt - pushUpSince : 0);
+    stats->pushConnects = pushConnects;
+    stats->pushDrops = pushDrops;
+    stats->pushEvents = pushEvents;
+    stats->pushDroppedEvents = pushDroppedEvents + pushStream.getDropped();
+    stats->pollPeriod = networkScheduler.getPeriod(apiJob);
+    
+    for (int i = 0; i < NETWORK_STAGES; i++) {
+        stats->stageLatency[i] = stageLatency[STAGE_DEVICE_INFO_API + i];
+    }
+    stats->apiErrorResponses = apiErrorResponses;
+    stats->jsonArenaPeak = jsonArena.getPeak();
+    stats->jsonArenaOverflows = jsonArena.getOverflows();
+    networkStats.publish();
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::sendCommand(const NetworkCommand& command) {
+    // The control loop never waits for the network task; a command still
+    // waiting for room is replaced by a newer one of the same kind
+    uint8_t bit = 1 << command.kind;
+    if (pendingCommandMask & bit) {
+        coalescedCommands++;
+    }
+    pendingCommands[command.kind] = command;
+    pendingCommandMask |= bit;
+    flushCommands();
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::flushCommands() {
+    for (int kind = 0; kind < NETWORK_COMMAND_KINDS && pendingCommandMask != 0; kind++) {
+        uint8_t bit = 1 << kind;
+        if (pendingCommandMask & bit) {
+            if (!commandQueue.push(pendingCommands[kind])) {
+                return;
+            }
+            pendingCommandMask &= ~bit;
+        }
+    }
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::processCommands() {
+    NetworkCommand command;
+    while (commandQueue.pop(command)) {
+        switch (command.kind) {
+            case NetworkCommand::SET_SERVER:
+                // ETags and hashes belong to the old server; the routine
+                // table does not, so delta sync still applies
+                networkServerIP = command.host;
+                memset(deviceInfoFetch, 0, sizeof(deviceInfoFetch));
+                memset(&routinesFetch, 0, sizeof(routinesFetch));
+                networkScheduler.runIn(apiJob, 0);
+                
+                // The event stream moves to the new server too
+                pushBackoff.reset();
+                if (!http.cancel(&DeviceManager::onPushResponse, this)) {
+                    networkScheduler.runIn(pushJob, 0);
+                }
+                break;
+                
+            case NetworkCommand::REFRESH:
+                networkScheduler.runIn(apiJob, 0);
+                break;
+                
+            case NetworkCommand::SET_BATCH:
+                telemetryBatchSize = command.batchSize;
+                telemetryFlushInterval = command.flushInterval;
+                break;
+                
+            case NetworkCommand::SET_ENCODING:
+                telemetryEncoding = command.encoding;
+                break;
+        }
+    }
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::uploadTelemetry() {
+    processCommands();
+    bool holdForClock = !isClockSynced() && telemetryQueue.size() < CLOCK_HOLD_SAMPLES;
+    
+    // While there is a backlog every reading goes through the log, so the
+    // server still receives them in order; without WiFi they wait there
+    if (telemetryOffline || !telemetryLog.isEmpty() || !wifi.isOnline()) {
+        TelemetrySample sample;
+        while (!holdForClock && telemetryQueue.pop(sample)) {
+            TelemetryRecord record = makeRecord(sample);
+            if (!telemetryLog.append(record)) {
+                unloggedSamples++;
+            }
+        }
+        if (wifi.isOnline()) {
+            replayTelemetry();
+        }
+        return;
+    }
+    if (holdForClock) {
+        return;
+    }
+    
+    // Samples stay queued while every HTTP slot is busy or the batch is
+    // still filling up
+    TelemetrySample sample;
+    while (http.canSubmit() && telemetryQueue.peek(sample) && !telemetryOffline) {
+        bool full = telemetryQueue.size() >= telemetryBatchSize;
+        bool due = Hal::Clock::millis() - sample.timestamp >= telemetryFlushInterval;
+        if (!full && !due) {
+            break;
+        }
+        TelemetryUpload* upload = acquireUpload();
+        if (!upload) {
+            break;
+        }
+        
+        upload->count = 0;
+        upload->replay = false;
+        while (upload->count < telemetryBatchSize && telemetryQueue.pop(sample)) {
+            upload->records[upload->count++] = makeRecord(sample);
+        }
+        submitUpload(*upload);
+    }
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::replayTelemetry() {
+    // Backpressure: the next batch waits for the previous acknowledgement
+    if (replayInFlight || !http.canSubmit()) {
+        return;
+    }
+    
+    unsigned long now = Hal::Clock::millis();
+    if (telemetryOffline && (long)(now - replayRetryAt) < 0) {
+        return;
+    }
+    if (telemetryLog.isEmpty()) {
+        telemetryOffline = false;
+        return;
+    }
+    
+    TelemetryUpload* upload = acquireUpload();
+    if (!upload) {
+        return;
+    }
+    
+    // The legacy endpoint takes one reading per POST
+    size_t max = telemetryBatchSize == 1 ? 1 : MAX_TELEMETRY_BATCH;
+    size_t peeked = telemetryLog.peek(upload->records, max, upload->nextSequence);
+    upload->count = dropUnknownZones(upload->records, peeked);
+    upload->replay = true;
+    if (upload->count == 0) {
+        // Nothing to send for these; the next pass moves on to the rest
+        if (peeked > 0) {
+            telemetryLog.acknowledge(upload->nextSequence);
+        }
+        upload->busy = false;
+        return;
+    }
+    
+    if (!replayActive) {
+        replayActive = true;
+        replayStartedAt = now;
+        replayDelivered = 0;
+        LOG_INFO("telemetria", "Reenviando lecturas guardadas: %lu", (unsigned long)telemetryLog.getPending());
+    }
+    replayInFlight = true;
+    submitUpload(*upload);
+}
+
+template <typename Hal>
+size_t DeviceManager<Hal>::dropUnknownZones(TelemetryRecord* records, size_t count) {
+    // A zone the log remembers but this configuration lacks has no device
+    // id to send the record under
+    size_t kept = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (!zoneDeviceId(records[i].zone)) {
+            unknownZoneRecords++;
+            continue;
+        }
+        records[kept++] = records[i];
+    }
+    if (kept < count) {
+        LOG_WARN("telemetria", "%u lecturas guardadas de zonas que ya no existen descartadas", (unsigned)(count - kept));
+    }
+    return kept;
+}
+
+template <typename Hal>
+bool DeviceManager<Hal>::isClockSynced() {
+    // Once set, SNTP keeps it set
+    if (!clockSynced) {
+        struct tm now;
+        clockSynced = Hal::Clock::localTime(&now);
+    }
+    return clockSynced;
+}
+
+template <typename Hal>
+typename DeviceManager<Hal>::TelemetryUpload* DeviceManager<Hal>::acquireUpload() {
+    for (int i = 0; i < AsyncHttpClient::MAX_IN_FLIGHT; i++) {
+        if (!uploads[i].busy) {
+            uploads[i].busy = true;
+            return &uploads[i];
+        }
+    }
+    return nullptr;
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::submitUpload(TelemetryUpload& upload) {
+    bool sent = false;
+    if (!wifi.isOnline()) {
+        LOG_WARN("telemetria", "No hay conexión WiFi.");
+        publishApiStatus("ERROR: Sin WiFi");
+    } else if (telemetryBatchSize == 1 && upload.count == 1) {
+        sent = sendToEdgeApi(upload);
+    } else {
+        sent = sendTelemetryBatch(upload);
+    }
+    
+    if (!sent) {
+        storeUpload(upload);
+    }
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::storeUpload(TelemetryUpload& upload) {
+    // Readings that never reached the server wait in flash; replayed ones
+    // are still there
+    if (!upload.replay) {
+        for (size_t i = 0; i < upload.count; i++) {
+            if (!telemetryLog.append(upload.records[i])) {
+                unloggedSamples++;
+            }
+        }
+    } else {
+        replayInFlight = false;
+    }
+    
+    if (telemetryLog.isAvailable()) {
+        telemetryOffline = true;
+        replayRetryAt = Hal::Clock::millis() + replayRetryInterval;
+    }
+    upload.busy = false;
+}
+
+template <typename Hal>
+TelemetryRecord DeviceManager<Hal>::makeRecord(const TelemetrySample& sample) {
+    // Readings carry millis(); the log keeps wall-clock time across resets.
+    // 0 marks one taken before NTP sync.
+    TelemetryRecord record;
+    if (isClockSynced()) {
+        record.timestamp = time(nullptr) - (Hal::Clock::millis() - sample.timestamp) / 1000;
+    } else {
+        record.timestamp = 0;
+        unsyncedRecords++;
+    }
+    record.temperature = sample.temperature;
+    record.humidity = sample.humidity;
+    record.ica = sample.ica;
+    record.deviceOn = sample.deviceOn;
+    record.zone = sample.zone;
+    return record;
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::sampleHeap() {
+    size_t freeHeap = Hal::Memory::freeHeap();
+    size_t largest = Hal::Memory::largestFreeBlock();
+    if (freeHeap == 0) {
+        return;     // Not tracked (native build)
+    }
+    
+    if (minLargestFreeBlock == 0 || largest < minLargestFreeBlock) {
+        minLargestFreeBlock = largest;
+    }
+    unsigned int fragmentation = largest < freeHeap ? (unsigned int)(100 - largest * 100 / freeHeap) : 0;
+    if (fragmentation > maxFragmentation) {
+        maxFragmentation = fragmentation;
+        LOG_DEBUG("heap", "Fragmentacion maxima %u%% (libre %lu, bloque mayor %lu)", fragmentation,
+                  (unsigned long)freeHeap, (unsigned long)largest);
+    }
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::onSensorJob(void* self) {
+    static_cast<DeviceManager*>(self)->updateSensorData();
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::onRoutineJob(void* self) {
+    static_cast<DeviceManager*>(self)->runRoutineCheck();
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::onUpdatesJob(void* self) {
+    DeviceManager* device = static_cast<DeviceManager*>(self);
+    device->processUpdates();
+    device->flushCommands();
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::onSerialJob(void* self) {
+    static_cast<DeviceManager*>(self)->processSerialCommands();
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::onHeapJob(void* self) {
+    static_cast<DeviceManager*>(self)->sampleHeap();
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::onApiJob(void* self) {
+    static_cast<DeviceManager*>(self)->refreshFromApi();
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::onDeviceInfoJob(void* self) {
+    static_cast<DeviceManager*>(self)->submitDeviceInfo();
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::onRoutinesJob(void* self) {
+    static_cast<DeviceManager*>(self)->getRoutineDataFromApi();
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::onPushJob(void* self) {
+    static_cast<DeviceManager*>(self)->openPushChannel();
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::onWifiJob(void* self) {
+    static_cast<DeviceManager*>(self)->checkWifi();
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::onUploadJob(void* self) {
+    static_cast<DeviceManager*>(self)->uploadTelemetry();
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::onStatsJob(void* self) {
+    static_cast<DeviceManager*>(self)->publishNetworkStats();
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::onDeviceInfoResponse(void* request, const HttpResponse& response) {
+    ZoneRequest* pending = static_cast<ZoneRequest*>(request);
+    pending->device->handleDeviceInfoResponse(pending->zone, response);
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::onRoutinesResponse(void* self, const HttpResponse& response) {
+    static_cast<DeviceManager*>(self)->handleRoutinesResponse(response);
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::onRoutinesBody(void* self, int status, const char* data, size_t length) {
+    static_cast<DeviceManager*>(self)->handleRoutinesBody(status, data, length);
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::onRoutineElement(void* self, const char* element, size_t length) {
+    static_cast<DeviceManager*>(self)->syncRoutine(element, length);
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::onPushResponse(void* self, const HttpResponse& response) {
+    static_cast<DeviceManager*>(self)->handlePushResponse(response);
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::onPushBody(void* self, int status, const char* data, size_t length) {
+    static_cast<DeviceManager*>(self)->handlePushBody(status, data, length);
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::onPushEvent(void* self, const char* type, const char* data, size_t length) {
+    static_cast<DeviceManager*>(self)->handlePushEvent(type, data, length);
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::onTelemetryResponse(void* upload, const HttpResponse& response) {
+    TelemetryUpload* pending = static_cast<TelemetryUpload*>(upload);
+    pending->device->handleTelemetryResponse(*pending, response);
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::setSensorUpdateInterval(unsigned long ms) {
+    // Before setup() the job does not exist yet; it is created with this
+    sensorInterval = ms;
+    scheduler.setPeriod(sensorJob, ms);
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::setApiUpdateInterval(unsigned long ms) {
+    // Applied by the network task's scheduler; only call before setup()
+    // or from the network task. With the push channel up it only applies
+    // once the channel goes down.
+    apiPollInterval = ms;
+    if (pushState != PUSH_UP) {
+        networkScheduler.setPeriod(apiJob, ms);
+    }
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::setRoutineCheckInterval(unsigned long ms) {
+    routineInterval = ms;
+    scheduler.setPeriod(routineJob, ms);
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::setTelemetryBatch(size_t batchSize, unsigned long flushIntervalMs) {
+    if (batchSize < 1) batchSize = 1;
+    if (batchSize > MAX_TELEMETRY_BATCH) batchSize = MAX_TELEMETRY_BATCH;
+    
+    NetworkCommand command;
+    command.kind = NetworkCommand::SET_BATCH;
+    command.batchSize = batchSize;
+    command.flushInterval = flushIntervalMs;
+    sendCommand(command);
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::setTelemetryEncoding(TelemetryEncoding encoding) {
+    NetworkCommand command;
+    command.kind = NetworkCommand::SET_ENCODING;
+    command.encoding = encoding;
+    sendCommand(command);
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::setReportPolicy(const ReportSettings& settings) {
+    for (int zone = 0; zone < MAX_ZONES; zone++) {
+        reportPolicies[zone].configure(settings);
+        reportPolicies[zone].setEnabled(true);
+    }
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::setReportByException(bool enabled) {
+    for (int zone = 0; zone < MAX_ZONES; zone++) {
+        reportPolicies[zone].setEnabled(enabled);
+    }
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::connectWiFi(const char* ssid, const char* password) {
+    // Only recorded here; the network task's WiFi job connects, so only
+    // call before setup() starts it
+    wifi.begin(ssid, password);
+    
+    Hal::console().print("Conectando a WiFi en segundo plano: ");
+    Hal::console().println(ssid);
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::setServerIP(const String& ip) {
+    serverIP = ip;
+    
+    NetworkCommand command;
+    command.kind = NetworkCommand::SET_SERVER;
+    strncpy(command.host, ip.c_str(), HOST_LENGTH - 1);
+    command.host[HOST_LENGTH - 1] = '\0';
+    sendCommand(command);
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::setDeviceId(const String& id) {
+    // The network task reads zone ids without a lock
+    if (networkStarted) {
+        Hal::console().println("ERROR: El id del dispositivo solo se puede cambiar antes de setup()");
+        return;
+    }
+    strncpy(zoneDeviceIds[0], id.c_str(), DEVICE_ID_LENGTH - 1);
+    zoneDeviceIds[0][DEVICE_ID_LENGTH - 1] = '\0';
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::setUbication(const char* ubication) {
+    // Routines are matched to zones on the network task
+    if (networkStarted) {
+        Hal::console().println("ERROR: La ubicacion solo se puede cambiar antes de setup()");
+        return;
+    }
+    strncpy(zoneUbications[0], ubication, UBICATION_LENGTH - 1);
+    zoneUbications[0][UBICATION_LENGTH - 1] = '\0';
+}
+
+template <typename Hal>
+int DeviceManager<Hal>::addZone(const char* deviceId, const char* ubication, int dhtPin, int ledPin, int dhtType) {
+    if (zoneCount >= MAX_ZONES || networkStarted) {
+        return -1;
+    }
+    
+    int zone = stateManager.addZone();
+    if (zone < 0) {
+        return -1;
+    }
+    actuatorManager.addZone(ledPin);
+    sensorPins[zone] = dhtPin;
+    sensorTypes[zone] = dhtType;
+    strncpy(zoneDeviceIds[zone], deviceId, DEVICE_ID_LENGTH - 1);
+    zoneDeviceIds[zone][DEVICE_ID_LENGTH - 1] = '\0';
+    strncpy(zoneUbications[zone], ubication, UBICATION_LENGTH - 1);
+    zoneUbications[zone][UBICATION_LENGTH - 1] = '\0';
+    zoneCount++;
+    return zone;
+}
+
+template <typename Hal>
+int DeviceManager<Hal>::getZoneCount() const {
+    return zoneCount;
+}
+
+template <typename Hal>
+int DeviceManager<Hal>::zoneForUbication(const char* ubication) const {
+    // With a single zone every routine is its own, as before zones existed
+    if (ubication[0] == '\0' || zoneCount == 1) {
+        return 0;
+    }
+    for (int zone = 0; zone < zoneCount; zone++) {
+        if (strcmp(zoneUbications[zone], ubication) == 0) {
+            return zone;
+        }
+    }
+    return -1;
+}
+
+template <typename Hal>
+int DeviceManager<Hal>::zoneForDeviceId(const char* deviceId) const {
+    for (int zone = 0; zone < zoneCount; zone++) {
+        if (strcmp(zoneDeviceIds[zone], deviceId) == 0) {
+            return zone;
+        }
+    }
+    return -1;
+}
+
+template <typename Hal>
+const char* DeviceManager<Hal>::zoneDeviceId(uint8_t zone) const {
+    // Records replayed from flash may name a zone that is no longer
+    // configured; nullptr for those
+    return zone < zoneCount ? zoneDeviceIds[zone] : nullptr;
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::getDeviceInfoFromApi() {
+    if (wifi.isOnline()) {
+        // A round still under way just carries on
+        if (deviceInfoPending == 0) {
+            deviceInfoPending = ((uint32_t)1 << zoneCount) - 1;
+        }
+        submitDeviceInfo();
+    } else {
+        LOG_WARN("api", "No hay conexión WiFi para obtener info del dispositivo.");
+        publishApiStatus("ERROR: No WiFi");
+    }
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::submitDeviceInfo() {
+    while (deviceInfoPending != 0 && deviceInfoInFlight < maxDeviceInfoInFlight) {
+        if (!http.canSubmit()) {
+            // Nothing of ours in flight to carry the round on: retry shortly
+            if (deviceInfoInFlight == 0) {
+                networkScheduler.runIn(deviceInfoJob, queuePollInterval);
+            }
+            return;
+        }
+
+        int zone = 0;
+        while (!(deviceInfoPending & ((uint32_t)1 << zone))) {
+            zone++;
+        }
+        char path[128];
+        snprintf(path, sizeof(path), "/api/v1/health-dehumidifier/get-dehumidifier?device_id=%s", zoneDeviceIds[zone]);
+
+        LOG_DEBUG("api", "Obteniendo info del dispositivo: %s", path);
+
+        if (!submitFetch(deviceInfoFetch[zone], path, &DeviceManager::onDeviceInfoResponse, &deviceInfoRequests[zone])) {
+            LOG_WARN("api", "Cliente HTTP ocupado, info del dispositivo pospuesta");
+            return;
+        }
+        deviceInfoInFlight++;
+        deviceInfoPending &= ~((uint32_t)1 << zone);
+    }
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::handleDeviceInfoResponse(int zone, const HttpResponse& response) {
+    int httpResponseCode = response.status;
+    uint32_t bodyHash = 0;
+    recordApiCall(STAGE_DEVICE_INFO_API, response);
+    deviceInfoInFlight--;
+    FetchState& fetch = deviceInfoFetch[zone];
+
+    if (isUnchanged(fetch, response, bodyHash)) {
+        LOG_DEBUG("api", "Info del dispositivo sin cambios (zona %d)", zone);
+        publishApiStatus("");
+    } else if (httpResponseCode > 0) {
+        LOG_DEBUG("api", "Respuesta GET dispositivo (código %d): %.*s", httpResponseCode,
+                  (int)response.bodyLength, response.body);
+        
+        if (httpResponseCode == 200) {
+            LOG_INFO("api", "Información del dispositivo obtenida exitosamente");
+            
+            // Only the fields we apply are kept, whatever else the server sends
+            JsonDocument filter(&jsonArena);
+            filter["humidifier_info"]["calidadDeAireMin"] = true;
+            filter["humidifier_info"]["calidadDeAireMax"] = true;
+            filter["humidifier_info"]["temperaturaMin"] = true;
+            filter["humidifier_info"]["temperaturaMax"] = true;
+            filter["humidifier_info"]["humedadMin"] = true;
+            filter["humidifier_info"]["humedadMax"] = true;
+            filter["humidifier_info"]["estado"] = true;
+            
+            JsonDocument doc(&jsonArena);
+            uint32_t started = Hal::Clock::cycles();
+            DeserializationError error = deserializeJson(doc, response.body, response.bodyLength,
+                                                         DeserializationOption::Filter(filter));
+            recordStage(STAGE_DEVICE_INFO_PARSE, started);
+            
+            if (!error) {
+                JsonObject humidifier_info = doc["humidifier_info"];
+                
+                if (!humidifier_info.isNull()) {
+                    int icaMin = humidifier_info["calidadDeAireMin"].as<int>();
+                    int icaMax = humidifier_info["calidadDeAireMax"].as<int>();
+                    float tempMin = humidifier_info["temperaturaMin"].as<float>();
+                    float tempMax = humidifier_info["temperaturaMax"].as<float>();
+                    float humMin = humidifier_info["humedadMin"].as<float>();
+                    float humMax = humidifier_info["humedadMax"].as<float>();
+                    
+                    ControlUpdate update;
+                    update.kind = ControlUpdate::DEVICE_CONFIG;
+                    update.config.zone = zone;
+                    update.config.icaMin = icaMin;
+                    update.config.icaMax = icaMax;
+                    update.config.tempMin = tempMin;
+                    update.config.tempMax = tempMax;
+                    update.config.humMin = humMin;
+                    update.config.humMax = humMax;
+                    update.config.estado = humidifier_info["estado"].as<bool>();
+                    publishUpdate(update);
+                    storeFetch(fetch, response, bodyHash);
+                    
+                    publishApiStatus("");
+                } else {
+                    LOG_WARN("api", "No se encontró humidifier_info en la respuesta");
+                }
+            } else {
+                LOG_ERROR("api", "Error parseando JSON: %s", error.c_str());
+            }
+        } else if (httpResponseCode == 404) {
+            LOG_ERROR("api", "Dispositivo no encontrado en el servidor");
+            publishApiStatus("ERROR: Device 404");
+        } else if (httpResponseCode == 500) {
+            LOG_ERROR("api", "Error interno del servidor - continuando con operación normal");
+            publishApiStatus("ERROR: Server 500");
+        } else {
+            LOG_ERROR("api", "Error desconocido del servidor (código %d)", httpResponseCode);
+            char status[API_STATUS_LENGTH];
+            snprintf(status, sizeof(status), "ERROR: Server %d", httpResponseCode);
+            publishApiStatus(status);
+        }
+    } else {
+        LOG_ERROR("api", "Error al obtener info del dispositivo. Código HTTP: %d", httpResponseCode);
+        publishApiStatus("ERROR: No connection");
+    }
+    
+    // The next zone of the round goes once this callback has freed its slot
+    if (deviceInfoPending != 0) {
+        networkScheduler.runIn(deviceInfoJob, 0);
+    }
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::getRoutineDataFromApi() {
+    if (wifi.isOnline()) {
+        char path[128];
+        snprintf(path, sizeof(path), "/api/v1/routine-monitoring/data-records/iot-device/%s", zoneDeviceIds[0]);
+
+        if (routineSyncActive) {
+            // The list may have changed after this one was sent
+            routineRefetch = true;
+            return;
+        }
+        
+        routineStream.begin(&DeviceManager::onRoutineElement, this);
+        routineSyncDeferred = false;
+        routineSyncIncomplete = false;
+        fetchedRoutineCount = 0;
+        routineBodyHash = 2166136261u;
+        lastRoutineBytes = 0;
+        lastRoutineMicros = 0;
+        
+        if (submitFetch(routinesFetch, path, &DeviceManager::onRoutinesResponse, this, &DeviceManager::onRoutinesBody)) {
+            routineSyncActive = true;
+        } else {
+            // The push channel holds a slot and polls may be far apart
+            LOG_WARN("api", "Cliente HTTP ocupado, rutinas pospuestas");
+            networkScheduler.runIn(routinesJob, queuePollInterval);
+        }
+    } else {
+        LOG_WARN("api", "No hay conexion WiFi para rutinas.");
+    }
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::handleRoutinesResponse(const HttpResponse& response) {
+    int httpResponseCode = response.status;
+    routineSyncActive = false;
+    recordApiCall(STAGE_ROUTINES_API, response);
+    if (routineRefetch) {
+        routineRefetch = false;
+        networkScheduler.runIn(routinesJob, 0);
+    }
+    
+    if (httpResponseCode == 304 && routinesFetch.bodyHash != 0) {
+        fetchNotModified++;
+        return;
+    }
+    
+    bool complete = httpResponseCode == 200 && routineStream.isComplete();
+    uint32_t bodyHash = routineBodyHash != 0 ? routineBodyHash : 1;
+    if (complete && bodyHash == routinesFetch.bodyHash) {
+        // Same list as the one applied (a server without ETags): nothing
+        // is published, whatever the sync started
+        if (stateManager.getRoutineUpdate()) {
+            stateManager.abandonRoutineUpdate();
+        }
+        routineSyncDeferred = false;
+        fetchUnchanged++;
+        storeFetch(routinesFetch, response, bodyHash);
+        return;
+    }
+    if (complete && routineStream.getSkipped() > 0) {
+        // Not the whole list: ask again on the next poll
+        LOG_WARN("api", "%lu rutinas demasiado grandes, se mantienen las anteriores",
+                 (unsigned long)routineStream.getSkipped());
+        routineSyncIncomplete = true;
+    }
+    finishRoutineSync(complete);
+    
+    if (complete) {
+        // The whole list, summed over the pieces it arrived in
+        stageLatency[STAGE_ROUTINES_PARSE].record(lastRoutineMicros);
+        if (!routineSyncIncomplete) {
+            storeFetch(routinesFetch, response, bodyHash);
+        }
+    } else if (httpResponseCode == 200) {
+        LOG_ERROR("api", "Error parseando JSON de rutinas: lista incompleta");
+    } else if (httpResponseCode < 0) {
+        LOG_ERROR("api", "Error en GET rutinas. Codigo HTTP: %d", httpResponseCode);
+    }
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::handleRoutinesBody(int status, const char* data, size_t length) {
+    if (status != 200) {
+        return;
+    }
+    
+    unsigned long started = Hal::Clock::micros();
+    if (lastRoutineBytes == 0) {
+        routineSyncStartedAt = Hal::Clock::millis();
+    }
+    lastRoutineBytes += length;
+    for (size_t i = 0; i < length; i++) {
+        routineBodyHash = (routineBodyHash ^ (uint8_t)data[i]) * 16777619u;
+    }
+    
+    routineStream.feed(data, length);
+    lastRoutineMicros += Hal::Clock::micros() - started;
+    lastRoutineMs = Hal::Clock::millis() - routineSyncStartedAt;
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::syncRoutine(const char* element, size_t length) {
+    JsonDocument filter(&jsonArena);
+    filter["routine_data"] = true;
+    
+    // Sized by this one element, whatever the length of the list
+    JsonDocument doc(&jsonArena);
+    DeserializationError error = deserializeJson(doc, element, length, DeserializationOption::Filter(filter));
+    if (error) {
+        LOG_ERROR("api", "Error parseando JSON de rutina: %s", error.c_str());
+        return;
+    }
+    
+    const char* routineData = doc["routine_data"] | "";
+    size_t routineDataLength = strlen(routineData);
+    if (routineDataLength == 0) {
+        return;
+    }
+    if (fetchedRoutineCount == StateManager<Hal>::MAX_ROUTINES) {
+        routineSyncIncomplete = true;
+        return;
+    }
+    
+    // Match the routine_data against the published set; only routines with
+    // new content are parsed into the next one
+    SyncedRoutine entry;
+    entry.hash = hashBytes(routineData, routineDataLength);
+    entry.upserted = true;
+    for (int i = 0; i < syncedRoutineCount; i++) {
+        if (syncedRoutines[i].hash == entry.hash) {
+            entry.id = syncedRoutines[i].id;
+            entry.upserted = false;
+            break;
+        }
+    }
+    
+    if (entry.upserted) {
+        Routine routine;
+        RoutineCondition condition;
+        char name[ROUTINE_NAME_LENGTH];
+        char ubication[UBICATION_LENGTH];
+        if (!routineParseData(routineData, routineDataLength, routine, condition, name, ubication)) {
+            LOG_WARN("api", "Rutina descartada, datos invalidos: %s", routineData);
+            return;
+        }
+        int zone = zoneForUbication(ubication);
+        if (zone < 0) {
+            LOG_WARN("api", "Rutina %ld descartada, ubicacion sin zona: %s", (long)routine.id, ubication);
+            return;
+        }
+        routine.zone = zone;
+        entry.id = routine.id;
+        
+        RoutineSet<StateManager<Hal>::MAX_ROUTINES>* next = beginRoutineSync();
+        if (!next) {
+            return;
+        }
+        // Removals are only made once the whole list is in; until then a
+        // full table has no room, so retry on the next poll
+        int index = next->upsert(routine, condition, name);
+        if (index < 0) {
+            routineSyncIncomplete = true;
+            return;
+        }
+        routinesUpserted++;
+        logRoutine(index, routine, condition, name);
+    }
+    
+    fetchedRoutines[fetchedRoutineCount++] = entry;
+}
+
+template <typename Hal>
+RoutineSet<StateManager<Hal>::MAX_ROUTINES>* DeviceManager<Hal>::beginRoutineSync() {
+    RoutineSet<StateManager<Hal>::MAX_ROUTINES>* next = stateManager.getRoutineUpdate();
+    if (next || routineSyncDeferred) {
+        return next;
+    }
+    
+    // The first change of this sync: start from a copy of the current set
+    next = stateManager.beginRoutineUpdate();
+    if (!next) {
+        // The control task is still on the spare set. It lets go on its next
+        // loop pass, so the whole list is asked for again shortly rather than
+        // at the next poll, which may be a push resync interval away.
+        LOG_WARN("api", "Tabla de rutinas en uso, sincronizacion pospuesta");
+        routineSyncDeferred = true;
+        routineSyncIncomplete = true;
+        networkScheduler.runIn(routinesJob, routineSyncRetryDelay);
+        return nullptr;
+    }
+    LOG_INFO("api", "Parseando rutinas");
+    return next;
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::logRoutine(int index, const Routine& routine, const RoutineCondition& condition,
+                                    const char* name) {
+#if CHAKIY_LOG_LEVEL >= LOG_LEVEL_INFO
+    char startTime[6];
+    char endTime[6];
+    routineFormatTime(routine.startMinute, startTime);
+    routineFormatTime(routine.endMinute, endTime);
+    
+    char days[64] = "";
+    for (int d = 0; d < 7; d++) {
+        if (routine.dayMask & (1 << d)) {
+            size_t used = strlen(days);
+            snprintf(days + used, sizeof(days) - used, "%s%s", used > 0 ? ", " : "", routineDayName(d));
+        }
+    }
+    
+    char conditionText[CONDITION_TEXT_LENGTH];
+    conditionFormat(condition, conditionText, sizeof(conditionText));
+    
+    LOG_INFO("rutinas", "Rutina #%d cargada: %s (zona %d)", index + 1, name, routine.zone);
+    LOG_INFO("rutinas", "   Dias: %s | Horario: %s - %s | Condicion: %s | %s",
+             days, startTime, endTime, conditionText,
+             (routine.flags & ROUTINE_DRY) ? "Deshumidificador" : "Humidificador");
+#else
+    (void)index;
+    (void)routine;
+    (void)condition;
+    (void)name;
+#endif
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::finishRoutineSync(bool complete) {
+    if (!complete || routineSyncDeferred) {
+        // Cut short: the control task keeps the whole set it has
+        if (stateManager.getRoutineUpdate()) {
+            stateManager.abandonRoutineUpdate();
+            LOG_WARN("api", "Sincronizacion de rutinas incompleta, se mantiene la tabla anterior");
+        }
+        routineSyncDeferred = false;
+        return;
+    }
+    
+    // Whatever the server no longer lists goes away. An element too large
+    // to read could have been any routine, so then none is removed and the
+    // ones not seen stay synced.
+    bool skipped = routineStream.getSkipped() > 0;
+    int seen = fetchedRoutineCount;
+    for (int i = 0; i < syncedRoutineCount; i++) {
+        bool kept = false;
+        for (int j = 0; j < seen && !kept; j++) {
+            kept = fetchedRoutines[j].id == syncedRoutines[i].id;
+        }
+        if (kept) {
+            continue;
+        }
+        if (skipped) {
+            if (fetchedRoutineCount < StateManager<Hal>::MAX_ROUTINES) {
+                fetchedRoutines[fetchedRoutineCount] = syncedRoutines[i];
+                fetchedRoutines[fetchedRoutineCount++].upserted = false;
+            }
+            continue;
+        }
+        
+        RoutineSet<StateManager<Hal>::MAX_ROUTINES>* next = beginRoutineSync();
+        if (!next) {
+            return;
+        }
+        if (next->remove(syncedRoutines[i].id)) {
+            LOG_INFO("rutinas", "Rutina eliminada: id %ld", (long)syncedRoutines[i].id);
+        }
+        routinesRemoved++;
+    }
+    
+    if (stateManager.getRoutineUpdate()) {
+        stateManager.publishRoutines();
+        routineSetsPublished++;
+    } else {
+        fetchUnchanged++;
+    }
+    memcpy(syncedRoutines, fetchedRoutines, fetchedRoutineCount * sizeof(SyncedRoutine));
+    syncedRoutineCount = fetchedRoutineCount;
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::openPushChannel() {
+    // Reopened when WiFi comes back
+    if (!wifi.isOnline()) {
+        return;
+    }
+    if (!http.canSubmit()) {
+        networkScheduler.runIn(pushJob, queuePollInterval);
+        return;
+    }
+    
+    // One stream carries the events of every zone
+    char path[64 + MAX_ZONES * DEVICE_ID_LENGTH];
+    int length = snprintf(path, sizeof(path), "/api/v1/health-dehumidifier/events?device_id=");
+    for (int zone = 0; zone < zoneCount; zone++) {
+        length += snprintf(path + length, sizeof(path) - length, "%s%s", zone > 0 ? "," : "", zoneDeviceIds[zone]);
+    }
+    
+    pushDroppedEvents += pushStream.getDropped();
+    pushStream.begin(&DeviceManager::onPushEvent, this);
+    if (http.submitStream(networkServerIP.c_str(), serverPort, path, eventStreamHeaders, pushIdleTimeout,
+                          &DeviceManager::onPushResponse, this, &DeviceManager::onPushBody)) {
+        pushState = PUSH_CONNECTING;
+        pushConnects++;
+    } else {
+        networkScheduler.runIn(pushJob, queuePollInterval);
+    }
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::handlePushBody(int status, const char* data, size_t length) {
+    if (status != 200) {
+        return;
+    }
+    
+    // The server opens the stream with a comment, so the first bytes tell
+    // it is live
+    if (pushState != PUSH_UP) {
+        pushState = PUSH_UP;
+        pushUpSince = Hal::Clock::millis();
+        LOG_INFO("push", "Canal de eventos conectado, consultas cada %lu s", pushResyncInterval / 1000);
+        
+        // Catch up on whatever changed while it was down
+        networkScheduler.setPeriod(apiJob, pushResyncInterval);
+        networkScheduler.runIn(apiJob, 0);
+    }
+    pushStream.feed(data, length);
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::handlePushEvent(const char* type, const char* data, size_t length) {
+    // Events only name what changed. The data is fetched as it would be
+    // when polling, so ETags, body hashes and routine sync still apply.
+    pushEvents++;
+    (void)length;   // Only logged, and logging may be compiled out
+    LOG_DEBUG("push", "Evento %s: %.*s", type, (int)length, data);
+    
+    if (strcmp(type, "config") == 0) {
+        int zone = zoneForDeviceId(data);
+        if (zone >= 0) {
+            deviceInfoPending |= (uint32_t)1 << zone;
+        } else {
+            deviceInfoPending = ((uint32_t)1 << zoneCount) - 1;
+        }
+        networkScheduler.runIn(deviceInfoJob, 0);
+    } else if (strcmp(type, "routines") == 0) {
+        networkScheduler.runIn(routinesJob, 0);
+    } else {
+        networkScheduler.runIn(apiJob, 0);
+    }
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::handlePushResponse(const HttpResponse& response) {
+    bool wasUp = pushState == PUSH_UP;
+    pushState = PUSH_DOWN;
+    
+    if (wasUp) {
+        unsigned long upFor = Hal::Clock::millis() - pushUpSince;
+        pushUpTimeMs += upFor;
+        pushDrops++;
+        networkScheduler.setPeriod(apiJob, apiPollInterval);
+        LOG_WARN("push", "Canal de eventos cerrado (codigo %d) tras %lu s, consultas cada %lu s",
+                 response.status, upFor / 1000, apiPollInterval / 1000);
+        
+        // A stream that held is reopened right away; one the server keeps
+        // dropping backs off like one that never came up
+        if (upFor >= pushIdleTimeout) {
+            pushBackoff.reset();
+        }
+    }
+    
+    unsigned long delay;
+    if (response.status == HTTP_ERROR_CANCELLED) {
+        delay = 0;
+    } else if (response.status == 404 || response.status == 405 || response.status == 501) {
+        LOG_INFO("push", "El servidor no ofrece canal de eventos (codigo %d)", response.status);
+        delay = pushUnsupportedRetry;
+    } else {
+        delay = pushBackoff.next();
+        if (!wasUp) {
+            LOG_DEBUG("push", "Canal de eventos no disponible (codigo %d), reintento en %lu ms", response.status, delay);
+        }
+    }
+    networkScheduler.runIn(pushJob, delay);
+}
+
+template <typename Hal>
+bool DeviceManager<Hal>::submitFetch(FetchState& fetch, const char* path, HttpCallback callback, void* context,
+                                     HttpBodyCallback onBody) {
+    const char* headers = apiKeyHeader;
+    char conditional[128];
+    if (fetch.etag[0] != '\0') {
+        snprintf(conditional, sizeof(conditional), "%sIf-None-Match: %s\r\n", apiKeyHeader, fetch.etag);
+        headers = conditional;
+    }
+    
+    return http.submit(networkServerIP.c_str(), serverPort, "GET", path, headers, nullptr, 0,
+                       httpTimeout, callback, context, onBody);
+}
+
+template <typename Hal>
+bool DeviceManager<Hal>::isUnchanged(FetchState& fetch, const HttpResponse& response, uint32_t& bodyHash) {
+    if (response.status == 304 && fetch.bodyHash != 0) {
+        fetchNotModified++;
+        return true;
+    }
+    if (response.status != 200) {
+        return false;
+    }
+    
+    bodyHash = hashBytes(response.body, response.bodyLength);
+    if (bodyHash != fetch.bodyHash) {
+        return false;
+    }
+    
+    // Same body without a 304: remember a new ETag if the server sent one
+    fetchUnchanged++;
+    storeFetch(fetch, response, bodyHash);
+    return true;
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::storeFetch(FetchState& fetch, const HttpResponse& response, uint32_t bodyHash) {
+    const char* etag;
+    size_t length;
+    if (httpFindHeader(response, "ETag", etag, length) && length < ETAG_LENGTH) {
+        memcpy(fetch.etag, etag, length);
+        fetch.etag[length] = '\0';
+    } else {
+        fetch.etag[0] = '\0';
+    }
+    fetch.bodyHash = bodyHash;
+}
+
+template <typename Hal>
+bool DeviceManager<Hal>::sendToEdgeApi(TelemetryUpload& upload) {
+    const char* path = "/api/v1/health-dehumidifier/data-records";
+
+    LOG_DEBUG("telemetria", "Conectando a la API en: %s", path);
+
+    char payload[256];
+    int length = encodeTelemetry(upload, true, payload, sizeof(payload));
+    if (length <= 0) {
+        LOG_ERROR("telemetria", "Lectura demasiado grande");
+        return false;
+    }
+
+    if (!http.submit(networkServerIP.c_str(), serverPort, "POST", path,
+                     upload.encoding == TELEMETRY_CBOR ? cborHeaders : jsonHeaders,
+                     payload, length, httpTimeout, &DeviceManager::onTelemetryResponse, &upload)) {
+        LOG_WARN("telemetria", "Cliente HTTP ocupado, lectura pospuesta");
+        return false;
+    }
+    
+    uploadRequests++;
+    uploadSamples++;
+    uploadPayloadBytes += length;
+    return true;
+}
+
+template <typename Hal>
+bool DeviceManager<Hal>::sendTelemetryBatch(TelemetryUpload& upload) {
+    const char* path = "/api/v1/health-dehumidifier/data-records/batch";
+    
+    char payload[AsyncHttpClient::REQUEST_BUFFER - 256];   // Leave room for the request headers
+    int length = encodeTelemetry(upload, false, payload, sizeof(payload));
+    
+    // More records than one request holds: the first half goes now and the
+    // rest waits in the log, which is sent in order after it
+    while (length <= 0 && upload.count > 1) {
+        size_t keep = upload.count / 2;
+        if (upload.replay) {
+            upload.nextSequence = upload.records[keep - 1].sequence + 1;
+        } else {
+            for (size_t i = keep; i < upload.count; i++) {
+                if (!telemetryLog.append(upload.records[i])) {
+                    unloggedSamples++;
+                }
+            }
+        }
+        upload.count = keep;
+        length = encodeTelemetry(upload, false, payload, sizeof(payload));
+    }
+    if (length <= 0) {
+        LOG_ERROR("telemetria", "Lote de telemetria demasiado grande");
+        return false;
+    }
+    
+    LOG_DEBUG("telemetria", "Enviando lote de %lu lecturas a: %s", (unsigned long)upload.count, path);
+    
+    if (!http.submit(networkServerIP.c_str(), serverPort, "POST", path,
+                     upload.encoding == TELEMETRY_CBOR ? cborHeaders : jsonHeaders,
+                     payload, length, httpTimeout, &DeviceManager::onTelemetryResponse, &upload)) {
+        LOG_WARN("telemetria", "Cliente HTTP ocupado, lote pospuesto");
+        return false;
+    }
+    
+    uploadRequests++;
+    uploadSamples += upload.count;
+    uploadPayloadBytes += length;
+    return true;
+}
+
+template <typename Hal>
+int DeviceManager<Hal>::encodeTelemetry(TelemetryUpload& upload, bool single, char* payload, size_t capacity) {
+    upload.encoding = telemetryEncoding;
+    
+    unsigned long started = Hal::Clock::micros();
+    int length = upload.encoding == TELEMETRY_CBOR
+        ? encodeTelemetryCbor(upload, single, reinterpret_cast<uint8_t*>(payload), capacity)
+        : encodeTelemetryJson(upload, single, payload, capacity);
+    
+    if (length > 0) {
+        EncodingStats& stats = encodingStats[upload.encoding];
+        stats.micros += Hal::Clock::micros() - started;
+        stats.samples += single ? 1 : upload.count;
+        stats.bytes += length;
+    }
+    return length;
+}
+
+template <typename Hal>
+int DeviceManager<Hal>::encodeTelemetryJson(const TelemetryUpload& upload, bool single, char* payload, size_t capacity) {
+    int length;
+    if (single) {
+        // Legacy endpoint: humidifier_info is itself a JSON text
+        const TelemetryRecord& record = upload.records[0];
+        length = snprintf(payload, capacity,
+                          "{\"device_id\":\"%s\",\"humidifier_info\":\"{\"temperature\":%.1f,\"humidity\":%.1f,\"ICA\":%d}\"}",
+                          zoneDeviceId(record.zone), record.temperature, record.humidity, record.ica);
+        return length > 0 && (size_t)length < capacity ? length : -1;
+    }
+    
+    // With zones, a batch mixes devices: each record names its own
+    length = snprintf(payload, capacity, "{\"device_id\":\"%s\",\"records\":[", zoneDeviceIds[0]);
+    for (size_t i = 0; i < upload.count && length > 0 && (size_t)length < capacity; i++) {
+        const TelemetryRecord& record = upload.records[i];
+        length += snprintf(payload + length, capacity - length, "%s{", i > 0 ? "," : "");
+        if (zoneCount > 1 && (size_t)length < capacity) {
+            length += snprintf(payload + length, capacity - length, "\"device_id\":\"%s\",", zoneDeviceId(record.zone));
+        }
+        if (record.timestamp != 0 && (size_t)length < capacity) {
+            length += snprintf(payload + length, capacity - length, "\"timestamp\":%lu,",
+                               (unsigned long)record.timestamp);
+        }
+        if ((size_t)length < capacity) {
+            length += snprintf(payload + length, capacity - length,
+                               "\"temperature\":%.1f,\"humidity\":%.1f,\"ICA\":%d,\"estado\":%s}",
+                               record.temperature, record.humidity, record.ica, record.deviceOn ? "true" : "false");
+        }
+    }
+    if (length > 0 && (size_t)length < capacity) {
+        length += snprintf(payload + length, capacity - length, "]}");
+    }
+    return length > 0 && (size_t)length < capacity ? length : -1;
+}
+
+template <typename Hal>
+int DeviceManager<Hal>::encodeTelemetryCbor(const TelemetryUpload& upload, bool single, uint8_t* payload, size_t capacity) {
+    // Same field names as the JSON form, but humidifier_info is a nested map
+    // rather than a string. Readings keep the JSON form's 0.1 resolution.
+    CborWriter cbor(payload, capacity);
+    cbor.beginMap(2);
+    cbor.writeText("device_id");
+    cbor.writeText(single ? zoneDeviceId(upload.records[0].zone) : zoneDeviceIds[0]);
+    
+    if (single) {
+        const TelemetryRecord& record = upload.records[0];
+        cbor.writeText("humidifier_info");
+        cbor.beginMap(3);
+        cbor.writeText("temperature");
+        cbor.writeFloat(roundf(record.temperature * 10) / 10);
+        cbor.writeText("humidity");
+        cbor.writeFloat(roundf(record.humidity * 10) / 10);
+        cbor.writeText("ICA");
+        cbor.writeInt(record.ica);
+    } else {
+        cbor.writeText("records");
+        cbor.beginArray(upload.count);
+        for (size_t i = 0; i < upload.count; i++) {
+            const TelemetryRecord& record = upload.records[i];
+            cbor.beginMap((zoneCount > 1 ? 6 : 5) - (record.timestamp == 0 ? 1 : 0));
+            if (zoneCount > 1) {
+                cbor.writeText("device_id");
+                cbor.writeText(zoneDeviceId(record.zone));
+            }
+            if (record.timestamp != 0) {
+                cbor.writeText("timestamp");
+                cbor.writeUnsigned(record.timestamp);
+            }
+            cbor.writeText("temperature");
+            cbor.writeFloat(roundf(record.temperature * 10) / 10);
+            cbor.writeText("humidity");
+            cbor.writeFloat(roundf(record.humidity * 10) / 10);
+            cbor.writeText("ICA");
+            cbor.writeInt(record.ica);
+            cbor.writeText("estado");
+            cbor.writeBool(record.deviceOn);
+        }
+    }
+    return cbor.ok() ? (int)cbor.size() : -1;
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::handleTelemetryResponse(TelemetryUpload& upload, const HttpResponse& response) {
+    int httpResponseCode = response.status;
+    recordApiCall(STAGE_TELEMETRY_API, response);
+    
+    // Server errors and connection failures keep the readings for later;
+    // a 4xx rejection would fail the same way on every replay, so drop them
+    bool keep = httpResponseCode < 0 || httpResponseCode >= 500;
+    
+    if (httpResponseCode == 415 && upload.encoding == TELEMETRY_CBOR) {
+        // Unsupported Media Type: the server only speaks JSON
+        LOG_WARN("telemetria", "El servidor no acepta CBOR, enviando en JSON");
+        telemetryEncoding = TELEMETRY_JSON;
+        submitUpload(upload);
+        return;
+    }
+
+    if (httpResponseCode > 0 && httpResponseCode >= 200 && httpResponseCode < 300) {
+        LOG_INFO("telemetria", "Datos enviados exitosamente. Código HTTP: %d", httpResponseCode);
+        publishApiStatus("");
+    } else if (httpResponseCode > 0) {
+        LOG_ERROR("telemetria", "Error al enviar datos. Código HTTP: %d", httpResponseCode);
+        char status[API_STATUS_LENGTH];
+        snprintf(status, sizeof(status), "ERROR: Servidor %d", httpResponseCode);
+        publishApiStatus(status);
+    } else {
+        LOG_ERROR("telemetria", "Error de conexión al servidor: %d", httpResponseCode);
+        publishApiStatus("ERROR: Sin servidor");
+    }
+    
+    if (keep) {
+        storeUpload(upload);
+        return;
+    }
+    
+    upload.busy = false;
+    telemetryOffline = false;
+    if (!upload.replay) {
+        return;
+    }
+    
+    replayInFlight = false;
+    telemetryLog.acknowledge(upload.nextSequence);
+    replayDelivered += upload.count;
+    
+    if (telemetryLog.isEmpty()) {
+        lastReplayRecords = replayDelivered;
+        lastReplayMs = Hal::Clock::millis() - replayStartedAt;
+        replayActive = false;
+        LOG_INFO("telemetria", "Registro de telemetria vaciado: %lu lecturas en %lu ms",
+                 (unsigned long)lastReplayRecords, (unsigned long)lastReplayMs);
+    } else {
+        replayTelemetry();
+    }
+}
+template <typename Hal>
+void DeviceManager<Hal>::updateSensorData() {
+    // Every zone in one pass, and the display once at the end
+    bool updated = false;
+    for (int zone = 0; zone < zoneCount; zone++) {
+        SensorPipeline& pipeline = sensorPipelines[zone];
+        
+        // One bus transaction per cycle; the DHT22 disables interrupts while
+        // it is read, so it is not read twice
+        float temperature;
+        float humidity;
+        uint32_t started = Hal::Clock::cycles();
+        bool read = sensors[zone].read(temperature, humidity);
+        recordStage(STAGE_SENSOR, started);
+
+        if (!read) {
+            pipeline.addFailure();
+            LOG_ERROR("sensor", "Zona %d: error leyendo del DHT22 (%lu seguidos)", zone,
+                      pipeline.getStats().consecutiveFailures);
+            continue;
+        }
+        if (!pipeline.addReading(temperature, humidity)) {
+            LOG_WARN("sensor", "Zona %d: lectura descartada por atipica: %.2f °C | %.2f %%", zone, temperature, humidity);
+            continue;
+        }
+        
+        // Control and uploads use the mean of the window, not the raw reading
+        SensorWindow temperatureWindow = pipeline.getTemperature();
+        SensorWindow humidityWindow = pipeline.getHumidity();
+        LOG_INFO("sensor", "Zona %d | Temp: %.2f °C | Humidity: %.2f %% (media de %d, lectura %.2f / %.2f)", zone,
+                 temperatureWindow.mean, humidityWindow.mean, pipeline.getSampleCount(), temperature, humidity);
+
+        stateManager.updateSensorData(zone, temperatureWindow.mean, humidityWindow.mean);
+        updated = true;
+        
+        // Uploading is the network task's job; never wait for it here
+        ZoneStates<MAX_ZONES>& zones = stateManager.getZones();
+        TelemetrySample sample;
+        sample.timestamp = Hal::Clock::millis();
+        sample.temperature = temperatureWindow.mean;
+        sample.humidity = humidityWindow.mean;
+        sample.ica = zones.ICA[zone];
+        sample.deviceOn = zones.estado_device[zone];
+        sample.zone = zone;
+        if (!reportPolicies[zone].shouldReport(sample)) {
+            continue;
+        }
+        if (!telemetryQueue.push(sample)) {
+            droppedSamples++;
+        }
+    }
+    
+    if (updated) {
+        refreshDisplay();
+    }
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::recordStage(Stage stage, uint32_t startCycles) {
+    stageLatency[stage].record((Hal::Clock::cycles() - startCycles) / Hal::Clock::cyclesPerMicrosecond());
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::recordApiCall(Stage stage, const HttpResponse& response) {
+    stageLatency[stage].record(response.elapsedMs * 1000);
+    if (response.status >= 400) {
+        apiErrorResponses++;
+    }
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::printConnectionInfo() {
+    Hal::console().println("========================================");
+    Hal::console().println("=== INFORMACIÓN DE CONECTIVIDAD ===");
+    // The SSID is only set before setup(); the link state is the network
+    // task's, from its last stats copy
+    uint32_t held = networkStats.acquire();
+    bool online = networkStats.read(held).wifiState == WifiManager<Hal>::ONLINE;
+    networkStats.release();
+    Hal::console().print("Red WiFi: "); 
+    Hal::console().print(wifi.getSsid());
+    Hal::console().println(online ? " (conectado)" : " (sin conexion)");
+    Hal::console().print("IP del ESP32: "); 
+    Hal::console().println(Hal::Network::localIP());
+    Hal::console().print("IP del servidor configurada: "); 
+    Hal::console().println(serverIP);
+    Hal::console().print("Puerto del servidor: 5000");
+    Hal::console().println();
+    Hal::console().print("URL base de la API: http://"); 
+    Hal::console().print(serverIP); 
+    Hal::console().println(":5000");
+    Hal::console().println("========================================");
+    Hal::console().println();
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::printJobStats() {
+    Hal::console().println("========================================");
+    Hal::console().println("=== TAREAS PROGRAMADAS (control) ===");
+    printSchedulerStats(scheduler);
+    
+    // The network task's copy, up to networkStatsInterval old
+    uint32_t held = networkStats.acquire();
+    const NetworkStats& stats = networkStats.read(held);
+    Hal::console().println("=== TAREAS PROGRAMADAS (red) ===");
+    for (int id = 0; id < stats.jobCount; id++) {
+        printJob(stats.jobNames[id], stats.jobPeriods[id], stats.jobStats[id]);
+    }
+    Hal::console().print("Muestras descartadas (cola llena): "); Hal::console().println(droppedSamples);
+    Hal::console().print("Combinados (cola llena): comandos="); Hal::console().print(coalescedCommands);
+    Hal::console().print(" actualizaciones="); Hal::console().println(stats.coalescedUpdates);
+    printHttpStats(stats);
+    printUploadStats(stats);
+    printFetchStats(stats);
+    printWifiStats(stats);
+    printPushStats(stats);
+    networkStats.release();
+    printRoutineCheckStats();
+    printLogStats();
+    Hal::console().println("========================================");
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::printUploadStats(const NetworkStats& stats) {
+    // Compare batch sizes with BATCH:n and this summary
+    unsigned long uptimeSec = Hal::Clock::millis() / 1000;
+    Hal::console().println("=== TELEMETRIA ===");
+    Hal::console().print("lote="); Hal::console().print((unsigned long)stats.batchSize);
+    Hal::console().print(" intervalo="); Hal::console().print(stats.flushInterval);
+    Hal::console().print("ms peticiones="); Hal::console().print(stats.uploadRequests);
+    Hal::console().print(" lecturas="); Hal::console().println(stats.uploadSamples);
+    Hal::console().print("peticiones/min=");
+    Hal::console().print(uptimeSec > 0 ? stats.uploadRequests * 60.0 / uptimeSec : 0.0);
+    Hal::console().print(" bytes/lectura (payload)=");
+    Hal::console().println(stats.uploadSamples > 0 ? (double)stats.uploadPayloadBytes / stats.uploadSamples : 0.0);
+    
+    // Switch with FORMAT:JSON / FORMAT:CBOR to compare the two
+    static const char* const encodingNames[2] = { "json", "cbor" };
+    for (int i = 0; i < 2; i++) {
+        const EncodingStats& format = stats.encodingStats[i];
+        Hal::console().print(encodingNames[i]);
+        Hal::console().print(i == stats.encoding ? "*: lecturas=" : ": lecturas=");
+        Hal::console().print(format.samples);
+        Hal::console().print(" bytes/lectura=");
+        Hal::console().print(format.samples > 0 ? (double)format.bytes / format.samples : 0.0);
+        Hal::console().print(" codificacion us/lectura=");
+        Hal::console().println(format.samples > 0 ? (double)format.micros / format.samples : 0.0);
+    }
+    
+    const TelemetryLogStats& log = stats.log;
+    Hal::console().print("registro: pendientes="); Hal::console().print((unsigned long)stats.logPending);
+    Hal::console().print(" escritas="); Hal::console().print(log.appended);
+    Hal::console().print(" entregadas="); Hal::console().print(log.delivered);
+    Hal::console().print(" expulsadas="); Hal::console().print(log.evicted);
+    Hal::console().print(" corruptas="); Hal::console().print(log.corrupt);
+    Hal::console().print(" errores="); Hal::console().println(log.writeErrors);
+    Hal::console().print("sin hora NTP="); Hal::console().print(stats.unsyncedRecords);
+    Hal::console().print(" zona desconocida="); Hal::console().print(stats.unknownZoneRecords);
+    Hal::console().print(" no registradas="); Hal::console().println(stats.unloggedSamples);
+    Hal::console().print("amplificacion de escritura=");
+    Hal::console().print(log.recordBytes > 0 ? (double)log.flashBytes / log.recordBytes : 0.0);
+    Hal::console().print(" ultimo reenvio="); Hal::console().print(stats.lastReplayRecords);
+    Hal::console().print(" lecturas en "); Hal::console().print(stats.lastReplayMs);
+    Hal::console().print("ms (");
+    Hal::console().print(stats.lastReplayMs > 0 ? stats.lastReplayRecords * 1000.0 / stats.lastReplayMs : 0.0);
+    Hal::console().println(" lecturas/s)");
+    
+    // REPORT:OFF goes back to one upload per reading, for comparison. The
+    // settings are shared; counts are summed over the zones.
+    const ReportSettings& report = reportPolicies[0].getSettings();
+    ReportStats reportStats;
+    memset(&reportStats, 0, sizeof(reportStats));
+    for (int zone = 0; zone < zoneCount; zone++) {
+        const ReportStats& zoneStats = reportPolicies[zone].getStats();
+        reportStats.samples += zoneStats.samples;
+        reportStats.reported += zoneStats.reported;
+        reportStats.changed += zoneStats.changed;
+        reportStats.stateChanges += zoneStats.stateChanges;
+        reportStats.heartbeats += zoneStats.heartbeats;
+        reportStats.deferred += zoneStats.deferred;
+    }
+    Hal::console().print("reporte por excepcion="); Hal::console().print(reportPolicies[0].isEnabled() ? "si" : "no");
+    Hal::console().print(" bandas="); Hal::console().print(report.temperatureDeadband);
+    Hal::console().print("C/"); Hal::console().print(report.humidityDeadband);
+    Hal::console().print("%/"); Hal::console().print(report.icaDeadband);
+    Hal::console().print(" intervalo zona 0="); Hal::console().print(reportPolicies[0].getIntervalMs());
+    Hal::console().print("ms latido="); Hal::console().print(report.heartbeatMs);
+    Hal::console().println("ms");
+    Hal::console().print("muestras="); Hal::console().print(reportStats.samples);
+    Hal::console().print(" enviadas="); Hal::console().print(reportStats.reported);
+    Hal::console().print(" (cambio="); Hal::console().print(reportStats.changed);
+    Hal::console().print(" estado="); Hal::console().print(reportStats.stateChanges);
+    Hal::console().print(" latido="); Hal::console().print(reportStats.heartbeats);
+    Hal::console().print(") diferidas="); Hal::console().println(reportStats.deferred);
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::printFetchStats(const NetworkStats& stats) {
+    Hal::console().println("=== CONSULTAS API ===");
+    Hal::console().print("304="); Hal::console().print(stats.fetchNotModified);
+    Hal::console().print(" sin cambios="); Hal::console().print(stats.fetchUnchanged);
+    Hal::console().print(" rutinas sincronizadas="); Hal::console().print(stats.syncedRoutineCount);
+    Hal::console().print(" actualizadas="); Hal::console().print(stats.routinesUpserted);
+    Hal::console().print(" eliminadas="); Hal::console().print(stats.routinesRemoved);
+    Hal::console().print(" tablas publicadas="); Hal::console().println(stats.routineSetsPublished);
+    Hal::console().print("ultima lista: bytes="); Hal::console().print(stats.lastRoutineBytes);
+    Hal::console().print(" elementos="); Hal::console().print((unsigned long)stats.routineElements);
+    Hal::console().print(" descartados="); Hal::console().print((unsigned long)stats.routineSkipped);
+    Hal::console().print(" elemento_max="); Hal::console().print((unsigned long)stats.routineMaxElement);
+    Hal::console().print(" parseo="); Hal::console().print(stats.lastRoutineMicros);
+    Hal::console().print("us en "); Hal::console().print(stats.lastRoutineMs);
+    Hal::console().print("ms buffer="); 
+    Hal::console().print((unsigned long)sizeof(JsonArrayStream));
+    Hal::console().println(" bytes");
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::printWifiStats(const NetworkStats& network) {
+    // Connected share of the uptime when the copy was taken
+    static const char* const stateNames[] = { "inactivo", "conectando", "conectado", "en espera" };
+    unsigned long now = Hal::Clock::millis();
+    unsigned long takenAt = network.takenAt;
+    unsigned long connected = network.wifiConnectedMs;
+    const WifiStats& stats = network.wifi;
+    Hal::console().println("=== WIFI ===");
+    Hal::console().print("estado="); Hal::console().print(stateNames[network.wifiState]);
+    Hal::console().print(" intentos="); Hal::console().print(stats.attempts);
+    Hal::console().print(" fallidos="); Hal::console().print(stats.failures);
+    Hal::console().print(" conexiones="); Hal::console().print(stats.connects);
+    Hal::console().print(" caidas="); Hal::console().println(stats.drops);
+    Hal::console().print("conectado="); Hal::console().print(connected / 1000);
+    Hal::console().print("s ("); Hal::console().print(takenAt > 0 ? connected * 100.0 / takenAt : 0.0);
+    Hal::console().print("%) corte mas largo="); Hal::console().print(stats.longestOutageMs / 1000);
+    Hal::console().print("s");
+    if (network.wifiState == WifiManager<Hal>::WAITING) {
+        Hal::console().print(" reintento en="); Hal::console().print((long)(network.wifiRetryAt - now));
+        Hal::console().print("ms");
+    }
+    Hal::console().println();
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::printPushStats(const NetworkStats& stats) {
+    // Shares are of the uptime when the copy was taken
+    static const char* const stateNames[] = { "caido", "conectando", "conectado" };
+    unsigned long takenAt = stats.takenAt;
+    Hal::console().println("=== CANAL DE EVENTOS ===");
+    Hal::console().print("estado="); Hal::console().print(stateNames[stats.pushState]);
+    Hal::console().print(" aperturas="); Hal::console().print(stats.pushConnects);
+    Hal::console().print(" caidas="); Hal::console().print(stats.pushDrops);
+    Hal::console().print(" conectado="); Hal::console().print(stats.pushUpTimeMs / 1000);
+    Hal::console().print("s ("); Hal::console().print(takenAt > 0 ? stats.pushUpTimeMs * 100.0 / takenAt : 0.0);
+    Hal::console().println("%)");
+    Hal::console().print("eventos="); Hal::console().print(stats.pushEvents);
+    Hal::console().print(" descartados="); Hal::console().print(stats.pushDroppedEvents);
+    Hal::console().print(" consulta cada="); Hal::console().print(stats.pollPeriod);
+    Hal::console().print("ms peticiones/min=");
+    Hal::console().println(takenAt >= 1000 ? stats.http.requests * 60000.0 / takenAt : 0.0);
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::printRoutineCheckStats() {
+    // Zones skipped kept the decision of an earlier check
+    const RoutineCheckStats& stats = stateManager.getRoutineCheckStats();
+    unsigned long zones = stats.zonesEvaluated + stats.zonesSkipped;
+    Hal::console().println("=== DECISION DE RUTINAS ===");
+    Hal::console().print("verificaciones="); Hal::console().print(stats.checks);
+    Hal::console().print(" zonas evaluadas="); Hal::console().print(stats.zonesEvaluated);
+    Hal::console().print(" omitidas="); Hal::console().print(stats.zonesSkipped);
+    Hal::console().print(" (");
+    Hal::console().print(zones > 0 ? 100.0 * stats.zonesSkipped / zones : 0.0);
+    Hal::console().print("%) condiciones="); Hal::console().print(stats.conditionsEvaluated);
+#ifdef CHAKIY_VERIFY_ROUTINES
+    Hal::console().print(" discrepancias="); Hal::console().print(stats.mismatches);
+#endif
+    Hal::console().println();
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::printLogStats() {
+    // Compare the control jobs' max run time above with LOG:0 and LOG:3
+    LogStats stats = logGetStats();
+    Hal::console().println("=== REGISTRO ===");
+    Hal::console().print("nivel="); Hal::console().print((unsigned int)logGetLevel());
+    Hal::console().print(" (compilado hasta "); Hal::console().print(CHAKIY_LOG_LEVEL);
+    Hal::console().print(") escritos="); Hal::console().print(stats.written);
+    Hal::console().print(" descartados="); Hal::console().print(stats.dropped);
+    Hal::console().print(" truncados="); Hal::console().print(stats.truncated);
+    Hal::console().print(" cola_max="); Hal::console().print(stats.maxQueued);
+    Hal::console().print("/"); Hal::console().println((unsigned long)LOG_SLOTS);
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::printStageStats() {
+    char line[96];
+    uint32_t held = networkStats.acquire();
+    const NetworkStats& network = networkStats.read(held);
+    Hal::console().println("========================================");
+    Hal::console().println("=== LATENCIA POR ETAPA (us) ===");
+    Hal::console().println("etapa                  n       min       p50       p99       max");
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        const LatencyHistogram& histogram = stageHistogram(network, i);
+        snprintf(line, sizeof(line), "%-16s %7lu %9lu %9lu %9lu %9lu", STAGE_NAMES[i],
+                 (unsigned long)histogram.getCount(), (unsigned long)histogram.getMin(),
+                 (unsigned long)histogram.percentile(50), (unsigned long)histogram.percentile(99),
+                 (unsigned long)histogram.getMax());
+        Hal::console().println(line);
+    }
+    Hal::console().print("HTTP fallidas="); Hal::console().print(network.http.failures);
+    Hal::console().print(" respuestas 4xx/5xx="); Hal::console().println(network.apiErrorResponses);
+    Hal::console().print("heap libre="); Hal::console().print((unsigned long)Hal::Memory::freeHeap());
+    Hal::console().print(" minimo="); Hal::console().print((unsigned long)Hal::Memory::minFreeHeap());
+    Hal::console().print(" bloque mayor="); Hal::console().print((unsigned long)Hal::Memory::largestFreeBlock());
+    Hal::console().print(" minimo="); Hal::console().print((unsigned long)minLargestFreeBlock);
+    Hal::console().print(" fragmentacion max="); Hal::console().print(maxFragmentation);
+    Hal::console().println("%");
+    Hal::console().print("JSON arena pico="); Hal::console().print((unsigned long)network.jsonArenaPeak);
+    Hal::console().print("/"); Hal::console().print((unsigned long)JsonArena::SIZE);
+    Hal::console().print(" al heap="); Hal::console().println(network.jsonArenaOverflows);
+    networkStats.release();
+    const DisplayStats& display = actuatorManager.getDisplayStats();
+    Hal::console().print("LCD frames="); Hal::console().print(display.frames);
+    Hal::console().print(" bytes/frame=");
+    Hal::console().println(display.frames > 0 ? (double)(display.characters + display.cursorMoves) / display.frames : 0.0);
+    printSensorStats();
+    Hal::console().println("========================================");
+}
+
+template <typename Hal>
+const LatencyHistogram& DeviceManager<Hal>::stageHistogram(const NetworkStats& stats, int stage) const {
+    // The control task's own stages are read directly
+    return stage < STAGE_DEVICE_INFO_API ? stageLatency[stage] : stats.stageLatency[stage - STAGE_DEVICE_INFO_API];
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::printSensorStats() {
+    // Counts are summed over the zones; windows are per zone, see ZONES
+    SensorStats stats;
+    memset(&stats, 0, sizeof(stats));
+    for (int zone = 0; zone < zoneCount; zone++) {
+        const SensorStats& zoneStats = sensorPipelines[zone].getStats();
+        stats.reads += zoneStats.reads;
+        stats.failures += zoneStats.failures;
+        stats.outliers += zoneStats.outliers;
+        if (zoneStats.maxConsecutiveFailures > stats.maxConsecutiveFailures) {
+            stats.maxConsecutiveFailures = zoneStats.maxConsecutiveFailures;
+        }
+    }
+    SensorWindow temperature = sensorPipelines[0].getTemperature();
+    SensorWindow humidity = sensorPipelines[0].getHumidity();
+    Hal::console().println("=== SENSOR DHT22 ===");
+    Hal::console().print("zonas="); Hal::console().print(zoneCount);
+    Hal::console().print(" lecturas="); Hal::console().print(stats.reads);
+    Hal::console().print(" fallos="); Hal::console().print(stats.failures);
+    Hal::console().print(" (");
+    Hal::console().print(stats.reads > 0 ? 100.0 * stats.failures / stats.reads : 0.0);
+    Hal::console().print("%) atipicas="); Hal::console().print(stats.outliers);
+    Hal::console().print(" fallos_seguidos_max="); Hal::console().println(stats.maxConsecutiveFailures);
+    Hal::console().print("zona 0: ventana="); Hal::console().print(sensorPipelines[0].getSampleCount());
+    if (!sensorPipelines[0].hasData()) {
+        Hal::console().println(" sin lecturas validas");
+        return;
+    }
+    Hal::console().print(" temp min/media/max="); Hal::console().print(temperature.min);
+    Hal::console().print("/"); Hal::console().print(temperature.mean);
+    Hal::console().print("/"); Hal::console().print(temperature.max);
+    Hal::console().print(" humedad min/media/max="); Hal::console().print(humidity.min);
+    Hal::console().print("/"); Hal::console().print(humidity.mean);
+    Hal::console().print("/"); Hal::console().println(humidity.max);
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::printZones() {
+    ZoneStates<MAX_ZONES>& zones = stateManager.getZones();
+    char line[112];
+    Hal::console().println("========================================");
+    Hal::console().println("=== ZONAS ===");
+    Hal::console().println("zona dispositivo         ubicacion      temp  humedad  ICA estado");
+    for (int zone = 0; zone < zoneCount; zone++) {
+        snprintf(line, sizeof(line), "%c%-3d %-20s %-12s %6.1f %8.1f %4d %s %s",
+                 zone == actuatorManager.getDisplayZone() ? '*' : ' ', zone, zoneDeviceIds[zone],
+                 zoneUbications[zone][0] != '\0' ? zoneUbications[zone] : "-", zones.temperature[zone],
+                 zones.humidity[zone], zones.ICA[zone], zones.estado_device[zone] ? "ACTIVO" : "INACTIVO",
+                 zones.active_device_type[zone]);
+        Hal::console().println(line);
+    }
+    Hal::console().println("* en pantalla (ZONE:n para cambiarla)");
+    Hal::console().println("========================================");
+}
+
+template <typename Hal>
+bool DeviceManager<Hal>::printJsonPiece(const char* piece, int length, size_t size) {
+    if (length < 0 || (size_t)length >= size) {
+        // Ends the line so the next one starts clean; scripts drop it as invalid
+        Hal::console().println();
+        LOG_ERROR("stats", "Linea STATS:JSON truncada (%d de %u bytes)", length, (unsigned)size);
+        return false;
+    }
+    Hal::console().print(piece);
+    return true;
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::printStageStatsJson() {
+    // One line, for scripts reading the serial port, printed in pieces
+    char field[160];
+    int length = snprintf(field, sizeof(field), "{\"uptime_ms\":%lu,\"stages\":{", Hal::Clock::millis());
+    if (!printJsonPiece(field, length, sizeof(field))) return;
+    
+    // Copied so the network task's snapshot is not held across early returns
+    uint32_t held = networkStats.acquire();
+    const NetworkStats& network = networkStats.read(held);
+    LatencyHistogram networkLatency[NETWORK_STAGES];
+    for (int i = 0; i < NETWORK_STAGES; i++) {
+        networkLatency[i] = network.stageLatency[i];
+    }
+    HttpStats stats = network.http;
+    unsigned long errorResponses = network.apiErrorResponses;
+    size_t arenaPeak = network.jsonArenaPeak;
+    unsigned long arenaOverflows = network.jsonArenaOverflows;
+    networkStats.release();
+    
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        const LatencyHistogram& histogram =
+            i < STAGE_DEVICE_INFO_API ? stageLatency[i] : networkLatency[i - STAGE_DEVICE_INFO_API];
+        length = snprintf(field, sizeof(field),
+                          "%s\"%s\":{\"n\":%lu,\"min\":%lu,\"p50\":%lu,\"p99\":%lu,\"max\":%lu,\"mean\":%lu}",
+                          i > 0 ? "," : "", STAGE_NAMES[i], (unsigned long)histogram.getCount(),
+                          (unsigned long)histogram.getMin(), (unsigned long)histogram.percentile(50),
+                          (unsigned long)histogram.percentile(99), (unsigned long)histogram.getMax(),
+                          (unsigned long)histogram.getMean());
+        if (!printJsonPiece(field, length, sizeof(field))) return;
+    }
+    length = snprintf(field, sizeof(field),
+                      "},\"http\":{\"requests\":%lu,\"failures\":%lu,\"error_responses\":%lu},",
+                      stats.requests, stats.failures, errorResponses);
+    if (!printJsonPiece(field, length, sizeof(field))) return;
+    length = snprintf(field, sizeof(field),
+                      "\"heap\":{\"free\":%lu,\"min_free\":%lu,\"largest_block\":%lu,\"min_largest_block\":%lu,"
+                      "\"max_fragmentation\":%u,",
+                      (unsigned long)Hal::Memory::freeHeap(), (unsigned long)Hal::Memory::minFreeHeap(),
+                      (unsigned long)Hal::Memory::largestFreeBlock(), (unsigned long)minLargestFreeBlock,
+                      maxFragmentation);
+    if (!printJsonPiece(field, length, sizeof(field))) return;
+    length = snprintf(field, sizeof(field), "\"json_arena_peak\":%lu,\"json_arena_overflows\":%lu},",
+                      (unsigned long)arenaPeak, arenaOverflows);
+    if (!printJsonPiece(field, length, sizeof(field))) return;
+    const DisplayStats& display = actuatorManager.getDisplayStats();
+    length = snprintf(field, sizeof(field), "\"lcd\":{\"frames\":%lu,\"characters\":%lu,\"cursor_moves\":%lu},",
+                      display.frames, display.characters, display.cursorMoves);
+    if (!printJsonPiece(field, length, sizeof(field))) return;
+    const RoutineCheckStats& routineChecks = stateManager.getRoutineCheckStats();
+    length = snprintf(field, sizeof(field),
+                      "\"routines\":{\"checks\":%lu,\"zones_evaluated\":%lu,\"zones_skipped\":%lu,\"conditions\":%lu},",
+                      routineChecks.checks, routineChecks.zonesEvaluated, routineChecks.zonesSkipped,
+                      routineChecks.conditionsEvaluated);
+    if (!printJsonPiece(field, length, sizeof(field))) return;
+    // Zone 0's sensor, as before zones existed
+    const SensorStats& sensor = sensorPipelines[0].getStats();
+    length = snprintf(field, sizeof(field),
+                      "\"zones\":%d,\"sensor\":{\"reads\":%lu,\"failures\":%lu,\"outliers\":%lu,"
+                      "\"max_consecutive_failures\":%lu,\"window\":%d,",
+                      zoneCount, sensor.reads, sensor.failures, sensor.outliers, sensor.maxConsecutiveFailures,
+                      sensorPipelines[0].getSampleCount());
+    if (!printJsonPiece(field, length, sizeof(field))) return;
+    // Until a reading is accepted the window has no min, mean or max
+    if (!sensorPipelines[0].hasData()) {
+        Hal::console().println("\"temperature\":null,\"humidity\":null}}");
+        return;
+    }
+    const SensorWindow windows[] = { sensorPipelines[0].getTemperature(), sensorPipelines[0].getHumidity() };
+    const char* const names[] = { "temperature", "humidity" };
+    for (int i = 0; i < 2; i++) {
+        // Room for FLT_MAX with two decimals, three times
+        char min[JSON_NUMBER_LENGTH], mean[JSON_NUMBER_LENGTH], max[JSON_NUMBER_LENGTH];
+        char window[3 * JSON_NUMBER_LENGTH + 48];
+        length = snprintf(window, sizeof(window), "%s\"%s\":{\"min\":%s,\"mean\":%s,\"max\":%s}",
+                          i > 0 ? "," : "", names[i], formatJsonNumber(min, sizeof(min), windows[i].min),
+                          formatJsonNumber(mean, sizeof(mean), windows[i].mean),
+                          formatJsonNumber(max, sizeof(max), windows[i].max));
+        if (!printJsonPiece(window, length, sizeof(window))) return;
+    }
+    Hal::console().println("}}");
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::printHttpStats(const NetworkStats& network) {
+    const HttpStats& stats = network.http;
+    Hal::console().println("=== CONEXIONES HTTP ===");
+    Hal::console().print("peticiones="); Hal::console().print(stats.requests);
+    Hal::console().print(" fallidas="); Hal::console().print(stats.failures);
+    Hal::console().print(" abiertas="); Hal::console().println(network.openConnections);
+    Hal::console().print("handshakes="); Hal::console().print(stats.handshakes);
+    Hal::console().print(" reusos="); Hal::console().print(stats.reuses);
+    Hal::console().print(" pipeline="); Hal::console().print(stats.pipelined);
+    Hal::console().print(" reconexiones="); Hal::console().print(stats.reconnects);
+    Hal::console().print(" reintentos="); Hal::console().println(stats.retries);
+    Hal::console().print("bytes enviados="); Hal::console().print(stats.bytesSent);
+    Hal::console().print(" recibidos="); Hal::console().println(stats.bytesReceived);
+    Hal::console().print("tiempo medio="); 
+    Hal::console().print(stats.requests > 0 ? stats.totalTimeMs / stats.requests : 0UL);
+    Hal::console().print("ms max="); Hal::console().print(stats.maxTimeMs);
+    Hal::console().println("ms");
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::printSchedulerStats(const JobScheduler& jobs) {
+    for (int id = 0; id < jobs.getJobCount(); id++) {
+        printJob(jobs.getJobName(id), jobs.getPeriod(id), jobs.getStats(id));
+    }
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::printJob(const char* name, unsigned long period, const JobStats& stats) {
+    Hal::console().print(name);
+    Hal::console().print(": periodo="); Hal::console().print(period);
+    Hal::console().print("ms ejecuciones="); Hal::console().print(stats.runs);
+    Hal::console().print(" atrasos="); Hal::console().print(stats.overruns);
+    Hal::console().print(" retraso_max="); Hal::console().print(stats.maxLatenessMs);
+    Hal::console().print("ms duracion_max="); Hal::console().print(stats.maxRunTimeMs);
+    Hal::console().println("ms");
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::processSerialCommands() {
+    if (Hal::console().available() > 0) {
+        String command = Hal::console().readStringUntil('\n');
+        command.trim();
+        
+        if (command.startsWith("IP:")) {
+            String newIP = command.substring(3);
+            newIP.trim();
+            
+            if (newIP.length() > 0) {
+                setServerIP(newIP);
+                Hal::console().println("========================================");
+                Hal::console().println("=== IP DEL SERVIDOR ACTUALIZADA ===");
+                Hal::console().print("Nueva IP configurada: ");
+                Hal::console().println(serverIP);
+                Hal::console().print("Nueva URL base: http://");
+                Hal::console().print(serverIP);
+                Hal::console().println(":5000");
+                Hal::console().println("========================================");
+                Hal::console().println();
+                
+                Hal::console().println("Probando conectividad con la nueva IP...");
+            } else {
+                Hal::console().println("ERROR: IP vacía. Formato correcto: IP:192.168.1.100");
+            }
+        } else if (command.equals("HELP") || command.equals("help")) {
+            Hal::console().println("========================================");
+            Hal::console().println("=== COMANDOS DISPONIBLES ===");
+            Hal::console().println("IP:x.x.x.x    - Cambiar IP del servidor");
+            Hal::console().println("              - Ejemplo: IP:192.168.1.100");
+            Hal::console().println("HELP          - Mostrar esta ayuda");
+            Hal::console().println("INFO          - Mostrar información actual");
+            Hal::console().println("JOBS          - Mostrar estadisticas de tareas");
+            Hal::console().println("ZONES         - Estado de cada zona");
+            Hal::console().println("ZONE:n        - Zona que muestra la pantalla");
+            Hal::console().println("STATS         - Latencia por etapa (min, p50, p99, max)");
+            Hal::console().println("STATS:JSON    - Lo mismo en una linea JSON");
+            Hal::console().println("BATCH:n[,ms]  - Lecturas por envio (1 = una por POST)");
+            Hal::console().println("              - Ejemplo: BATCH:8,30000");
+            Hal::console().println("FORMAT:JSON   - Telemetria en JSON (por defecto)");
+            Hal::console().println("FORMAT:CBOR   - Telemetria en CBOR (application/cbor)");
+            Hal::console().println("REPORT:t,h,ica[,s] - Enviar solo cambios (bandas muertas, latido en s)");
+            Hal::console().println("              - Ejemplo: REPORT:0.3,1,5,300");
+            Hal::console().println("REPORT:OFF    - Enviar cada lectura");
+            Hal::console().println("REPORT:ON     - Volver a enviar solo cambios");
+            Hal::console().println("LOG:n         - Nivel de registro (0 nada, 1 error, 2 aviso, 3 info, 4 debug)");
+            Hal::console().println("========================================");
+        } else if (command.equals("INFO") || command.equals("info")) {
+            printConnectionInfo();
+        } else if (command.equals("JOBS") || command.equals("jobs")) {
+            printJobStats();
+        } else if (command.equals("ZONES") || command.equals("zones")) {
+            printZones();
+        } else if (command.startsWith("ZONE:")) {
+            String zone = command.substring(5);
+            zone.trim();
+            long value = zone.length() > 0 ? zone.toInt() : -1;
+            
+            if (value >= 0 && value < zoneCount && (value > 0 || zone.equals("0"))) {
+                actuatorManager.setDisplayZone(value);
+                refreshDisplay();
+                Hal::console().print("Zona en pantalla: "); Hal::console().println(value);
+            } else {
+                Hal::console().println("ERROR: Formato correcto: ZONE:0");
+            }
+        } else if (command.equals("STATS") || command.equals("stats")) {
+            printStageStats();
+        } else if (command.equals("STATS:JSON") || command.equals("stats:json")) {
+            printStageStatsJson();
+        } else if (command.startsWith("BATCH:")) {
+            String args = command.substring(6);
+            int comma = args.indexOf(',');
+            long batchSize = (comma >= 0 ? args.substring(0, comma) : args).toInt();
+            long flushInterval = comma >= 0 ? args.substring(comma + 1).toInt() : 30000;
+            
+            if (batchSize > 0 && flushInterval > 0) {
+                setTelemetryBatch(batchSize, flushInterval);
+                Hal::console().print("Lote de telemetria: ");
+                Hal::console().print(batchSize > (long)MAX_TELEMETRY_BATCH ? (long)MAX_TELEMETRY_BATCH : batchSize);
+                Hal::console().print(" lecturas o cada ");
+                Hal::console().print(flushInterval);
+                Hal::console().println(" ms");
+            } else {
+                Hal::console().println("ERROR: Formato correcto: BATCH:8,30000");
+            }
+        } else if (command.equals("FORMAT:JSON") || command.equals("FORMAT:CBOR")) {
+            bool cbor = command.equals("FORMAT:CBOR");
+            setTelemetryEncoding(cbor ? TELEMETRY_CBOR : TELEMETRY_JSON);
+            Hal::console().print("Formato de telemetria: ");
+            Hal::console().println(cbor ? "CBOR" : "JSON");
+        } else if (command.equals("REPORT:OFF") || command.equals("REPORT:ON")) {
+            bool enabled = command.equals("REPORT:ON");
+            setReportByException(enabled);
+            Hal::console().print("Reporte por excepcion: ");
+            Hal::console().println(enabled ? "activo" : "cada lectura");
+        } else if (command.startsWith("REPORT:")) {
+            ReportSettings settings = reportPolicies[0].getSettings();
+            unsigned long heartbeatSec = settings.heartbeatMs / 1000;
+            int fields = sscanf(command.c_str() + 7, "%f,%f,%d,%lu", &settings.temperatureDeadband,
+                                &settings.humidityDeadband, &settings.icaDeadband, &heartbeatSec);
+            
+            if (fields >= 3 && settings.temperatureDeadband >= 0 && settings.humidityDeadband >= 0 &&
+                settings.icaDeadband >= 0 && heartbeatSec > 0) {
+                settings.heartbeatMs = heartbeatSec * 1000;
+                setReportPolicy(settings);
+                Hal::console().print("Reporte por excepcion: bandas ");
+                Hal::console().print(settings.temperatureDeadband); Hal::console().print("C / ");
+                Hal::console().print(settings.humidityDeadband); Hal::console().print("% / ICA ");
+                Hal::console().print(settings.icaDeadband); Hal::console().print(", latido ");
+                Hal::console().print(heartbeatSec); Hal::console().println(" s");
+            } else {
+                Hal::console().println("ERROR: Formato correcto: REPORT:0.3,1,5,300");
+            }
+        } else if (command.startsWith("LOG:")) {
+            String level = command.substring(4);
+            level.trim();
+            long value = level.length() == 1 ? level.charAt(0) - '0' : -1;
+            
+            if (value >= LOG_LEVEL_NONE && value <= LOG_LEVEL_DEBUG) {
+                logSetLevel((uint8_t)value);
+                Hal::console().print("Nivel de registro: "); Hal::console().print(value);
+                if (value > CHAKIY_LOG_LEVEL) {
+                    Hal::console().print(" (compilado solo hasta "); Hal::console().print(CHAKIY_LOG_LEVEL);
+                    Hal::console().print(")");
+                }
+                Hal::console().println();
+            } else {
+                Hal::console().println("ERROR: Formato correcto: LOG:3");
+            }
+        } else if (command.length() > 0) {
+            Hal::console().println("Comando no reconocido. Envía 'HELP' para ver comandos disponibles.");
+        }
+    }
+}
+
+template <typename Hal>
+void DeviceManager<Hal>::initializeTime() {
+    Hal::Clock::configure(-5 * 3600, 0, "pool.ntp.org", "time.nist.gov");
+}
+
+#endif
@@ -0,0 +1,146 @@
+#ifndef ESP32_HAL_H
+#define ESP32_HAL_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <LittleFS.h>
+#include <LiquidCrystal_I2C.h>
+#include <time.h>
+#include "DHT.h"
+
+// Hardware bindings for the ESP32 DevKit. Each type exposes the same static
+// or member API as its NativeHal counterpart so the managers can be
+// instantiated against either one without virtual dispatch.
+
+struct Esp32Clock {
+    static unsigned long millis() { return ::millis(); }
+    static unsigned long micros() { return ::micros(); }
+    // CPU cycle counter; wraps every 17.9 s at 240 MHz
+    static uint32_t cycles() { return ESP.getCycleCount(); }
+    static uint32_t cyclesPerMicrosecond() { return ESP.getCpuFreqMHz(); }
+    static void delay(unsigned long ms) { ::delay(ms); }
+
+    static void configure(long gmtOffsetSec, int daylightOffsetSec, const char* server1, const char* server2) {
+        configTime(gmtOffsetSec, daylightOffsetSec, server1, server2);
+    }
+
+    // Without a timeout getLocalTime() retries for 5 s until NTP has synced;
+    // callers only want to know whether it has
+    static bool localTime(struct tm* info) { return getLocalTime(info, 0); }
+};
+
+struct Esp32Gpio {
+    static void configureOutput(int pin) { pinMode(pin, OUTPUT); }
+    static void write(int pin, bool high) { digitalWrite(pin, high ? HIGH : LOW); }
+};
+
+struct Esp32Network {
+    // Starts one connection attempt and returns at once. WifiManager does
+    // the retrying, so the driver's own reconnect is turned off.
+    static void begin(const char* ssid, const char* password) {
+        WiFi.mode(WIFI_STA);
+        WiFi.setAutoReconnect(false);
+        WiFi.begin(ssid, password);
+    }
+    static void disconnect() { WiFi.disconnect(); }
+    static bool isConnected() { return WiFi.status() == WL_CONNECTED; }
+    // Hardware RNG, seeded from RF noise once the radio is on
+    static uint32_t random() { return esp_random(); }
+    static String ssid() { return WiFi.SSID(); }
+    static String localIP() { return WiFi.localIP().toString(); }
+};
+
+struct Esp32Tasks {
+    // Starts a FreeRTOS task pinned to the given core
+    static bool start(const char* name, void (*entry)(void*), void* context, int core,
+                      unsigned int priority, unsigned long stackSize) {
+        return xTaskCreatePinnedToCore(entry, name, stackSize, context, priority, nullptr, core) == pdPASS;
+    }
+};
+
+// LittleFS on the flash partition, formatted on first use
+struct Esp32Storage {
+    static bool begin() { return LittleFS.begin(true); }
+
+    static long size(const char* path) {
+        if (!LittleFS.exists(path)) return -1;
+        File file = LittleFS.open(path, "r");
+        if (!file) return -1;
+        long length = file.size();
+        file.close();
+        return length;
+    }
+
+    static long read(const char* path, size_t offset, void* data, size_t length) {
+        if (!LittleFS.exists(path)) return -1;
+        File file = LittleFS.open(path, "r");
+        if (!file || !file.seek(offset)) return -1;
+        long count = file.read(static_cast<uint8_t*>(data), length);
+        file.close();
+        return count;
+    }
+
+    static bool append(const char* path, const void* data, size_t length) {
+        File file = LittleFS.open(path, "a");
+        if (!file) return false;
+        bool written = file.write(static_cast<const uint8_t*>(data), length) == length;
+        file.close();
+        return written;
+    }
+
+    static bool write(const char* path, const void* data, size_t length) {
+        File file = LittleFS.open(path, "w");
+        if (!file) return false;
+        bool written = file.write(static_cast<const uint8_t*>(data), length) == length;
+        file.close();
+        return written;
+    }
+
+    static bool remove(const char* path) { return LittleFS.exists(path) && LittleFS.remove(path); }
+};
+
+struct Esp32Memory {
+    static size_t freeHeap() { return ESP.getFreeHeap(); }
+    static size_t minFreeHeap() { return ESP.getMinFreeHeap(); }   // Since boot
+    static size_t largestFreeBlock() { return ESP.getMaxAllocHeap(); }
+};
+
+class Esp32Sensor {
+private:
+    DHT dht;
+
+public:
+    // Default-constructed so a table of them can be kept; the pin is bound
+    // in begin()
+    Esp32Sensor() : dht(0, DHT22) {}
+
+    void begin(int pin, int type) {
+        dht = DHT(pin, type);
+        dht.begin();
+    }
+
+    // One bus transaction: the library caches the result, so the two getters
+    // that follow do not read the sensor again
+    bool read(float& temperature, float& humidity) {
+        if (!dht.read(true)) return false;
+        temperature = dht.readTemperature();
+        humidity = dht.readHumidity();
+        return !isnan(temperature) && !isnan(humidity);
+    }
+};
+
+struct Esp32Hal {
+    using Clock = Esp32Clock;
+    using Gpio = Esp32Gpio;
+    using Network = Esp32Network;
+    using Tasks = Esp32Tasks;
+    using Sensor = Esp32Sensor;
+    using Storage = Esp32Storage;
+    using Memory = Esp32Memory;
+    using Display = LiquidCrystal_I2C;
+    using Console = HardwareSerial;
+
+    static Console& console() { return Serial; }
+};
+
+#endif
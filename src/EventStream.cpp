@@ -0,0 +1,118 @@
+#include "EventStream.h"
+#include <string.h>
+
+EventStream::EventStream() : callback(nullptr), context(nullptr) {
+    begin(nullptr, nullptr);
+}
+
+void EventStream::begin(EventCallback eventCallback, void* eventContext) {
+    callback = eventCallback;
+    context = eventContext;
+    lineLength = 0;
+    lineTooLong = false;
+    afterCr = false;
+    type[0] = '\0';
+    dataLength = 0;
+    hasData = false;
+    tooLarge = false;
+    events = 0;
+    dropped = 0;
+    comments = 0;
+}
+
+void EventStream::feed(const char* bytes, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        char c = bytes[i];
+
+        // Lines end in "\r\n", "\n" or "\r"
+        if (c == '\n' && afterCr) {
+            afterCr = false;
+            continue;
+        }
+        afterCr = c == '\r';
+        if (c == '\r' || c == '\n') {
+            processLine();
+            lineLength = 0;
+            lineTooLong = false;
+            continue;
+        }
+
+        if (lineLength < LINE_BUFFER - 1) {
+            line[lineLength++] = c;
+        } else {
+            lineTooLong = true;
+        }
+    }
+}
+
+size_t EventStream::getEvents() const {
+    return events;
+}
+
+size_t EventStream::getDropped() const {
+    return dropped;
+}
+
+size_t EventStream::getComments() const {
+    return comments;
+}
+
+void EventStream::processLine() {
+    if (lineLength == 0 && !lineTooLong) {
+        dispatch();
+        return;
+    }
+    if (line[0] == ':') {
+        comments++;
+        return;
+    }
+
+    // "field: value", or a bare field name with an empty value
+    line[lineLength] = '\0';
+    char* value = strchr(line, ':');
+    if (value) {
+        *value++ = '\0';
+        if (*value == ' ') value++;
+    } else {
+        value = line + lineLength;
+    }
+    size_t valueLength = line + lineLength - value;
+
+    if (strcmp(line, "event") == 0) {
+        if (lineTooLong || valueLength >= TYPE_LENGTH) {
+            tooLarge = true;
+        } else {
+            memcpy(type, value, valueLength + 1);
+        }
+    } else if (strcmp(line, "data") == 0) {
+        // Further data lines join the first with '\n'
+        size_t needed = valueLength + (hasData ? 1 : 0);
+        if (lineTooLong || dataLength + needed >= DATA_BUFFER) {
+            tooLarge = true;
+        } else {
+            if (hasData) data[dataLength++] = '\n';
+            memcpy(data + dataLength, value, valueLength);
+            dataLength += valueLength;
+        }
+        hasData = true;
+    }
+}
+
+void EventStream::dispatch() {
+    // A blank line with no data before it ends nothing
+    if (hasData) {
+        if (tooLarge) {
+            dropped++;
+        } else {
+            events++;
+            data[dataLength] = '\0';
+            if (callback) {
+                callback(context, type[0] ? type : "message", data, dataLength);
+            }
+        }
+    }
+    type[0] = '\0';
+    dataLength = 0;
+    hasData = false;
+    tooLarge = false;
+}
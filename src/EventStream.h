@@ -0,0 +1,54 @@
+#ifndef EVENT_STREAM_H
+#define EVENT_STREAM_H
+
+#include <stddef.h>
+
+// Parses a server-sent event stream (text/event-stream) as it streams in,
+// in pieces of any size. Each event is handed to the callback with its type
+// ("message" when the server gives none) and its data lines joined by '\n'.
+// Comment lines, which servers send as keep-alives, and the id and retry
+// fields are skipped. Memory is fixed: an event whose data does not fit in
+// DATA_BUFFER is dropped and counted.
+class EventStream {
+public:
+    static const size_t TYPE_LENGTH = 24;
+    static const size_t DATA_BUFFER = 256;
+    static const size_t LINE_BUFFER = DATA_BUFFER + 8;    // "data: " and the value
+
+    typedef void (*EventCallback)(void* context, const char* type, const char* data, size_t length);
+
+    EventStream();
+
+    // Starts a new stream
+    void begin(EventCallback callback, void* context);
+
+    void feed(const char* data, size_t length);
+
+    size_t getEvents() const;         // Dispatched
+    size_t getDropped() const;        // Too large for DATA_BUFFER
+    size_t getComments() const;       // Keep-alives, mostly
+
+private:
+    EventCallback callback;
+    void* context;
+
+    char line[LINE_BUFFER];
+    size_t lineLength;
+    bool lineTooLong;
+    bool afterCr;               // A '\n' right after '\r' ends nothing more
+
+    char type[TYPE_LENGTH];
+    char data[DATA_BUFFER];
+    size_t dataLength;
+    bool hasData;
+    bool tooLarge;
+
+    size_t events;
+    size_t dropped;
+    size_t comments;
+
+    void processLine();
+    void dispatch();
+};
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef HAL_H
+#define HAL_H
+
+// Selects the peripheral bindings the managers are instantiated with.
+// A HAL is a plain struct of types (Clock, Gpio, Network, Tasks, Sensor,
+// Storage, Display, Console) plus a console() accessor; see Esp32Hal.h and NativeHal.h.
+
+#ifdef ARDUINO
+#include "Esp32Hal.h"
+using DefaultHal = Esp32Hal;
+#else
+#include "NativeHal.h"
+using DefaultHal = NativeHal;
+#endif
+
+#endif
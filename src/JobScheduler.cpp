@@ -0,0 +1,202 @@
+#include "JobScheduler.h"
+#include <string.h>
+
+JobScheduler::JobScheduler(unsigned long (*clock)()) : jobCount(0), heapSize(0), clock(clock) {
+}
+
+int JobScheduler::addPeriodic(const char* name, unsigned long periodMs, JobCallback callback, void* context,
+                              unsigned long firstDelayMs) {
+    int id = addOneShot(name, callback, context);
+    if (id < 0) {
+        return -1;
+    }
+    
+    jobs[id].periodMs = periodMs > 0 ? periodMs : 1;
+    runIn(id, firstDelayMs);
+    return id;
+}
+
+int JobScheduler::addOneShot(const char* name, JobCallback callback, void* context) {
+    if (jobCount >= MAX_JOBS) {
+        return -1;
+    }
+    
+    Job& job = jobs[jobCount];
+    job.name = name;
+    job.callback = callback;
+    job.context = context;
+    job.periodMs = 0;
+    job.deadline = 0;
+    job.heapIndex = -1;
+    memset(&job.stats, 0, sizeof(job.stats));
+    return jobCount++;
+}
+
+bool JobScheduler::setPeriod(int id, unsigned long periodMs) {
+    if (!isValid(id) || jobs[id].periodMs == 0 || periodMs == 0) {
+        return false;
+    }
+    
+    // A cancelled job stays cancelled; the new period applies once runIn
+    // schedules it again
+    Job& job = jobs[id];
+    if (job.heapIndex < 0) {
+        job.periodMs = periodMs;
+        return true;
+    }
+    
+    // Keep the phase: the next run is one new period after the last deadline
+    unsigned long lastDeadline = job.deadline - job.periodMs;
+    job.periodMs = periodMs;
+    remove(id);
+    job.deadline = lastDeadline + periodMs;
+    push(id);
+    return true;
+}
+
+bool JobScheduler::runIn(int id, unsigned long delayMs) {
+    if (!isValid(id)) {
+        return false;
+    }
+    
+    remove(id);
+    jobs[id].deadline = clock() + delayMs;
+    push(id);
+    return true;
+}
+
+bool JobScheduler::cancel(int id) {
+    if (!isValid(id)) {
+        return false;
+    }
+    
+    remove(id);
+    return true;
+}
+
+unsigned long JobScheduler::runDue(unsigned long now, unsigned long maxWaitMs) {
+    while (heapSize > 0 && !before(now, jobs[heap[0]].deadline)) {
+        int id = heap[0];
+        Job& job = jobs[id];
+        remove(id);
+        
+        unsigned long lateness = now - job.deadline;
+        if (lateness > job.stats.maxLatenessMs) {
+            job.stats.maxLatenessMs = lateness;
+        }
+        
+        // Re-arm before running so the callback may reschedule or cancel
+        if (job.periodMs > 0) {
+            job.deadline += job.periodMs;
+            if (!before(now, job.deadline)) {
+                unsigned long missed = (now - job.deadline) / job.periodMs + 1;
+                job.deadline += missed * job.periodMs;
+                job.stats.overruns += missed;
+            }
+            push(id);
+        }
+        
+        unsigned long started = clock();
+        job.callback(job.context);
+        unsigned long runTime = clock() - started;
+        
+        job.stats.runs++;
+        if (runTime > job.stats.maxRunTimeMs) {
+            job.stats.maxRunTimeMs = runTime;
+        }
+        
+        now = clock();
+    }
+    
+    if (heapSize == 0) {
+        return maxWaitMs;
+    }
+    unsigned long wait = jobs[heap[0]].deadline - now;
+    return wait < maxWaitMs ? wait : maxWaitMs;
+}
+
+int JobScheduler::getJobCount() const {
+    return jobCount;
+}
+
+const char* JobScheduler::getJobName(int id) const {
+    return isValid(id) ? jobs[id].name : "";
+}
+
+unsigned long JobScheduler::getPeriod(int id) const {
+    return isValid(id) ? jobs[id].periodMs : 0;
+}
+
+const JobStats& JobScheduler::getStats(int id) const {
+    return jobs[isValid(id) ? id : 0].stats;
+}
+
+bool JobScheduler::before(unsigned long a, unsigned long b) {
+    return (long)(a - b) < 0;
+}
+
+void JobScheduler::push(int id) {
+    jobs[id].heapIndex = heapSize;
+    heap[heapSize++] = id;
+    siftUp(heapSize - 1);
+}
+
+void JobScheduler::remove(int id) {
+    int pos = jobs[id].heapIndex;
+    if (pos < 0) {
+        return;
+    }
+    
+    jobs[id].heapIndex = -1;
+    heapSize--;
+    if (pos == heapSize) {
+        return;
+    }
+    
+    heap[pos] = heap[heapSize];
+    jobs[heap[pos]].heapIndex = pos;
+    siftUp(pos);
+    siftDown(jobs[heap[pos]].heapIndex);
+}
+
+void JobScheduler::siftUp(int pos) {
+    while (pos > 0) {
+        int parent = (pos - 1) / 2;
+        if (!before(jobs[heap[pos]].deadline, jobs[heap[parent]].deadline)) {
+            break;
+        }
+        swap(pos, parent);
+        pos = parent;
+    }
+}
+
+void JobScheduler::siftDown(int pos) {
+    for (;;) {
+        int smallest = pos;
+        int left = 2 * pos + 1;
+        int right = left + 1;
+        if (left < heapSize && before(jobs[heap[left]].deadline, jobs[heap[smallest]].deadline)) {
+            smallest = left;
+        }
+        if (right < heapSize && before(jobs[heap[right]].deadline, jobs[heap[smallest]].deadline)) {
+            smallest = right;
+        }
+        if (smallest == pos) {
+            return;
+        }
+        swap(pos, smallest);
+        pos = smallest;
+    }
+}
+
+void JobScheduler::swap(int a, int b) {
+    int tmp = heap[a];
+    heap[a] = heap[b];
+    heap[b] = tmp;
+    jobs[heap[a]].heapIndex = a;
+    jobs[heap[b]].heapIndex = b;
+}
+
+bool JobScheduler::isValid(int id) const {
+    return id >= 0 && id < jobCount;
+}
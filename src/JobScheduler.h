@@ -0,0 +1,74 @@
+#ifndef JOB_SCHEDULER_H
+#define JOB_SCHEDULER_H
+
+#include <stdint.h>
+
+typedef void (*JobCallback)(void* context);
+
+struct JobStats {
+    unsigned long runs;
+    unsigned long overruns;       // Periodic slots skipped because the job ran late
+    unsigned long maxLatenessMs;  // Worst delay between deadline and start
+    unsigned long maxRunTimeMs;
+};
+
+// Deadline scheduler for named jobs, kept in a binary min-heap ordered by
+// next deadline. Periodic jobs advance their deadline by whole periods from
+// the previous deadline (not from the time they actually ran), so sampling
+// does not drift; slots missed entirely are skipped and counted as overruns.
+// All times are millis() values and compared wrap-safely.
+class JobScheduler {
+public:
+    static const int MAX_JOBS = 8;
+
+    // The clock is used to measure run time and to reschedule jobs; it is
+    // the same millis() source the caller passes to runDue
+    explicit JobScheduler(unsigned long (*clock)());
+
+    // Return the job id, or -1 if the table is full
+    int addPeriodic(const char* name, unsigned long periodMs, JobCallback callback, void* context,
+                    unsigned long firstDelayMs = 0);
+    int addOneShot(const char* name, JobCallback callback, void* context);
+
+    // Changes a periodic job's period. A scheduled job keeps its phase; a
+    // cancelled one is not re-armed.
+    bool setPeriod(int id, unsigned long periodMs);
+    bool runIn(int id, unsigned long delayMs);
+    bool cancel(int id);
+
+    // Runs every job whose deadline has passed and returns the number of
+    // milliseconds until the next deadline (maxWaitMs if nothing is pending)
+    unsigned long runDue(unsigned long now, unsigned long maxWaitMs);
+
+    int getJobCount() const;
+    const char* getJobName(int id) const;
+    unsigned long getPeriod(int id) const;
+    const JobStats& getStats(int id) const;
+
+private:
+    struct Job {
+        const char* name;
+        JobCallback callback;
+        void* context;
+        unsigned long periodMs;   // 0 for one-shot jobs
+        unsigned long deadline;
+        int heapIndex;            // -1 while not scheduled
+        JobStats stats;
+    };
+
+    Job jobs[MAX_JOBS];
+    int jobCount;
+    int heap[MAX_JOBS];
+    int heapSize;
+    unsigned long (*clock)();
+
+    static bool before(unsigned long a, unsigned long b);
+    void push(int id);
+    void remove(int id);
+    void siftUp(int pos);
+    void siftDown(int pos);
+    void swap(int a, int b);
+    bool isValid(int id) const;
+};
+
+#endif
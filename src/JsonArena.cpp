@@ -0,0 +1,95 @@
+#include "JsonArena.h"
+#include <stdlib.h>
+#include <string.h>
+
+namespace {
+
+size_t roundUp(size_t size, size_t align) {
+    return (size + align - 1) & ~(align - 1);
+}
+
+}
+
+JsonArena::JsonArena() : used(0), last(NONE), live(0), peak(0), overflows(0) {
+}
+
+void* JsonArena::allocate(size_t size) {
+    size_t capacity = roundUp(size, ALIGN);
+    if (capacity > SIZE - used || HEADER > SIZE - used - capacity) {
+        overflows++;
+        return malloc(size);
+    }
+
+    last = used;
+    capacityOf(last) = capacity;
+    used += HEADER + capacity;
+    live++;
+    if (used > peak) {
+        peak = used;
+    }
+    return buffer + last + HEADER;
+}
+
+void JsonArena::deallocate(void* pointer) {
+    if (!owns(pointer)) {
+        free(pointer);
+        return;
+    }
+
+    size_t offset = (unsigned char*)pointer - buffer - HEADER;
+    live--;
+    if (live == 0) {
+        used = 0;
+        last = NONE;
+    } else if (offset == last) {
+        // Only the top block can be taken back before the rest is freed
+        used = last;
+        last = NONE;
+    }
+}
+
+void* JsonArena::reallocate(void* pointer, size_t size) {
+    if (!pointer) {
+        return allocate(size);
+    }
+    if (!owns(pointer)) {
+        return realloc(pointer, size);
+    }
+
+    size_t offset = (unsigned char*)pointer - buffer - HEADER;
+    size_t capacity = roundUp(size, ALIGN);
+    if (offset == last && capacity <= SIZE - offset - HEADER) {
+        capacityOf(offset) = capacity;
+        used = offset + HEADER + capacity;
+        if (used > peak) {
+            peak = used;
+        }
+        return pointer;
+    }
+    if (capacity <= capacityOf(offset)) {
+        return pointer;
+    }
+
+    void* moved = allocate(size);
+    if (moved) {
+        memcpy(moved, pointer, capacityOf(offset));
+        deallocate(pointer);
+    }
+    return moved;
+}
+
+size_t JsonArena::getPeak() const {
+    return peak;
+}
+
+unsigned long JsonArena::getOverflows() const {
+    return overflows;
+}
+
+bool JsonArena::owns(const void* pointer) const {
+    return pointer >= (const void*)buffer && pointer < (const void*)(buffer + SIZE);
+}
+
+size_t& JsonArena::capacityOf(size_t offset) {
+    return *(size_t*)(buffer + offset);
+}
@@ -0,0 +1,43 @@
+#ifndef JSON_ARENA_H
+#define JSON_ARENA_H
+
+#include <stddef.h>
+#include <ArduinoJson.h>
+
+// JsonDocument allocator over a fixed buffer, so parsing API responses does
+// not churn the heap. A document's pools and strings are stacked in the
+// buffer; the space is handed back when everything in it has been freed,
+// which for the filter/document pairs parsed on the network task is at the
+// end of every parse. The last block can grow or shrink in place, which
+// covers strings being built and the final shrinkToFit(). Anything that does
+// not fit goes to the heap, so a response larger than usual still parses.
+class JsonArena : public ArduinoJson::Allocator {
+public:
+    static const size_t SIZE = 6144;
+
+    JsonArena();
+
+    void* allocate(size_t size) override;
+    void deallocate(void* pointer) override;
+    void* reallocate(void* pointer, size_t size) override;
+
+    size_t getPeak() const;                 // Most bytes in use at once
+    unsigned long getOverflows() const;     // Allocations that went to the heap
+
+private:
+    static const size_t ALIGN = 8;
+    static const size_t HEADER = ALIGN;     // Holds the block's capacity
+    static const size_t NONE = (size_t)-1;
+
+    alignas(ALIGN) unsigned char buffer[SIZE];
+    size_t used;
+    size_t last;                            // Offset of the top block's header, or NONE
+    size_t live;                            // Blocks not yet freed
+    size_t peak;
+    unsigned long overflows;
+
+    bool owns(const void* pointer) const;
+    size_t& capacityOf(size_t offset);
+};
+
+#endif
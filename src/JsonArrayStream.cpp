@@ -0,0 +1,142 @@
+#include "JsonArrayStream.h"
+
+namespace {
+
+bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+}
+
+JsonArrayStream::JsonArrayStream() : callback(nullptr), context(nullptr) {
+    begin(nullptr, nullptr);
+}
+
+void JsonArrayStream::begin(ElementCallback elementCallback, void* elementContext) {
+    state = BEFORE_ARRAY;
+    depth = 0;
+    inString = false;
+    escaped = false;
+    callback = elementCallback;
+    context = elementContext;
+    length = 0;
+    size = 0;
+    elements = 0;
+    skipped = 0;
+    maxElement = 0;
+}
+
+bool JsonArrayStream::feed(const char* data, size_t count) {
+    for (size_t i = 0; i < count && state != FAILED; i++) {
+        char c = data[i];
+
+        switch (state) {
+            case BEFORE_ARRAY:
+                if (c == '[') {
+                    state = BEFORE_ELEMENT;
+                } else if (!isSpace(c)) {
+                    state = FAILED;
+                }
+                continue;
+
+            case BEFORE_ELEMENT:
+                if (isSpace(c)) {
+                    continue;
+                }
+                if (c == ']' && elements == 0) {
+                    state = DONE;
+                    continue;
+                }
+                if (c == ',' || c == ']') {
+                    state = FAILED;
+                    continue;
+                }
+                state = IN_ELEMENT;
+                depth = 0;
+                inString = false;
+                escaped = false;
+                length = 0;
+                size = 0;
+                break;
+
+            case DONE:
+                if (!isSpace(c)) {
+                    state = FAILED;
+                }
+                continue;
+
+            default:
+                break;
+        }
+
+        // Inside an element: only a ',' or ']' outside any string or nested
+        // value ends it
+        if (inString) {
+            if (escaped) {
+                escaped = false;
+            } else if (c == '\\') {
+                escaped = true;
+            } else if (c == '"') {
+                inString = false;
+            }
+        } else if (depth == 0 && (c == ',' || c == ']')) {
+            emit();
+            state = c == ',' ? BEFORE_ELEMENT : DONE;
+            continue;
+        } else if (c == '"') {
+            inString = true;
+        } else if (c == '{' || c == '[') {
+            depth++;
+        } else if (c == '}' || c == ']') {
+            if (--depth < 0) {
+                state = FAILED;
+                continue;
+            }
+        }
+
+        if (length < ELEMENT_BUFFER - 1) {
+            element[length++] = c;
+        }
+        size++;
+    }
+    return state != FAILED;
+}
+
+bool JsonArrayStream::isComplete() const {
+    return state == DONE;
+}
+
+bool JsonArrayStream::hasError() const {
+    return state == FAILED;
+}
+
+size_t JsonArrayStream::getElements() const {
+    return elements;
+}
+
+size_t JsonArrayStream::getSkipped() const {
+    return skipped;
+}
+
+size_t JsonArrayStream::getMaxElement() const {
+    return maxElement;
+}
+
+void JsonArrayStream::emit() {
+    while (size == length && length > 0 && isSpace(element[length - 1])) {
+        length--;
+        size--;
+    }
+
+    elements++;
+    if (size > maxElement) maxElement = size;
+    if (size != length) {
+        skipped++;
+        return;
+    }
+
+    element[length] = '\0';
+    if (callback) {
+        callback(context, element, length);
+    }
+}
@@ -0,0 +1,60 @@
+#ifndef JSON_ARRAY_STREAM_H
+#define JSON_ARRAY_STREAM_H
+
+#include <stddef.h>
+
+// Splits a top-level JSON array into its elements as the document streams
+// in, in pieces of any size. Each complete element is handed to the callback
+// as one NUL-terminated string, so memory is bounded by the largest element
+// rather than the whole document. Elements are only delimited here, not
+// validated; that is left to whoever parses them.
+class JsonArrayStream {
+public:
+    static const size_t ELEMENT_BUFFER = 512;
+
+    typedef void (*ElementCallback)(void* context, const char* element, size_t length);
+
+    JsonArrayStream();
+
+    // Starts a new document
+    void begin(ElementCallback callback, void* context);
+
+    // Feeds the next bytes. Returns false once the input cannot be an array.
+    bool feed(const char* data, size_t length);
+
+    // True once the closing ']' has been seen
+    bool isComplete() const;
+    bool hasError() const;
+
+    size_t getElements() const;       // Elements delimited, skipped included
+    size_t getSkipped() const;        // Elements too large for ELEMENT_BUFFER
+    size_t getMaxElement() const;     // Longest element seen, in bytes
+
+private:
+    enum State {
+        BEFORE_ARRAY,
+        BEFORE_ELEMENT,
+        IN_ELEMENT,
+        DONE,
+        FAILED
+    };
+
+    State state;
+    int depth;
+    bool inString;
+    bool escaped;
+    ElementCallback callback;
+    void* context;
+
+    char element[ELEMENT_BUFFER];
+    size_t length;              // Bytes kept in element
+    size_t size;                // Full size of the current element
+
+    size_t elements;
+    size_t skipped;
+    size_t maxElement;
+
+    void emit();
+};
+
+#endif
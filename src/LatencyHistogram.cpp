@@ -0,0 +1,90 @@
+#include "LatencyHistogram.h"
+#include <string.h>
+
+namespace {
+
+const int SUB_BUCKETS = 4;      // Per power of two, and the exact range 0-3 us
+const int SUB_BITS = 2;
+
+int highestBit(uint32_t value) {
+    return 31 - __builtin_clz(value);
+}
+
+}
+
+LatencyHistogram::LatencyHistogram() {
+    reset();
+}
+
+void LatencyHistogram::reset() {
+    memset(counts, 0, sizeof(counts));
+    count = 0;
+    min = 0;
+    max = 0;
+    sum = 0;
+}
+
+int LatencyHistogram::bucketOf(uint32_t micros) {
+    if (micros < (uint32_t)SUB_BUCKETS) {
+        return micros;
+    }
+    int octave = highestBit(micros);
+    int sub = (micros >> (octave - SUB_BITS)) & (SUB_BUCKETS - 1);
+    int bucket = SUB_BUCKETS + (octave - SUB_BITS) * SUB_BUCKETS + sub;
+    return bucket < BUCKETS ? bucket : BUCKETS - 1;
+}
+
+uint32_t LatencyHistogram::bucketLow(int bucket) {
+    if (bucket < SUB_BUCKETS) {
+        return bucket;
+    }
+    int octave = (bucket - SUB_BUCKETS) / SUB_BUCKETS + SUB_BITS;
+    int sub = (bucket - SUB_BUCKETS) % SUB_BUCKETS;
+    return (uint32_t)(SUB_BUCKETS + sub) << (octave - SUB_BITS);
+}
+
+void LatencyHistogram::record(uint32_t micros) {
+    counts[bucketOf(micros)]++;
+    if (count == 0 || micros < min) min = micros;
+    if (micros > max) max = micros;
+    count++;
+    sum += micros;
+}
+
+uint32_t LatencyHistogram::getCount() const {
+    return count;
+}
+
+uint32_t LatencyHistogram::getMin() const {
+    return min;
+}
+
+uint32_t LatencyHistogram::getMax() const {
+    return max;
+}
+
+uint32_t LatencyHistogram::getMean() const {
+    return count > 0 ? (uint32_t)(sum / count) : 0;
+}
+
+uint32_t LatencyHistogram::percentile(uint8_t percent) const {
+    if (count == 0) {
+        return 0;
+    }
+
+    // Smallest value with at least percent% of the samples at or below it
+    uint32_t rank = (uint32_t)(((uint64_t)count * percent + 99) / 100);
+    if (rank == 0) rank = 1;
+
+    uint32_t seen = 0;
+    for (int i = 0; i < BUCKETS; i++) {
+        seen += counts[i];
+        if (seen >= rank) {
+            uint32_t high = i + 1 < BUCKETS ? bucketLow(i + 1) - 1 : max;
+            if (high > max) high = max;
+            if (high < min) high = min;
+            return high;
+        }
+    }
+    return max;
+}
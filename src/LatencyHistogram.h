@@ -0,0 +1,42 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Fixed-bucket latency histogram in microseconds. Values below 4 us get a
+// bucket each; above that every power of two is split into 4 buckets, so a
+// percentile is known to within 25% of its value. Recording is a few shifts
+// and an increment, with no allocation. Values past the last bucket (from
+// 3.67 s) are counted in it, so a percentile that falls there reads as the
+// max; min and max are always exact.
+class LatencyHistogram {
+public:
+    static const int BUCKETS = 84;
+
+    LatencyHistogram();
+
+    void record(uint32_t micros);
+    void reset();
+
+    uint32_t getCount() const;
+    uint32_t getMin() const;           // 0 while empty
+    uint32_t getMax() const;
+    uint32_t getMean() const;
+
+    // Upper edge of the bucket holding the given percentile (0-100),
+    // clamped to the observed min and max
+    uint32_t percentile(uint8_t percent) const;
+
+private:
+    uint32_t counts[BUCKETS];
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+
+    static int bucketOf(uint32_t micros);
+    static uint32_t bucketLow(int bucket);
+};
+
+#endif
@@ -0,0 +1,112 @@
+#include "Log.h"
+#include <atomic>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+static_assert((LOG_SLOTS & (LOG_SLOTS - 1)) == 0, "LOG_SLOTS must be a power of two");
+
+namespace {
+
+// Bounded multi-producer, single-consumer ring. Each slot carries a sequence
+// number: a producer may claim slot (pos % LOG_SLOTS) only while it reads
+// pos, and publishes it as pos + 1; the consumer frees it as pos + LOG_SLOTS.
+// Sequences are stored relative to the slot index so that the zeroed
+// statics are already a valid empty ring, and logging works even from
+// other static constructors.
+struct LogSlot {
+    std::atomic<uint32_t> sequence;
+    LogEntry entry;
+};
+
+LogSlot slots[LOG_SLOTS];
+std::atomic<uint32_t> head(0);      // Next position to claim
+uint32_t tail = 0;                  // Next position to read (consumer only)
+
+std::atomic<uint8_t> runtimeLevel(CHAKIY_LOG_LEVEL);
+std::atomic<unsigned long> written(0);
+std::atomic<unsigned long> dropped(0);
+std::atomic<unsigned long> truncated(0);
+unsigned long maxQueued = 0;
+
+uint32_t loadSequence(uint32_t pos) {
+    return slots[pos & (LOG_SLOTS - 1)].sequence.load(std::memory_order_acquire) + (pos & (LOG_SLOTS - 1));
+}
+
+void storeSequence(uint32_t pos, uint32_t sequence) {
+    slots[pos & (LOG_SLOTS - 1)].sequence.store(sequence - (pos & (LOG_SLOTS - 1)), std::memory_order_release);
+}
+
+}
+
+void logWrite(uint8_t level, const char* tag, const char* format, ...) {
+    if (level > runtimeLevel.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    uint32_t pos = head.load(std::memory_order_relaxed);
+    for (;;) {
+        int32_t diff = (int32_t)(loadSequence(pos) - pos);
+        if (diff == 0) {
+            if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // Still holds a message the drain task has not written out
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        } else {
+            pos = head.load(std::memory_order_relaxed);
+        }
+    }
+
+    LogEntry& entry = slots[pos & (LOG_SLOTS - 1)].entry;
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(entry.message, LOG_MESSAGE_LENGTH, format, args);
+    va_end(args);
+    if (length >= (int)LOG_MESSAGE_LENGTH) {
+        truncated.fetch_add(1, std::memory_order_relaxed);
+    }
+    entry.level = level;
+    entry.tag = tag;
+
+    storeSequence(pos, pos + 1);
+    written.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool logRead(LogEntry& entry) {
+    if (loadSequence(tail) != tail + 1) {
+        return false;
+    }
+
+    uint32_t queued = head.load(std::memory_order_relaxed) - tail;
+    if (queued > maxQueued) maxQueued = queued;
+
+    entry = slots[tail & (LOG_SLOTS - 1)].entry;
+    storeSequence(tail, tail + LOG_SLOTS);
+    tail++;
+    return true;
+}
+
+void logSetLevel(uint8_t level) {
+    runtimeLevel.store(level, std::memory_order_relaxed);
+}
+
+uint8_t logGetLevel() {
+    return runtimeLevel.load(std::memory_order_relaxed);
+}
+
+LogStats logGetStats() {
+    LogStats stats;
+    stats.written = written.load(std::memory_order_relaxed);
+    stats.dropped = dropped.load(std::memory_order_relaxed);
+    stats.truncated = truncated.load(std::memory_order_relaxed);
+    stats.maxQueued = maxQueued;
+    return stats;
+}
+
+char logLevelLetter(uint8_t level) {
+    static const char letters[] = "-EWID";
+    return level <= LOG_LEVEL_DEBUG ? letters[level] : '?';
+}
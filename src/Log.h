@@ -0,0 +1,89 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Leveled logging. Messages are formatted into a fixed lock-free ring by the
+// task that logs them and written to the console later by a low-priority
+// drain task, so logging never waits on the UART. When the ring is full the
+// message is dropped and counted instead.
+//
+// Levels above CHAKIY_LOG_LEVEL (a build flag, INFO by default) compile to
+// nothing, arguments included. logSetLevel() lowers the threshold further at
+// run time.
+//
+//   LOG_INFO("rutinas", "Rutina #%d cargada: %s", index, name);
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+#ifndef CHAKIY_LOG_LEVEL
+#define CHAKIY_LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#if defined(__GNUC__)
+#define LOG_PRINTF_FORMAT(fmt, args) __attribute__((format(printf, fmt, args)))
+#else
+#define LOG_PRINTF_FORMAT(fmt, args)
+#endif
+
+#define LOG_DISABLED(...) do {} while (0)
+
+#if CHAKIY_LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(tag, ...) logWrite(LOG_LEVEL_ERROR, tag, __VA_ARGS__)
+#else
+#define LOG_ERROR(tag, ...) LOG_DISABLED()
+#endif
+
+#if CHAKIY_LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(tag, ...) logWrite(LOG_LEVEL_WARN, tag, __VA_ARGS__)
+#else
+#define LOG_WARN(tag, ...) LOG_DISABLED()
+#endif
+
+#if CHAKIY_LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(tag, ...) logWrite(LOG_LEVEL_INFO, tag, __VA_ARGS__)
+#else
+#define LOG_INFO(tag, ...) LOG_DISABLED()
+#endif
+
+#if CHAKIY_LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(tag, ...) logWrite(LOG_LEVEL_DEBUG, tag, __VA_ARGS__)
+#else
+#define LOG_DEBUG(tag, ...) LOG_DISABLED()
+#endif
+
+const size_t LOG_MESSAGE_LENGTH = 96;
+const size_t LOG_SLOTS = 64;     // Power of two
+
+struct LogEntry {
+    uint8_t level;
+    const char* tag;             // Must be a string literal or otherwise static
+    char message[LOG_MESSAGE_LENGTH];
+};
+
+struct LogStats {
+    unsigned long written;
+    unsigned long dropped;       // Ring full
+    unsigned long truncated;     // Longer than LOG_MESSAGE_LENGTH - 1
+    unsigned long maxQueued;     // High-water mark of the ring
+};
+
+// Producer side, safe from any task
+void logWrite(uint8_t level, const char* tag, const char* format, ...) LOG_PRINTF_FORMAT(3, 4);
+
+// Consumer side, for the single drain task. Returns false when empty.
+bool logRead(LogEntry& entry);
+
+void logSetLevel(uint8_t level);
+uint8_t logGetLevel();
+LogStats logGetStats();
+
+// One letter per level, for the console prefix
+char logLevelLetter(uint8_t level);
+
+#endif
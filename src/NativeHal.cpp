@@ -0,0 +1,336 @@
+#ifndef ARDUINO
+
+#include "NativeHal.h"
+#include <chrono>
+#include <thread>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+
+void setup();
+void loop();
+
+namespace {
+
+const std::chrono::steady_clock::time_point bootTime = std::chrono::steady_clock::now();
+const time_t bootWallTime = time(nullptr);
+long clockOffsetSec = 0;
+bool gpioLevels[64];
+
+const char* flashDir() {
+    static const char* dir = getenv("CHAKIY_FLASH_DIR") ? getenv("CHAKIY_FLASH_DIR") : "flash";
+    return dir;
+}
+
+unsigned long timeScale() {
+    static unsigned long scale = getenv("CHAKIY_TIME_SCALE") && atol(getenv("CHAKIY_TIME_SCALE")) > 0
+                                     ? (unsigned long)atol(getenv("CHAKIY_TIME_SCALE")) : 1;
+    return scale;
+}
+
+// Simulated time since boot
+std::chrono::microseconds elapsed() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - bootTime) * timeScale();
+}
+
+void flashPath(const char* path, char* full, size_t size) {
+    snprintf(full, size, "%s%s%s", flashDir(), path[0] == '/' ? "" : "/", path);
+}
+
+// Simulated access point; only the network task connects
+bool networkStarted = false;
+bool networkLost = false;
+unsigned long networkStartedAt = 0;
+
+unsigned long wifiConnectMs() {
+    static unsigned long delay = getenv("CHAKIY_WIFI_CONNECT_MS") ? (unsigned long)atol(getenv("CHAKIY_WIFI_CONNECT_MS")) : 0;
+    return delay;
+}
+
+bool accessPointDown(unsigned long now) {
+    const char* outages = getenv("CHAKIY_WIFI_OUTAGES");
+    while (outages && *outages) {
+        unsigned long from, to;
+        if (sscanf(outages, "%lu-%lu", &from, &to) != 2) {
+            break;
+        }
+        if (now >= from * 1000 && now < to * 1000) {
+            return true;
+        }
+        outages = strchr(outages, ',');
+        if (outages) outages++;
+    }
+    return false;
+}
+
+}
+
+unsigned long NativeClock::millis() {
+    return (unsigned long)std::chrono::duration_cast<std::chrono::milliseconds>(elapsed()).count();
+}
+
+unsigned long NativeClock::micros() {
+    return (unsigned long)elapsed().count();
+}
+
+uint32_t NativeClock::cycles() {
+    return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - bootTime).count();
+}
+
+void NativeClock::delay(unsigned long ms) {
+    std::this_thread::sleep_for(std::chrono::microseconds(ms * 1000 / timeScale()));
+}
+
+void NativeClock::configure(long gmtOffsetSec, int daylightOffsetSec, const char* server1, const char* server2) {
+    (void)server1;
+    (void)server2;
+    clockOffsetSec = gmtOffsetSec + daylightOffsetSec;
+}
+
+bool NativeClock::localTime(struct tm* info) {
+    time_t now = bootWallTime + std::chrono::duration_cast<std::chrono::seconds>(elapsed()).count() + clockOffsetSec;
+    return gmtime_r(&now, info) != nullptr;
+}
+
+void NativeGpio::configureOutput(int pin) {
+    write(pin, false);
+}
+
+void NativeGpio::write(int pin, bool high) {
+    if (pin >= 0 && pin < 64) gpioLevels[pin] = high;
+}
+
+bool NativeGpio::read(int pin) {
+    return pin >= 0 && pin < 64 && gpioLevels[pin];
+}
+
+void NativeNetwork::begin(const char* ssid, const char* password) {
+    (void)ssid;
+    (void)password;
+    networkStartedAt = NativeClock::millis();
+    networkStarted = true;
+    networkLost = false;
+}
+
+void NativeNetwork::disconnect() {
+    networkStarted = false;
+}
+
+bool NativeNetwork::isConnected() {
+    if (!networkStarted || networkLost) {
+        return false;
+    }
+    unsigned long now = NativeClock::millis();
+    if (accessPointDown(now)) {
+        networkLost = true;
+        return false;
+    }
+    return now - networkStartedAt >= wifiConnectMs();
+}
+
+uint32_t NativeNetwork::random() {
+    return (uint32_t)getpid() * 2654435761u ^ (uint32_t)time(nullptr);
+}
+
+String NativeNetwork::ssid() {
+    return "native";
+}
+
+String NativeNetwork::localIP() {
+    return "127.0.0.1";
+}
+
+bool NativeTasks::start(const char* name, void (*entry)(void*), void* context, int core,
+                        unsigned int priority, unsigned long stackSize) {
+    (void)name;
+    (void)core;
+    (void)priority;
+    (void)stackSize;
+    std::thread(entry, context).detach();
+    return true;
+}
+
+bool NativeStorage::begin() {
+    return mkdir(flashDir(), 0755) == 0 || errno == EEXIST;
+}
+
+long NativeStorage::size(const char* path) {
+    char full[256];
+    flashPath(path, full, sizeof(full));
+    struct stat info;
+    return stat(full, &info) == 0 ? (long)info.st_size : -1;
+}
+
+// Plain descriptors rather than stdio, whose FILE and buffer would show up
+// in the allocation check on every telemetry write
+long NativeStorage::read(const char* path, size_t offset, void* data, size_t length) {
+    char full[256];
+    flashPath(path, full, sizeof(full));
+    int fd = open(full, O_RDONLY);
+    if (fd < 0) return -1;
+    long count = (long)pread(fd, data, length, offset);
+    close(fd);
+    return count;
+}
+
+bool NativeStorage::append(const char* path, const void* data, size_t length) {
+    char full[256];
+    flashPath(path, full, sizeof(full));
+    int fd = open(full, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) return false;
+    bool written = ::write(fd, data, length) == (ssize_t)length;
+    return close(fd) == 0 && written;
+}
+
+bool NativeStorage::write(const char* path, const void* data, size_t length) {
+    char full[256];
+    flashPath(path, full, sizeof(full));
+    int fd = open(full, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+    bool written = ::write(fd, data, length) == (ssize_t)length;
+    return close(fd) == 0 && written;
+}
+
+bool NativeStorage::remove(const char* path) {
+    char full[256];
+    flashPath(path, full, sizeof(full));
+    return ::remove(full) == 0;
+}
+
+NativeSensor::NativeSensor() : pin(0), noise(0), dropoutPercent(0), spikePercent(0) {
+    const char* faults = getenv("CHAKIY_SENSOR_FAULTS");
+    if (faults) {
+        sscanf(faults, "%f,%d,%d", &noise, &dropoutPercent, &spikePercent);
+    }
+}
+
+void NativeSensor::begin(int sensorPin, int type) {
+    (void)type;
+    // The pin offsets the phase, so each zone reads differently
+    pin = sensorPin;
+}
+
+bool NativeSensor::read(float& temperature, float& humidity) {
+    if (rand() % 100 < dropoutPercent) {
+        return false;
+    }
+    temperature = 24.0f + 3.0f * sinf(NativeClock::millis() / 60000.0f + pin);
+    humidity = 55.0f + 15.0f * sinf(NativeClock::millis() / 90000.0f + pin);
+
+    if (noise > 0) {
+        // Box-Muller
+        float u1 = (rand() + 1.0f) / (RAND_MAX + 2.0f);
+        float u2 = (rand() + 1.0f) / (RAND_MAX + 2.0f);
+        float radius = sqrtf(-2.0f * logf(u1));
+        temperature += noise * radius * cosf(6.2831853f * u2);
+        humidity += noise * radius * sinf(6.2831853f * u2);
+    }
+    if (rand() % 100 < spikePercent) {
+        // A corrupted frame that still passed its checksum
+        temperature += (rand() % 2 ? 1 : -1) * (10.0f + rand() % 40);
+        humidity += (rand() % 2 ? 1 : -1) * (20.0f + rand() % 40);
+    }
+    return true;
+}
+
+NativeDisplay::NativeDisplay(uint8_t address, int cols, int rows)
+    : cols(cols < MAX_COLS ? cols : MAX_COLS), rows(rows < MAX_ROWS ? rows : MAX_ROWS),
+      cursorCol(0), cursorRow(0), bytesSent(0) {
+    (void)address;
+    memset(cells, ' ', sizeof(cells));
+}
+
+void NativeDisplay::init() {
+    clear();
+}
+
+void NativeDisplay::backlight() {
+    bytesSent++;
+}
+
+void NativeDisplay::clear() {
+    memset(cells, ' ', sizeof(cells));
+    cursorCol = 0;
+    cursorRow = 0;
+    bytesSent++;
+}
+
+void NativeDisplay::setCursor(int col, int row) {
+    cursorCol = col;
+    cursorRow = row;
+    bytesSent++;
+}
+
+size_t NativeDisplay::write(const char* data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (cursorRow < rows && cursorCol < cols) {
+            cells[cursorRow][cursorCol] = data[i];
+        }
+        cursorCol++;
+    }
+    bytesSent += len;
+    return len;
+}
+
+char NativeDisplay::cellAt(int col, int row) const {
+    if (col < 0 || col >= cols || row < 0 || row >= rows) return 0;
+    return cells[row][col];
+}
+
+unsigned long NativeDisplay::getBytesSent() const {
+    return bytesSent;
+}
+
+void NativeConsole::begin(unsigned long baud) {
+    (void)baud;
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+}
+
+int NativeConsole::available() {
+    struct pollfd fd = { STDIN_FILENO, POLLIN, 0 };
+    return poll(&fd, 1, 0) > 0 && (fd.revents & POLLIN) ? 1 : 0;
+}
+
+String NativeConsole::readStringUntil(char terminator) {
+    String line;
+    char c;
+    while (read(STDIN_FILENO, &c, 1) == 1 && c != terminator) {
+        line += c;
+    }
+    return line;
+}
+
+size_t NativeConsole::write(const char* data, size_t len) {
+    return fwrite(data, 1, len, stdout);
+}
+
+NativeConsole& NativeHal::console() {
+    static NativeConsole console;
+    return console;
+}
+
+int nativeAllocationCheck(const char* spec);
+
+// Test builds (pio test) bring their own main()
+#ifndef PIO_UNIT_TESTING
+int main() {
+    if (getenv("CHAKIY_ALLOC_CHECK")) {
+        int status = nativeAllocationCheck(getenv("CHAKIY_ALLOC_CHECK"));
+        // The other tasks are still running; don't wait for them or run
+        // static destructors under them
+        fflush(stderr);
+        fflush(stdout);
+        _exit(status);
+    }
+    setup();
+    for (;;) {
+        loop();
+    }
+}
+#endif
+
+#endif
@@ -0,0 +1,194 @@
+#ifndef NATIVE_HAL_H
+#define NATIVE_HAL_H
+
+#include <Arduino.h>
+#include <time.h>
+
+// Host-side stand-ins for the ESP32 peripherals, used by the `native`
+// PlatformIO environment to run and profile the control path on Linux.
+// Sensors are simulated and the LCD renders into memory; the HTTP client
+// talks to a real backend over host sockets.
+//
+// CHAKIY_TIME_SCALE=n runs the clock n times faster than real time (delays
+// shrink to match), so hours of jobs can be simulated in minutes.
+// CHAKIY_ALLOC_CHECK runs the heap check described at NativeMemory instead
+// of the endless loop.
+
+#ifndef DHT22
+#define DHT22 22
+#endif
+
+// Arduino-style print()/println() overloads on top of a write(data, len)
+// provided by the derived class.
+template <typename Derived>
+class NativePrint {
+public:
+    size_t print(const char* str) { return emit(str, strlen(str)); }
+    size_t print(const String& str) { return emit(str.c_str(), str.length()); }
+    size_t print(char c) { return emit(&c, 1); }
+    size_t print(int value) { return print((long)value); }
+    size_t print(unsigned int value) { return print((unsigned long)value); }
+    size_t print(long value) {
+        char tmp[24];
+        return emit(tmp, snprintf(tmp, sizeof(tmp), "%ld", value));
+    }
+    size_t print(unsigned long value) {
+        char tmp[24];
+        return emit(tmp, snprintf(tmp, sizeof(tmp), "%lu", value));
+    }
+    size_t print(double value, int digits = 2) {
+        char tmp[32];
+        return emit(tmp, snprintf(tmp, sizeof(tmp), "%.*f", digits, value));
+    }
+
+    size_t println() { return emit("\n", 1); }
+    size_t println(double value, int digits) { return print(value, digits) + println(); }
+    template <typename T>
+    size_t println(const T& value) { return print(value) + println(); }
+
+private:
+    size_t emit(const char* data, size_t len) {
+        return static_cast<Derived*>(this)->write(data, len);
+    }
+};
+
+struct NativeClock {
+    static unsigned long millis();      // Scaled by CHAKIY_TIME_SCALE, as are
+    static unsigned long micros();      // micros(), delay() and localTime()
+    // Nanoseconds stand in for CPU cycles on the host
+    static uint32_t cycles();
+    static uint32_t cyclesPerMicrosecond() { return 1000; }
+    static void delay(unsigned long ms);
+    static void configure(long gmtOffsetSec, int daylightOffsetSec, const char* server1, const char* server2);
+    static bool localTime(struct tm* info);
+};
+
+struct NativeGpio {
+    static void configureOutput(int pin);
+    static void write(int pin, bool high);
+    static bool read(int pin);
+};
+
+// Connected unless CHAKIY_WIFI_OUTAGES=from-to[,from-to...] (seconds of
+// simulated uptime) takes the access point away; a link lost that way stays
+// down until the next begin(). CHAKIY_WIFI_CONNECT_MS is how long an
+// attempt takes to come up (default 0).
+struct NativeNetwork {
+    static void begin(const char* ssid, const char* password);
+    static void disconnect();
+    static bool isConnected();
+    static uint32_t random();
+    static String ssid();
+    static String localIP();
+};
+
+// Tasks run as detached host threads; core and priority are ignored.
+struct NativeTasks {
+    static bool start(const char* name, void (*entry)(void*), void* context, int core,
+                      unsigned int priority, unsigned long stackSize);
+};
+
+// Flash stand-in: each path is a file under $CHAKIY_FLASH_DIR (default
+// ./flash), so logs survive restarts of the native program.
+struct NativeStorage {
+    static bool begin();
+    static long size(const char* path);
+    static long read(const char* path, size_t offset, void* data, size_t length);
+    static bool append(const char* path, const void* data, size_t length);
+    static bool write(const char* path, const void* data, size_t length);
+    static bool remove(const char* path);
+};
+
+// The host heap has no fixed size, so the free and largest-block figures
+// are 0. Instead, with glibc, malloc, calloc, realloc and free are wrapped
+// to count allocations and live bytes, grouped by call site: the first two
+// frames of the firmware's own code on the stack.
+//
+// CHAKIY_ALLOC_CHECK="iterations[,budget[,warmup]]" runs setup(), then
+// warmup loop() iterations (a fifth of iterations by default) to reach the
+// steady state, then counts allocations from every task over iterations
+// more. The sites are printed to stderr and the program exits with status 1
+// if there were more than budget (default 0) allocations per iteration, or
+// if live bytes grew. Use it with CHAKIY_TIME_SCALE so the iterations cover
+// every job.
+struct NativeMemory {
+    static size_t freeHeap() { return 0; }
+    static size_t minFreeHeap() { return 0; }
+    static size_t largestFreeBlock() { return 0; }
+
+    static bool trackingAvailable();
+    static void setTracking(bool enabled);
+    static void resetTracking();
+    static void ignoreThisThread();             // For test servers sharing the process
+    static unsigned long allocations();         // While tracking
+    static unsigned long controlAllocations();  // Of those, on the control task
+    static long liveBytes();                    // Allocated minus freed while tracking
+    static void printSites(FILE* out, int maxSites);
+};
+
+// Simulated DHT22: slow sinusoidal drift around a comfortable room climate.
+// CHAKIY_SENSOR_FAULTS="noise,dropout,spikes" adds Gaussian noise (standard
+// deviation in degrees / %RH), failed reads and wild readings (both in
+// percent of reads), e.g. "0.2,10,5".
+class NativeSensor {
+private:
+    int pin;
+    float noise;
+    int dropoutPercent;
+    int spikePercent;
+
+public:
+    NativeSensor();
+
+    void begin(int pin, int type);
+    bool read(float& temperature, float& humidity);
+};
+
+// In-memory 20x4 character LCD. Counts the bytes that would go over I2C.
+class NativeDisplay : public NativePrint<NativeDisplay> {
+private:
+    static const int MAX_COLS = 20;
+    static const int MAX_ROWS = 4;
+    char cells[MAX_ROWS][MAX_COLS];
+    int cols;
+    int rows;
+    int cursorCol;
+    int cursorRow;
+    unsigned long bytesSent;
+
+public:
+    NativeDisplay(uint8_t address, int cols, int rows);
+
+    void init();
+    void backlight();
+    void clear();
+    void setCursor(int col, int row);
+    size_t write(const char* data, size_t len);
+
+    char cellAt(int col, int row) const;
+    unsigned long getBytesSent() const;
+};
+
+class NativeConsole : public NativePrint<NativeConsole> {
+public:
+    void begin(unsigned long baud);
+    int available();
+    String readStringUntil(char terminator);
+    size_t write(const char* data, size_t len);
+};
+
+struct NativeHal {
+    using Clock = NativeClock;
+    using Gpio = NativeGpio;
+    using Network = NativeNetwork;
+    using Tasks = NativeTasks;
+    using Sensor = NativeSensor;
+    using Storage = NativeStorage;
+    using Memory = NativeMemory;
+    using Display = NativeDisplay;
+    using Console = NativeConsole;
+
+    static Console& console();
+};
+
+#endif
@@ -0,0 +1,306 @@
+#ifndef ARDUINO
+
+#include "NativeHal.h"
+#include <atomic>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#include <execinfo.h>
+#include <dlfcn.h>
+#include <cxxabi.h>
+
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* pointer, size_t size);
+void __libc_free(void* pointer);
+
+// Bounds of the executable's code, from the GNU linker
+extern char __executable_start;
+extern char etext;
+}
+#endif
+
+void setup();
+void loop();
+
+namespace {
+
+const int MAX_SITES = 256;
+const int MAX_FRAMES = 24;
+const int SITE_FRAMES = 4;      // Of the executable's code, innermost first
+const int HOOK_FRAMES = 3;      // recordSite, trackAllocation and the wrapper
+
+struct Site {
+    void* frames[SITE_FRAMES];
+    unsigned long count;
+    unsigned long bytes;
+};
+
+std::atomic<bool> tracking(false);
+std::atomic<unsigned long> allocationCount(0);
+std::atomic<unsigned long> controlAllocationCount(0);
+std::atomic<long> liveByteCount(0);
+std::atomic<unsigned long> untrackedSites(0);
+std::atomic_flag sitesLock = ATOMIC_FLAG_INIT;
+Site sites[MAX_SITES];
+
+// Set while inside the wrappers (backtrace() may allocate) and on the
+// thread that runs setup() and loop()
+thread_local bool inHook = false;
+thread_local bool controlThread = false;
+thread_local bool ignoredThread = false;
+
+#if defined(__GLIBC__)
+
+bool inExecutable(void* address) {
+    return (char*)address >= &__executable_start && (char*)address < &etext;
+}
+
+__attribute__((noinline)) void recordSite(size_t size) {
+    void* stack[MAX_FRAMES];
+    int count = backtrace(stack, MAX_FRAMES);
+
+    // Frames in shared libraries (operator new, libc) are left out; the ones
+    // from inlined library templates are dropped when printing
+    void* frames[SITE_FRAMES] = {};
+    int found = 0;
+    size_t hash = 0;
+    for (int i = HOOK_FRAMES; i < count && found < SITE_FRAMES; i++) {
+        if (inExecutable(stack[i])) {
+            frames[found++] = stack[i];
+            hash = hash * 31 + ((uintptr_t)stack[i] >> 2);
+        }
+    }
+
+    while (sitesLock.test_and_set(std::memory_order_acquire)) {}
+    bool stored = false;
+    for (int probe = 0; probe < MAX_SITES && !stored; probe++) {
+        Site& site = sites[(hash + probe) % MAX_SITES];
+        if (site.count == 0) {
+            memcpy(site.frames, frames, sizeof(frames));
+        }
+        if (memcmp(site.frames, frames, sizeof(frames)) == 0) {
+            site.count++;
+            site.bytes += size;
+            stored = true;
+        }
+    }
+    sitesLock.clear(std::memory_order_release);
+    if (!stored) {
+        untrackedSites++;
+    }
+}
+
+__attribute__((noinline)) void trackAllocation(void* pointer, size_t size) {
+    if (!pointer || !tracking.load(std::memory_order_relaxed) || inHook || ignoredThread) {
+        return;
+    }
+    inHook = true;
+    allocationCount++;
+    if (controlThread) {
+        controlAllocationCount++;
+    }
+    liveByteCount += malloc_usable_size(pointer);
+    recordSite(size);
+    inHook = false;
+}
+
+void trackFree(void* pointer) {
+    if (pointer && tracking.load(std::memory_order_relaxed) && !inHook && !ignoredThread) {
+        liveByteCount -= malloc_usable_size(pointer);
+    }
+}
+
+// Writes "function+0x12" for a code address, or the offset into the
+// executable for addr2line when symbols are not exported. Returns false for
+// standard library code.
+bool describe(void* address, char* out, size_t size) {
+    Dl_info info;
+    if (dladdr(address, &info) && info.dli_sname) {
+        int status;
+        char* demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+        const char* name = status == 0 ? demangled : info.dli_sname;
+        bool own = strncmp(name, "std::", 5) != 0 && strncmp(name, "__gnu_cxx::", 11) != 0 &&
+                   strncmp(name, "void std::", 10) != 0;
+        // Drop the parameter list; the offset pins down the line anyway
+        const char* parameters = strchr(name, '(');
+        int nameLength = parameters ? (int)(parameters - name) : (int)strlen(name);
+        snprintf(out, size, "%.*s+0x%lx", nameLength, name, (unsigned long)((char*)address - (char*)info.dli_saddr));
+        free(demangled);
+        return own;
+    }
+    snprintf(out, size, "0x%lx", (unsigned long)((char*)address - (char*)&__executable_start));
+    return true;
+}
+
+#endif
+
+void printSummary(FILE* out, int iterations, unsigned long simulatedMs) {
+    fprintf(out, "=== ALLOCACIONES EN REGIMEN ===\n");
+    fprintf(out, "iteraciones=%d tiempo simulado=%lus allocaciones=%lu (control %lu) por iteracion=%.3f bytes vivos=%+ld\n",
+            iterations, simulatedMs / 1000, NativeMemory::allocations(), NativeMemory::controlAllocations(),
+            iterations > 0 ? (double)NativeMemory::allocations() / iterations : 0.0, NativeMemory::liveBytes());
+}
+
+}
+
+#if defined(__GLIBC__)
+
+extern "C" {
+
+void* malloc(size_t size) {
+    void* pointer = __libc_malloc(size);
+    trackAllocation(pointer, size);
+    return pointer;
+}
+
+void* calloc(size_t count, size_t size) {
+    void* pointer = __libc_calloc(count, size);
+    trackAllocation(pointer, count * size);
+    return pointer;
+}
+
+void* realloc(void* pointer, size_t size) {
+    trackFree(pointer);
+    void* moved = __libc_realloc(pointer, size);
+    trackAllocation(moved, size);
+    return moved;
+}
+
+void free(void* pointer) {
+    trackFree(pointer);
+    __libc_free(pointer);
+}
+
+}
+
+bool NativeMemory::trackingAvailable() {
+    return true;
+}
+
+void NativeMemory::printSites(FILE* out, int maxSites) {
+    Site sorted[MAX_SITES];
+    int count = 0;
+    while (sitesLock.test_and_set(std::memory_order_acquire)) {}
+    for (int i = 0; i < MAX_SITES; i++) {
+        if (sites[i].count > 0) sorted[count++] = sites[i];
+    }
+    sitesLock.clear(std::memory_order_release);
+
+    // Few sites: a selection sort by count is plenty
+    for (int i = 0; i < count; i++) {
+        for (int j = i + 1; j < count; j++) {
+            if (sorted[j].count > sorted[i].count) {
+                Site swap = sorted[i];
+                sorted[i] = sorted[j];
+                sorted[j] = swap;
+            }
+        }
+    }
+
+    // The first two firmware frames of each site
+    char frame[160];
+    fprintf(out, "  veces     bytes  sitio <- llamado desde\n");
+    for (int i = 0; i < count && i < maxSites; i++) {
+        fprintf(out, "%7lu %9lu ", sorted[i].count, sorted[i].bytes);
+        int shown = 0;
+        for (int f = 0; f < SITE_FRAMES && sorted[i].frames[f] && shown < 2; f++) {
+            if (describe(sorted[i].frames[f], frame, sizeof(frame))) {
+                fprintf(out, "%s %s", shown > 0 ? " <-" : "", frame);
+                shown++;
+            }
+        }
+        fprintf(out, "\n");
+    }
+    if (untrackedSites > 0) {
+        fprintf(out, "(%lu allocaciones en sitios fuera de la tabla)\n", untrackedSites.load());
+    }
+}
+
+#else
+
+bool NativeMemory::trackingAvailable() {
+    return false;
+}
+
+void NativeMemory::printSites(FILE* out, int maxSites) {
+    (void)maxSites;
+    fprintf(out, "Seguimiento de allocaciones no disponible (requiere glibc)\n");
+}
+
+#endif
+
+void NativeMemory::setTracking(bool enabled) {
+#if defined(__GLIBC__)
+    if (enabled) {
+        // The first backtrace() loads libgcc and allocates; do it untracked
+        void* frame;
+        backtrace(&frame, 1);
+    }
+#endif
+    tracking = enabled;
+}
+
+void NativeMemory::ignoreThisThread() {
+    ignoredThread = true;
+}
+
+void NativeMemory::resetTracking() {
+    while (sitesLock.test_and_set(std::memory_order_acquire)) {}
+    memset(sites, 0, sizeof(sites));
+    sitesLock.clear(std::memory_order_release);
+    allocationCount = 0;
+    controlAllocationCount = 0;
+    liveByteCount = 0;
+    untrackedSites = 0;
+}
+
+unsigned long NativeMemory::allocations() {
+    return allocationCount;
+}
+
+unsigned long NativeMemory::controlAllocations() {
+    return controlAllocationCount;
+}
+
+long NativeMemory::liveBytes() {
+    return liveByteCount;
+}
+
+int nativeAllocationCheck(const char* spec) {
+    int iterations = 0;
+    double budget = 0;
+    int warmup = -1;
+    if (sscanf(spec, "%d,%lf,%d", &iterations, &budget, &warmup) < 1 || iterations <= 0) {
+        fprintf(stderr, "CHAKIY_ALLOC_CHECK: formato iteraciones[,presupuesto[,calentamiento]]\n");
+        return 2;
+    }
+    if (warmup < 0) {
+        warmup = iterations / 5;
+    }
+
+    controlThread = true;
+    setup();
+    for (int i = 0; i < warmup; i++) {
+        loop();
+    }
+
+    NativeMemory::resetTracking();
+    NativeMemory::setTracking(true);
+    unsigned long started = NativeClock::millis();
+    for (int i = 0; i < iterations; i++) {
+        loop();
+    }
+    NativeMemory::setTracking(false);
+
+    printSummary(stderr, iterations, NativeClock::millis() - started);
+    NativeMemory::printSites(stderr, 20);
+    double perIteration = (double)NativeMemory::allocations() / iterations;
+    bool passed = NativeMemory::trackingAvailable() && perIteration <= budget && NativeMemory::liveBytes() <= 0;
+    fprintf(stderr, "%s: %.3f allocaciones por iteracion (presupuesto %.3f), bytes vivos %+ld\n",
+            passed ? "OK" : "FALLO", perIteration, budget, NativeMemory::liveBytes());
+    return passed ? 0 : 1;
+}
+
+#endif
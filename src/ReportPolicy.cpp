@@ -0,0 +1,89 @@
+#include "ReportPolicy.h"
+#include <string.h>
+#include <math.h>
+
+ReportPolicy::ReportPolicy() : enabled(true), hasReported(false), intervalMs(0), quietSince(0) {
+    ReportSettings defaults = { 0.3f, 1.0f, 5, 5000, 60000, 300000 };
+    configure(defaults);
+    memset(&lastReported, 0, sizeof(lastReported));
+    memset(&stats, 0, sizeof(stats));
+}
+
+void ReportPolicy::configure(const ReportSettings& newSettings) {
+    settings = newSettings;
+    if (settings.maxIntervalMs < settings.minIntervalMs) settings.maxIntervalMs = settings.minIntervalMs;
+    intervalMs = settings.minIntervalMs;
+}
+
+const ReportSettings& ReportPolicy::getSettings() const {
+    return settings;
+}
+
+void ReportPolicy::setEnabled(bool enable) {
+    enabled = enable;
+    intervalMs = settings.minIntervalMs;
+}
+
+bool ReportPolicy::isEnabled() const {
+    return enabled;
+}
+
+bool ReportPolicy::outsideDeadband(const TelemetrySample& sample) const {
+    return fabsf(sample.temperature - lastReported.temperature) >= settings.temperatureDeadband ||
+           fabsf(sample.humidity - lastReported.humidity) >= settings.humidityDeadband ||
+           abs(sample.ica - lastReported.ica) >= settings.icaDeadband;
+}
+
+void ReportPolicy::report(const TelemetrySample& sample) {
+    lastReported = sample;
+    hasReported = true;
+    quietSince = sample.timestamp;
+    stats.reported++;
+}
+
+bool ReportPolicy::shouldReport(const TelemetrySample& sample) {
+    stats.samples++;
+    if (!enabled || !hasReported) {
+        report(sample);
+        return true;
+    }
+
+    unsigned long now = sample.timestamp;
+    unsigned long elapsed = now - lastReported.timestamp;
+
+    if (sample.deviceOn != lastReported.deviceOn) {
+        stats.stateChanges++;
+        intervalMs = settings.minIntervalMs;
+        report(sample);
+        return true;
+    }
+
+    if (outsideDeadband(sample)) {
+        if (elapsed >= intervalMs) {
+            stats.changed++;
+            intervalMs = intervalMs / 2 > settings.minIntervalMs ? intervalMs / 2 : settings.minIntervalMs;
+            report(sample);
+            return true;
+        }
+        stats.deferred++;
+    } else if (now - quietSince >= intervalMs) {
+        // A whole interval without movement: back off
+        intervalMs = intervalMs * 2 < settings.maxIntervalMs ? intervalMs * 2 : settings.maxIntervalMs;
+        quietSince = now;
+    }
+
+    if (elapsed >= settings.heartbeatMs) {
+        stats.heartbeats++;
+        report(sample);
+        return true;
+    }
+    return false;
+}
+
+unsigned long ReportPolicy::getIntervalMs() const {
+    return intervalMs;
+}
+
+const ReportStats& ReportPolicy::getStats() const {
+    return stats;
+}
@@ -0,0 +1,60 @@
+#ifndef REPORT_POLICY_H
+#define REPORT_POLICY_H
+
+#include "TaskMessages.h"
+
+struct ReportSettings {
+    float temperatureDeadband;        // Degrees from the last reported value
+    float humidityDeadband;           // %RH
+    int icaDeadband;
+    unsigned long minIntervalMs;      // Fastest cadence, while values move
+    unsigned long maxIntervalMs;      // Slowest cadence, once they settle
+    unsigned long heartbeatMs;        // Reported at least this often
+};
+
+struct ReportStats {
+    unsigned long samples;            // Offered to the policy
+    unsigned long reported;
+    unsigned long changed;            // Reported: a value left its deadband
+    unsigned long stateChanges;       // Reported: the device switched on/off
+    unsigned long heartbeats;         // Reported: nothing else for heartbeatMs
+    unsigned long deferred;           // Outside the deadband but too soon
+};
+
+// Report-by-exception for telemetry. A sample is reported when the device
+// switches on or off, when a value has moved past its deadband since the
+// last report, or when nothing has been reported for a heartbeat period.
+// Change reports are also spaced by an adaptive interval: it halves on every
+// change report, down to minIntervalMs, and doubles each time an interval
+// passes quietly, up to maxIntervalMs. Fast-moving values are tracked at
+// sensor rate and a steady room costs a heartbeat now and then.
+class ReportPolicy {
+public:
+    ReportPolicy();
+
+    void configure(const ReportSettings& settings);
+    const ReportSettings& getSettings() const;
+
+    // When disabled, every sample is reported (the fixed cadence)
+    void setEnabled(bool enabled);
+    bool isEnabled() const;
+
+    bool shouldReport(const TelemetrySample& sample);
+
+    unsigned long getIntervalMs() const;
+    const ReportStats& getStats() const;
+
+private:
+    ReportSettings settings;
+    bool enabled;
+    bool hasReported;
+    TelemetrySample lastReported;
+    unsigned long intervalMs;
+    unsigned long quietSince;         // Start of the current quiet interval
+    ReportStats stats;
+
+    bool outsideDeadband(const TelemetrySample& sample) const;
+    void report(const TelemetrySample& sample);
+};
+
+#endif
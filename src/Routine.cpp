@@ -0,0 +1,320 @@
+#include "Routine.h"
+#include <string.h>
+#include <stdlib.h>
+
+namespace {
+
+const char* const DAY_NAMES[7] = {
+    "SUNDAY", "MONDAY", "TUESDAY", "WEDNESDAY", "THURSDAY", "FRIDAY", "SATURDAY"
+};
+
+// Keys of a routine_data payload, as bits of the "seen" mask
+enum RoutineKey {
+    KEY_ID = 1 << 0,
+    KEY_NAME = 1 << 1,
+    KEY_CONDITION = 1 << 2,
+    KEY_IS_DRY = 1 << 3,
+    KEY_START_TIME = 1 << 4,
+    KEY_END_TIME = 1 << 5,
+    KEY_DAYS = 1 << 6,
+    KEY_ALL = (1 << 7) - 1
+};
+
+const int MAX_NESTING = 4;  // Of skipped values
+
+// Read position over the payload; every step checks the end, so nothing
+// past length is ever touched and no terminator is needed
+struct Cursor {
+    const char* p;
+    const char* end;
+};
+
+void skipSpace(Cursor& in) {
+    while (in.p < in.end && (*in.p == ' ' || *in.p == '\t' || *in.p == '\r' || *in.p == '\n')) {
+        in.p++;
+    }
+}
+
+bool expect(Cursor& in, char c) {
+    skipSpace(in);
+    if (in.p < in.end && *in.p == c) {
+        in.p++;
+        return true;
+    }
+    return false;
+}
+
+// A quoted string; start/length span its raw contents, escapes included
+bool readString(Cursor& in, const char*& start, size_t& length) {
+    skipSpace(in);
+    if (in.p >= in.end || (*in.p != '\'' && *in.p != '"')) {
+        return false;
+    }
+    char quote = *in.p++;
+    start = in.p;
+    while (in.p < in.end && *in.p != quote) {
+        if (*in.p == '\\') {
+            in.p++;
+            if (in.p >= in.end) return false;
+        }
+        in.p++;
+    }
+    if (in.p >= in.end) {
+        return false;
+    }
+    length = in.p - start;
+    in.p++;
+    return true;
+}
+
+// A bare token: number, True/False/None or true/false/null
+bool readScalar(Cursor& in, const char*& start, size_t& length) {
+    skipSpace(in);
+    start = in.p;
+    while (in.p < in.end && (*in.p == '-' || *in.p == '+' || *in.p == '.' ||
+           (*in.p >= '0' && *in.p <= '9') || (*in.p >= 'a' && *in.p <= 'z') || (*in.p >= 'A' && *in.p <= 'Z'))) {
+        in.p++;
+    }
+    length = in.p - start;
+    return length > 0;
+}
+
+bool skipValue(Cursor& in, int depth);
+
+bool skipContainer(Cursor& in, char close, bool keyed, int depth) {
+    if (depth >= MAX_NESTING) {
+        return false;
+    }
+    if (expect(in, close)) {
+        return true;
+    }
+    do {
+        const char* start;
+        size_t length;
+        if (keyed && (!readString(in, start, length) || !expect(in, ':'))) {
+            return false;
+        }
+        if (!skipValue(in, depth + 1)) {
+            return false;
+        }
+    } while (expect(in, ','));
+    return expect(in, close);
+}
+
+bool skipValue(Cursor& in, int depth) {
+    const char* start;
+    size_t length;
+    if (expect(in, '[')) return skipContainer(in, ']', false, depth);
+    if (expect(in, '{')) return skipContainer(in, '}', true, depth);
+    if (in.p < in.end && (*in.p == '\'' || *in.p == '"')) return readString(in, start, length);
+    return readScalar(in, start, length);
+}
+
+bool tokenIs(const char* start, size_t length, const char* word) {
+    return strlen(word) == length && strncmp(start, word, length) == 0;
+}
+
+// strtol/strtof need a terminated string; numbers are short, so copy them
+bool parseNumber(const char* start, size_t length, bool integer, float& value, int32_t& whole) {
+    char buffer[24];
+    if (length == 0 || length >= sizeof(buffer)) {
+        return false;
+    }
+    memcpy(buffer, start, length);
+    buffer[length] = '\0';
+
+    char* end;
+    if (integer) {
+        whole = strtol(buffer, &end, 10);
+    } else {
+        value = strtof(buffer, &end);
+    }
+    return end == buffer + length;
+}
+
+// Copies a string value, resolving backslash escapes, truncating to fit
+void copyString(const char* start, size_t length, char* out, size_t size) {
+    size_t used = 0;
+    for (size_t i = 0; i < length && used < size - 1; i++) {
+        if (start[i] == '\\' && i + 1 < length) i++;
+        out[used++] = start[i];
+    }
+    out[used] = '\0';
+}
+
+bool parseDays(Cursor& in, uint8_t& dayMask) {
+    dayMask = 0;
+    if (!expect(in, '[')) {
+        return false;
+    }
+    if (expect(in, ']')) {
+        return true;
+    }
+    do {
+        const char* start;
+        size_t length;
+        if (!readString(in, start, length)) {
+            return false;
+        }
+        int weekday = routineDayFromName(start, length);
+        if (weekday >= 0) {
+            dayMask |= (1 << weekday);
+        }
+    } while (expect(in, ','));
+    return expect(in, ']');
+}
+
+}
+
+const char* routineDayName(int weekday) {
+    if (weekday < 0 || weekday > 6) {
+        return "UNKNOWN";
+    }
+    return DAY_NAMES[weekday];
+}
+
+int routineDayFromName(const char* name, size_t length) {
+    for (int i = 0; i < 7; i++) {
+        if (strlen(DAY_NAMES[i]) == length && strncmp(DAY_NAMES[i], name, length) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int routineParseTime(const char* str, size_t length) {
+    // Seconds, if present ("HH:MM:SS"), are ignored
+    if (length < 5 || str[2] != ':') {
+        return -1;
+    }
+    for (size_t i = 0; i < 5; i++) {
+        if (i != 2 && (str[i] < '0' || str[i] > '9')) {
+            return -1;
+        }
+    }
+
+    int hours = (str[0] - '0') * 10 + (str[1] - '0');
+    int minutes = (str[3] - '0') * 10 + (str[4] - '0');
+    if (hours > 23 || minutes > 59) {
+        return -1;
+    }
+    return hours * 60 + minutes;
+}
+
+bool routineParseData(const char* data, size_t length, Routine& routine, RoutineCondition& condition, char* name,
+                      char* ubication) {
+    Cursor in = { data, data + length };
+    unsigned seen = 0;
+    // Compiled once isDry is known, which may come later
+    const char* conditionText = nullptr;
+    size_t conditionLength = 0;
+
+    routine.flags = ROUTINE_ACTIVE;
+    routine.zone = 0;
+    if (ubication) {
+        ubication[0] = '\0';
+    }
+    if (!expect(in, '{')) {
+        return false;
+    }
+    if (expect(in, '}')) {
+        return false;
+    }
+
+    do {
+        const char* key;
+        size_t keyLength;
+        if (!readString(in, key, keyLength) || !expect(in, ':')) {
+            return false;
+        }
+
+        const char* value;
+        size_t valueLength;
+        float number;
+        int32_t whole;
+        int minute;
+
+        if (tokenIs(key, keyLength, "id")) {
+            if (!readScalar(in, value, valueLength) || !parseNumber(value, valueLength, true, number, whole)) {
+                return false;
+            }
+            routine.id = whole;
+            seen |= KEY_ID;
+        } else if (tokenIs(key, keyLength, "name")) {
+            if (!readString(in, value, valueLength)) {
+                return false;
+            }
+            copyString(value, valueLength, name, ROUTINE_NAME_LENGTH);
+            seen |= KEY_NAME;
+        } else if (tokenIs(key, keyLength, "condition")) {
+            // Sent as a string ('60'), but a bare number is fine too
+            skipSpace(in);
+            bool quoted = in.p < in.end && (*in.p == '\'' || *in.p == '"');
+            if (!(quoted ? readString(in, conditionText, conditionLength)
+                         : readScalar(in, conditionText, conditionLength))) {
+                return false;
+            }
+            seen |= KEY_CONDITION;
+        } else if (tokenIs(key, keyLength, "isDry")) {
+            if (!readScalar(in, value, valueLength)) {
+                return false;
+            }
+            if (tokenIs(value, valueLength, "True") || tokenIs(value, valueLength, "true")) {
+                routine.flags |= ROUTINE_DRY;
+            } else if (tokenIs(value, valueLength, "False") || tokenIs(value, valueLength, "false")) {
+                routine.flags &= ~ROUTINE_DRY;
+            } else {
+                return false;
+            }
+            seen |= KEY_IS_DRY;
+        } else if (tokenIs(key, keyLength, "startTime") || tokenIs(key, keyLength, "endTime")) {
+            if (!readString(in, value, valueLength) || (minute = routineParseTime(value, valueLength)) < 0) {
+                return false;
+            }
+            if (key[0] == 's') {
+                routine.startMinute = minute;
+                seen |= KEY_START_TIME;
+            } else {
+                routine.endMinute = minute;
+                seen |= KEY_END_TIME;
+            }
+        } else if (tokenIs(key, keyLength, "days")) {
+            if (!parseDays(in, routine.dayMask)) {
+                return false;
+            }
+            seen |= KEY_DAYS;
+        } else if (ubication && tokenIs(key, keyLength, "ubication")) {
+            // A routine without a zone may come with None rather than no key
+            skipSpace(in);
+            bool quoted = in.p < in.end && (*in.p == '\'' || *in.p == '"');
+            if (quoted ? !readString(in, value, valueLength)
+                       : !readScalar(in, value, valueLength) ||
+                             !(tokenIs(value, valueLength, "None") || tokenIs(value, valueLength, "null"))) {
+                return false;
+            }
+            if (quoted) {
+                copyString(value, valueLength, ubication, UBICATION_LENGTH);
+            }
+        } else if (!skipValue(in, 0)) {
+            return false;
+        }
+    } while (expect(in, ','));
+
+    if (!expect(in, '}')) {
+        return false;
+    }
+    skipSpace(in);
+    return in.p == in.end && seen == KEY_ALL &&
+           conditionCompile(conditionText, conditionLength, (routine.flags & ROUTINE_DRY) != 0, condition);
+}
+
+void routineFormatTime(uint16_t minuteOfDay, char* out) {
+    int hours = (minuteOfDay / 60) % 24;
+    int minutes = minuteOfDay % 60;
+    out[0] = '0' + hours / 10;
+    out[1] = '0' + hours % 10;
+    out[2] = ':';
+    out[3] = '0' + minutes / 10;
+    out[4] = '0' + minutes % 10;
+    out[5] = '\0';
+}
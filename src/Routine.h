@@ -0,0 +1,54 @@
+#ifndef ROUTINE_H
+#define ROUTINE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "RoutineCondition.h"
+
+// Routine flags
+const uint8_t ROUTINE_DRY = 0x01;     // Dehumidifier routine
+const uint8_t ROUTINE_ACTIVE = 0x02;
+
+const int ROUTINE_NAME_LENGTH = 24;
+const int UBICATION_LENGTH = 24;
+
+// Routine compiled at parse time. Days are a bitmask indexed like
+// tm_wday (bit 0 = SUNDAY) and times are minutes since midnight, so the
+// schedule is integer compares only; the condition is compiled separately
+// (RoutineCondition.h). zone is the index of the zone the routine drives,
+// resolved from its ubication by the caller (0 until then).
+struct Routine {
+    int32_t id;
+    uint16_t startMinute;
+    uint16_t endMinute;
+    uint8_t dayMask;
+    uint8_t flags;
+    uint8_t zone;
+};
+
+// Weekday helpers (0 = SUNDAY ... 6 = SATURDAY, -1 = unknown)
+const char* routineDayName(int weekday);
+int routineDayFromName(const char* name, size_t length);
+
+// Parses "HH:MM" into minutes since midnight, -1 if malformed
+int routineParseTime(const char* str, size_t length);
+
+// Parses a routine_data payload, the Python dict literal the backend sends:
+//   {'id': 7, 'name': 'Noche', 'condition': '60', 'isDry': True,
+//    'startTime': '22:00', 'endTime': '06:00', 'days': ['MONDAY', 'FRIDAY']}
+// in one pass over the bytes, without allocating. Double-quoted strings and
+// JSON literals are accepted too, unknown keys are skipped and unknown day
+// names ignored. The condition is compiled into condition, see
+// conditionCompile() for its syntax. Returns false, leaving routine and
+// condition undefined, if the payload is malformed, the condition does not
+// compile or any of the keys above is missing. name must hold
+// ROUTINE_NAME_LENGTH bytes; longer names are truncated. The optional
+// 'ubication' key, the zone the routine belongs to, goes to ubication
+// (UBICATION_LENGTH bytes, empty if absent or None) when it is not null.
+bool routineParseData(const char* data, size_t length, Routine& routine, RoutineCondition& condition, char* name,
+                      char* ubication = nullptr);
+
+// Writes "HH:MM" into out (at least 6 bytes)
+void routineFormatTime(uint16_t minuteOfDay, char* out);
+
+#endif
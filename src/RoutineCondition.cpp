@@ -0,0 +1,346 @@
+#include "RoutineCondition.h"
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+namespace {
+
+// Comparisons: op, input, float constant[, float hysteresis]
+const uint8_t OP_GT = 0x00;
+const uint8_t OP_GE = 0x01;
+const uint8_t OP_LT = 0x02;
+const uint8_t OP_LE = 0x03;
+const uint8_t OP_COMPARE_MASK = 0x03;
+const uint8_t OP_HYSTERESIS = 0x04;     // Flag on a comparison
+// Logic, no operands
+const uint8_t OP_AND = 0x10;
+const uint8_t OP_OR = 0x11;
+const uint8_t OP_NOT = 0x12;
+
+const int MAX_NESTING = 8;              // Of parentheses and negations
+
+const char* const INPUT_NAMES[INPUT_COUNT] = { "temperature", "humidity", "ica" };
+const char* const COMPARE_NAMES[4] = { ">", ">=", "<", "<=" };
+
+struct Compiler {
+    const char* p;
+    const char* end;
+    RoutineCondition* out;
+    int depth;                          // Values on the stack at this point
+    int nesting;
+};
+
+bool isWordChar(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+void skipSpace(Compiler& c) {
+    while (c.p < c.end && (*c.p == ' ' || *c.p == '\t')) {
+        c.p++;
+    }
+}
+
+// An operator token, or a keyword not followed by more of a word
+bool accept(Compiler& c, const char* token) {
+    skipSpace(c);
+    size_t length = strlen(token);
+    if ((size_t)(c.end - c.p) < length || strncasecmp(c.p, token, length) != 0) {
+        return false;
+    }
+    if (isWordChar(token[0]) && c.p + length < c.end && isWordChar(c.p[length])) {
+        return false;
+    }
+    c.p += length;
+    return true;
+}
+
+bool readNumber(Compiler& c, float& value) {
+    skipSpace(c);
+    char buffer[24];
+    size_t length = 0;
+    while (c.p + length < c.end && length < sizeof(buffer) - 1 &&
+           (c.p[length] == '-' || c.p[length] == '+' || c.p[length] == '.' ||
+            (c.p[length] >= '0' && c.p[length] <= '9'))) {
+        buffer[length] = c.p[length];
+        length++;
+    }
+    if (length == 0) {
+        return false;
+    }
+    buffer[length] = '\0';
+
+    char* parsed;
+    value = strtof(buffer, &parsed);
+    if (parsed != buffer + length || isnan(value) || isinf(value)) {
+        return false;
+    }
+    c.p += length;
+    return true;
+}
+
+bool emit(Compiler& c, const void* bytes, size_t length) {
+    if (c.out->length + length > (size_t)CONDITION_CODE_LENGTH) {
+        return false;
+    }
+    memcpy(c.out->code + c.out->length, bytes, length);
+    c.out->length += length;
+    return true;
+}
+
+bool emitCompare(Compiler& c, uint8_t op, uint8_t input, float constant, float hysteresis) {
+    if (c.depth >= CONDITION_STACK_DEPTH) {
+        return false;
+    }
+    if (hysteresis > 0) {
+        op |= OP_HYSTERESIS;
+    }
+    uint8_t header[2] = { op, input };
+    if (!emit(c, header, sizeof(header)) || !emit(c, &constant, sizeof(constant)) ||
+        (hysteresis > 0 && !emit(c, &hysteresis, sizeof(hysteresis)))) {
+        return false;
+    }
+    c.out->inputs |= 1 << input;
+    c.depth++;
+    return true;
+}
+
+bool emitLogic(Compiler& c, uint8_t op) {
+    if (!emit(c, &op, 1)) {
+        return false;
+    }
+    if (op != OP_NOT) {
+        c.depth--;
+    }
+    return true;
+}
+
+bool parseOr(Compiler& c, bool negated);
+
+bool parseCompare(Compiler& c, bool negated) {
+    int input = -1;
+    if (accept(c, "temperature") || accept(c, "temp")) {
+        input = INPUT_TEMPERATURE;
+    } else if (accept(c, "humidity") || accept(c, "hum")) {
+        input = INPUT_HUMIDITY;
+    } else if (accept(c, "ica")) {
+        input = INPUT_ICA;
+    } else {
+        return false;
+    }
+
+    // Two-character operators first
+    uint8_t op;
+    if (accept(c, ">=")) op = OP_GE;
+    else if (accept(c, "<=")) op = OP_LE;
+    else if (accept(c, ">")) op = OP_GT;
+    else if (accept(c, "<")) op = OP_LT;
+    else return false;
+
+    float constant;
+    float hysteresis = 0;
+    if (!readNumber(c, constant)) {
+        return false;
+    }
+    if (accept(c, "~")) {
+        // Under a negation it would widen the side that switches off
+        if (negated || !readNumber(c, hysteresis) || hysteresis < 0) {
+            return false;
+        }
+    }
+    return emitCompare(c, op, input, constant, hysteresis);
+}
+
+bool parseFactor(Compiler& c, bool negated) {
+    if (accept(c, "!") || accept(c, "not")) {
+        if (++c.nesting > MAX_NESTING || !parseFactor(c, !negated)) {
+            return false;
+        }
+        c.nesting--;
+        return emitLogic(c, OP_NOT);
+    }
+    if (accept(c, "(")) {
+        if (++c.nesting > MAX_NESTING || !parseOr(c, negated) || !accept(c, ")")) {
+            return false;
+        }
+        c.nesting--;
+        return true;
+    }
+    return parseCompare(c, negated);
+}
+
+bool parseAnd(Compiler& c, bool negated) {
+    if (!parseFactor(c, negated)) {
+        return false;
+    }
+    while (accept(c, "&&") || accept(c, "and")) {
+        if (!parseFactor(c, negated) || !emitLogic(c, OP_AND)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool parseOr(Compiler& c, bool negated) {
+    if (!parseAnd(c, negated)) {
+        return false;
+    }
+    while (accept(c, "||") || accept(c, "or")) {
+        if (!parseAnd(c, negated) || !emitLogic(c, OP_OR)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Operator precedence of a formatted operand, to know when it needs parentheses
+enum Precedence : uint8_t { PREC_OR, PREC_AND, PREC_ATOM };
+
+}
+
+bool conditionCompile(const char* text, size_t length, bool isDry, RoutineCondition& condition) {
+    Compiler c = { text, text + length, &condition, 0, 0 };
+    condition.length = 0;
+    condition.inputs = 0;
+
+    // Legacy form: just the humidity threshold
+    float threshold;
+    if (readNumber(c, threshold)) {
+        skipSpace(c);
+        if (c.p != c.end) {
+            return false;
+        }
+        return emitCompare(c, isDry ? OP_GT : OP_LT, INPUT_HUMIDITY, threshold, 0);
+    }
+
+    if (!parseOr(c, false)) {
+        return false;
+    }
+    skipSpace(c);
+    return c.p == c.end && c.depth == 1;
+}
+
+bool conditionEvaluate(const RoutineCondition& condition, const float* inputs, bool active, ConditionBands* bands) {
+    bool stack[CONDITION_STACK_DEPTH];
+    int top = 0;
+    const uint8_t* pc = condition.code;
+    const uint8_t* end = pc + condition.length;
+
+    // The compiler guarantees operands and stack room, so nothing is
+    // checked here
+    while (pc < end) {
+        uint8_t op = *pc++;
+        if (op == OP_AND) {
+            top--;
+            stack[top - 1] = stack[top - 1] && stack[top];
+        } else if (op == OP_OR) {
+            top--;
+            stack[top - 1] = stack[top - 1] || stack[top];
+        } else if (op == OP_NOT) {
+            stack[top - 1] = !stack[top - 1];
+        } else {
+            uint8_t input = *pc++;
+            float constant;
+            memcpy(&constant, pc, sizeof(constant));
+            pc += sizeof(constant);
+            uint8_t compare = op & OP_COMPARE_MASK;
+            if (op & OP_HYSTERESIS) {
+                float hysteresis;
+                memcpy(&hysteresis, pc, sizeof(hysteresis));
+                pc += sizeof(hysteresis);
+                if (active) {
+                    constant += (compare == OP_LT || compare == OP_LE) ? hysteresis : -hysteresis;
+                }
+            }
+
+            float value = inputs[input];
+            if (bands) {
+                if (constant < value) {
+                    bands->low[input] = fmaxf(bands->low[input], constant);
+                } else if (constant > value) {
+                    bands->high[input] = fminf(bands->high[input], constant);
+                } else {
+                    bands->exact[input] = true;
+                    bands->low[input] = value;
+                }
+            }
+
+            bool result;
+            switch (compare) {
+                case OP_GT: result = value > constant; break;
+                case OP_GE: result = value >= constant; break;
+                case OP_LT: result = value < constant; break;
+                default: result = value <= constant; break;
+            }
+            stack[top++] = result;
+        }
+    }
+    return top > 0 && stack[top - 1];
+}
+
+void conditionResetBands(ConditionBands& bands) {
+    for (int i = 0; i < INPUT_COUNT; i++) {
+        bands.low[i] = -INFINITY;
+        bands.high[i] = INFINITY;
+        bands.exact[i] = false;
+    }
+}
+
+bool conditionInBands(const ConditionBands& bands, const float* inputs) {
+    for (int i = 0; i < INPUT_COUNT; i++) {
+        if (bands.exact[i] ? inputs[i] != bands.low[i]
+                           : !(inputs[i] > bands.low[i] && inputs[i] < bands.high[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void conditionFormat(const RoutineCondition& condition, char* out, size_t size) {
+    // Operands are formatted onto a stack of strings, like the VM's values
+    char parts[CONDITION_STACK_DEPTH][CONDITION_TEXT_LENGTH];
+    Precedence precedence[CONDITION_STACK_DEPTH];
+    char joined[CONDITION_TEXT_LENGTH];
+    int top = 0;
+    const uint8_t* pc = condition.code;
+    const uint8_t* end = pc + condition.length;
+
+    while (pc < end) {
+        uint8_t op = *pc++;
+        if (op == OP_AND || op == OP_OR) {
+            top--;
+            bool isAnd = op == OP_AND;
+            // OR binds looser than AND, so only it needs parentheses under one
+            bool wrapLeft = isAnd && precedence[top - 1] == PREC_OR;
+            bool wrapRight = isAnd && precedence[top] == PREC_OR;
+            snprintf(joined, sizeof(joined), "%s%s%s %s %s%s%s", wrapLeft ? "(" : "", parts[top - 1],
+                     wrapLeft ? ")" : "", isAnd ? "&&" : "||", wrapRight ? "(" : "", parts[top], wrapRight ? ")" : "");
+            memcpy(parts[top - 1], joined, sizeof(joined));
+            precedence[top - 1] = isAnd ? PREC_AND : PREC_OR;
+        } else if (op == OP_NOT) {
+            bool wrap = precedence[top - 1] != PREC_ATOM;
+            snprintf(joined, sizeof(joined), "!%s%s%s", wrap ? "(" : "", parts[top - 1], wrap ? ")" : "");
+            memcpy(parts[top - 1], joined, sizeof(joined));
+            precedence[top - 1] = PREC_ATOM;
+        } else {
+            uint8_t input = *pc++;
+            float constant;
+            memcpy(&constant, pc, sizeof(constant));
+            pc += sizeof(constant);
+            if (op & OP_HYSTERESIS) {
+                float hysteresis;
+                memcpy(&hysteresis, pc, sizeof(hysteresis));
+                pc += sizeof(hysteresis);
+                snprintf(parts[top], CONDITION_TEXT_LENGTH, "%s %s %g ~ %g", INPUT_NAMES[input],
+                         COMPARE_NAMES[op & OP_COMPARE_MASK], constant, hysteresis);
+            } else {
+                snprintf(parts[top], CONDITION_TEXT_LENGTH, "%s %s %g", INPUT_NAMES[input],
+                         COMPARE_NAMES[op & OP_COMPARE_MASK], constant);
+            }
+            precedence[top] = PREC_ATOM;
+            top++;
+        }
+    }
+    snprintf(out, size, "%s", top > 0 ? parts[top - 1] : "");
+}
@@ -0,0 +1,67 @@
+#ifndef ROUTINE_CONDITION_H
+#define ROUTINE_CONDITION_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Zone values a condition can read
+enum ConditionInput : uint8_t {
+    INPUT_TEMPERATURE,
+    INPUT_HUMIDITY,
+    INPUT_ICA,
+    INPUT_COUNT
+};
+
+const int CONDITION_CODE_LENGTH = 46;
+const int CONDITION_STACK_DEPTH = 8;
+const int CONDITION_TEXT_LENGTH = 64;   // conditionFormat() output, terminator included
+
+// A routine condition compiled at load time into postfix bytecode. Each
+// comparison pushes one boolean, AND, OR and NOT pop their operands and push
+// the result; a compiled program leaves exactly one value. Comparisons hold
+// their constant inline, so evaluation is a walk over the bytes with a
+// fixed-size stack: no parsing, no allocation.
+struct RoutineCondition {
+    uint8_t length;                     // Bytes of code in use
+    uint8_t inputs;                     // Bit per ConditionInput read
+    uint8_t code[CONDITION_CODE_LENGTH];
+};
+
+// For each input, the interval between the nearest constants below and above
+// it that an evaluation compared it with, or the constant it sat exactly on.
+// While every input stays inside its band, every comparison, and so the
+// result, comes out the same.
+struct ConditionBands {
+    float low[INPUT_COUNT];
+    float high[INPUT_COUNT];
+    bool exact[INPUT_COUNT];
+};
+
+// Compiles a routine's 'condition' text:
+//
+//   humidity > 60                          a single comparison
+//   humidity > 60 ~ 3                      with hysteresis (see below)
+//   temperature >= 18 && (ica < 50 || !(humidity <= 40))
+//
+// Inputs are temperature (temp), humidity (hum) and ica; operators > >= < <=;
+// && || ! or and, or, not, with the usual precedence. A bare number is the
+// legacy form: humidity above it for a dry routine, below it otherwise.
+// Hysteresis moves a comparison's threshold by the given amount towards
+// staying true while its routine is the zone's active one, so it switches on
+// at 60 and off below 57; it is rejected under a negation. Returns false on
+// a syntax error or when the program would not fit.
+bool conditionCompile(const char* text, size_t length, bool isDry, RoutineCondition& condition);
+
+// inputs is indexed by ConditionInput. active tells whether the routine is
+// the one driving its zone right now, which engages hysteresis. When bands is
+// given, every comparison narrows the band of its input.
+bool conditionEvaluate(const RoutineCondition& condition, const float* inputs, bool active,
+                       ConditionBands* bands = nullptr);
+
+void conditionResetBands(ConditionBands& bands);
+bool conditionInBands(const ConditionBands& bands, const float* inputs);
+
+// Writes the condition back as text, truncated to size
+void conditionFormat(const RoutineCondition& condition, char* out, size_t size);
+
+#endif
@@ -0,0 +1,153 @@
+#ifndef ROUTINE_TABLE_H
+#define ROUTINE_TABLE_H
+
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+#include "Routine.h"
+#include "RoutineCondition.h"
+
+// A complete set of routines in server order, with their conditions and
+// names alongside.
+template <int N>
+struct RoutineSet {
+    Routine routines[N];
+    RoutineCondition conditions[N];
+    char names[N][ROUTINE_NAME_LENGTH];
+    int count;
+
+    int find(int32_t id) const {
+        for (int i = 0; i < count; i++) {
+            if (routines[i].id == id) return i;
+        }
+        return -1;
+    }
+
+    // Replaces the routine with the same id, or adds it. Returns its index,
+    // -1 if the set is full.
+    int upsert(const Routine& routine, const RoutineCondition& condition, const char* name) {
+        int index = find(routine.id);
+        if (index < 0) {
+            if (count >= N) return -1;
+            index = count++;
+        }
+        routines[index] = routine;
+        conditions[index] = condition;
+        strncpy(names[index], name, ROUTINE_NAME_LENGTH - 1);
+        names[index][ROUTINE_NAME_LENGTH - 1] = '\0';
+        return index;
+    }
+
+    bool remove(int32_t id) {
+        int index = find(id);
+        if (index < 0) {
+            return false;
+        }
+        // Keep the server's order for the routines that remain
+        int after = count - index - 1;
+        memmove(&routines[index], &routines[index + 1], after * sizeof(Routine));
+        memmove(&conditions[index], &conditions[index + 1], after * sizeof(RoutineCondition));
+        memmove(names[index], names[index + 1], after * ROUTINE_NAME_LENGTH);
+        count--;
+        return true;
+    }
+
+    void copyFrom(const RoutineSet& other) {
+        count = other.count;
+        memcpy(routines, other.routines, count * sizeof(Routine));
+        memcpy(conditions, other.conditions, count * sizeof(RoutineCondition));
+        memcpy(names, other.names, count * ROUTINE_NAME_LENGTH);
+    }
+};
+
+// Double-buffered routine table for one writer task and one reader task,
+// read-copy-update style. The writer builds the next set in the buffer the
+// reader is not using, starting from a copy of the published one, and
+// publishes it with a single store of the generation counter; the low bit
+// picks the buffer. A set is never changed once published, so the reader
+// neither locks nor sees one half-built, and an update cut short is simply
+// abandoned.
+//
+// The reader brackets its use of a set with acquire() and release(), and
+// must not keep references past release(). The writer may only reuse a
+// buffer once the reader has let go of it: acquire() announces the
+// generation being read, and beginUpdate() returns null while that is the
+// previous one. A reader that releases on every pass of its loop is rarely
+// in the way for long.
+template <int N>
+class RoutineTable {
+public:
+    RoutineTable() : generation(FIRST), readerGeneration(FIRST), updating(false) {
+        sets[0].count = 0;
+        sets[1].count = 0;
+    }
+
+    // Reader side. Returns the generation now held, whose set read() gives.
+    // Until its first release() the reader holds the initial, empty set.
+    uint32_t acquire() {
+        uint32_t current = generation.load();
+        for (;;) {
+            readerGeneration.store(current);
+            // The writer looks at readerGeneration after publishing, so a set
+            // published since the load above must be the one taken
+            uint32_t latest = generation.load();
+            if (latest == current) return current;
+            current = latest;
+        }
+    }
+
+    const RoutineSet<N>& read(uint32_t held) const {
+        return sets[held & 1];
+    }
+
+    void release() {
+        readerGeneration.store(IDLE);
+    }
+
+    // Writer side. Returns the set to build, a copy of the published one,
+    // or null while the reader may still be on the spare buffer.
+    RoutineSet<N>* beginUpdate() {
+        uint32_t current = generation.load(std::memory_order_relaxed);
+        if (readerGeneration.load() == current - 1) {
+            return nullptr;
+        }
+        RoutineSet<N>& next = sets[(current + 1) & 1];
+        next.copyFrom(sets[current & 1]);
+        updating = true;
+        return &next;
+    }
+
+    // The set being built, null outside beginUpdate() and publish()/abandon()
+    RoutineSet<N>* getUpdate() {
+        return updating ? &sets[(generation.load(std::memory_order_relaxed) + 1) & 1] : nullptr;
+    }
+
+    void publish() {
+        if (updating) {
+            generation.store(generation.load(std::memory_order_relaxed) + 1);
+            updating = false;
+        }
+    }
+
+    void abandon() {
+        updating = false;
+    }
+
+    // Writer side: the published set, which only the writer replaces
+    const RoutineSet<N>& getPublished() const {
+        return sets[generation.load(std::memory_order_relaxed) & 1];
+    }
+
+private:
+    // 0 marks an idle reader; starting at 2 keeps the generation before any
+    // published one clear of it. 2^32 publications are not a concern.
+    static const uint32_t IDLE = 0;
+    static const uint32_t FIRST = 2;
+
+    RoutineSet<N> sets[2];
+    std::atomic<uint32_t> generation;       // sets[generation & 1] is published
+    std::atomic<uint32_t> readerGeneration; // Held by the reader, or IDLE
+    bool updating;
+};
+
+#endif
@@ -0,0 +1,175 @@
+#ifndef SCHEDULE_INDEX_H
+#define SCHEDULE_INDEX_H
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include "Routine.h"
+
+// Weekly schedule of a routine table, built once per load.
+//
+// Every routine contributes one active interval per configured day (two
+// when start > end, mirroring the overnight wrap of
+// StateManager::isTimeInRange). Each interval becomes an "on" event at its
+// first minute and an "off" event after its last one; events are kept
+// sorted by minute of week. The candidate set (routines whose day and time
+// match) is maintained incrementally by replaying the events between the
+// last queried minute and the new one, which is O(1) amortized for a
+// clock that moves forward, and any jump (NTP sync, week wrap, backwards)
+// is still exact because the events form a closed weekly cycle.
+//
+// The generation counter moves whenever the candidate set changes, so a
+// caller can tell that nothing did since its last look without comparing
+// the sets.
+template <int MaxRoutines>
+class ScheduleIndex {
+public:
+    static const int MINUTES_PER_DAY = 24 * 60;
+    static const int MINUTES_PER_WEEK = 7 * MINUTES_PER_DAY;
+
+    ScheduleIndex() : generation(0) { clear(); }
+
+    void clear() {
+        eventCount = 0;
+        routineCount = 0;
+        cursorMinute = MINUTES_PER_WEEK - 1;
+        cursorEvent = 0;
+        memset(activeCount, 0, sizeof(activeCount));
+        memset(candidateBits, 0, sizeof(candidateBits));
+        generation++;
+    }
+
+    void build(const Routine* routines, int count) {
+        clear();
+        routineCount = count < MaxRoutines ? count : MaxRoutines;
+
+        for (int r = 0; r < routineCount; r++) {
+            const Routine& routine = routines[r];
+            for (int day = 0; day < 7; day++) {
+                if (!(routine.dayMask & (1 << day))) continue;
+
+                int base = day * MINUTES_PER_DAY;
+                if (routine.startMinute <= routine.endMinute) {
+                    addInterval(r, base + routine.startMinute, base + routine.endMinute);
+                } else {
+                    addInterval(r, base, base + routine.endMinute);
+                    addInterval(r, base + routine.startMinute, base + MINUTES_PER_DAY - 1);
+                }
+            }
+        }
+
+        std::sort(events, events + eventCount, [](const Event& a, const Event& b) {
+            return a.minute < b.minute;
+        });
+
+        // Seed the state at the last minute of the week; no event is later,
+        // so the cursor starts past the end and wraps on the first query.
+        for (int r = 0; r < routineCount; r++) {
+            const Routine& routine = routines[r];
+            bool saturday = (routine.dayMask & (1 << 6)) != 0;
+            bool untilMidnight = routine.startMinute > routine.endMinute ||
+                                 routine.endMinute == MINUTES_PER_DAY - 1;
+            if (saturday && untilMidnight) {
+                activeCount[r] = 1;
+                setCandidate(r, true);
+            }
+        }
+        cursorEvent = eventCount;
+    }
+
+    // Moves the index to the given minute of week (0 = SUNDAY 00:00)
+    void advanceTo(int minuteOfWeek) {
+        if (minuteOfWeek == cursorMinute) return;
+
+        if (minuteOfWeek < cursorMinute) {
+            while (cursorEvent < eventCount) apply(events[cursorEvent++]);
+            cursorEvent = 0;
+        }
+        while (cursorEvent < eventCount && events[cursorEvent].minute <= minuteOfWeek) {
+            apply(events[cursorEvent++]);
+        }
+        cursorMinute = minuteOfWeek;
+    }
+
+    bool isCandidate(int index) const {
+        return (candidateBits[index >> 5] >> (index & 31)) & 1;
+    }
+
+    // First candidate at or after index, -1 when there are none left
+    int nextCandidate(int index) const {
+        while (index < routineCount) {
+            uint32_t word = candidateBits[index >> 5] >> (index & 31);
+            if (word) {
+                int found = index + __builtin_ctz(word);
+                return found < routineCount ? found : -1;
+            }
+            index = (index | 31) + 1;
+        }
+        return -1;
+    }
+
+    int getCandidateCount() const {
+        int count = 0;
+        for (int i = 0; i < WORDS; i++) count += __builtin_popcount(candidateBits[i]);
+        return count;
+    }
+
+    // Minute of week at which the candidate set next changes after the given
+    // one (wrapping into next week), -1 when no routine is scheduled
+    int nextScheduleChange(int minuteOfWeek) const {
+        if (eventCount == 0) return -1;
+
+        const Event* next = std::upper_bound(events, events + eventCount, minuteOfWeek,
+            [](int minute, const Event& e) { return minute < e.minute; });
+        return next == events + eventCount ? events[0].minute : next->minute;
+    }
+
+    int getEventCount() const { return eventCount; }
+
+    uint32_t getGeneration() const { return generation; }
+
+private:
+    struct Event {
+        uint16_t minute;
+        uint16_t routine;   // Routine index, EVENT_ON set for interval starts
+    };
+
+    static const uint16_t EVENT_ON = 0x8000;
+    static const int MAX_EVENTS = MaxRoutines * 7 * 4;
+    static const int WORDS = (MaxRoutines + 31) / 32;
+
+    Event events[MAX_EVENTS];
+    uint8_t activeCount[MaxRoutines];
+    uint32_t candidateBits[WORDS];
+    int eventCount;
+    int routineCount;
+    int cursorMinute;
+    int cursorEvent;    // First event later than cursorMinute
+    uint32_t generation;
+
+    void addInterval(int routine, int first, int last) {
+        events[eventCount++] = { (uint16_t)first, (uint16_t)(routine | EVENT_ON) };
+        events[eventCount++] = { (uint16_t)((last + 1) % MINUTES_PER_WEEK), (uint16_t)routine };
+    }
+
+    void apply(const Event& event) {
+        int r = event.routine & ~EVENT_ON;
+        if (event.routine & EVENT_ON) {
+            if (activeCount[r]++ == 0) setCandidate(r, true);
+        } else if (activeCount[r] > 0) {
+            if (--activeCount[r] == 0) setCandidate(r, false);
+        }
+    }
+
+    void setCandidate(int index, bool candidate) {
+        uint32_t bit = 1u << (index & 31);
+        generation++;
+        if (candidate) {
+            candidateBits[index >> 5] |= bit;
+        } else {
+            candidateBits[index >> 5] &= ~bit;
+        }
+    }
+};
+
+#endif
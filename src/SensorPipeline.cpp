@@ -0,0 +1,143 @@
+#include "SensorPipeline.h"
+#include <string.h>
+#include <math.h>
+
+namespace {
+
+// Sorts values in place
+float medianOf(float* values, int count) {
+    for (int i = 1; i < count; i++) {
+        float key = values[i];
+        int j = i - 1;
+        while (j >= 0 && values[j] > key) {
+            values[j + 1] = values[j];
+            j--;
+        }
+        values[j + 1] = key;
+    }
+    return count % 2 ? values[count / 2] : (values[count / 2 - 1] + values[count / 2]) / 2;
+}
+
+}
+
+SensorPipeline::SensorPipeline(float temperatureLimit, float humidityLimit)
+    : recentCount(0), recentNext(0), windowCount(0), windowNext(0) {
+    temperature.limit = temperatureLimit;
+    humidity.limit = humidityLimit;
+    memset(&stats, 0, sizeof(stats));
+}
+
+bool SensorPipeline::Channel::isOutlier(float value, int recentCount) const {
+    // Too little history to tell a glitch from the real value
+    if (recentCount < MEDIAN_WINDOW / 2) {
+        return false;
+    }
+
+    float sorted[MEDIAN_WINDOW + 1];
+    memcpy(sorted, recent, recentCount * sizeof(float));
+    sorted[recentCount] = value;
+    return fabsf(value - medianOf(sorted, recentCount + 1)) > limit;
+}
+
+float SensorPipeline::Channel::recentMedian(int recentCount) const {
+    float sorted[MEDIAN_WINDOW];
+    memcpy(sorted, recent, recentCount * sizeof(float));
+    return medianOf(sorted, recentCount);
+}
+
+SensorWindow SensorPipeline::Channel::summarize(int count) const {
+    SensorWindow result = { 0, 0, 0 };
+    if (count == 0) {
+        return result;
+    }
+    result.min = window[0];
+    result.max = window[0];
+    float sum = 0;
+    for (int i = 0; i < count; i++) {
+        if (window[i] < result.min) result.min = window[i];
+        if (window[i] > result.max) result.max = window[i];
+        sum += window[i];
+    }
+    result.mean = sum / count;
+    return result;
+}
+
+bool SensorPipeline::addReading(float temperatureValue, float humidityValue) {
+    if (isnan(temperatureValue) || isnan(humidityValue)) {
+        addFailure();
+        return false;
+    }
+    stats.reads++;
+    stats.consecutiveFailures = 0;
+
+    bool outlier = temperature.isOutlier(temperatureValue, recentCount) ||
+                   humidity.isOutlier(humidityValue, recentCount);
+    bool firstCheck = recentCount == MEDIAN_WINDOW / 2;
+
+    // Rejected readings still enter the median window, so a lasting change
+    // is followed after a couple of samples
+    temperature.recent[recentNext] = temperatureValue;
+    humidity.recent[recentNext] = humidityValue;
+    recentNext = (recentNext + 1) % MEDIAN_WINDOW;
+    if (recentCount < MEDIAN_WINDOW) recentCount++;
+
+    if (firstCheck) {
+        // The readings let in unchecked are checked now against the first
+        // median, so an early glitch does not linger in the window
+        float temperatureMedian = temperature.recentMedian(recentCount);
+        float humidityMedian = humidity.recentMedian(recentCount);
+        windowCount = 0;
+        windowNext = 0;
+        for (int i = 0; i < recentCount - 1; i++) {
+            if (fabsf(temperature.recent[i] - temperatureMedian) <= temperature.limit &&
+                fabsf(humidity.recent[i] - humidityMedian) <= humidity.limit) {
+                pushWindow(temperature.recent[i], humidity.recent[i]);
+            } else {
+                stats.outliers++;
+            }
+        }
+    }
+
+    if (outlier) {
+        stats.outliers++;
+        return false;
+    }
+    pushWindow(temperatureValue, humidityValue);
+    return true;
+}
+
+void SensorPipeline::pushWindow(float temperatureValue, float humidityValue) {
+    temperature.window[windowNext] = temperatureValue;
+    humidity.window[windowNext] = humidityValue;
+    windowNext = (windowNext + 1) % AGGREGATE_WINDOW;
+    if (windowCount < AGGREGATE_WINDOW) windowCount++;
+}
+
+void SensorPipeline::addFailure() {
+    stats.reads++;
+    stats.failures++;
+    stats.consecutiveFailures++;
+    if (stats.consecutiveFailures > stats.maxConsecutiveFailures) {
+        stats.maxConsecutiveFailures = stats.consecutiveFailures;
+    }
+}
+
+bool SensorPipeline::hasData() const {
+    return windowCount > 0;
+}
+
+int SensorPipeline::getSampleCount() const {
+    return windowCount;
+}
+
+SensorWindow SensorPipeline::getTemperature() const {
+    return temperature.summarize(windowCount);
+}
+
+SensorWindow SensorPipeline::getHumidity() const {
+    return humidity.summarize(windowCount);
+}
+
+const SensorStats& SensorPipeline::getStats() const {
+    return stats;
+}
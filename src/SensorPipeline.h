@@ -0,0 +1,69 @@
+#ifndef SENSOR_PIPELINE_H
+#define SENSOR_PIPELINE_H
+
+#include <stdint.h>
+
+// Rolling min, max and mean over the readings kept in the window
+struct SensorWindow {
+    float min;
+    float max;
+    float mean;
+};
+
+struct SensorStats {
+    unsigned long reads;                  // Attempts, failed ones included
+    unsigned long failures;               // No reading (timeout, checksum, NaN)
+    unsigned long outliers;               // Rejected as too far from the median
+    unsigned long consecutiveFailures;
+    unsigned long maxConsecutiveFailures;
+};
+
+// Acquisition stage for one temperature/humidity sensor. Each reading is
+// compared with the median of the last MEDIAN_WINDOW raw readings, itself
+// included; one that strays further than the channel's limit is rejected
+// as a glitch. A real step change still gets through once it makes up
+// most of the median window. Accepted readings go into a window of
+// AGGREGATE_WINDOW samples, whose mean is what control and uploads use.
+// The first readings are accepted before there is a median to check them
+// against, and checked again once there is. Fixed-size, no allocation.
+class SensorPipeline {
+public:
+    static const int MEDIAN_WINDOW = 5;
+    static const int AGGREGATE_WINDOW = 6;
+
+    SensorPipeline(float temperatureLimit = 3.0f, float humidityLimit = 10.0f);
+
+    // Returns true if the reading was accepted into the window
+    bool addReading(float temperature, float humidity);
+    void addFailure();
+
+    bool hasData() const;
+    int getSampleCount() const;           // Readings in the window
+    // All zero while the window is empty; check hasData() first
+    SensorWindow getTemperature() const;
+    SensorWindow getHumidity() const;
+    const SensorStats& getStats() const;
+
+private:
+    struct Channel {
+        float limit;
+        float recent[MEDIAN_WINDOW];      // Raw readings, rejected ones too
+        float window[AGGREGATE_WINDOW];   // Accepted readings
+
+        bool isOutlier(float value, int recentCount) const;
+        float recentMedian(int recentCount) const;
+        SensorWindow summarize(int count) const;
+    };
+
+    Channel temperature;
+    Channel humidity;
+    int recentCount;
+    int recentNext;
+    int windowCount;
+    int windowNext;
+    SensorStats stats;
+
+    void pushWindow(float temperatureValue, float humidityValue);
+};
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <atomic>
+#include <stdint.h>
+
+// Double-buffered copy of one task's state for one other task to read, with
+// RoutineTable's generation protocol. The writer fills the buffer the reader
+// is not using and publishes it with a single store; the reader brackets its
+// use with acquire() and release() and never sees a copy half-written.
+// Unlike a routine set, each copy is written whole, so a writer turned away
+// by beginUpdate() just tries again at its next chance.
+template <typename T>
+class Snapshot {
+public:
+    // Both buffers start value-initialized, so a reader before the first
+    // publish sees zeros
+    Snapshot() : buffers(), generation(FIRST), readerGeneration(IDLE) {}
+
+    // Reader side
+    uint32_t acquire() {
+        uint32_t current = generation.load();
+        for (;;) {
+            readerGeneration.store(current);
+            uint32_t latest = generation.load();
+            if (latest == current) return current;
+            current = latest;
+        }
+    }
+
+    const T& read(uint32_t held) const {
+        return buffers[held & 1];
+    }
+
+    void release() {
+        readerGeneration.store(IDLE);
+    }
+
+    // Writer side. Returns the buffer to fill, or null while the reader may
+    // still be on it.
+    T* beginUpdate() {
+        uint32_t current = generation.load(std::memory_order_relaxed);
+        if (readerGeneration.load() == current - 1) {
+            return nullptr;
+        }
+        return &buffers[(current + 1) & 1];
+    }
+
+    void publish() {
+        generation.store(generation.load(std::memory_order_relaxed) + 1);
+    }
+
+private:
+    static const uint32_t IDLE = 0;
+    static const uint32_t FIRST = 2;
+
+    T buffers[2];
+    std::atomic<uint32_t> generation;       // buffers[generation & 1] is published
+    std::atomic<uint32_t> readerGeneration; // Held by the reader, or IDLE
+};
+
+#endif
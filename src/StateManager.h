@@ -2,74 +2,146 @@
 #define STATE_MANAGER_H
 
 #include <Arduino.h>
+#include "Hal.h"
+#include "Routine.h"
+#include "ScheduleIndex.h"
+#include "RoutineTable.h"
+#include "TaskMessages.h"
 
-struct DeviceState {
-    float temperature;
-    float humidity;
-    int ICA;
-    bool estado_device;
-    bool estado_device_original;
-    String active_device_type;
-    String api_error_message;
+// Per-zone device state in structure-of-arrays form: one array per field,
+// indexed by zone. Evaluation walks a field across every zone at once, so
+// it touches only the arrays it needs, contiguously.
+template <int N>
+struct ZoneStates {
+    float temperature[N];
+    float humidity[N];
+    int ICA[N];
+    bool estado_device[N];
+    bool estado_device_original[N];
+    const char* active_device_type[N];      // "", "Deshumidificador" or "Humidificador"
     
     // Device configuration
-    int ICA_min_device;
-    int ICA_max_device;
-    float Temp_min_device;
-    float Temp_max_device;
-    float humidity_min_device;
-    float humidity_max_device;
+    int ICA_min_device[N];
+    int ICA_max_device[N];
+    float Temp_min_device[N];
+    float Temp_max_device[N];
+    float humidity_min_device[N];
+    float humidity_max_device[N];
 };
 
-struct Routine {
-    int id;
-    String name;
-    String condition;
-    String days[7];
-    int dayCount;
-    String startTime;
-    String endTime;
-    String ubication;
-    bool isDry;
-    bool isActive;
+// Work done by checkActiveRoutines(). A zone is skipped when none of the
+// inputs its decision depends on changed since it was last evaluated.
+struct RoutineCheckStats {
+    unsigned long checks;
+    unsigned long zonesEvaluated;
+    unsigned long zonesSkipped;
+    unsigned long conditionsEvaluated;    // Routine conditions tested
+    unsigned long mismatches;             // CHAKIY_VERIFY_ROUTINES builds only
 };
 
+template <typename Hal = DefaultHal>
 class StateManager {
-private:
-    DeviceState deviceState;
+public:
     static const int MAX_ROUTINES = 100;
-    Routine routines[MAX_ROUTINES];
-    int routineCount;
+    static const int MAX_ZONES = 16;
+    
+private:
+    ZoneStates<MAX_ZONES> zones;
+    int zoneCount;
+    char apiErrorMessage[API_STATUS_LENGTH];   // Copied in, so a new error never allocates
+    
+    // Built and published by the network task; the control task works on
+    // the set it acquired for the current pass of its loop
+    RoutineTable<MAX_ROUTINES> routineTable;
+    const RoutineSet<MAX_ROUTINES>* routineSet;
+    uint32_t routineGeneration;           // Of routineSet; moves on every new set
+    ScheduleIndex<MAX_ROUTINES> scheduleIndex;
+    bool scheduleDirty;
+    
+    // Last routine decision of each zone and the inputs it was made from.
+    // It stays valid while the routine table and the candidate set are the
+    // same, the zone's in-range check gives the same answer and its values
+    // stay on the same side of every constant the conditions evaluated on
+    // the way compared them with (the bands).
+    struct ZoneDecisions {
+        int activeRoutine[MAX_ZONES];
+        int32_t activeRoutineId[MAX_ZONES];   // Survives table changes, for hysteresis
+        bool valid[MAX_ZONES];
+        bool inRange[MAX_ZONES];
+        ConditionBands bands[MAX_ZONES];
+        uint32_t routineGeneration;
+        uint32_t scheduleGeneration;
+        bool timeKnown;
+    };
+    ZoneDecisions decisions;
+    RoutineCheckStats checkStats;
+    
+    void ensureScheduleIndex();
+    void invalidateDecisions();
+    void readInputs(int zone, float* inputs) const;
+    bool isDecisionCurrent(int zone, bool inRange, const float* inputs) const;
+#ifdef CHAKIY_VERIFY_ROUTINES
+    int referenceDecision(int zone, bool inRange, bool timeKnown, bool hadRoutine, int32_t previousId);
+#endif
     
 public:
     StateManager();
     
+    // Zone management. Zone 0 always exists; returns the new zone's index,
+    // -1 if the table is full.
+    int addZone();
+    int getZoneCount() const;
+    
     // Device state management
-    DeviceState& getDeviceState();
-    void updateSensorData(float temp, float hum);
-    void updateDeviceConfiguration(int icaMin, int icaMax, float tempMin, float tempMax, float humMin, float humMax);
-    void setDeviceStatus(bool status, String deviceType = "");
-    void setApiError(String error);
+    ZoneStates<MAX_ZONES>& getZones();
+    void updateSensorData(int zone, float temp, float hum);
+    void updateDeviceConfiguration(int zone, int icaMin, int icaMax, float tempMin, float tempMax, float humMin, float humMax);
+    void setDeviceStatus(int zone, bool status, const char* deviceType = "");
+    void setApiError(const char* error);
+    const char* getApiError() const;
     
-    // Routine management
-    void clearRoutines();
-    bool addRoutine(const Routine& routine);
+    // Routine table, control task side. The routine accessors and checks
+    // below may only be used between acquireRoutines() and
+    // releaseRoutines(); acquireRoutines() returns true when it picked up a
+    // newly published set.
+    bool acquireRoutines();
+    void releaseRoutines();
     int getRoutineCount() const;
-    Routine* getRoutines();
+    const Routine* getRoutines() const;
+    const char* getRoutineName(int index) const;
+    const RoutineCondition& getRoutineCondition(int index) const;
+    static size_t getRoutineFootprint();
+    
+    // Network task side: the next set is built with RoutineSet's upsert()
+    // and remove() on what beginRoutineUpdate() returns (null while the
+    // control task is still on the spare buffer), then published whole or
+    // abandoned.
+    RoutineSet<MAX_ROUTINES>* beginRoutineUpdate();
+    RoutineSet<MAX_ROUTINES>* getRoutineUpdate();
+    void publishRoutines();
+    void abandonRoutineUpdate();
+    const RoutineSet<MAX_ROUTINES>& getPublishedRoutines() const;
     
     // Time utilities
-    String getCurrentDay();
-    String getCurrentTime();
-    bool isDayInRoutine(const Routine& routine, const String& currentDay);
-    bool isTimeInRange(const String& currentTime, const String& startTime, const String& endTime);
+    bool getCurrentWeekTime(int& weekday, int& minuteOfDay);
+    bool isDayInRoutine(const Routine& routine, int weekday) const;
+    bool isTimeInRange(int currentMinute, int startMinute, int endMinute) const;
+    int getNextScheduleChange();
+    long getMillisUntilScheduleChange();
     
     // Environment checks
-    bool isTemperatureInRange() const;
-    bool isHumidityInRange() const;
-    bool isEnvironmentSafe() const;
+    bool isTemperatureInRange(int zone) const;
+    bool isHumidityInRange(int zone) const;
+    bool isEnvironmentSafe(int zone) const;
     
-    // Routine logic
+    // Routine logic, for every zone in one pass over the routines in schedule.
+    // Only zones whose inputs changed are evaluated again; the others keep
+    // their last decision.
     void checkActiveRoutines();
+    const RoutineCheckStats& getRoutineCheckStats() const;
 };
 
+// Instantiated in StateManager.cpp
+extern template class StateManager<DefaultHal>;
+
 #endif
@@ -0,0 +1,483 @@
+#ifndef STATE_MANAGER_IMPL_H
+#define STATE_MANAGER_IMPL_H
+
+// Member definitions of StateManager. StateManager.cpp instantiates them for
+// DefaultHal; tests include this header to use a mock HAL instead.
+
+#include "StateManager.h"
+#include <time.h>
+#include <string.h>
+#include "Log.h"
+
+template <typename Hal>
+StateManager<Hal>::StateManager() {
+    zoneCount = 0;
+    addZone();
+    apiErrorMessage[0] = '\0';
+    
+    // Held until the first releaseRoutines(), so setup() can use it too
+    routineGeneration = routineTable.acquire();
+    routineSet = &routineTable.read(routineGeneration);
+    scheduleDirty = true;
+    for (int zone = 0; zone < MAX_ZONES; zone++) {
+        decisions.activeRoutine[zone] = -1;
+    }
+    invalidateDecisions();
+    memset(&checkStats, 0, sizeof(checkStats));
+}
+
+template <typename Hal>
+int StateManager<Hal>::addZone() {
+    if (zoneCount >= MAX_ZONES) {
+        return -1;
+    }
+    
+    int zone = zoneCount++;
+    zones.temperature[zone] = 0.0;
+    zones.humidity[zone] = 0.0;
+    zones.ICA[zone] = 42;
+    zones.estado_device[zone] = false;
+    zones.estado_device_original[zone] = false;
+    zones.active_device_type[zone] = "";
+    
+    // Device configuration defaults, until the server sends the real one
+    zones.ICA_min_device[zone] = 0;
+    zones.ICA_max_device[zone] = 0;
+    zones.Temp_min_device[zone] = 0.0;
+    zones.Temp_max_device[zone] = 0.0;
+    zones.humidity_min_device[zone] = 0.0;
+    zones.humidity_max_device[zone] = 0.0;
+    decisions.valid[zone] = false;
+    return zone;
+}
+
+template <typename Hal>
+int StateManager<Hal>::getZoneCount() const {
+    return zoneCount;
+}
+
+template <typename Hal>
+ZoneStates<StateManager<Hal>::MAX_ZONES>& StateManager<Hal>::getZones() {
+    return zones;
+}
+
+template <typename Hal>
+void StateManager<Hal>::updateSensorData(int zone, float temp, float hum) {
+    zones.temperature[zone] = temp;
+    zones.humidity[zone] = hum;
+    
+    // Calculate ICA
+    zones.ICA[zone] = (int)(abs(temp - 22) * 2 + abs(hum - 50) * 0.5);
+}
+
+template <typename Hal>
+void StateManager<Hal>::updateDeviceConfiguration(int zone, int icaMin, int icaMax, float tempMin, float tempMax,
+                                                  float humMin, float humMax) {
+    zones.ICA_min_device[zone] = icaMin;
+    zones.ICA_max_device[zone] = icaMax;
+    zones.Temp_min_device[zone] = tempMin;
+    zones.Temp_max_device[zone] = tempMax;
+    zones.humidity_min_device[zone] = humMin;
+    zones.humidity_max_device[zone] = humMax;
+}
+
+template <typename Hal>
+void StateManager<Hal>::setDeviceStatus(int zone, bool status, const char* deviceType) {
+    zones.estado_device[zone] = status;
+    if (deviceType[0] != '\0') {
+        zones.active_device_type[zone] = deviceType;
+    }
+}
+
+template <typename Hal>
+void StateManager<Hal>::setApiError(const char* error) {
+    strncpy(apiErrorMessage, error, sizeof(apiErrorMessage) - 1);
+    apiErrorMessage[sizeof(apiErrorMessage) - 1] = '\0';
+}
+
+template <typename Hal>
+const char* StateManager<Hal>::getApiError() const {
+    return apiErrorMessage;
+}
+
+template <typename Hal>
+bool StateManager<Hal>::acquireRoutines() {
+    uint32_t held = routineTable.acquire();
+    if (held == routineGeneration) {
+        return false;
+    }
+    
+    // A new set: the schedule and every cached decision refer to the old one
+    routineGeneration = held;
+    routineSet = &routineTable.read(held);
+    scheduleDirty = true;
+    return true;
+}
+
+template <typename Hal>
+void StateManager<Hal>::releaseRoutines() {
+    routineTable.release();
+}
+
+template <typename Hal>
+RoutineSet<StateManager<Hal>::MAX_ROUTINES>* StateManager<Hal>::beginRoutineUpdate() {
+    return routineTable.beginUpdate();
+}
+
+template <typename Hal>
+RoutineSet<StateManager<Hal>::MAX_ROUTINES>* StateManager<Hal>::getRoutineUpdate() {
+    return routineTable.getUpdate();
+}
+
+template <typename Hal>
+void StateManager<Hal>::publishRoutines() {
+    routineTable.publish();
+}
+
+template <typename Hal>
+void StateManager<Hal>::abandonRoutineUpdate() {
+    routineTable.abandon();
+}
+
+template <typename Hal>
+const RoutineSet<StateManager<Hal>::MAX_ROUTINES>& StateManager<Hal>::getPublishedRoutines() const {
+    return routineTable.getPublished();
+}
+
+template <typename Hal>
+int StateManager<Hal>::getRoutineCount() const {
+    return routineSet->count;
+}
+
+template <typename Hal>
+const Routine* StateManager<Hal>::getRoutines() const {
+    return routineSet->routines;
+}
+
+template <typename Hal>
+const char* StateManager<Hal>::getRoutineName(int index) const {
+    if (index < 0 || index >= routineSet->count) {
+        return "";
+    }
+    return routineSet->names[index];
+}
+
+template <typename Hal>
+const RoutineCondition& StateManager<Hal>::getRoutineCondition(int index) const {
+    return routineSet->conditions[index];
+}
+
+template <typename Hal>
+size_t StateManager<Hal>::getRoutineFootprint() {
+    // Twice: the published set and the one the next is built in
+    return 2 * (sizeof(Routine) + sizeof(RoutineCondition) + ROUTINE_NAME_LENGTH);
+}
+
+template <typename Hal>
+bool StateManager<Hal>::getCurrentWeekTime(int& weekday, int& minuteOfDay) {
+    struct tm timeinfo;
+    if (!Hal::Clock::localTime(&timeinfo)) {
+        LOG_WARN("rutinas", "Failed to obtain time");
+        weekday = -1;
+        minuteOfDay = 0;
+        return false;
+    }
+    
+    weekday = timeinfo.tm_wday;
+    minuteOfDay = timeinfo.tm_hour * 60 + timeinfo.tm_min;
+    return true;
+}
+
+template <typename Hal>
+bool StateManager<Hal>::isDayInRoutine(const Routine& routine, int weekday) const {
+    return weekday >= 0 && (routine.dayMask & (1 << weekday)) != 0;
+}
+
+template <typename Hal>
+bool StateManager<Hal>::isTimeInRange(int currentMinute, int startMinute, int endMinute) const {
+    if (startMinute <= endMinute) {
+        return (currentMinute >= startMinute && currentMinute <= endMinute);
+    } else {
+        return (currentMinute >= startMinute || currentMinute <= endMinute);
+    }
+}
+
+template <typename Hal>
+void StateManager<Hal>::ensureScheduleIndex() {
+    if (scheduleDirty) {
+        scheduleIndex.build(routineSet->routines, routineSet->count);
+        scheduleDirty = false;
+    }
+}
+
+template <typename Hal>
+int StateManager<Hal>::getNextScheduleChange() {
+    ensureScheduleIndex();
+    
+    int currentDay;
+    int currentMinute;
+    if (!getCurrentWeekTime(currentDay, currentMinute)) {
+        return -1;
+    }
+    return scheduleIndex.nextScheduleChange(currentDay * ScheduleIndex<MAX_ROUTINES>::MINUTES_PER_DAY + currentMinute);
+}
+
+template <typename Hal>
+long StateManager<Hal>::getMillisUntilScheduleChange() {
+    ensureScheduleIndex();
+    
+    struct tm timeinfo;
+    if (!Hal::Clock::localTime(&timeinfo)) {
+        return -1;
+    }
+    
+    const int minutesPerWeek = ScheduleIndex<MAX_ROUTINES>::MINUTES_PER_WEEK;
+    int minuteOfWeek = timeinfo.tm_wday * ScheduleIndex<MAX_ROUTINES>::MINUTES_PER_DAY +
+                       timeinfo.tm_hour * 60 + timeinfo.tm_min;
+    int next = scheduleIndex.nextScheduleChange(minuteOfWeek);
+    if (next < 0) {
+        return -1;
+    }
+    
+    int minutes = (next - minuteOfWeek + minutesPerWeek) % minutesPerWeek;
+    if (minutes == 0) minutes = minutesPerWeek;
+    return minutes * 60000L - timeinfo.tm_sec * 1000L;
+}
+
+template <typename Hal>
+bool StateManager<Hal>::isTemperatureInRange(int zone) const {
+    return (zones.temperature[zone] >= zones.Temp_min_device[zone] && 
+            zones.temperature[zone] <= zones.Temp_max_device[zone]);
+}
+
+template <typename Hal>
+bool StateManager<Hal>::isHumidityInRange(int zone) const {
+    return (zones.humidity[zone] >= zones.humidity_min_device[zone] && 
+            zones.humidity[zone] <= zones.humidity_max_device[zone]);
+}
+
+template <typename Hal>
+bool StateManager<Hal>::isEnvironmentSafe(int zone) const {
+    return isTemperatureInRange(zone) && isHumidityInRange(zone);
+}
+
+template <typename Hal>
+void StateManager<Hal>::invalidateDecisions() {
+    for (int zone = 0; zone < MAX_ZONES; zone++) {
+        decisions.valid[zone] = false;
+    }
+}
+
+template <typename Hal>
+void StateManager<Hal>::readInputs(int zone, float* inputs) const {
+    inputs[INPUT_TEMPERATURE] = zones.temperature[zone];
+    inputs[INPUT_HUMIDITY] = zones.humidity[zone];
+    inputs[INPUT_ICA] = zones.ICA[zone];
+}
+
+template <typename Hal>
+bool StateManager<Hal>::isDecisionCurrent(int zone, bool inRange, const float* inputs) const {
+    return decisions.valid[zone] && decisions.inRange[zone] == inRange &&
+           conditionInBands(decisions.bands[zone], inputs);
+}
+
+#ifdef CHAKIY_VERIFY_ROUTINES
+// The decision made from scratch, the way it was before it was cached
+template <typename Hal>
+int StateManager<Hal>::referenceDecision(int zone, bool inRange, bool timeKnown, bool hadRoutine, int32_t previousId) {
+    if (!timeKnown || !inRange) {
+        return -1;
+    }
+    float inputs[INPUT_COUNT];
+    readInputs(zone, inputs);
+    const RoutineSet<MAX_ROUTINES>& set = *routineSet;
+    for (int i = scheduleIndex.nextCandidate(0); i >= 0; i = scheduleIndex.nextCandidate(i + 1)) {
+        if (set.routines[i].zone != zone) {
+            continue;
+        }
+        if (conditionEvaluate(set.conditions[i], inputs, hadRoutine && set.routines[i].id == previousId)) {
+            return i;
+        }
+    }
+    return -1;
+}
+#endif
+
+template <typename Hal>
+void StateManager<Hal>::checkActiveRoutines() {
+    int currentDay;
+    int currentMinute;
+    bool timeKnown = getCurrentWeekTime(currentDay, currentMinute);
+    
+    ensureScheduleIndex();
+    const RoutineSet<MAX_ROUTINES>& set = *routineSet;
+    
+    // Only routines whose day and time window contain the current minute are
+    // evaluated; the index keeps that set up to date as the clock advances.
+    int minuteOfWeek = currentDay * ScheduleIndex<MAX_ROUTINES>::MINUTES_PER_DAY + currentMinute;
+    if (timeKnown) {
+        scheduleIndex.advanceTo(minuteOfWeek);
+    }
+    
+    // A new routine table or candidate set can change any zone's decision
+    if (decisions.routineGeneration != routineGeneration ||
+        decisions.scheduleGeneration != scheduleIndex.getGeneration() || decisions.timeKnown != timeKnown) {
+        invalidateDecisions();
+        decisions.routineGeneration = routineGeneration;
+        decisions.scheduleGeneration = scheduleIndex.getGeneration();
+        decisions.timeKnown = timeKnown;
+    }
+    checkStats.checks++;
+    
+    // The safety limits of every zone, one pass over the arrays; a zone whose
+    // inputs have not changed keeps its decision and is left out of the walk
+    bool inRange[MAX_ZONES];
+    bool evaluate[MAX_ZONES];
+    float inputs[MAX_ZONES][INPUT_COUNT];
+    // The routine each zone ran under until now, for hysteresis
+    bool hadRoutine[MAX_ZONES];
+    int32_t previousId[MAX_ZONES];
+    int evaluated = 0;
+    int pending = 0;
+    for (int zone = 0; zone < zoneCount; zone++) {
+        inRange[zone] = zones.temperature[zone] >= zones.Temp_min_device[zone] &&
+                        zones.temperature[zone] <= zones.Temp_max_device[zone] &&
+                        zones.humidity[zone] >= zones.humidity_min_device[zone] &&
+                        zones.humidity[zone] <= zones.humidity_max_device[zone];
+        readInputs(zone, inputs[zone]);
+        hadRoutine[zone] = decisions.activeRoutine[zone] >= 0;
+        previousId[zone] = decisions.activeRoutineId[zone];
+        evaluate[zone] = !isDecisionCurrent(zone, inRange[zone], inputs[zone]);
+        if (!evaluate[zone]) {
+            continue;
+        }
+        
+        // Out of range, no routine can switch the zone on whatever the values
+        decisions.activeRoutine[zone] = -1;
+        decisions.valid[zone] = true;
+        decisions.inRange[zone] = inRange[zone];
+        conditionResetBands(decisions.bands[zone]);
+        if (timeKnown && inRange[zone]) {
+            pending++;
+        } else {
+            evaluate[zone] = false;
+        }
+        evaluated++;
+    }
+    checkStats.zonesEvaluated += evaluated;
+    checkStats.zonesSkipped += zoneCount - evaluated;
+    
+    char currentTime[6];
+    routineFormatTime(currentMinute, currentTime);
+    
+    LOG_INFO("rutinas", "Verificando rutinas: %s %s, %d zonas, %d cargadas, %d en horario, %d por evaluar",
+             routineDayName(currentDay), currentTime, zoneCount, set.count,
+             timeKnown ? scheduleIndex.getCandidateCount() : 0, pending);
+    
+    // The routines in schedule are walked once for the zones being
+    // evaluated; each takes the first one of its own whose condition holds.
+    // The constants compared on the way bound the bands over which the
+    // decision stays the same.
+    int first = pending > 0 ? scheduleIndex.nextCandidate(0) : -1;
+    for (int i = first; i >= 0 && pending > 0; i = scheduleIndex.nextCandidate(i + 1)) {
+        const Routine& routine = set.routines[i];
+        int zone = routine.zone;
+        if (zone >= zoneCount || !evaluate[zone]) {
+            continue;
+        }
+        
+        bool active = hadRoutine[zone] && routine.id == previousId[zone];
+        bool condition = conditionEvaluate(set.conditions[i], inputs[zone], active, &decisions.bands[zone]);
+        checkStats.conditionsEvaluated++;
+        
+#if CHAKIY_LOG_LEVEL >= LOG_LEVEL_DEBUG
+        char startTime[6];
+        char endTime[6];
+        char conditionText[CONDITION_TEXT_LENGTH];
+        routineFormatTime(routine.startMinute, startTime);
+        routineFormatTime(routine.endMinute, endTime);
+        conditionFormat(set.conditions[i], conditionText, sizeof(conditionText));
+#endif
+        LOG_DEBUG("rutinas", "Rutina #%d %s zona %d (%s-%s): %s, %s %s",
+                  i + 1, set.names[i], zone, startTime, endTime,
+                  (routine.flags & ROUTINE_DRY) ? "Deshumidificador" : "Humidificador", conditionText,
+                  condition ? "SI" : "NO");
+        
+        if (condition) {
+            decisions.activeRoutine[zone] = i;
+            decisions.activeRoutineId[zone] = routine.id;
+            evaluate[zone] = false;
+            pending--;
+        }
+    }
+    
+    if (timeKnown) {
+        int nextChange = scheduleIndex.nextScheduleChange(minuteOfWeek);
+        if (nextChange >= 0) {
+            char nextTime[6];
+            routineFormatTime(nextChange % ScheduleIndex<MAX_ROUTINES>::MINUTES_PER_DAY, nextTime);
+            LOG_INFO("rutinas", "Proximo cambio de horario: %s %s",
+                     routineDayName(nextChange / ScheduleIndex<MAX_ROUTINES>::MINUTES_PER_DAY), nextTime);
+        }
+    }
+    
+    int activeZones = 0;
+    for (int zone = 0; zone < zoneCount; zone++) {
+        int activeRoutine = decisions.activeRoutine[zone];
+        
+#ifdef CHAKIY_VERIFY_ROUTINES
+        int expected = referenceDecision(zone, inRange[zone], timeKnown, hadRoutine[zone], previousId[zone]);
+        if (expected != activeRoutine) {
+            checkStats.mismatches++;
+            LOG_ERROR("rutinas", "Zona %d: decision en cache #%d, recalculada #%d", zone, activeRoutine + 1,
+                      expected + 1);
+            activeRoutine = expected;
+        }
+#endif
+        
+        bool wasOn = zones.estado_device[zone];
+        const char* wasType = zones.active_device_type[zone];
+        
+        // Las rutinas tienen PRIORIDAD ABSOLUTA sobre decisiones manuales del usuario
+        if (activeRoutine >= 0) {
+            const char* activeRoutineName = set.names[activeRoutine];
+            const char* deviceType = (set.routines[activeRoutine].flags & ROUTINE_DRY) ? "Deshumidificador"
+                                                                                       : "Humidificador";
+            (void)activeRoutineName;   // Only logged, and logging may be compiled out
+            if (!wasOn) {
+                LOG_INFO("rutinas", ">>> ZONA %d ACTIVADA POR RUTINA <<< %s (%s)", zone, activeRoutineName, deviceType);
+                
+                if (!zones.estado_device_original[zone]) {
+                    LOG_INFO("rutinas", ">>> RUTINA OVERRIDE - IGNORANDO ESTADO MANUAL DEL USUARIO <<<");
+                }
+            } else {
+                LOG_DEBUG("rutinas", "Zona %d ya estaba activa, rutina actual: %s", zone, activeRoutineName);
+            }
+            zones.estado_device[zone] = true;
+            zones.active_device_type[zone] = deviceType;
+        } else if (zones.estado_device_original[zone]) {
+            zones.estado_device[zone] = true;
+            zones.active_device_type[zone] = "Deshumidificador";
+        } else {
+            zones.estado_device[zone] = false;
+            zones.active_device_type[zone] = "";
+        }
+        
+        if (zones.estado_device[zone]) {
+            activeZones++;
+        }
+        if (zones.estado_device[zone] != wasOn || strcmp(zones.active_device_type[zone], wasType) != 0) {
+            LOG_INFO("rutinas", "Estado final zona %d: %s %s", zone, zones.estado_device[zone] ? "ACTIVO" : "INACTIVO",
+                     zones.active_device_type[zone]);
+        }
+    }
+    
+    LOG_INFO("rutinas", "Zonas activas: %d de %d", activeZones, zoneCount);
+}
+
+template <typename Hal>
+const RoutineCheckStats& StateManager<Hal>::getRoutineCheckStats() const {
+    return checkStats;
+}
+
+#endif
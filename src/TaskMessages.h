@@ -0,0 +1,76 @@
+#ifndef TASK_MESSAGES_H
+#define TASK_MESSAGES_H
+
+#include <stdint.h>
+#include "Routine.h"
+
+// Messages exchanged between the control task (sensing, routines,
+// actuators) and the network task (API calls). Plain PODs so they can be
+// copied through SpscQueue slots.
+
+const int HOST_LENGTH = 64;
+const int API_STATUS_LENGTH = 32;
+
+// Control -> network: one sensor reading to upload
+struct TelemetrySample {
+    unsigned long timestamp;
+    float temperature;
+    float humidity;
+    int ica;
+    bool deviceOn;
+    uint8_t zone;
+};
+
+// Wire format of telemetry uploads, chosen by Content-Type
+enum TelemetryEncoding : uint8_t {
+    TELEMETRY_JSON,
+    TELEMETRY_CBOR
+};
+
+// Control -> network: requests coming from serial commands
+struct NetworkCommand {
+    enum Kind : uint8_t {
+        SET_SERVER,     // host holds the new server IP/name
+        REFRESH,        // Fetch device info and routines now
+        SET_BATCH,      // batchSize/flushInterval configure telemetry uploads
+        SET_ENCODING    // encoding is the telemetry wire format
+    };
+
+    Kind kind;
+    char host[HOST_LENGTH];
+    uint16_t batchSize;
+    unsigned long flushInterval;
+    TelemetryEncoding encoding;
+};
+
+// The control task keeps one command of each kind waiting while the queue
+// is full
+const int NETWORK_COMMAND_KINDS = NetworkCommand::SET_ENCODING + 1;
+
+struct DeviceConfigUpdate {
+    uint8_t zone;
+    int icaMin;
+    int icaMax;
+    float tempMin;
+    float tempMax;
+    float humMin;
+    float humMax;
+    bool estado;
+};
+
+// Network -> control: configuration and API status. Routine sets do not
+// go through here; they are published in StateManager's RoutineTable.
+struct ControlUpdate {
+    enum Kind : uint8_t {
+        DEVICE_CONFIG,
+        API_STATUS        // apiStatus is empty when the API call succeeded
+    };
+
+    Kind kind;
+    union {
+        DeviceConfigUpdate config;
+        char apiStatus[API_STATUS_LENGTH];
+    };
+};
+
+#endif
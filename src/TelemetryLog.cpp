@@ -0,0 +1,3 @@
+#include "TelemetryLogImpl.h"
+
+template class TelemetryLog<DefaultHal>;
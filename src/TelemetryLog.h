@@ -0,0 +1,87 @@
+#ifndef TELEMETRY_LOG_H
+#define TELEMETRY_LOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "Hal.h"
+
+// One sensor reading as stored in flash. The sequence number fixes where the
+// record lives (segment file and offset), and the CRC covers everything
+// before it, so torn or stale records are recognised after a reset.
+struct TelemetryRecord {
+    uint32_t sequence;
+    uint32_t timestamp;     // Unix time (s)
+    float temperature;
+    float humidity;
+    int16_t ica;
+    uint8_t deviceOn;
+    uint8_t zone;           // 0 in records written before zones existed
+    uint32_t crc;
+};
+
+static_assert(sizeof(TelemetryRecord) == 24, "TelemetryRecord layout must stay fixed in flash");
+
+struct TelemetryLogStats {
+    unsigned long appended;       // Records written
+    unsigned long delivered;      // Records the cursor moved past
+    unsigned long evicted;        // Undelivered records overwritten when full
+    unsigned long corrupt;        // Records skipped for a bad CRC or sequence
+    unsigned long writeErrors;
+    unsigned long recordBytes;    // Bytes of records appended
+    unsigned long flashBytes;     // Bytes written to flash, cursor included
+};
+
+// Append-only store-and-forward log of telemetry records, kept on the HAL's
+// Storage (LittleFS on the ESP32, a directory of files on the host).
+//
+// Records go into a fixed ring of SEGMENT_COUNT segment files holding
+// SEGMENT_RECORDS each. Starting a segment deletes the oldest one, so the
+// log is bounded and evicts oldest-first. A small cursor file remembers the
+// first undelivered record; it is only written when the server acknowledges
+// a batch, never per append. Delivery is at-least-once: if the cursor file is
+// lost, the oldest retained records are sent again.
+template <typename Hal = DefaultHal>
+class TelemetryLog {
+public:
+    static const uint32_t SEGMENT_RECORDS = 64;
+    static const uint32_t SEGMENT_COUNT = 8;
+    static const uint32_t CAPACITY = SEGMENT_RECORDS * SEGMENT_COUNT;
+
+    TelemetryLog();
+
+    // Mounts storage and recovers the log left by the previous boot
+    bool begin();
+
+    // Assigns the sequence number and CRC, then appends. Returns false if
+    // the log is unavailable or the write failed.
+    bool append(TelemetryRecord& record);
+
+    // Copies up to max of the oldest undelivered records without consuming
+    // them. nextSequence is what to acknowledge once they are delivered.
+    size_t peek(TelemetryRecord* records, size_t max, uint32_t& nextSequence);
+
+    // Everything before nextSequence has been delivered
+    void acknowledge(uint32_t nextSequence);
+
+    uint32_t getPending() const;
+    bool isEmpty() const;
+    bool isAvailable() const;
+    const TelemetryLogStats& getStats() const;
+
+private:
+    bool available;
+    uint32_t cursor;            // First undelivered sequence
+    uint32_t nextSequence;      // Sequence of the next append
+    TelemetryLogStats stats;
+
+    static void segmentPath(uint32_t sequence, char* path);
+    static uint32_t segmentStart(uint32_t sequence);
+    static bool isValid(const TelemetryRecord& record, uint32_t sequence);
+    void writeCursor();
+    bool readCursor(uint32_t& value);
+};
+
+// Instantiated in TelemetryLog.cpp
+extern template class TelemetryLog<DefaultHal>;
+
+#endif
@@ -0,0 +1,280 @@
+#ifndef TELEMETRY_LOG_IMPL_H
+#define TELEMETRY_LOG_IMPL_H
+
+// Member definitions of TelemetryLog. TelemetryLog.cpp instantiates them for
+// DefaultHal; tests include this header to use a mock HAL instead.
+
+#include "TelemetryLog.h"
+#include <stdio.h>
+#include <string.h>
+#include "Log.h"
+
+namespace {
+
+const char* cursorPath = "/tlm.cur";
+const uint32_t cursorMagic = 0x544C4D31;   // "TLM1"
+
+struct CursorFile {
+    uint32_t magic;
+    uint32_t cursor;
+    uint32_t crc;
+};
+
+uint32_t crc32(const void* data, size_t length) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= bytes[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+}
+
+template <typename Hal>
+TelemetryLog<Hal>::TelemetryLog() : available(false), cursor(0), nextSequence(0) {
+    memset(&stats, 0, sizeof(stats));
+}
+
+template <typename Hal>
+bool TelemetryLog<Hal>::begin() {
+    available = Hal::Storage::begin();
+    if (!available) {
+        LOG_ERROR("telemetria", "No se pudo montar el almacenamiento del registro de telemetria");
+        return false;
+    }
+
+    // Find the newest segment by the sequence of its first record
+    bool found = false;
+    uint32_t newest = 0;
+    for (uint32_t slot = 0; slot < SEGMENT_COUNT; slot++) {
+        char path[16];
+        segmentPath(slot * SEGMENT_RECORDS, path);
+
+        TelemetryRecord first;
+        if (Hal::Storage::read(path, 0, &first, sizeof(first)) != (long)sizeof(first)) continue;
+        if (!isValid(first, first.sequence) || first.sequence % SEGMENT_RECORDS != 0 ||
+            (first.sequence / SEGMENT_RECORDS) % SEGMENT_COUNT != slot) continue;
+
+        if (!found || (int32_t)(first.sequence - newest) > 0) {
+            newest = first.sequence;
+            found = true;
+        }
+    }
+
+    uint32_t savedCursor = 0;
+    bool hasCursor = readCursor(savedCursor);
+
+    if (!found) {
+        // Empty log: continue numbering after the saved cursor
+        nextSequence = hasCursor ? segmentStart(savedCursor + SEGMENT_RECORDS - 1) : 0;
+        cursor = nextSequence;
+        return true;
+    }
+
+    // Count the intact records of the newest segment. A torn tail cannot be
+    // appended to in place, so writing resumes at the next segment.
+    char path[16];
+    segmentPath(newest, path);
+    long size = Hal::Storage::size(path);
+    uint32_t valid = 0;
+    TelemetryRecord record;
+    while (valid < SEGMENT_RECORDS &&
+           Hal::Storage::read(path, valid * sizeof(record), &record, sizeof(record)) == (long)sizeof(record) &&
+           isValid(record, newest + valid)) {
+        valid++;
+    }
+    nextSequence = newest + valid;
+    if ((long)(valid * sizeof(record)) != size) {
+        stats.corrupt++;
+        nextSequence = newest + SEGMENT_RECORDS;
+    }
+
+    // Find the oldest retained segment; anything in the ring that does not
+    // hold the segment it should is a stale or damaged leftover
+    uint32_t oldest = newest;
+    for (uint32_t back = SEGMENT_COUNT - 1; back > 0; back--) {
+        uint32_t start = newest - back * SEGMENT_RECORDS;
+        segmentPath(start, path);
+
+        TelemetryRecord first;
+        bool intact = back * SEGMENT_RECORDS <= newest &&
+                      Hal::Storage::read(path, 0, &first, sizeof(first)) == (long)sizeof(first) &&
+                      isValid(first, start);
+        if (!intact) {
+            Hal::Storage::remove(path);
+        } else if (oldest == newest) {
+            oldest = start;
+        }
+    }
+
+    cursor = oldest;
+    if (hasCursor && (int32_t)(savedCursor - oldest) >= 0 && (int32_t)(nextSequence - savedCursor) >= 0) {
+        cursor = savedCursor;
+    }
+
+    LOG_INFO("telemetria", "Registro de telemetria: %lu lecturas pendientes de envio", (unsigned long)getPending());
+    return true;
+}
+
+template <typename Hal>
+bool TelemetryLog<Hal>::append(TelemetryRecord& record) {
+    if (!available) {
+        return false;
+    }
+
+    uint32_t sequence = nextSequence;
+    char path[16];
+    segmentPath(sequence, path);
+
+    if (sequence % SEGMENT_RECORDS == 0) {
+        // Starting a segment reuses the oldest slot of the ring
+        Hal::Storage::remove(path);
+
+        uint32_t retained = sequence - (SEGMENT_COUNT - 1) * SEGMENT_RECORDS;
+        if (sequence >= (SEGMENT_COUNT - 1) * SEGMENT_RECORDS && (int32_t)(retained - cursor) > 0) {
+            stats.evicted += retained - cursor;
+            cursor = retained;
+        }
+    }
+
+    record.sequence = sequence;
+    record.crc = crc32(&record, offsetof(TelemetryRecord, crc));
+
+    if (!Hal::Storage::append(path, &record, sizeof(record))) {
+        // The segment may now hold a partial record; never append after it
+        stats.writeErrors++;
+        nextSequence = segmentStart(sequence) + SEGMENT_RECORDS;
+        return false;
+    }
+
+    nextSequence++;
+    stats.appended++;
+    stats.recordBytes += sizeof(record);
+    stats.flashBytes += sizeof(record);
+    return true;
+}
+
+template <typename Hal>
+size_t TelemetryLog<Hal>::peek(TelemetryRecord* records, size_t max, uint32_t& next) {
+    uint32_t sequence = cursor;
+    size_t count = 0;
+
+    while (available && count < max && sequence != nextSequence) {
+        uint32_t segmentEnd = segmentStart(sequence) + SEGMENT_RECORDS;
+        uint32_t wanted = segmentEnd - sequence;
+        if (nextSequence - sequence < wanted) wanted = nextSequence - sequence;
+        if (max - count < wanted) wanted = max - count;
+
+        // One read per segment for the whole run of records
+        char path[16];
+        segmentPath(sequence, path);
+        long bytes = Hal::Storage::read(path, (sequence % SEGMENT_RECORDS) * sizeof(TelemetryRecord),
+                                        records + count, wanted * sizeof(TelemetryRecord));
+        uint32_t got = bytes > 0 ? bytes / sizeof(TelemetryRecord) : 0;
+
+        uint32_t valid = 0;
+        while (valid < got && isValid(records[count + valid], sequence + valid)) {
+            valid++;
+        }
+        count += valid;
+        sequence += valid;
+
+        if (valid < wanted) {
+            // Missing or damaged: the rest of the segment cannot be trusted
+            uint32_t skipTo = (int32_t)(nextSequence - segmentEnd) < 0 ? nextSequence : segmentEnd;
+            stats.corrupt += skipTo - sequence;
+            sequence = skipTo;
+            if (count > 0) break;
+        }
+    }
+
+    next = sequence;
+    if (count == 0 && sequence != cursor) {
+        acknowledge(sequence);
+    }
+    return count;
+}
+
+template <typename Hal>
+void TelemetryLog<Hal>::acknowledge(uint32_t next) {
+    if ((int32_t)(next - cursor) <= 0 || (int32_t)(next - nextSequence) > 0) {
+        return;
+    }
+
+    stats.delivered += next - cursor;
+
+    // Free segments that are now fully delivered
+    for (uint32_t start = segmentStart(cursor); start + SEGMENT_RECORDS <= next; start += SEGMENT_RECORDS) {
+        char path[16];
+        segmentPath(start, path);
+        Hal::Storage::remove(path);
+    }
+
+    cursor = next;
+    writeCursor();
+}
+
+template <typename Hal>
+uint32_t TelemetryLog<Hal>::getPending() const {
+    return nextSequence - cursor;
+}
+
+template <typename Hal>
+bool TelemetryLog<Hal>::isEmpty() const {
+    return cursor == nextSequence;
+}
+
+template <typename Hal>
+bool TelemetryLog<Hal>::isAvailable() const {
+    return available;
+}
+
+template <typename Hal>
+const TelemetryLogStats& TelemetryLog<Hal>::getStats() const {
+    return stats;
+}
+
+template <typename Hal>
+void TelemetryLog<Hal>::segmentPath(uint32_t sequence, char* path) {
+    snprintf(path, 16, "/tlm%u.log", (unsigned)((sequence / SEGMENT_RECORDS) % SEGMENT_COUNT));
+}
+
+template <typename Hal>
+uint32_t TelemetryLog<Hal>::segmentStart(uint32_t sequence) {
+    return sequence - sequence % SEGMENT_RECORDS;
+}
+
+template <typename Hal>
+bool TelemetryLog<Hal>::isValid(const TelemetryRecord& record, uint32_t sequence) {
+    return record.sequence == sequence && record.crc == crc32(&record, offsetof(TelemetryRecord, crc));
+}
+
+template <typename Hal>
+void TelemetryLog<Hal>::writeCursor() {
+    CursorFile file;
+    file.magic = cursorMagic;
+    file.cursor = cursor;
+    file.crc = crc32(&file, offsetof(CursorFile, crc));
+    if (Hal::Storage::write(cursorPath, &file, sizeof(file))) {
+        stats.flashBytes += sizeof(file);
+    } else {
+        stats.writeErrors++;
+    }
+}
+
+template <typename Hal>
+bool TelemetryLog<Hal>::readCursor(uint32_t& value) {
+    CursorFile file;
+    if (Hal::Storage::read(cursorPath, 0, &file, sizeof(file)) != (long)sizeof(file) ||
+        file.magic != cursorMagic || file.crc != crc32(&file, offsetof(CursorFile, crc))) {
+        return false;
+    }
+    value = file.cursor;
+    return true;
+}
+
+#endif
@@ -0,0 +1,3 @@
+#include "WifiManagerImpl.h"
+
+template class WifiManager<DefaultHal>;
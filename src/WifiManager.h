@@ -0,0 +1,78 @@
+#ifndef WIFI_MANAGER_H
+#define WIFI_MANAGER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "Hal.h"
+#include "Backoff.h"
+
+struct WifiStats {
+    unsigned long attempts;         // Connection attempts started
+    unsigned long failures;         // Attempts that timed out
+    unsigned long connects;         // Attempts that came up, the first one included
+    unsigned long drops;            // Connections lost
+    unsigned long connectedMs;      // Over past connections; see getConnectedMs()
+    unsigned long longestOutageMs;  // Longest time offline after a drop
+};
+
+// Non-blocking WiFi connection state machine. begin() only records the
+// network; step(), called periodically, starts an attempt, watches it, and
+// once the link is up watches for it to drop. An attempt that has not
+// connected within CONNECT_TIMEOUT is dropped and retried after an
+// exponential backoff with jitter, so an unreachable access point costs a
+// status check per step and never holds up the caller. A lost link is
+// retried at once, then backs off the same way.
+template <typename Hal = DefaultHal>
+class WifiManager {
+public:
+    enum State : uint8_t {
+        IDLE,           // begin() not called yet
+        CONNECTING,
+        ONLINE,
+        WAITING         // Backing off before the next attempt
+    };
+
+    // What a step() changed, for pausing and resuming network traffic
+    enum Event {
+        NONE,
+        CONNECTED,
+        DISCONNECTED
+    };
+
+    static const unsigned long CONNECT_TIMEOUT = 15000;
+    static const unsigned long RETRY_MIN = 2000;
+    static const unsigned long RETRY_MAX = 120000;
+    static const size_t SSID_LENGTH = 33;
+    static const size_t PASSWORD_LENGTH = 65;
+
+    WifiManager();
+
+    void begin(const char* ssid, const char* password);
+    Event step();
+
+    bool isOnline() const;
+    State getState() const;
+    const char* getSsid() const;
+    unsigned long getConnectedMs() const;   // Current connection included
+    unsigned long getRetryAt() const;       // millis() of the next attempt while WAITING
+    const WifiStats& getStats() const;
+
+private:
+    State state;
+    char ssid[SSID_LENGTH];
+    char password[PASSWORD_LENGTH];
+    Backoff backoff;
+    unsigned long attemptStartedAt;
+    unsigned long connectedAt;
+    unsigned long droppedAt;
+    unsigned long retryAt;
+    bool dropped;                   // Offline after a drop, for the outage time
+    WifiStats stats;
+
+    void startAttempt(unsigned long now);
+};
+
+// Instantiated in WifiManager.cpp
+extern template class WifiManager<DefaultHal>;
+
+#endif
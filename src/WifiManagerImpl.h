@@ -0,0 +1,127 @@
+#ifndef WIFI_MANAGER_IMPL_H
+#define WIFI_MANAGER_IMPL_H
+
+// Member definitions of WifiManager. WifiManager.cpp instantiates them for
+// DefaultHal; tests include this header to use a mock HAL instead.
+
+#include "WifiManager.h"
+#include <string.h>
+#include "Log.h"
+
+template <typename Hal>
+WifiManager<Hal>::WifiManager()
+    : state(IDLE), backoff(RETRY_MIN, RETRY_MAX), attemptStartedAt(0), connectedAt(0), droppedAt(0),
+      retryAt(0), dropped(false) {
+    ssid[0] = '\0';
+    password[0] = '\0';
+    memset(&stats, 0, sizeof(stats));
+}
+
+template <typename Hal>
+void WifiManager<Hal>::begin(const char* networkSsid, const char* networkPassword) {
+    strncpy(ssid, networkSsid, SSID_LENGTH - 1);
+    ssid[SSID_LENGTH - 1] = '\0';
+    strncpy(password, networkPassword, PASSWORD_LENGTH - 1);
+    password[PASSWORD_LENGTH - 1] = '\0';
+
+    // Devices that lose the same access point should not retry together
+    backoff.seed(Hal::Network::random());
+    backoff.reset();
+    state = WAITING;
+    retryAt = Hal::Clock::millis();
+}
+
+template <typename Hal>
+typename WifiManager<Hal>::Event WifiManager<Hal>::step() {
+    unsigned long now = Hal::Clock::millis();
+
+    switch (state) {
+        case CONNECTING:
+            if (Hal::Network::isConnected()) {
+                state = ONLINE;
+                connectedAt = now;
+                stats.connects++;
+                backoff.reset();
+                if (dropped) {
+                    unsigned long outage = now - droppedAt;
+                    if (outage > stats.longestOutageMs) stats.longestOutageMs = outage;
+                    dropped = false;
+                }
+                LOG_INFO("wifi", "Conectado a %s tras %lu ms (intento %lu)", ssid, now - attemptStartedAt,
+                         stats.attempts);
+                return CONNECTED;
+            }
+            if (now - attemptStartedAt >= CONNECT_TIMEOUT) {
+                Hal::Network::disconnect();
+                stats.failures++;
+                unsigned long delay = backoff.next();
+                state = WAITING;
+                retryAt = now + delay;
+                LOG_WARN("wifi", "Sin conexion a %s, reintento en %lu ms", ssid, delay);
+            }
+            return NONE;
+
+        case ONLINE:
+            if (Hal::Network::isConnected()) {
+                return NONE;
+            }
+            stats.drops++;
+            stats.connectedMs += now - connectedAt;
+            dropped = true;
+            droppedAt = now;
+            LOG_WARN("wifi", "Conexion perdida tras %lu s", (now - connectedAt) / 1000);
+            startAttempt(now);
+            return DISCONNECTED;
+
+        case WAITING:
+            if ((long)(now - retryAt) >= 0) {
+                startAttempt(now);
+            }
+            return NONE;
+
+        default:
+            return NONE;
+    }
+}
+
+template <typename Hal>
+bool WifiManager<Hal>::isOnline() const {
+    return state == ONLINE;
+}
+
+template <typename Hal>
+typename WifiManager<Hal>::State WifiManager<Hal>::getState() const {
+    return state;
+}
+
+template <typename Hal>
+const char* WifiManager<Hal>::getSsid() const {
+    return ssid;
+}
+
+template <typename Hal>
+unsigned long WifiManager<Hal>::getConnectedMs() const {
+    return stats.connectedMs + (state == ONLINE ? Hal::Clock::millis() - connectedAt : 0);
+}
+
+template <typename Hal>
+unsigned long WifiManager<Hal>::getRetryAt() const {
+    return retryAt;
+}
+
+template <typename Hal>
+const WifiStats& WifiManager<Hal>::getStats() const {
+    return stats;
+}
+
+template <typename Hal>
+void WifiManager<Hal>::startAttempt(unsigned long now) {
+    // A stale attempt or link is dropped first so the driver starts clean
+    Hal::Network::disconnect();
+    Hal::Network::begin(ssid, password);
+    state = CONNECTING;
+    attemptStartedAt = now;
+    stats.attempts++;
+}
+
+#endif
@@ -1,7 +1,7 @@
 #include "DeviceManager.h"
 
 // Create device manager instance
-DeviceManager device;
+DeviceManager<> device;
 
 
 void setup() {
@@ -9,6 +9,5 @@ void setup() {
 }
 
 void loop() {
-    device.getCurrentTimeDevice();
     device.loop();
-    }
\ No newline at end of file
+}
\ No newline at end of file
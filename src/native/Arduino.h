@@ -0,0 +1,106 @@
+#ifndef NATIVE_ARDUINO_H
+#define NATIVE_ARDUINO_H
+
+// Minimal Arduino core surface for the host-native build. Only what the
+// managers use is provided: the String class and the usual C headers the
+// Arduino core pulls in. Peripherals live in NativeHal.h.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <cmath>
+#include <string>
+
+using std::abs;
+using std::isnan;
+
+class String {
+private:
+    std::string buffer;
+
+public:
+    String() {}
+    String(const char* str) : buffer(str ? str : "") {}
+    String(const std::string& str) : buffer(str) {}
+    String(char c) : buffer(1, c) {}
+    String(int value) : buffer(std::to_string(value)) {}
+    String(unsigned int value) : buffer(std::to_string(value)) {}
+    String(long value) : buffer(std::to_string(value)) {}
+    String(unsigned long value) : buffer(std::to_string(value)) {}
+    String(double value, unsigned int decimals = 2) {
+        char tmp[32];
+        snprintf(tmp, sizeof(tmp), "%.*f", (int)decimals, value);
+        buffer = tmp;
+    }
+
+    String& operator=(const char* str) {
+        buffer = str ? str : "";
+        return *this;
+    }
+
+    unsigned int length() const { return buffer.length(); }
+    const char* c_str() const { return buffer.c_str(); }
+    char charAt(unsigned int index) const { return index < buffer.length() ? buffer[index] : 0; }
+    char operator[](unsigned int index) const { return charAt(index); }
+    bool reserve(unsigned int size) { buffer.reserve(size); return true; }
+
+    bool concat(const String& str) { buffer += str.buffer; return true; }
+    bool concat(const char* str) { if (!str) return false; buffer += str; return true; }
+    bool concat(char c) { buffer += c; return true; }
+    String& operator+=(const String& str) { concat(str); return *this; }
+    String& operator+=(const char* str) { concat(str); return *this; }
+    String& operator+=(char c) { concat(c); return *this; }
+
+    bool equals(const String& str) const { return buffer == str.buffer; }
+    bool equals(const char* str) const { return buffer == (str ? str : ""); }
+    bool operator==(const String& str) const { return equals(str); }
+    bool operator==(const char* str) const { return equals(str); }
+    bool operator!=(const String& str) const { return !equals(str); }
+    bool operator!=(const char* str) const { return !equals(str); }
+    bool startsWith(const String& prefix) const { return buffer.compare(0, prefix.buffer.length(), prefix.buffer) == 0; }
+
+    int indexOf(char c, unsigned int from = 0) const {
+        size_t pos = buffer.find(c, from);
+        return pos == std::string::npos ? -1 : (int)pos;
+    }
+    int indexOf(const String& str, unsigned int from = 0) const {
+        size_t pos = buffer.find(str.buffer, from);
+        return pos == std::string::npos ? -1 : (int)pos;
+    }
+
+    String substring(unsigned int from) const {
+        return from < buffer.length() ? String(buffer.substr(from)) : String();
+    }
+    String substring(unsigned int from, unsigned int to) const {
+        if (from > to) { unsigned int tmp = from; from = to; to = tmp; }
+        if (from >= buffer.length()) return String();
+        return String(buffer.substr(from, to - from));
+    }
+
+    void replace(const String& find, const String& replacement) {
+        if (find.buffer.empty()) return;
+        size_t pos = 0;
+        while ((pos = buffer.find(find.buffer, pos)) != std::string::npos) {
+            buffer.replace(pos, find.buffer.length(), replacement.buffer);
+            pos += replacement.buffer.length();
+        }
+    }
+
+    void trim() {
+        size_t begin = buffer.find_first_not_of(" \t\r\n");
+        if (begin == std::string::npos) { buffer.clear(); return; }
+        size_t end = buffer.find_last_not_of(" \t\r\n");
+        buffer = buffer.substr(begin, end - begin + 1);
+    }
+
+    long toInt() const { return atol(buffer.c_str()); }
+    float toFloat() const { return (float)atof(buffer.c_str()); }
+
+    friend String operator+(const String& lhs, const String& rhs) { String s(lhs); s += rhs; return s; }
+    friend String operator+(const String& lhs, const char* rhs) { String s(lhs); s += rhs; return s; }
+    friend String operator+(const char* lhs, const String& rhs) { String s(lhs); s += rhs; return s; }
+};
+
+#endif
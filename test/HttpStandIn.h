@@ -0,0 +1,153 @@
+#ifndef HTTP_STAND_IN_H
+#define HTTP_STAND_IN_H
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "NativeHal.h"
+
+// Stand-in HTTP/1.1 server on 127.0.0.1 for the tests that talk to real
+// sockets. Every connection gets its own thread, reads requests in order
+// (pipelined ones included) and hands each to the handler, which returns
+// the raw response: a slow server sleeps in it, a streaming one writes to
+// fd itself. Connections are kept alive unless the response says
+// "Connection: close".
+
+struct HttpStandInRequest {
+    std::string method;
+    std::string path;
+    std::string headers;
+    std::string body;
+    int connection;     // 1 for the first connection accepted
+    int number;         // Request on that connection, from 1
+    int fd;
+};
+
+// An empty response closes the connection without one
+typedef std::function<std::string(const HttpStandInRequest&)> HttpStandInHandler;
+
+class HttpStandIn {
+public:
+    std::atomic<int> connections{0};
+    std::atomic<int> requests{0};
+    std::atomic<bool> closeAfterReply{false};   // Drop keep-alive connections silently
+
+    // Listens on port, or an ephemeral one for 0; false if it cannot
+    bool start(uint16_t port = 0) {
+        listener = socket(AF_INET, SOCK_STREAM, 0);
+        int on = 1;
+        setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t length = sizeof(address);
+        if (listener < 0 || bind(listener, (sockaddr*)&address, sizeof(address)) != 0 ||
+            listen(listener, 16) != 0 || getsockname(listener, (sockaddr*)&address, &length) != 0) {
+            return false;
+        }
+        listenPort = ntohs(address.sin_port);
+        std::thread([this]() { acceptLoop(); }).detach();
+        return true;
+    }
+
+    uint16_t port() const { return listenPort; }
+
+    void setHandler(HttpStandInHandler next) {
+        std::lock_guard<std::mutex> lock(mutex);
+        handler = next;
+    }
+
+    void resetCounters() {
+        connections = 0;
+        requests = 0;
+        closeAfterReply = false;
+    }
+
+    static std::string response(int status, const std::string& body, const char* extraHeaders = "") {
+        char head[256];
+        snprintf(head, sizeof(head), "HTTP/1.1 %d %s\r\nContent-Length: %u\r\n%s\r\n", status,
+                 status == 200 ? "OK" : "Error", (unsigned)body.size(), extraHeaders);
+        return head + body;
+    }
+
+private:
+    int listener = -1;
+    uint16_t listenPort = 0;
+    std::mutex mutex;
+    HttpStandInHandler handler;
+
+    // The server's own allocations stay out of NativeMemory's counts
+    void acceptLoop() {
+        NativeMemory::ignoreThisThread();
+        for (;;) {
+            int fd = accept(listener, nullptr, nullptr);
+            if (fd < 0) return;
+            int connection = ++connections;
+            std::thread([this, fd, connection]() { serve(fd, connection); }).detach();
+        }
+    }
+
+    void serve(int fd, int connection) {
+        NativeMemory::ignoreThisThread();
+        std::string buffer;
+        char chunk[2048];
+        for (int number = 1;; number++) {
+            // Head, then as much body as Content-Length says
+            size_t headEnd;
+            while ((headEnd = buffer.find("\r\n\r\n")) == std::string::npos) {
+                if (!receive(fd, buffer, chunk, sizeof(chunk))) return;
+            }
+            HttpStandInRequest request;
+            request.headers = buffer.substr(0, headEnd);
+            size_t space = request.headers.find(' ');
+            size_t space2 = request.headers.find(' ', space + 1);
+            request.method = request.headers.substr(0, space);
+            request.path = request.headers.substr(space + 1, space2 - space - 1);
+            size_t bodyLength = 0;
+            size_t field = request.headers.find("Content-Length: ");
+            if (field != std::string::npos) bodyLength = strtoul(request.headers.c_str() + field + 16, nullptr, 10);
+            while (buffer.size() < headEnd + 4 + bodyLength) {
+                if (!receive(fd, buffer, chunk, sizeof(chunk))) return;
+            }
+            request.body = buffer.substr(headEnd + 4, bodyLength);
+            buffer.erase(0, headEnd + 4 + bodyLength);
+            request.connection = connection;
+            request.number = number;
+            request.fd = fd;
+            requests++;
+
+            HttpStandInHandler current;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                current = handler;
+            }
+            std::string reply = current ? current(request) : response(404, "");
+            if (reply.empty() || send(fd, reply.data(), reply.size(), MSG_NOSIGNAL) < 0 ||
+                reply.find("Connection: close") != std::string::npos || closeAfterReply) {
+                close(fd);
+                return;
+            }
+        }
+    }
+
+    static bool receive(int fd, std::string& buffer, char* chunk, size_t size) {
+        ssize_t n = recv(fd, chunk, size, 0);
+        if (n <= 0) {
+            close(fd);
+            return false;
+        }
+        buffer.append(chunk, n);
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,274 @@
+#ifndef MOCK_HAL_H
+#define MOCK_HAL_H
+
+#include <Arduino.h>
+#include <time.h>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+#include "NativeHal.h"
+
+// Scriptable HAL for the native tests. The managers are instantiated with it
+// from their *Impl.h headers, so a test controls time, sensors, storage and
+// the network, and can look at what went to the LCD and the console.
+//
+// Everything is static and single-threaded: tasks are recorded but never
+// started, so the control loop runs alone on the test's thread. Call
+// MockHal::reset() at the start of every test.
+
+// Simulated time: millis() only moves with delay() or advance(). cycles()
+// is real time, so the stage timers and benchmarks measure actual work.
+struct MockClock {
+    static inline unsigned long now = 0;
+    static inline bool synced = true;                   // localTime() succeeds
+    static inline time_t bootEpoch = 1718013600;        // Mon 2024-06-10 10:00 UTC
+    static inline long offsetSec = 0;
+
+    static unsigned long millis() { return now; }
+    static unsigned long micros() { return now * 1000; }
+    static uint32_t cycles() {
+        return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    static uint32_t cyclesPerMicrosecond() { return 1000; }
+    static void delay(unsigned long ms) { now += ms; }
+    static void advance(unsigned long ms) { now += ms; }
+    static void configure(long gmtOffsetSec, int daylightOffsetSec, const char* server1, const char* server2) {
+        (void)server1;
+        (void)server2;
+        offsetSec = gmtOffsetSec + daylightOffsetSec;
+    }
+    static bool localTime(struct tm* info) {
+        if (!synced) return false;
+        time_t t = bootEpoch + (time_t)(now / 1000) + offsetSec;
+        return gmtime_r(&t, info) != nullptr;
+    }
+    // Sets the local wall-clock time, keeping millis()
+    static void setLocalTime(int weekday, int hour, int minute) {
+        // 2024-06-09 was a Sunday (weekday 0)
+        time_t sunday = 1717891200;
+        bootEpoch = sunday + weekday * 86400L + hour * 3600L + minute * 60L - (time_t)(now / 1000) - offsetSec;
+    }
+};
+
+struct MockGpio {
+    static inline bool levels[64];
+    static inline unsigned long writes = 0;
+
+    static void configureOutput(int pin) { write(pin, false); }
+    static void write(int pin, bool high) {
+        if (pin >= 0 && pin < 64) levels[pin] = high;
+        writes++;
+    }
+    static bool read(int pin) { return pin >= 0 && pin < 64 && levels[pin]; }
+};
+
+struct MockNetwork {
+    static inline bool connected = true;
+    static inline unsigned long begins = 0;
+    static inline uint32_t seed = 12345;                // What random() returns
+
+    static void begin(const char* ssid, const char* password) {
+        (void)ssid;
+        (void)password;
+        begins++;
+    }
+    static void disconnect() {}
+    static bool isConnected() { return connected; }
+    static uint32_t random() { return seed; }
+    static String ssid() { return "mock"; }
+    static String localIP() { return "127.0.0.1"; }
+};
+
+struct MockTasks {
+    static inline int started = 0;
+
+    static bool start(const char* name, void (*entry)(void*), void* context, int core,
+                      unsigned int priority, unsigned long stackSize) {
+        (void)name; (void)entry; (void)context; (void)core; (void)priority; (void)stackSize;
+        started++;
+        return true;
+    }
+};
+
+// Flash as a map of files. Counts reads and what was written so tests can
+// work out write amplification, and survives a "reset" (a new TelemetryLog) until
+// clear().
+struct MockStorage {
+    static inline std::map<std::string, std::vector<uint8_t>> files;
+    static inline unsigned long bytesWritten = 0;
+    static inline unsigned long reads = 0;
+    static inline bool failing = false;                 // Every call fails, like missing flash
+
+    static void clear() {
+        files.clear();
+        bytesWritten = 0;
+        reads = 0;
+        failing = false;
+    }
+    static bool begin() { return !failing; }
+    static long size(const char* path) {
+        auto it = files.find(path);
+        return failing || it == files.end() ? -1 : (long)it->second.size();
+    }
+    static long read(const char* path, size_t offset, void* data, size_t length) {
+        auto it = files.find(path);
+        reads++;
+        if (failing || it == files.end()) return -1;
+        if (offset >= it->second.size()) return 0;
+        size_t n = it->second.size() - offset < length ? it->second.size() - offset : length;
+        memcpy(data, it->second.data() + offset, n);
+        return (long)n;
+    }
+    static bool append(const char* path, const void* data, size_t length) {
+        if (failing) return false;
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        files[path].insert(files[path].end(), bytes, bytes + length);
+        bytesWritten += length;
+        return true;
+    }
+    static bool write(const char* path, const void* data, size_t length) {
+        if (failing) return false;
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        files[path].assign(bytes, bytes + length);
+        bytesWritten += length;
+        return true;
+    }
+    static bool remove(const char* path) {
+        return !failing && files.erase(path) > 0;
+    }
+};
+
+// Readings come from source, when set; otherwise a steady room.
+class MockSensor {
+public:
+    static inline bool (*source)(int pin, float& temperature, float& humidity) = nullptr;
+    static inline unsigned long reads = 0;
+
+    void begin(int sensorPin, int type) {
+        pin = sensorPin;
+        (void)type;
+    }
+    bool read(float& temperature, float& humidity) {
+        reads++;
+        if (source) return source(pin, temperature, humidity);
+        temperature = 24.0f;
+        humidity = 55.0f;
+        return true;
+    }
+
+private:
+    int pin = -1;
+};
+
+// 20x4 character LCD that keeps its cells and counts the bytes each call
+// would put on the I2C bus: one per command or cursor move, one per
+// character. last points at the most recently constructed display.
+class MockDisplay : public NativePrint<MockDisplay> {
+public:
+    static const int COLS = 20;
+    static const int ROWS = 4;
+    static inline MockDisplay* last = nullptr;
+
+    unsigned long commands = 0;
+    unsigned long characters = 0;
+    unsigned long clears = 0;
+
+    MockDisplay(uint8_t address, int cols, int rows) {
+        (void)address; (void)cols; (void)rows;
+        memset(cells, ' ', sizeof(cells));
+        last = this;
+    }
+    void init() { clear(); }
+    void backlight() { commands++; }
+    void clear() {
+        memset(cells, ' ', sizeof(cells));
+        col = 0;
+        row = 0;
+        commands++;
+        clears++;
+    }
+    void setCursor(int c, int r) {
+        col = c;
+        row = r;
+        commands++;
+    }
+    size_t write(const char* data, size_t len) {
+        for (size_t i = 0; i < len; i++, col++) {
+            if (row >= 0 && row < ROWS && col >= 0 && col < COLS) cells[row][col] = data[i];
+        }
+        characters += len;
+        return len;
+    }
+
+    unsigned long bytes() const { return commands + characters; }
+    std::string rowText(int r) const { return std::string(cells[r], COLS); }
+
+private:
+    char cells[ROWS][COLS];
+    int col = 0;
+    int row = 0;
+};
+
+// Output is kept in output (and echoed when echo is set); input is read a
+// line at a time.
+class MockConsole : public NativePrint<MockConsole> {
+public:
+    std::string output;
+    std::deque<std::string> input;
+    bool echo = false;
+
+    void begin(unsigned long baud) { (void)baud; }
+    int available() { return input.empty() ? 0 : 1; }
+    String readStringUntil(char terminator) {
+        (void)terminator;
+        if (input.empty()) return String();
+        String line(input.front().c_str());
+        input.pop_front();
+        return line;
+    }
+    size_t write(const char* data, size_t len) {
+        output.append(data, len);
+        if (echo) fwrite(data, 1, len, stdout);
+        return len;
+    }
+};
+
+struct MockHal {
+    using Clock = MockClock;
+    using Gpio = MockGpio;
+    using Network = MockNetwork;
+    using Tasks = MockTasks;
+    using Sensor = MockSensor;
+    using Storage = MockStorage;
+    using Memory = NativeMemory;
+    using Display = MockDisplay;
+    using Console = MockConsole;
+
+    static Console& console() {
+        static Console console;
+        return console;
+    }
+
+    static void reset() {
+        MockClock::now = 0;
+        MockClock::synced = true;
+        MockClock::bootEpoch = 1718013600;
+        MockClock::offsetSec = 0;
+        memset(MockGpio::levels, 0, sizeof(MockGpio::levels));
+        MockGpio::writes = 0;
+        MockNetwork::connected = true;
+        MockNetwork::begins = 0;
+        MockNetwork::seed = 12345;
+        MockTasks::started = 0;
+        MockStorage::clear();
+        MockSensor::source = nullptr;
+        MockSensor::reads = 0;
+        console().output.clear();
+        console().input.clear();
+    }
+};
+
+#endif
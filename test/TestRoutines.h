@@ -0,0 +1,59 @@
+#ifndef TEST_ROUTINES_H
+#define TEST_ROUTINES_H
+
+#include <stdio.h>
+#include <string.h>
+#include "Routine.h"
+#include "RoutineTable.h"
+
+// Routine fixtures shared by the tests: a small LCG so runs are repeatable,
+// and routine_data payloads in the backend's Python-dict form.
+
+struct TestRandom {
+    uint32_t state;
+
+    explicit TestRandom(uint32_t seed) : state(seed) {}
+
+    // 0 .. n-1
+    uint32_t next(uint32_t n) {
+        state = state * 1103515245u + 12345u;
+        return (state >> 8) % n;
+    }
+};
+
+// Writes a routine_data payload and returns its length
+inline int formatRoutineData(char* out, size_t size, int id, const char* condition, bool dry,
+                             int startMinute, int endMinute, uint8_t dayMask) {
+    static const char* const days[] = { "SUNDAY", "MONDAY", "TUESDAY", "WEDNESDAY", "THURSDAY", "FRIDAY", "SATURDAY" };
+    char dayList[96] = "";
+    for (int day = 0; day < 7; day++) {
+        if (dayMask & (1 << day)) {
+            size_t used = strlen(dayList);
+            snprintf(dayList + used, sizeof(dayList) - used, "%s'%s'", used ? ", " : "", days[day]);
+        }
+    }
+    return snprintf(out, size,
+                    "{'id': %d, 'name': 'Rutina %d', 'condition': '%s', 'isDry': %s, "
+                    "'startTime': '%02d:%02d', 'endTime': '%02d:%02d', 'days': [%s]}",
+                    id, id, condition, dry ? "True" : "False", startMinute / 60, startMinute % 60,
+                    endMinute / 60, endMinute % 60, dayList);
+}
+
+// Parses payloads into set, as the network task does; returns how many
+// were added
+template <int N>
+int addRoutines(RoutineSet<N>& set, const char* const* payloads, int count) {
+    int added = 0;
+    for (int i = 0; i < count; i++) {
+        Routine routine;
+        RoutineCondition condition;
+        char name[ROUTINE_NAME_LENGTH];
+        if (routineParseData(payloads[i], strlen(payloads[i]), routine, condition, name) &&
+            set.upsert(routine, condition, name) >= 0) {
+            added++;
+        }
+    }
+    return added;
+}
+
+#endif
@@ -0,0 +1,159 @@
+// The steady-state allocation check as a test: NativeMemory's counters on
+// their own, then a device with its network task on a thread and the clock
+// 200 times faster, with the backend down and then up. Once warmed up, the
+// control loop and network task must not allocate beyond the DNS retries
+// while the backend is down, nor at all once it answers, and live bytes
+// must not grow. With glibc only, like the counters.
+//
+//   pio test -e native -f test_allocation_check -v
+
+#include <unity.h>
+#include <stdlib.h>
+#include <string>
+#include "MockHal.h"
+#include "HttpStandIn.h"
+#include "DeviceManagerImpl.h"
+#include "TelemetryLogImpl.h"
+#include "Log.h"
+
+namespace {
+
+// The mock's storage grows containers as the telemetry log fills; the
+// native one writes files with plain descriptors, as flash does in place
+struct AllocHal : MockHal {
+    using Clock = NativeClock;
+    using Tasks = NativeTasks;
+    using Storage = NativeStorage;
+};
+
+const unsigned long WARMUP_MS = 10 * 60000;
+const unsigned long MEASURE_MS = 30 * 60000;
+
+HttpStandIn server;
+
+// Device info, an empty routine list and telemetry, with ETags as the
+// backend sends them; no event stream, so the device polls
+std::string backend(const HttpStandInRequest& request) {
+    if (request.method == "POST") {
+        return HttpStandIn::response(200, "{}");
+    }
+    if (request.path.find("/events") != std::string::npos) {
+        return HttpStandIn::response(404, "");
+    }
+    bool routines = request.path.find("/routine-monitoring/") != std::string::npos;
+    const char* etag = routines ? "\"routines-1\"" : "\"info-1\"";
+    if (request.headers.find(etag) != std::string::npos) {
+        return HttpStandIn::response(304, "");
+    }
+    std::string headers = std::string("ETag: ") + etag + "\r\n";
+    if (routines) {
+        return HttpStandIn::response(200, "[]", headers.c_str());
+    }
+    return HttpStandIn::response(200,
+                                 "{\"humidifier_info\":{\"calidadDeAireMin\":0,\"calidadDeAireMax\":500,"
+                                 "\"temperaturaMin\":5,\"temperaturaMax\":35,\"humedadMin\":20,"
+                                 "\"humedadMax\":90,\"estado\":false}}", headers.c_str());
+}
+
+// Runs the control loop for ms of simulated time; returns the iterations
+unsigned long run(DeviceManager<AllocHal>& device, unsigned long ms) {
+    unsigned long start = NativeClock::millis();
+    unsigned long iterations = 0;
+    while (NativeClock::millis() - start < ms) {
+        device.loop();
+        iterations++;
+    }
+    return iterations;
+}
+
+// Counts allocations over ms of simulated time, after a warmup
+double measure(DeviceManager<AllocHal>& device, const char* name) {
+    run(device, WARMUP_MS);
+    NativeMemory::resetTracking();
+    NativeMemory::setTracking(true);
+    unsigned long iterations = run(device, MEASURE_MS);
+    NativeMemory::setTracking(false);
+
+    double perIteration = (double)NativeMemory::allocations() / iterations;
+    char message[160];
+    snprintf(message, sizeof(message), "%s: %lu iterations over %lu s, %lu allocations (%.4f per iteration), live bytes %+ld",
+             name, iterations, MEASURE_MS / 1000, NativeMemory::allocations(), perIteration, NativeMemory::liveBytes());
+    TEST_MESSAGE(message);
+    if (NativeMemory::allocations() > 0) {
+        NativeMemory::printSites(stdout, 10);
+    }
+    return perIteration;
+}
+
+}
+
+void setUp(void) {
+    MockHal::reset();
+    logSetLevel(LOG_LEVEL_NONE);
+}
+
+void tearDown(void) {
+}
+
+void test_counters(void) {
+    if (!NativeMemory::trackingAvailable()) {
+        TEST_IGNORE_MESSAGE("allocation tracking needs glibc");
+    }
+    NativeMemory::resetTracking();
+    NativeMemory::setTracking(true);
+    void* blocks[10];
+    for (int i = 0; i < 10; i++) {
+        blocks[i] = malloc(100 + i);
+    }
+    blocks[0] = realloc(blocks[0], 4000);
+    long live = NativeMemory::liveBytes();
+    for (int i = 0; i < 10; i++) {
+        free(blocks[i]);
+    }
+    NativeMemory::setTracking(false);
+
+    TEST_ASSERT_EQUAL_UINT32(11, NativeMemory::allocations());
+    TEST_ASSERT_TRUE(live >= 4000 + 9 * 100);
+    TEST_ASSERT_EQUAL(0, NativeMemory::liveBytes());
+}
+
+void test_steady_state(void) {
+    if (!NativeMemory::trackingAvailable()) {
+        TEST_IGNORE_MESSAGE("allocation tracking needs glibc");
+    }
+
+    // The device keeps running after the test, so it is never deleted
+    DeviceManager<AllocHal>* device = new DeviceManager<AllocHal>();
+    device->setServerIP("127.0.0.1");
+    device->setup();
+
+    // Nothing listening: failed connects, retries and backoff, with
+    // readings piling up in the telemetry log
+    double down = measure(*device, "backend down");
+    TEST_ASSERT_TRUE(down <= 0.05);
+    TEST_ASSERT_TRUE(NativeMemory::liveBytes() <= 0);
+
+    server.setHandler(&backend);
+    if (!server.start(5000)) {
+        TEST_IGNORE_MESSAGE("port 5000 is in use");
+    }
+    measure(*device, "backend up");
+    TEST_ASSERT_TRUE(server.requests > 0);
+    TEST_ASSERT_EQUAL_UINT32(0, NativeMemory::allocations());
+    TEST_ASSERT_TRUE(NativeMemory::liveBytes() <= 0);
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    // Before the clock is first read, and a fresh telemetry log
+    setenv("CHAKIY_TIME_SCALE", "200", 1);
+    char flash[] = "/tmp/chakiy-alloc-XXXXXX";
+    if (mkdtemp(flash)) {
+        setenv("CHAKIY_FLASH_DIR", flash, 1);
+    }
+    UNITY_BEGIN();
+    RUN_TEST(test_counters);
+    RUN_TEST(test_steady_state);
+    return UNITY_END();
+}
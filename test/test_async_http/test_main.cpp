@@ -0,0 +1,229 @@
+// AsyncHttpClient against a stand-in server on real sockets: keep-alive,
+// pipelining, replay when a connection drops, cancel and deadlines.
+//
+//   pio test -e native -f test_async_http -v
+
+#include <unity.h>
+#include <chrono>
+#include <string>
+#include "AsyncHttpClient.h"
+#include "HttpStandIn.h"
+
+namespace {
+
+HttpStandIn server;
+
+unsigned long realMillis() {
+    return (unsigned long)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct Result {
+    int calls = 0;
+    int status = 0;
+    std::string body;
+    unsigned long finishedAt = 0;
+};
+
+void record(void* context, const HttpResponse& response) {
+    Result* result = static_cast<Result*>(context);
+    result->calls++;
+    result->status = response.status;
+    result->body.assign(response.body, response.bodyLength);
+    result->finishedAt = realMillis();
+}
+
+bool get(AsyncHttpClient& client, const char* path, Result& result, unsigned long timeoutMs = 2000) {
+    return client.submit("127.0.0.1", server.port(), "GET", path, nullptr, nullptr, 0, timeoutMs, &record, &result);
+}
+
+// Polls until every result has its callback, or two seconds pass
+void pollUntilDone(AsyncHttpClient& client, Result* results, int count) {
+    unsigned long start = realMillis();
+    while (realMillis() - start < 2000) {
+        bool done = true;
+        for (int i = 0; i < count; i++) done = done && results[i].calls > 0;
+        if (done) return;
+        client.poll(10);
+    }
+}
+
+// Echoes the method and path
+std::string echo(const HttpStandInRequest& request) {
+    return HttpStandIn::response(200, request.method + " " + request.path);
+}
+
+}
+
+void setUp(void) {
+    server.resetCounters();
+    server.setHandler(&echo);
+}
+
+void tearDown(void) {
+}
+
+void test_connection_is_kept_alive(void) {
+    AsyncHttpClient client(&realMillis);
+    for (int i = 0; i < 5; i++) {
+        Result result;
+        TEST_ASSERT_TRUE(get(client, "/api/a", result));
+        pollUntilDone(client, &result, 1);
+        TEST_ASSERT_EQUAL(1, result.calls);
+        TEST_ASSERT_EQUAL(200, result.status);
+        TEST_ASSERT_EQUAL_STRING("GET /api/a", result.body.c_str());
+    }
+    TEST_ASSERT_EQUAL(1, server.connections.load());
+    TEST_ASSERT_EQUAL(1, (int)client.getStats().handshakes);
+    TEST_ASSERT_EQUAL(4, (int)client.getStats().reuses);
+}
+
+void test_requests_are_pipelined_in_order(void) {
+    AsyncHttpClient client(&realMillis);
+    Result first;
+    get(client, "/first", first);
+    pollUntilDone(client, &first, 1);
+    TEST_ASSERT_EQUAL(200, first.status);
+
+    // The server has kept the connection open, so the rest queue behind
+    // each other on it; it answers slowly enough for them to pile up
+    server.setHandler([](const HttpStandInRequest& request) {
+        usleep(50000);
+        return echo(request);
+    });
+    Result results[3];
+    const char* paths[] = { "/p0", "/p1", "/p2" };
+    for (int i = 0; i < 3; i++) {
+        TEST_ASSERT_TRUE(get(client, paths[i], results[i]));
+    }
+    TEST_ASSERT_FALSE(client.canSubmit());
+    pollUntilDone(client, results, 3);
+
+    for (int i = 0; i < 3; i++) {
+        TEST_ASSERT_EQUAL(200, results[i].status);
+        TEST_ASSERT_EQUAL_STRING((std::string("GET ") + paths[i]).c_str(), results[i].body.c_str());
+    }
+    TEST_ASSERT_TRUE(results[0].finishedAt <= results[1].finishedAt && results[1].finishedAt <= results[2].finishedAt);
+    TEST_ASSERT_EQUAL(1, server.connections.load());
+    TEST_ASSERT_EQUAL(2, (int)client.getStats().pipelined);
+}
+
+void test_dropped_get_is_replayed_once(void) {
+    AsyncHttpClient client(&realMillis);
+    Result first;
+    get(client, "/first", first);
+    pollUntilDone(client, &first, 1);
+
+    // The second request on the first connection is read and never answered
+    server.setHandler([](const HttpStandInRequest& request) {
+        return request.connection == 1 && request.number == 2 ? std::string() : echo(request);
+    });
+    Result second;
+    get(client, "/second", second);
+    pollUntilDone(client, &second, 1);
+
+    TEST_ASSERT_EQUAL(1, second.calls);
+    TEST_ASSERT_EQUAL(200, second.status);
+    TEST_ASSERT_EQUAL_STRING("GET /second", second.body.c_str());
+    TEST_ASSERT_EQUAL(1, (int)client.getStats().retries);
+    TEST_ASSERT_EQUAL(2, server.connections.load());
+    TEST_ASSERT_EQUAL(3, server.requests.load());
+}
+
+void test_sent_post_is_not_replayed(void) {
+    AsyncHttpClient client(&realMillis);
+    Result first;
+    get(client, "/first", first);
+    pollUntilDone(client, &first, 1);
+
+    server.setHandler([](const HttpStandInRequest& request) {
+        return request.method == "POST" ? std::string() : echo(request);
+    });
+    Result post;
+    const char body[] = "{\"temperature\": 24.0}";
+    TEST_ASSERT_TRUE(client.submit("127.0.0.1", server.port(), "POST", "/api/data", nullptr, body, sizeof(body) - 1,
+                                   2000, &record, &post));
+    pollUntilDone(client, &post, 1);
+
+    // The server may have acted on it, so it fails rather than repeating
+    TEST_ASSERT_EQUAL(1, post.calls);
+    TEST_ASSERT_TRUE(post.status < 0);
+    TEST_ASSERT_EQUAL(0, (int)client.getStats().retries);
+    TEST_ASSERT_EQUAL(2, server.requests.load());
+}
+
+void test_stale_connection_is_replaced(void) {
+    // The server closes idle connections without saying so
+    server.closeAfterReply = true;
+    AsyncHttpClient client(&realMillis);
+    for (int i = 0; i < 3; i++) {
+        Result result;
+        get(client, "/api/a", result);
+        pollUntilDone(client, &result, 1);
+        TEST_ASSERT_EQUAL(200, result.status);
+        usleep(20000);
+    }
+    TEST_ASSERT_EQUAL(3, server.connections.load());
+    TEST_ASSERT_EQUAL(3, (int)client.getStats().handshakes);
+}
+
+void test_cancel_reports_once(void) {
+    server.setHandler([](const HttpStandInRequest& request) {
+        usleep(500000);
+        return echo(request);
+    });
+    AsyncHttpClient client(&realMillis);
+    Result result;
+    get(client, "/slow", result);
+    for (int i = 0; i < 5; i++) client.poll(10);
+    TEST_ASSERT_EQUAL(0, result.calls);
+
+    TEST_ASSERT_TRUE(client.cancel(&record, &result));
+    TEST_ASSERT_EQUAL(1, result.calls);
+    TEST_ASSERT_EQUAL(HTTP_ERROR_CANCELLED, result.status);
+    TEST_ASSERT_FALSE(client.cancel(&record, &result));
+    TEST_ASSERT_EQUAL(0, client.getInFlight());
+
+    // The late answer goes nowhere, and the slot is free again
+    unsigned long start = realMillis();
+    while (realMillis() - start < 700) client.poll(10);
+    TEST_ASSERT_EQUAL(1, result.calls);
+    server.setHandler(&echo);
+    Result next;
+    get(client, "/next", next);
+    pollUntilDone(client, &next, 1);
+    TEST_ASSERT_EQUAL(200, next.status);
+}
+
+void test_deadline_ends_a_silent_request(void) {
+    server.setHandler([](const HttpStandInRequest& request) {
+        usleep(1000000);
+        return echo(request);
+    });
+    AsyncHttpClient client(&realMillis);
+    Result result;
+    unsigned long start = realMillis();
+    get(client, "/silent", result, 200);
+    pollUntilDone(client, &result, 1);
+
+    TEST_ASSERT_EQUAL(HTTP_ERROR_TIMEOUT, result.status);
+    TEST_ASSERT_TRUE(result.finishedAt - start >= 200 && result.finishedAt - start < 400);
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    if (!server.start()) {
+        TEST_MESSAGE("Cannot listen on 127.0.0.1");
+        return UNITY_END();
+    }
+    RUN_TEST(test_connection_is_kept_alive);
+    RUN_TEST(test_requests_are_pipelined_in_order);
+    RUN_TEST(test_dropped_get_is_replayed_once);
+    RUN_TEST(test_sent_post_is_not_replayed);
+    RUN_TEST(test_stale_connection_is_replaced);
+    RUN_TEST(test_cancel_reports_once);
+    RUN_TEST(test_deadline_ends_a_silent_request);
+    return UNITY_END();
+}
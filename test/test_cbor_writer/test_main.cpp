@@ -0,0 +1,262 @@
+// CborWriter against the encoding examples of RFC 8949 (Appendix A):
+// integer heads at every width boundary, negative integers down to
+// INT64_MIN, single-precision floats, simple values, text and nested
+// containers, byte for byte; then a buffer that runs out.
+//
+//   pio test -e native -f test_cbor_writer -v
+
+#include <unity.h>
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include "CborWriter.h"
+
+namespace {
+
+uint8_t buffer[64];
+
+// The bytes written as hex, so a mismatch shows the whole encoding
+std::string hex(const uint8_t* data, size_t length) {
+    std::string out;
+    char byte[4];
+    for (size_t i = 0; i < length; i++) {
+        snprintf(byte, sizeof(byte), i > 0 ? " %02x" : "%02x", data[i]);
+        out += byte;
+    }
+    return out;
+}
+
+void expectBytes(const char* expected, const CborWriter& writer) {
+    TEST_ASSERT_TRUE(writer.ok());
+    std::string written = hex(buffer, writer.size());
+    TEST_ASSERT_EQUAL_STRING(expected, written.c_str());
+}
+
+void expectUnsigned(uint64_t value, const char* expected) {
+    CborWriter writer(buffer, sizeof(buffer));
+    writer.writeUnsigned(value);
+    expectBytes(expected, writer);
+}
+
+void expectInt(int64_t value, const char* expected) {
+    CborWriter writer(buffer, sizeof(buffer));
+    writer.writeInt(value);
+    expectBytes(expected, writer);
+}
+
+void expectFloat(float value, const char* expected) {
+    CborWriter writer(buffer, sizeof(buffer));
+    writer.writeFloat(value);
+    expectBytes(expected, writer);
+}
+
+void expectText(const char* text, const char* expected) {
+    CborWriter writer(buffer, sizeof(buffer));
+    writer.writeText(text);
+    expectBytes(expected, writer);
+}
+
+}
+
+void setUp(void) {
+    memset(buffer, 0xEE, sizeof(buffer));
+}
+
+void tearDown(void) {
+}
+
+void test_unsigned_integers(void) {
+    expectUnsigned(0, "00");
+    expectUnsigned(1, "01");
+    expectUnsigned(10, "0a");
+    expectUnsigned(23, "17");
+    expectUnsigned(24, "18 18");
+    expectUnsigned(25, "18 19");
+    expectUnsigned(100, "18 64");
+    expectUnsigned(255, "18 ff");
+    expectUnsigned(256, "19 01 00");
+    expectUnsigned(1000, "19 03 e8");
+    expectUnsigned(65535, "19 ff ff");
+    expectUnsigned(65536, "1a 00 01 00 00");
+    expectUnsigned(1000000, "1a 00 0f 42 40");
+    expectUnsigned(4294967295ULL, "1a ff ff ff ff");
+    expectUnsigned(4294967296ULL, "1b 00 00 00 01 00 00 00 00");
+    expectUnsigned(1000000000000ULL, "1b 00 00 00 e8 d4 a5 10 00");
+    expectUnsigned(UINT64_MAX, "1b ff ff ff ff ff ff ff ff");
+}
+
+void test_signed_integers(void) {
+    expectInt(0, "00");
+    expectInt(24, "18 18");
+    expectInt(-1, "20");
+    expectInt(-10, "29");
+    expectInt(-24, "37");
+    expectInt(-25, "38 18");
+    expectInt(-100, "38 63");
+    expectInt(-256, "38 ff");
+    expectInt(-257, "39 01 00");
+    expectInt(-1000, "39 03 e7");
+    expectInt(-4294967296LL, "3a ff ff ff ff");
+    expectInt(INT64_MAX, "1b 7f ff ff ff ff ff ff ff");
+    expectInt(INT64_MIN, "3b 7f ff ff ff ff ff ff ff");
+}
+
+void test_single_precision_floats(void) {
+    // Always written in 32 bits, even where the RFC's shortest form is half
+    expectFloat(100000.0f, "fa 47 c3 50 00");
+    expectFloat(FLT_MAX, "fa 7f 7f ff ff");
+    expectFloat(0.0f, "fa 00 00 00 00");
+    expectFloat(-0.0f, "fa 80 00 00 00");
+    expectFloat(1.5f, "fa 3f c0 00 00");
+    expectFloat(-4.0f, "fa c0 80 00 00");
+    expectFloat(INFINITY, "fa 7f 80 00 00");
+    expectFloat(-INFINITY, "fa ff 80 00 00");
+}
+
+void test_simple_values(void) {
+    CborWriter writer(buffer, sizeof(buffer));
+    writer.writeBool(false);
+    writer.writeBool(true);
+    expectBytes("f4 f5", writer);
+}
+
+void test_text(void) {
+    expectText("", "60");
+    expectText("a", "61 61");
+    expectText("IETF", "64 49 45 54 46");
+    expectText("\"\\", "62 22 5c");
+    expectText("\xc3\xbc", "62 c3 bc");
+    expectText("\xe6\xb0\xb4", "63 e6 b0 b4");
+
+    // Past 23 bytes the length takes a byte of its own
+    CborWriter writer(buffer, sizeof(buffer));
+    writer.writeText("abcdefghijklmnopqrstuvwxyz", 24);
+    TEST_ASSERT_TRUE(writer.ok());
+    TEST_ASSERT_EQUAL_UINT32(26, writer.size());
+    TEST_ASSERT_EQUAL_UINT8(0x78, buffer[0]);
+    TEST_ASSERT_EQUAL_UINT8(24, buffer[1]);
+    TEST_ASSERT_EQUAL_UINT8('a', buffer[2]);
+    TEST_ASSERT_EQUAL_UINT8('x', buffer[25]);
+}
+
+void test_containers(void) {
+    {
+        CborWriter writer(buffer, sizeof(buffer));
+        writer.beginArray(0);
+        expectBytes("80", writer);
+    }
+    {
+        CborWriter writer(buffer, sizeof(buffer));
+        writer.beginMap(0);
+        expectBytes("a0", writer);
+    }
+    {
+        // [1, [2, 3], [4, 5]]
+        CborWriter writer(buffer, sizeof(buffer));
+        writer.beginArray(3);
+        writer.writeUnsigned(1);
+        writer.beginArray(2);
+        writer.writeUnsigned(2);
+        writer.writeUnsigned(3);
+        writer.beginArray(2);
+        writer.writeUnsigned(4);
+        writer.writeUnsigned(5);
+        expectBytes("83 01 82 02 03 82 04 05", writer);
+    }
+    {
+        // {"a": 1, "b": [2, 3]}
+        CborWriter writer(buffer, sizeof(buffer));
+        writer.beginMap(2);
+        writer.writeText("a");
+        writer.writeUnsigned(1);
+        writer.writeText("b");
+        writer.beginArray(2);
+        writer.writeUnsigned(2);
+        writer.writeUnsigned(3);
+        expectBytes("a2 61 61 01 61 62 82 02 03", writer);
+    }
+    {
+        // ["a", {"b": "c"}]
+        CborWriter writer(buffer, sizeof(buffer));
+        writer.beginArray(2);
+        writer.writeText("a");
+        writer.beginMap(1);
+        writer.writeText("b");
+        writer.writeText("c");
+        expectBytes("82 61 61 a1 61 62 61 63", writer);
+    }
+    {
+        // [1, 2, ..., 25]: the count takes a byte of its own
+        CborWriter writer(buffer, sizeof(buffer));
+        writer.beginArray(25);
+        for (int i = 1; i <= 25; i++) {
+            writer.writeUnsigned(i);
+        }
+        expectBytes("98 19 01 02 03 04 05 06 07 08 09 0a 0b 0c 0d 0e 0f 10 11 12 13 14 15 16 17 18 18 18 19",
+                    writer);
+    }
+    {
+        // Heads of large containers, whose items would not fit here
+        CborWriter writer(buffer, sizeof(buffer));
+        writer.beginMap(256);
+        writer.beginArray(65536);
+        expectBytes("b9 01 00 9a 00 01 00 00", writer);
+    }
+}
+
+void test_overflow_stops_writing(void) {
+    CborWriter writer(buffer, 8);
+    writer.writeUnsigned(1000000);            // 5 bytes
+    writer.writeUnsigned(1000);               // 3 bytes: exactly full
+    TEST_ASSERT_TRUE(writer.ok());
+    TEST_ASSERT_EQUAL_UINT32(8, writer.size());
+
+    writer.writeBool(true);
+    TEST_ASSERT_FALSE(writer.ok());
+    TEST_ASSERT_EQUAL_UINT32(8, writer.size());
+
+    // Nothing is written past the buffer, nor anything after the overflow
+    TEST_ASSERT_EQUAL_UINT8(0xEE, buffer[8]);
+    writer.writeText("abc");
+    writer.writeFloat(1.0f);
+    writer.beginMap(1);
+    TEST_ASSERT_FALSE(writer.ok());
+    TEST_ASSERT_EQUAL_UINT32(8, writer.size());
+    TEST_ASSERT_EQUAL_UINT8(0xEE, buffer[8]);
+}
+
+void test_item_too_large_is_not_written_in_part(void) {
+    // A 5-byte float with 4 bytes left leaves the buffer as it was, and
+    // a later item that would fit is dropped too: the output is unusable
+    CborWriter writer(buffer, 5);
+    writer.writeUnsigned(0);
+    writer.writeFloat(100000.0f);
+    TEST_ASSERT_FALSE(writer.ok());
+    TEST_ASSERT_EQUAL_UINT32(1, writer.size());
+    TEST_ASSERT_EQUAL_UINT8(0xEE, buffer[1]);
+    writer.writeUnsigned(1);
+    TEST_ASSERT_EQUAL_UINT32(1, writer.size());
+
+    CborWriter empty(buffer, 0);
+    empty.writeUnsigned(0);
+    TEST_ASSERT_FALSE(empty.ok());
+    TEST_ASSERT_EQUAL_UINT32(0, empty.size());
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_unsigned_integers);
+    RUN_TEST(test_signed_integers);
+    RUN_TEST(test_single_precision_floats);
+    RUN_TEST(test_simple_values);
+    RUN_TEST(test_text);
+    RUN_TEST(test_containers);
+    RUN_TEST(test_overflow_stops_writing);
+    RUN_TEST(test_item_too_large_is_not_written_in_part);
+    return UNITY_END();
+}
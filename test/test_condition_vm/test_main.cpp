@@ -0,0 +1,207 @@
+// The routine condition compiler and VM: what compiles and evaluates to
+// what, hysteresis, what is rejected, formatting back to text, bands, and
+// evaluations per second for 100 routines of each condition shape against
+// the inline float compare that single thresholds used to be.
+//
+//   pio test -e native -f test_condition_vm -v
+
+#include <unity.h>
+#include <string.h>
+#include <chrono>
+#include "RoutineCondition.h"
+#include "TestRoutines.h"
+
+namespace {
+
+bool compile(const char* text, RoutineCondition& condition, bool isDry = false) {
+    return conditionCompile(text, strlen(text), isDry, condition);
+}
+
+bool evaluate(const char* text, float temperature, float humidity, float ica, bool active = false) {
+    RoutineCondition condition;
+    if (!compile(text, condition)) {
+        char message[96];
+        snprintf(message, sizeof(message), "did not compile: %s", text);
+        TEST_FAIL_MESSAGE(message);
+    }
+    float inputs[INPUT_COUNT];
+    inputs[INPUT_TEMPERATURE] = temperature;
+    inputs[INPUT_HUMIDITY] = humidity;
+    inputs[INPUT_ICA] = ica;
+    return conditionEvaluate(condition, inputs, active);
+}
+
+void expectFormat(const char* text, const char* expected) {
+    RoutineCondition condition;
+    TEST_ASSERT_TRUE(compile(text, condition));
+    char out[CONDITION_TEXT_LENGTH];
+    conditionFormat(condition, out, sizeof(out));
+    TEST_ASSERT_EQUAL_STRING(expected, out);
+}
+
+double nanosSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+void test_bare_number_keeps_its_old_meaning(void) {
+    // Above the threshold for a dehumidifier, below it for a humidifier
+    RoutineCondition condition;
+    TEST_ASSERT_TRUE(compile("60", condition, true));
+    float inputs[INPUT_COUNT] = { 20, 61, 0 };
+    TEST_ASSERT_TRUE(conditionEvaluate(condition, inputs, false));
+    inputs[INPUT_HUMIDITY] = 60;
+    TEST_ASSERT_FALSE(conditionEvaluate(condition, inputs, false));
+
+    TEST_ASSERT_TRUE(compile(" 45.5 ", condition, false));
+    inputs[INPUT_HUMIDITY] = 45;
+    TEST_ASSERT_TRUE(conditionEvaluate(condition, inputs, false));
+}
+
+void test_expressions(void) {
+    TEST_ASSERT_TRUE(evaluate("humidity > 60 && temperature < 30", 25, 65, 0));
+    TEST_ASSERT_FALSE(evaluate("humidity > 60 && temperature < 30", 31, 65, 0));
+    TEST_ASSERT_TRUE(evaluate("hum < 40 || temp >= 30", 30, 65, 0));
+    TEST_ASSERT_TRUE(evaluate("HUMIDITY <= 40 or ICA > 10", 0, 50, 11));
+    TEST_ASSERT_TRUE(evaluate("not (ica > 10)", 0, 0, 5));
+    TEST_ASSERT_TRUE(evaluate("!(ica > 10) and temp > 1", 2, 0, 5));
+    // && binds tighter than ||
+    TEST_ASSERT_TRUE(evaluate("temp > 1 || hum > 1 && ica > 100", 2, 0, 0));
+    TEST_ASSERT_FALSE(evaluate("(temp > 1 || hum > 1) && ica > 100", 2, 0, 0));
+}
+
+void test_hysteresis_applies_while_active(void) {
+    TEST_ASSERT_FALSE(evaluate("humidity > 60 ~ 3", 0, 58, 0, false));
+    TEST_ASSERT_TRUE(evaluate("humidity > 60 ~ 3", 0, 58, 0, true));
+    TEST_ASSERT_FALSE(evaluate("humidity > 60 ~ 3", 0, 57, 0, true));
+    TEST_ASSERT_TRUE(evaluate("humidity < 40 ~2", 0, 41, 0, true));
+}
+
+void test_rejected(void) {
+    const char* const bad[] = {
+        "", "humidity", "humidity >", "humidity > x", "pressure > 3", "humidity > 60 &&",
+        "(humidity > 60", "humidity > 60)", "!(humidity > 60 ~ 2)", "humidity > 60 ~ -1", "60 70",
+        "humidity >> 3", "humidityx > 3", "hum > nan", "hum > 1e99",
+        // Too long for the code buffer, too deeply nested, too deep a stack
+        "temp > 1 && temp > 2 && temp > 3 && temp > 4 && temp > 5 && temp > 6 && temp > 7 && temp > 8",
+        "((((((((((temp > 1))))))))))",
+        "t > 1 || (t > 1 || (t > 1 || (t > 1 || (t > 1 || (t > 1 || (t > 1 || (t > 1 || t > 1)))))))",
+    };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        RoutineCondition condition;
+        if (compile(bad[i], condition)) {
+            char message[160];
+            snprintf(message, sizeof(message), "accepted: %s", bad[i]);
+            TEST_FAIL_MESSAGE(message);
+        }
+    }
+}
+
+void test_format_round_trip(void) {
+    expectFormat("humidity > 60", "humidity > 60");
+    expectFormat("hum>60.5 && (temp<30 || ica>=50)", "humidity > 60.5 && (temperature < 30 || ica >= 50)");
+    expectFormat("not (temp <= 1 and hum > 2) or ica < 3", "!(temperature <= 1 && humidity > 2) || ica < 3");
+    expectFormat("humidity > 60 ~ 3", "humidity > 60 ~ 3");
+}
+
+void test_bands_bound_the_decision(void) {
+    RoutineCondition condition;
+    TEST_ASSERT_TRUE(compile("hum > 60 && temp < 30", condition));
+    ConditionBands bands;
+    conditionResetBands(bands);
+    float inputs[INPUT_COUNT] = { 25, 65, 0 };
+    conditionEvaluate(condition, inputs, false, &bands);
+    TEST_ASSERT_TRUE(bands.low[INPUT_HUMIDITY] == 60 && bands.high[INPUT_TEMPERATURE] == 30);
+    TEST_ASSERT_TRUE(conditionInBands(bands, inputs));
+    inputs[INPUT_HUMIDITY] = 59;
+    TEST_ASSERT_FALSE(conditionInBands(bands, inputs));
+}
+
+void test_benchmark_evaluations_per_second(void) {
+    const int ROUTINES = 100;
+    const long ROUNDS = 200000;
+    const char* const forms[] = {
+        "%d",
+        "humidity > %d && temperature < 28",
+        "humidity > %d ~ 3 || (ica > 40 && temp > 30)",
+        "temp >= 18 && (ica < 50 || !(humidity <= %d)) && hum < 90",
+    };
+    const char* const names[] = { "'60'", "two comparisons", "three, hysteresis", "four, with a negation", "mixed" };
+    TestRandom random(3);
+
+    // Inputs change every round, as readings do between checks
+    float inputs[64][INPUT_COUNT];
+    for (int k = 0; k < 64; k++) {
+        inputs[k][INPUT_TEMPERATURE] = 15 + random.next(200) * 0.1f;
+        inputs[k][INPUT_HUMIDITY] = 30 + random.next(600) * 0.1f;
+        inputs[k][INPUT_ICA] = random.next(80);
+    }
+
+    for (int mix = 0; mix < 5; mix++) {
+        RoutineCondition conditions[ROUTINES];
+        bool dry[ROUTINES];
+        float thresholds[ROUTINES];
+        int bytes = 0;
+        for (int i = 0; i < ROUTINES; i++) {
+            char text[96];
+            int form = mix < 4 ? mix : (int)random.next(4);
+            int threshold = 40 + random.next(41);
+            snprintf(text, sizeof(text), forms[form], threshold);
+            dry[i] = random.next(2);
+            thresholds[i] = threshold;
+            TEST_ASSERT_TRUE(compile(text, conditions[i], dry[i]));
+            bytes += conditions[i].length;
+        }
+
+        long hits = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (long round = 0; round < ROUNDS; round++) {
+            const float* in = inputs[round & 63];
+            for (int i = 0; i < ROUTINES; i++) {
+                hits += conditionEvaluate(conditions[i], in, i == (round & 7));
+            }
+        }
+        double perSecond = ROUNDS * ROUTINES / (nanosSince(start) / 1e9);
+
+        char message[192];
+        int length = snprintf(message, sizeof(message),
+                              "%-22s %4.1f B/condition: %6.1f M evaluations/s, %5.2f us per 100 routines",
+                              names[mix], bytes / (double)ROUTINES, perSecond / 1e6, ROUTINES * 1e6 / perSecond);
+
+        // The single threshold compared inline, as before the VM
+        if (mix == 0) {
+            start = std::chrono::steady_clock::now();
+            for (long round = 0; round < ROUNDS; round++) {
+                const float* in = inputs[round & 63];
+                for (int i = 0; i < ROUTINES; i++) {
+                    hits += dry[i] ? in[INPUT_HUMIDITY] > thresholds[i] : in[INPUT_HUMIDITY] < thresholds[i];
+                }
+            }
+            double inline_ = ROUNDS * ROUTINES / (nanosSince(start) / 1e9);
+            snprintf(message + length, sizeof(message) - length, " (inline compare %.0f M/s)", inline_ / 1e6);
+        }
+        TEST_MESSAGE(message);
+        TEST_ASSERT_GREATER_THAN(0, hits);
+    }
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_bare_number_keeps_its_old_meaning);
+    RUN_TEST(test_expressions);
+    RUN_TEST(test_hysteresis_applies_while_active);
+    RUN_TEST(test_rejected);
+    RUN_TEST(test_format_round_trip);
+    RUN_TEST(test_bands_bound_the_decision);
+    RUN_TEST(test_benchmark_evaluations_per_second);
+    return UNITY_END();
+}
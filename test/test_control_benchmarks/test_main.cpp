@@ -0,0 +1,153 @@
+// Timings of the control path on the host, against the mock HAL:
+// checkActiveRoutines, routine_data parsing, updateDisplay and a full
+// DeviceManager::loop pass. Results are printed; the asserts only check that
+// the work was done.
+//
+//   pio test -e native -f test_control_benchmarks -v
+
+#include <unity.h>
+#include <chrono>
+#include "MockHal.h"
+#include "TestRoutines.h"
+#include "DeviceManagerImpl.h"
+#include "Log.h"
+
+namespace {
+
+const int ROUTINES = StateManager<MockHal>::MAX_ROUTINES;
+
+char payloads[ROUTINES][256];
+const char* payloadPointers[ROUTINES];
+
+void makePayloads() {
+    TestRandom random(7);
+    for (int i = 0; i < ROUTINES; i++) {
+        char condition[16];
+        snprintf(condition, sizeof(condition), "%d", 40 + (int)random.next(41));
+        formatRoutineData(payloads[i], sizeof(payloads[i]), i + 1, condition, random.next(2), 0, 1439, 0x7f);
+        payloadPointers[i] = payloads[i];
+    }
+}
+
+double nanosSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+void report(const char* name, double nanos, long operations) {
+    char message[128];
+    snprintf(message, sizeof(message), "%s: %.0f ns/op (%ld ops)", name, nanos / operations, operations);
+    TEST_MESSAGE(message);
+}
+
+}
+
+void setUp(void) {
+    MockHal::reset();
+    logSetLevel(LOG_LEVEL_NONE);
+    makePayloads();
+}
+
+void tearDown(void) {
+}
+
+void test_check_active_routines(void) {
+    StateManager<MockHal>* states = new StateManager<MockHal>();
+    states->updateDeviceConfiguration(0, 0, 500, 0, 50, 0, 100);
+    RoutineSet<ROUTINES>* set = states->beginRoutineUpdate();
+    TEST_ASSERT_EQUAL(ROUTINES, addRoutines(*set, payloadPointers, ROUTINES));
+    states->publishRoutines();
+    states->acquireRoutines();
+
+    // Humidity drifts like the windowed sensor mean, so some checks cross a
+    // threshold and most are answered from the cached decision
+    const long passes = 20000;
+    float humidity = 55.0f;
+    TestRandom random(3);
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < passes; i++) {
+        humidity += ((int)random.next(3) - 1) * 0.1f;
+        states->updateSensorData(0, 24.0f, humidity);
+        states->checkActiveRoutines();
+    }
+    report("checkActiveRoutines, 100 routines", nanosSince(start), passes);
+
+    // And with nothing cached: every pass evaluates every routine
+    start = std::chrono::steady_clock::now();
+    for (long i = 0; i < passes; i++) {
+        states->updateSensorData(0, 24.0f, i % 2 ? 30.0f : 90.0f);
+        states->checkActiveRoutines();
+    }
+    report("checkActiveRoutines, 100 routines, uncached", nanosSince(start), passes);
+
+    TEST_ASSERT_EQUAL((unsigned long)2 * passes, states->getRoutineCheckStats().checks);
+    states->releaseRoutines();
+    delete states;
+}
+
+void test_parse_routine_data(void) {
+    const long passes = 2000;
+    Routine routine;
+    RoutineCondition condition;
+    char name[ROUTINE_NAME_LENGTH];
+    int parsed = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (long pass = 0; pass < passes; pass++) {
+        for (int i = 0; i < ROUTINES; i++) {
+            parsed += routineParseData(payloads[i], strlen(payloads[i]), routine, condition, name);
+        }
+    }
+    report("routineParseData", nanosSince(start), passes * ROUTINES);
+    TEST_ASSERT_EQUAL(passes * ROUTINES, parsed);
+}
+
+void test_update_display(void) {
+    StateManager<MockHal> states;
+    ActuatorManager<MockHal> actuators;
+    actuators.setStateManager(&states);
+    actuators.begin();
+
+    const long passes = 100000;
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < passes; i++) {
+        states.updateSensorData(0, 20.0f + (i % 100) * 0.1f, 55.0f);
+        actuators.updateDisplay();
+    }
+    report("updateDisplay", nanosSince(start), passes);
+    TEST_ASSERT_EQUAL((unsigned long)passes, actuators.getDisplayStats().frames);
+}
+
+void test_device_manager_loop(void) {
+    DeviceManager<MockHal>* device = new DeviceManager<MockHal>();
+    device->setup();
+
+    // Each pass runs the jobs that are due and then sleeps, which the mock
+    // clock skips, until the next deadline
+    const long passes = 50000;
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < passes; i++) {
+        device->loop();
+        LogEntry entry;
+        while (logRead(entry)) {
+        }
+    }
+    double nanos = nanosSince(start);
+    report("DeviceManager::loop", nanos, passes);
+
+    char message[96];
+    snprintf(message, sizeof(message), "%lu s simulated, %lu sensor reads", MockClock::now / 1000, MockSensor::reads);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_GREATER_THAN(0, (long)MockSensor::reads);
+    delete device;
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_check_active_routines);
+    RUN_TEST(test_parse_routine_data);
+    RUN_TEST(test_update_display);
+    RUN_TEST(test_device_manager_loop);
+    return UNITY_END();
+}
@@ -0,0 +1,169 @@
+// The LCD shadow buffer on the mock display: an unchanged frame sends
+// nothing, a changed reading rewrites only the cells that differ, the LCD
+// always ends up showing the frame, and the bytes per frame over a day of
+// readings against redrawing all four rows.
+//
+//   pio test -e native -f test_display_diff -v
+
+#include <unity.h>
+#include <string>
+#include "MockHal.h"
+#include "TestRoutines.h"
+#include "ActuatorManagerImpl.h"
+#include "Log.h"
+
+namespace {
+
+const int COLS = ActuatorManager<MockHal>::LCD_COLS;
+const int ROWS = ActuatorManager<MockHal>::LCD_ROWS;
+
+// A full redraw: a cursor move and every cell, for each row
+const unsigned long FULL_FRAME_BYTES = ROWS * (1 + COLS);
+
+StateManager<MockHal>* states;
+
+std::string screen(const MockDisplay& lcd) {
+    std::string text;
+    for (int row = 0; row < ROWS; row++) {
+        text += lcd.rowText(row);
+    }
+    return text;
+}
+
+int cellsDiffering(const std::string& before, const std::string& after) {
+    int cells = 0;
+    for (size_t i = 0; i < before.size(); i++) {
+        cells += before[i] != after[i];
+    }
+    return cells;
+}
+
+}
+
+void setUp(void) {
+    MockHal::reset();
+    logSetLevel(LOG_LEVEL_NONE);
+    states = new StateManager<MockHal>();
+}
+
+void tearDown(void) {
+    delete states;
+}
+
+void test_unchanged_frame_sends_nothing(void) {
+    ActuatorManager<MockHal> actuators;
+    actuators.setStateManager(states);
+    actuators.begin();
+    MockDisplay& lcd = *MockDisplay::last;
+
+    states->updateSensorData(0, 22.4f, 55.0f);
+    actuators.updateDisplay();
+    unsigned long bytes = lcd.bytes();
+    actuators.updateDisplay();
+    actuators.updateDisplay();
+
+    TEST_ASSERT_EQUAL_UINT32(bytes, lcd.bytes());
+    TEST_ASSERT_EQUAL_UINT32(3, actuators.getDisplayStats().frames);
+}
+
+void test_changed_reading_rewrites_only_its_cells(void) {
+    ActuatorManager<MockHal> actuators;
+    actuators.setStateManager(states);
+    actuators.begin();
+    MockDisplay& lcd = *MockDisplay::last;
+
+    states->updateSensorData(0, 22.4f, 55.0f);
+    actuators.updateDisplay();
+    std::string before = screen(lcd);
+    unsigned long characters = lcd.characters;
+    unsigned long commands = lcd.commands;
+
+    // One decimal of the temperature; humidity and ICA stay the same
+    states->updateSensorData(0, 22.6f, 55.0f);
+    actuators.updateDisplay();
+    TEST_ASSERT_EQUAL(1, cellsDiffering(before, screen(lcd)));
+    TEST_ASSERT_EQUAL_UINT32(characters + 1, lcd.characters);
+    TEST_ASSERT_EQUAL_UINT32(commands + 1, lcd.commands);
+    std::string reading = lcd.rowText(1);
+    TEST_ASSERT_EQUAL_STRING("T:22.6C H:55%ICA:3  ", reading.c_str());
+
+    // Two cells with one unchanged between them go out as one write of
+    // three, the same bytes as two cursor moves
+    before = screen(lcd);
+    characters = lcd.characters;
+    commands = lcd.commands;
+    states->updateSensorData(0, 21.4f, 55.0f);
+    actuators.updateDisplay();
+    TEST_ASSERT_EQUAL(2, cellsDiffering(before, screen(lcd)));
+    TEST_ASSERT_EQUAL_UINT32(characters + 3, lcd.characters);
+    TEST_ASSERT_EQUAL_UINT32(commands + 1, lcd.commands);
+}
+
+void test_lcd_always_shows_the_frame(void) {
+    ActuatorManager<MockHal> actuators;
+    actuators.setStateManager(states);
+    actuators.begin();
+    MockDisplay& lcd = *MockDisplay::last;
+    const char* const errors[] = { "", "API: timeout", "API: HTTP 500", "WiFi desconectado" };
+
+    TestRandom random(16);
+    for (int i = 0; i < 5000; i++) {
+        states->updateSensorData(0, 10.0f + random.next(300) * 0.1f, 20.0f + random.next(700) * 0.1f);
+        states->setDeviceStatus(0, random.next(2), random.next(2) ? "Humidificador" : "Deshumidificador");
+        states->setApiError(errors[random.next(4)]);
+        actuators.updateDisplay();
+
+        // What a display drawn from scratch with the same state shows
+        ActuatorManager<MockHal> fresh;
+        fresh.setStateManager(states);
+        fresh.begin();
+        fresh.updateDisplay();
+        std::string expected = screen(*MockDisplay::last);
+        std::string shown = screen(lcd);
+        TEST_ASSERT_EQUAL_STRING(expected.c_str(), shown.c_str());
+    }
+    TEST_ASSERT_EQUAL_UINT32(1, lcd.clears);
+}
+
+void test_benchmark_bytes_per_frame(void) {
+    ActuatorManager<MockHal> actuators;
+    actuators.setStateManager(states);
+    actuators.begin();
+    MockDisplay& lcd = *MockDisplay::last;
+
+    // A day of 5 s readings drifting a little each time, the device
+    // switching a few times an hour
+    const int FRAMES = 24 * 60 * 12;
+    TestRandom random(24);
+    float temperature = 22.0f;
+    float humidity = 55.0f;
+    bool on = false;
+    actuators.updateDisplay();
+    unsigned long before = lcd.bytes();
+    for (int i = 0; i < FRAMES; i++) {
+        temperature += (random.next(5) - 2.0f) * 0.05f;
+        humidity += (random.next(5) - 2.0f) * 0.1f;
+        if (random.next(240) == 0) on = !on;
+        states->updateSensorData(0, temperature, humidity);
+        states->setDeviceStatus(0, on);
+        actuators.updateDisplay();
+    }
+    double bytesPerFrame = (double)(lcd.bytes() - before) / FRAMES;
+
+    char message[128];
+    snprintf(message, sizeof(message), "%.2f bytes/frame to the LCD against %lu for a full redraw (%d frames)",
+             bytesPerFrame, FULL_FRAME_BYTES, FRAMES);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_TRUE(bytesPerFrame < FULL_FRAME_BYTES / 4.0);
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_unchanged_frame_sends_nothing);
+    RUN_TEST(test_changed_reading_rewrites_only_its_cells);
+    RUN_TEST(test_lcd_always_shows_the_frame);
+    RUN_TEST(test_benchmark_bytes_per_frame);
+    return UNITY_END();
+}
@@ -0,0 +1,150 @@
+// JobScheduler deadlines and period changes, and the DeviceManager intervals
+// and zone settings that are set before setup().
+//
+//   pio test -e native -f test_job_scheduler -v
+
+#include <unity.h>
+#include "MockHal.h"
+#include "JobScheduler.h"
+#include "DeviceManagerImpl.h"
+#include "Log.h"
+
+namespace {
+
+unsigned long now;
+unsigned long clockNow() { return now; }
+
+struct Counter {
+    int runs = 0;
+    unsigned long lastRun = 0;
+};
+
+void count(void* context) {
+    Counter* counter = static_cast<Counter*>(context);
+    counter->runs++;
+    counter->lastRun = now;
+}
+
+// Steps the clock a millisecond at a time up to until
+void runUntil(JobScheduler& scheduler, unsigned long until) {
+    while (now < until) {
+        now++;
+        scheduler.runDue(now, 1000);
+    }
+}
+
+}
+
+void setUp(void) {
+    now = 0;
+    MockHal::reset();
+    logSetLevel(LOG_LEVEL_NONE);
+}
+
+void tearDown(void) {
+}
+
+void test_periodic_job_keeps_its_phase(void) {
+    JobScheduler scheduler(&clockNow);
+    Counter counter;
+    int id = scheduler.addPeriodic("job", 100, &count, &counter, 50);
+
+    runUntil(scheduler, 1000);
+    TEST_ASSERT_EQUAL(10, counter.runs);
+    TEST_ASSERT_EQUAL(950, counter.lastRun);
+
+    // The next run is one new period after the last deadline
+    TEST_ASSERT_TRUE(scheduler.setPeriod(id, 300));
+    runUntil(scheduler, 1300);
+    TEST_ASSERT_EQUAL(11, counter.runs);
+    TEST_ASSERT_EQUAL(1250, counter.lastRun);
+    TEST_ASSERT_EQUAL(0, scheduler.getStats(id).overruns);
+}
+
+void test_set_period_does_not_rearm_a_cancelled_job(void) {
+    JobScheduler scheduler(&clockNow);
+    Counter counter;
+    int id = scheduler.addPeriodic("job", 100, &count, &counter);
+
+    runUntil(scheduler, 250);
+    TEST_ASSERT_EQUAL(3, counter.runs);
+    TEST_ASSERT_TRUE(scheduler.cancel(id));
+    TEST_ASSERT_TRUE(scheduler.setPeriod(id, 40));
+    TEST_ASSERT_EQUAL(40, scheduler.getPeriod(id));
+    runUntil(scheduler, 2000);
+    TEST_ASSERT_EQUAL(3, counter.runs);
+
+    // Once scheduled again it runs at the new period
+    scheduler.runIn(id, 0);
+    runUntil(scheduler, 2200);
+    TEST_ASSERT_EQUAL(3 + 1 + 5, counter.runs);
+}
+
+void test_missed_slots_are_skipped(void) {
+    JobScheduler scheduler(&clockNow);
+    Counter counter;
+    int id = scheduler.addPeriodic("job", 100, &count, &counter, 100);
+
+    now = 1050;
+    scheduler.runDue(now, 1000);
+    TEST_ASSERT_EQUAL(1, counter.runs);
+    TEST_ASSERT_EQUAL(9, scheduler.getStats(id).overruns);
+    TEST_ASSERT_EQUAL(950, scheduler.getStats(id).maxLatenessMs);
+    TEST_ASSERT_EQUAL(50, scheduler.runDue(now, 1000));
+}
+
+void test_intervals_set_before_setup_apply(void) {
+    DeviceManager<MockHal>* device = new DeviceManager<MockHal>();
+    device->setSensorUpdateInterval(1000);
+    device->setRoutineCheckInterval(2000);
+    device->setup();
+
+    unsigned long start = MockClock::now;
+    unsigned long readsBefore = MockSensor::reads;
+    while (MockClock::now - start < 60000) {
+        device->loop();
+        LogEntry entry;
+        while (logRead(entry)) {
+        }
+    }
+    // One zone read every second rather than every 5 s
+    unsigned long reads = MockSensor::reads - readsBefore;
+    TEST_ASSERT_TRUE(reads >= 59 && reads <= 61);
+    delete device;
+}
+
+void test_zone_settings_are_fixed_after_setup(void) {
+    // The network task reads zone ids and ubications without a lock
+    DeviceManager<MockHal>* device = new DeviceManager<MockHal>();
+    device->setDeviceId("Sala01");
+    device->setUbication("sala");
+    device->setup();
+
+    MockConsole& console = MockHal::console();
+    console.output.clear();
+    device->setDeviceId("Cocina01");
+    device->setUbication("cocina");
+    TEST_ASSERT_EQUAL(-1, device->addZone("Cocina01", "cocina", 25, 26));
+    TEST_ASSERT_EQUAL(1, device->getZoneCount());
+    TEST_ASSERT_TRUE(console.output.find("ERROR") != std::string::npos);
+
+    console.output.clear();
+    device->printZones();
+    TEST_ASSERT_TRUE(console.output.find("Sala01") != std::string::npos);
+    TEST_ASSERT_TRUE(console.output.find("sala") != std::string::npos);
+    TEST_ASSERT_TRUE(console.output.find("Cocina01") == std::string::npos);
+    TEST_ASSERT_TRUE(console.output.find("cocina") == std::string::npos);
+    delete device;
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_periodic_job_keeps_its_phase);
+    RUN_TEST(test_set_period_does_not_rearm_a_cancelled_job);
+    RUN_TEST(test_missed_slots_are_skipped);
+    RUN_TEST(test_intervals_set_before_setup_apply);
+    RUN_TEST(test_zone_settings_are_fixed_after_setup);
+    return UNITY_END();
+}
@@ -0,0 +1,179 @@
+// LatencyHistogram against the exact percentiles of the same samples: a
+// constant, uniform ranges from a few us to seconds, every percentile of a
+// range spanning all the buckets, and values past the last bucket. Below
+// the last bucket a percentile may only read high, and by at most 25%.
+//
+//   pio test -e native -f test_latency_histogram -v
+
+#include <unity.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <algorithm>
+#include <vector>
+#include "LatencyHistogram.h"
+#include "TestRoutines.h"
+
+namespace {
+
+const uint32_t LAST_BUCKET_LOW = 7u << 19;     // 3.67 s; the last bucket starts here
+const uint32_t SAMPLES = 20000;
+
+LatencyHistogram histogram;
+std::vector<uint32_t> samples;
+
+void record(uint32_t micros) {
+    histogram.record(micros);
+    samples.push_back(micros);
+}
+
+// Smallest sample with at least percent% of the samples at or below it, as
+// percentile() defines it
+uint32_t exactPercentile(uint8_t percent) {
+    std::vector<uint32_t> sorted(samples);
+    std::sort(sorted.begin(), sorted.end());
+    uint64_t rank = ((uint64_t)sorted.size() * percent + 99) / 100;
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+// Checks the estimate against the exact value and returns its error in
+// thousandths of the exact value
+unsigned long checkPercentile(uint8_t percent) {
+    uint32_t exact = exactPercentile(percent);
+    uint32_t estimate = histogram.percentile(percent);
+    char message[96];
+    snprintf(message, sizeof(message), "p%u: exact %lu, estimate %lu", percent, (unsigned long)exact,
+             (unsigned long)estimate);
+    TEST_ASSERT_TRUE_MESSAGE(estimate >= exact, message);
+    TEST_ASSERT_TRUE_MESSAGE((uint64_t)(estimate - exact) * 4 <= exact, message);
+    return exact > 0 ? (unsigned long)((uint64_t)(estimate - exact) * 1000 / exact) : 0;
+}
+
+void checkExactFigures() {
+    TEST_ASSERT_EQUAL_UINT32(samples.size(), histogram.getCount());
+    TEST_ASSERT_EQUAL_UINT32(*std::min_element(samples.begin(), samples.end()), histogram.getMin());
+    TEST_ASSERT_EQUAL_UINT32(*std::max_element(samples.begin(), samples.end()), histogram.getMax());
+    uint64_t sum = 0;
+    for (uint32_t sample : samples) {
+        sum += sample;
+    }
+    TEST_ASSERT_EQUAL_UINT32(sum / samples.size(), histogram.getMean());
+}
+
+void recordUniform(TestRandom& random, uint32_t low, uint32_t high) {
+    for (uint32_t i = 0; i < SAMPLES; i++) {
+        record(low + random.next(high - low + 1));
+    }
+}
+
+}
+
+void setUp(void) {
+    histogram.reset();
+    samples.clear();
+}
+
+void tearDown(void) {
+}
+
+void test_empty_histogram_reads_zero(void) {
+    TEST_ASSERT_EQUAL_UINT32(0, histogram.getCount());
+    TEST_ASSERT_EQUAL_UINT32(0, histogram.getMin());
+    TEST_ASSERT_EQUAL_UINT32(0, histogram.getMax());
+    TEST_ASSERT_EQUAL_UINT32(0, histogram.getMean());
+    TEST_ASSERT_EQUAL_UINT32(0, histogram.percentile(50));
+
+    histogram.record(1234);
+    histogram.reset();
+    TEST_ASSERT_EQUAL_UINT32(0, histogram.getCount());
+    TEST_ASSERT_EQUAL_UINT32(0, histogram.percentile(99));
+}
+
+void test_constant_is_exact(void) {
+    // Clamped to min and max, every percentile of a constant is the constant
+    static const uint32_t values[] = {0, 1, 3, 4, 5, 7, 8, 100, 1023, 1024, 12345, 1000000, LAST_BUCKET_LOW - 1,
+                                      LAST_BUCKET_LOW, 10000000, UINT32_MAX};
+    for (uint32_t value : values) {
+        setUp();
+        for (int i = 0; i < 1000; i++) {
+            record(value);
+        }
+        checkExactFigures();
+        TEST_ASSERT_EQUAL_UINT32(value, histogram.percentile(0));
+        TEST_ASSERT_EQUAL_UINT32(value, histogram.percentile(50));
+        TEST_ASSERT_EQUAL_UINT32(value, histogram.percentile(99));
+        TEST_ASSERT_EQUAL_UINT32(value, histogram.percentile(100));
+    }
+}
+
+void test_uniform_ranges_within_bound(void) {
+    static const uint32_t ranges[][2] = {
+        {0, 3}, {0, 10}, {90, 110}, {100, 200}, {1000, 50000}, {1, 100000}, {200000, 3000000}, {1, LAST_BUCKET_LOW - 1},
+    };
+    TestRandom random(15);
+    for (const uint32_t* range : ranges) {
+        setUp();
+        recordUniform(random, range[0], range[1]);
+        checkExactFigures();
+        unsigned long p50 = checkPercentile(50);
+        unsigned long p99 = checkPercentile(99);
+        char message[96];
+        snprintf(message, sizeof(message), "%lu-%lu us: p50 %lu.%lu%% high, p99 %lu.%lu%% high",
+                 (unsigned long)range[0], (unsigned long)range[1], p50 / 10, p50 % 10, p99 / 10, p99 % 10);
+        TEST_MESSAGE(message);
+    }
+}
+
+void test_every_percentile_within_bound(void) {
+    // Log-uniform from 1 us to the last bucket, so every bucket below it
+    // holds samples
+    TestRandom random(16);
+    for (uint32_t i = 0; i < SAMPLES; i++) {
+        int octave = random.next(21);
+        uint32_t low = 1u << octave;
+        record(low + random.next(low));
+    }
+    checkExactFigures();
+    unsigned long worst = 0;
+    for (int percent = 0; percent <= 100; percent++) {
+        worst = std::max(worst, checkPercentile(percent));
+    }
+    char message[64];
+    snprintf(message, sizeof(message), "worst of p0-p100: %lu.%lu%% high", worst / 10, worst % 10);
+    TEST_MESSAGE(message);
+}
+
+void test_values_past_the_last_bucket(void) {
+    // Mostly fast, with 2% of the samples between 5 and 60 s
+    TestRandom random(17);
+    for (uint32_t i = 0; i < SAMPLES; i++) {
+        if (random.next(50) == 0) {
+            record(5000000 + random.next(55000000 / 4) * 4);
+        } else {
+            record(1000 + random.next(9000));
+        }
+    }
+    record(UINT32_MAX);
+    checkExactFigures();
+
+    // Percentiles below the last bucket keep their bound
+    checkPercentile(50);
+    checkPercentile(90);
+
+    // One that lands in the last bucket only knows the samples there are
+    // at least 3.67 s, and reads as the max
+    TEST_ASSERT_TRUE(exactPercentile(99) >= LAST_BUCKET_LOW);
+    TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, histogram.percentile(99));
+    TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, histogram.percentile(100));
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_empty_histogram_reads_zero);
+    RUN_TEST(test_constant_is_exact);
+    RUN_TEST(test_uniform_ranges_within_bound);
+    RUN_TEST(test_every_percentile_within_bound);
+    RUN_TEST(test_values_past_the_last_bucket);
+    return UNITY_END();
+}
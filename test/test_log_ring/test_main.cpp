@@ -0,0 +1,255 @@
+// The log ring with producers on their own threads and the test as the
+// drain task. Below capacity every message arrives whole, once and in each
+// producer's order; with the ring full every message either arrives or is
+// counted as dropped. This file is built with CHAKIY_LOG_LEVEL at WARN, so
+// LOG_INFO and LOG_DEBUG must write nothing, and not evaluate their
+// arguments, whatever the run-time level.
+//
+//   pio test -e native -f test_log_ring -v
+
+#undef CHAKIY_LOG_LEVEL
+#define CHAKIY_LOG_LEVEL LOG_LEVEL_WARN
+
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Log.h"
+#include "TestRoutines.h"
+
+namespace {
+
+const int PRODUCERS = 3;
+const unsigned long MESSAGES = 20000;          // Per producer
+const size_t PREFIX_LENGTH = 10;               // "p1 000042 "
+const size_t FILLER_LENGTH = LOG_MESSAGE_LENGTH - 1 - PREFIX_LENGTH;
+
+const char* const TAGS[PRODUCERS] = {"uno", "dos", "tres"};
+
+// Room left in the ring: producers take one before writing and the drain
+// gives it back after reading, so the ring never holds more than LOG_SLOTS
+std::atomic<long> credits(0);
+std::atomic<int> producing(0);
+
+// Fills the message to the last byte the ring keeps, with a letter that
+// depends on both the producer and the index, so a torn copy shows
+void writeMessage(int producer, unsigned long index) {
+    char filler[FILLER_LENGTH + 1];
+    memset(filler, 'a' + (producer * 7 + index) % 26, FILLER_LENGTH);
+    filler[FILLER_LENGTH] = '\0';
+    logWrite(LOG_LEVEL_WARN, TAGS[producer], "p%d %06lu %s", producer, index, filler);
+}
+
+// Returns the producer of a whole message and sets its index, or -1
+int parseMessage(const LogEntry& entry, unsigned long& index) {
+    int producer;
+    if (entry.level != LOG_LEVEL_WARN || sscanf(entry.message, "p%d %lu", &producer, &index) != 2 ||
+        producer < 0 || producer >= PRODUCERS || entry.tag != TAGS[producer] ||
+        strlen(entry.message) != LOG_MESSAGE_LENGTH - 1) {
+        return -1;
+    }
+    char expected = 'a' + (producer * 7 + index) % 26;
+    for (size_t i = PREFIX_LENGTH; i < LOG_MESSAGE_LENGTH - 1; i++) {
+        if (entry.message[i] != expected) return -1;
+    }
+    return producer;
+}
+
+void producer(int id, bool throttled) {
+    TestRandom random(14 + id);
+    for (unsigned long index = 0; index < MESSAGES; index++) {
+        while (throttled) {
+            long available = credits.load();
+            if (available > 0 && credits.compare_exchange_weak(available, available - 1)) break;
+            std::this_thread::yield();
+        }
+        writeMessage(id, index);
+        if (random.next(8) == 0) std::this_thread::yield();
+    }
+    producing--;
+}
+
+// Drains the ring on this thread until every producer is done and the ring
+// is empty. Returns an empty string if every message was whole and in its
+// producer's order, or what is wrong; counts what arrived.
+std::string drain(bool throttled, unsigned long received[PRODUCERS]) {
+    std::vector<long> last(PRODUCERS, -1);
+    std::string problem;
+    LogEntry entry;
+    for (;;) {
+        bool done = producing == 0;
+        bool any = false;
+        while (logRead(entry)) {
+            any = true;
+            if (throttled) credits++;
+            unsigned long index;
+            int id = parseMessage(entry, index);
+            if (id < 0) {
+                if (problem.empty()) problem = std::string("torn message: ") + entry.message;
+                continue;
+            }
+            if ((long)index <= last[id] && problem.empty()) {
+                char message[64];
+                snprintf(message, sizeof(message), "producer %d: %lu after %ld", id, index, last[id]);
+                problem = message;
+            }
+            last[id] = index;
+            received[id]++;
+        }
+        if (done && !any) break;
+        std::this_thread::yield();
+    }
+    return problem;
+}
+
+void emptyRing() {
+    LogEntry entry;
+    while (logRead(entry)) {
+    }
+}
+
+int sideEffects;
+
+int sideEffect() {
+    sideEffects++;
+    return sideEffects;
+}
+
+}
+
+void setUp(void) {
+    emptyRing();
+    logSetLevel(LOG_LEVEL_DEBUG);
+    sideEffects = 0;
+}
+
+void tearDown(void) {
+}
+
+void test_producers_below_capacity_lose_nothing(void) {
+    LogStats before = logGetStats();
+    credits = LOG_SLOTS;
+    producing = PRODUCERS;
+    std::vector<std::thread> threads;
+    for (int id = 0; id < PRODUCERS; id++) {
+        threads.emplace_back(producer, id, true);
+    }
+    unsigned long received[PRODUCERS] = {};
+    std::string problem = drain(true, received);
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    LogStats after = logGetStats();
+
+    char message[128];
+    snprintf(message, sizeof(message), "%d producers x %lu messages: %lu, %lu, %lu received; ring held up to %lu",
+             PRODUCERS, MESSAGES, received[0], received[1], received[2], after.maxQueued);
+    TEST_MESSAGE(message);
+    if (!problem.empty()) {
+        TEST_FAIL_MESSAGE(problem.c_str());
+    }
+    for (int id = 0; id < PRODUCERS; id++) {
+        TEST_ASSERT_EQUAL_UINT32(MESSAGES, received[id]);
+    }
+    TEST_ASSERT_EQUAL_UINT32(PRODUCERS * MESSAGES, after.written - before.written);
+    TEST_ASSERT_EQUAL_UINT32(0, after.dropped - before.dropped);
+    TEST_ASSERT_EQUAL_UINT32(0, after.truncated - before.truncated);
+    TEST_ASSERT_TRUE(after.maxQueued <= LOG_SLOTS);
+}
+
+void test_full_ring_drops_and_counts(void) {
+    LogStats before = logGetStats();
+    for (unsigned long index = 0; index < LOG_SLOTS + 10; index++) {
+        writeMessage(0, index);
+    }
+    LogStats full = logGetStats();
+    TEST_ASSERT_EQUAL_UINT32(LOG_SLOTS, full.written - before.written);
+    TEST_ASSERT_EQUAL_UINT32(10, full.dropped - before.dropped);
+
+    // The first LOG_SLOTS arrive, whole and in order; the rest never do
+    LogEntry entry;
+    unsigned long index;
+    for (unsigned long expected = 0; expected < LOG_SLOTS; expected++) {
+        TEST_ASSERT_TRUE(logRead(entry));
+        TEST_ASSERT_EQUAL(0, parseMessage(entry, index));
+        TEST_ASSERT_EQUAL_UINT32(expected, index);
+    }
+    TEST_ASSERT_FALSE(logRead(entry));
+    TEST_ASSERT_EQUAL_UINT32(LOG_SLOTS, logGetStats().maxQueued);
+
+    // Once drained the ring takes messages again
+    writeMessage(1, 7);
+    TEST_ASSERT_TRUE(logRead(entry));
+    TEST_ASSERT_EQUAL(1, parseMessage(entry, index));
+    TEST_ASSERT_EQUAL_UINT32(7, index);
+    TEST_ASSERT_EQUAL_UINT32(10, logGetStats().dropped - before.dropped);
+}
+
+void test_producers_outrunning_the_drain_are_counted(void) {
+    LogStats before = logGetStats();
+    producing = PRODUCERS;
+    std::vector<std::thread> threads;
+    for (int id = 0; id < PRODUCERS; id++) {
+        threads.emplace_back(producer, id, false);
+    }
+    unsigned long received[PRODUCERS] = {};
+    std::string problem = drain(false, received);
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    LogStats after = logGetStats();
+
+    unsigned long total = received[0] + received[1] + received[2];
+    unsigned long dropped = after.dropped - before.dropped;
+    char message[128];
+    snprintf(message, sizeof(message), "%lu messages: %lu received, %lu dropped", PRODUCERS * MESSAGES, total,
+             dropped);
+    TEST_MESSAGE(message);
+    if (!problem.empty()) {
+        TEST_FAIL_MESSAGE(problem.c_str());
+    }
+    // Every message is either read once or counted, never both or neither
+    TEST_ASSERT_EQUAL_UINT32(total, after.written - before.written);
+    TEST_ASSERT_EQUAL_UINT32(PRODUCERS * MESSAGES, total + dropped);
+}
+
+void test_compiled_out_levels_write_nothing(void) {
+    LogStats before = logGetStats();
+    LOG_DEBUG("prueba", "debug %d", sideEffect());
+    LOG_INFO("prueba", "info %d", sideEffect());
+    LogEntry entry;
+    TEST_ASSERT_FALSE(logRead(entry));
+    TEST_ASSERT_EQUAL(0, sideEffects);
+
+    LOG_WARN("prueba", "warn %d", sideEffect());
+    LOG_ERROR("prueba", "error %d", sideEffect());
+    TEST_ASSERT_TRUE(logRead(entry));
+    TEST_ASSERT_EQUAL_UINT8(LOG_LEVEL_WARN, entry.level);
+    TEST_ASSERT_EQUAL_STRING("warn 1", entry.message);
+    TEST_ASSERT_TRUE(logRead(entry));
+    TEST_ASSERT_EQUAL_UINT8(LOG_LEVEL_ERROR, entry.level);
+    TEST_ASSERT_EQUAL_STRING("error 2", entry.message);
+    TEST_ASSERT_FALSE(logRead(entry));
+
+    // Below the run-time level the call returns before the ring
+    logSetLevel(LOG_LEVEL_ERROR);
+    LOG_WARN("prueba", "warn");
+    TEST_ASSERT_FALSE(logRead(entry));
+    LogStats after = logGetStats();
+    TEST_ASSERT_EQUAL_UINT32(2, after.written - before.written);
+    TEST_ASSERT_EQUAL_UINT32(0, after.dropped - before.dropped);
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_producers_below_capacity_lose_nothing);
+    RUN_TEST(test_full_ring_drops_and_counts);
+    RUN_TEST(test_producers_outrunning_the_drain_are_counted);
+    RUN_TEST(test_compiled_out_levels_write_nothing);
+    return UNITY_END();
+}
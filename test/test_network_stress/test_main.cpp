@@ -0,0 +1,156 @@
+// The control task against a server that takes seconds to answer, or never
+// does. A stand-in server on 127.0.0.1:5000 holds every request for 3 or
+// 7 s (past the client's timeout) before failing it, while the network task
+// runs on its own thread as on the device. Sensing, routine checks and the
+// safety cutoff must keep their cadence.
+//
+// Runs in real time, about 10 s.
+//
+//   pio test -e native -f test_network_stress -v
+
+#include <unity.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "MockHal.h"
+#include "DeviceManagerImpl.h"
+#include "Log.h"
+
+namespace {
+
+// The mock HAL with the host's real clock and threads, so the network task
+// runs beside the control loop and blocks only itself
+struct StressHal : MockHal {
+    using Clock = NativeClock;
+    using Tasks = NativeTasks;
+};
+
+const unsigned long CONTROL_INTERVAL = 200;
+const unsigned long RUN_MS = 10000;
+
+std::atomic<int> requests(0);
+std::atomic<int> answered(0);
+
+void serveSlowly(int client, int number) {
+    char buffer[1024];
+    std::string request;
+    while (request.find("\r\n\r\n") == std::string::npos) {
+        ssize_t n = recv(client, buffer, sizeof(buffer), 0);
+        if (n <= 0) {
+            close(client);
+            return;
+        }
+        request.append(buffer, n);
+    }
+    requests++;
+    std::this_thread::sleep_for(std::chrono::milliseconds(number % 2 ? 7000 : 3000));
+    const char* response = "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+    if (send(client, response, strlen(response), MSG_NOSIGNAL) > 0) answered++;
+    close(client);
+}
+
+bool startServer() {
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(5000);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(listener, (sockaddr*)&address, sizeof(address)) != 0 || listen(listener, 16) != 0) {
+        close(listener);
+        return false;
+    }
+    std::thread([listener]() {
+        for (int number = 0;; number++) {
+            int client = accept(listener, nullptr, nullptr);
+            if (client < 0) return;
+            std::thread(serveSlowly, client, number).detach();
+        }
+    }).detach();
+    return true;
+}
+
+typedef std::chrono::steady_clock::time_point TimePoint;
+
+TimePoint lastRead;
+bool haveRead = false;
+double maxReadGapMs = 0;
+
+// A steady room; only when the control task reads it matters
+bool timedReading(int pin, float& temperature, float& humidity) {
+    (void)pin;
+    TimePoint now = std::chrono::steady_clock::now();
+    if (haveRead) {
+        double gap = std::chrono::duration<double, std::milli>(now - lastRead).count();
+        if (gap > maxReadGapMs) maxReadGapMs = gap;
+    }
+    lastRead = now;
+    haveRead = true;
+    temperature = 24.0f;
+    humidity = 70.0f;
+    return true;
+}
+
+}
+
+void setUp(void) {
+    MockHal::reset();
+    logSetLevel(LOG_LEVEL_NONE);
+}
+
+void tearDown(void) {
+}
+
+void test_control_keeps_cadence_while_server_stalls(void) {
+    if (!startServer()) {
+        TEST_IGNORE_MESSAGE("port 5000 is in use");
+    }
+    MockSensor::source = &timedReading;
+
+    // The network task keeps running after the test, so the device is
+    // never deleted
+    DeviceManager<StressHal>* device = new DeviceManager<StressHal>();
+    device->setServerIP("127.0.0.1");
+    device->setSensorUpdateInterval(CONTROL_INTERVAL);
+    device->setRoutineCheckInterval(CONTROL_INTERVAL);
+    device->setApiUpdateInterval(1000);
+    device->setup();
+
+    double maxPassMs = 0;
+    unsigned long passes = 0;
+    TimePoint start = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - start < std::chrono::milliseconds(RUN_MS)) {
+        TimePoint passStart = std::chrono::steady_clock::now();
+        device->loop();
+        double passMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - passStart).count();
+        if (passMs > maxPassMs) maxPassMs = passMs;
+        passes++;
+    }
+
+    char message[160];
+    snprintf(message, sizeof(message), "%d requests held, %d answered late; %lu sensor reads, max gap %.1f ms; "
+             "%lu loop passes, longest %.1f ms", requests.load(), answered.load(), MockSensor::reads, maxReadGapMs,
+             passes, maxPassMs);
+    TEST_MESSAGE(message);
+
+    // The server did stall the network task...
+    TEST_ASSERT_GREATER_THAN(0, requests.load());
+    // ...and the control task did not notice: a pass only sleeps until the
+    // next job, and readings stay a period apart
+    TEST_ASSERT_TRUE(maxPassMs < CONTROL_INTERVAL + 50);
+    TEST_ASSERT_TRUE(maxReadGapMs < CONTROL_INTERVAL + 50);
+    TEST_ASSERT_TRUE(MockSensor::reads >= RUN_MS / CONTROL_INTERVAL - 2);
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_control_keeps_cadence_while_server_stalls);
+    return UNITY_END();
+}
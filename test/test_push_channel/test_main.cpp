@@ -0,0 +1,249 @@
+// The push channel against a stand-in backend that streams server-sent
+// events: how long a config change takes to be fetched once the backend
+// announces it, and how many requests an idle device makes, with the
+// stream up and with a backend that has no events endpoint, where the
+// device polls. The network task runs on its own thread and the clock runs
+// 200 times faster; times are in simulated ms.
+//
+//   pio test -e native -f test_push_channel -v
+
+#include <unity.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "MockHal.h"
+#include "TestRoutines.h"
+#include "HttpStandIn.h"
+#include "DeviceManagerImpl.h"
+#include "TelemetryLogImpl.h"
+#include "Log.h"
+
+namespace {
+
+struct PushHal : MockHal {
+    using Clock = NativeClock;
+    using Tasks = NativeTasks;
+};
+
+const int TIME_SCALE = 200;
+const unsigned long KEEP_ALIVE_MS = 15000;
+const int CHANGES = 20;
+const unsigned long IDLE_MS = 30 * 60000;
+const unsigned long POLL_MS = 10000;          // DeviceManager::apiUpdateInterval
+
+HttpStandIn server;
+std::atomic<bool> pushEnabled(true);
+std::atomic<bool> streamOpen(false);
+std::atomic<unsigned long> deviceGets(0);
+std::atomic<unsigned long> routineGets(0);
+std::atomic<unsigned long> eventGets(0);
+std::atomic<unsigned long> posts(0);
+std::atomic<unsigned long> lastDeviceGetAt(0);
+std::atomic<int> revision(0);
+
+// Events waiting to go out on the stream
+std::mutex eventsMutex;
+std::condition_variable eventsChanged;
+std::vector<std::string> events;
+
+bool sendAll(int fd, const std::string& data) {
+    return send(fd, data.data(), data.size(), MSG_NOSIGNAL) == (ssize_t)data.size();
+}
+
+// Holds the connection until the stream is switched off or the device goes
+std::string eventStream(const HttpStandInRequest& request) {
+    if (!sendAll(request.fd, "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nCache-Control: no-cache\r\n\r\n"
+                             ": ok\n\n")) {
+        return "";
+    }
+    streamOpen = true;
+    std::unique_lock<std::mutex> lock(eventsMutex);
+    size_t seen = events.size();
+    while (pushEnabled) {
+        eventsChanged.wait_for(lock, std::chrono::milliseconds(KEEP_ALIVE_MS / TIME_SCALE));
+        std::string out;
+        for (; seen < events.size(); seen++) {
+            out += events[seen];
+        }
+        if (!sendAll(request.fd, out.empty() ? ": keep-alive\n\n" : out)) {
+            break;
+        }
+    }
+    streamOpen = false;
+    return "";
+}
+
+std::string backend(const HttpStandInRequest& request) {
+    if (request.method == "POST") {
+        posts++;
+        return HttpStandIn::response(201, "{}");
+    }
+    if (request.path.find("/events") != std::string::npos) {
+        eventGets++;
+        return pushEnabled ? eventStream(request) : HttpStandIn::response(404, "");
+    }
+    char etag[32];
+    if (request.path.find("get-dehumidifier") != std::string::npos) {
+        deviceGets++;
+        lastDeviceGetAt = NativeClock::millis();
+        int current = revision;
+        snprintf(etag, sizeof(etag), "\"d%d\"", current);
+        if (request.headers.find(etag) != std::string::npos) {
+            return HttpStandIn::response(304, "");
+        }
+        char body[256];
+        snprintf(body, sizeof(body),
+                 "{\"humidifier_info\":{\"calidadDeAireMin\":0,\"calidadDeAireMax\":500,\"temperaturaMin\":0,"
+                 "\"temperaturaMax\":50,\"humedadMin\":0,\"humedadMax\":100,\"estado\":%s}}",
+                 current % 2 ? "false" : "true");
+        std::string headers = std::string("ETag: ") + etag + "\r\n";
+        return HttpStandIn::response(200, body, headers.c_str());
+    }
+    routineGets++;
+    snprintf(etag, sizeof(etag), "\"r1\"");
+    if (request.headers.find(etag) != std::string::npos) {
+        return HttpStandIn::response(304, "");
+    }
+    return HttpStandIn::response(200, "[]", "ETag: \"r1\"\r\n");
+}
+
+// The backend changes zone 0's config and, with the stream on, says so
+void changeConfig() {
+    revision++;
+    std::lock_guard<std::mutex> lock(eventsMutex);
+    events.push_back("event: config\ndata: PruebaOtraVes\n\n");
+    eventsChanged.notify_all();
+}
+
+// Runs the control loop for ms of simulated time, or until done
+template <typename Done>
+bool runUntil(DeviceManager<PushHal>& device, unsigned long ms, Done done) {
+    unsigned long start = NativeClock::millis();
+    while (NativeClock::millis() - start < ms) {
+        device.loop();
+        if (done()) return true;
+    }
+    return false;
+}
+
+void run(DeviceManager<PushHal>& device, unsigned long ms) {
+    runUntil(device, ms, []() { return false; });
+}
+
+struct Latency {
+    int missed;
+    unsigned long median;
+    unsigned long p90;
+    unsigned long max;
+};
+
+// Changes the config CHANGES times, a few seconds apart, and times each
+// until the device asks for it
+Latency measureLatency(DeviceManager<PushHal>& device, const char* name) {
+    TestRandom random(24);
+    std::vector<unsigned long> latencies;
+    int missed = 0;
+    for (int i = 0; i < CHANGES; i++) {
+        run(device, 3000 + random.next(15000));
+        unsigned long before = deviceGets;
+        unsigned long changedAt = NativeClock::millis();
+        changeConfig();
+        if (runUntil(device, 60000, [&]() { return deviceGets > before; })) {
+            latencies.push_back(lastDeviceGetAt - changedAt);
+        } else {
+            missed++;
+        }
+    }
+    std::sort(latencies.begin(), latencies.end());
+    Latency result = {};
+    result.missed = missed;
+    if (!latencies.empty()) {
+        result.median = latencies[latencies.size() / 2];
+        result.p90 = latencies[latencies.size() * 9 / 10];
+        result.max = latencies.back();
+    }
+    char message[160];
+    snprintf(message, sizeof(message), "%-9s %d changes, %d missed: fetched after median %lu ms, p90 %lu ms, max %lu ms",
+             name, CHANGES, missed, result.median, result.p90, result.max);
+    TEST_MESSAGE(message);
+    return result;
+}
+
+// GETs per minute while nothing changes
+double measureIdle(DeviceManager<PushHal>& device, const char* name) {
+    unsigned long device0 = deviceGets, routines0 = routineGets, events0 = eventGets, posts0 = posts;
+    run(device, IDLE_MS);
+    unsigned long gets = deviceGets - device0 + routineGets - routines0 + eventGets - events0;
+    double perMinute = gets * 60000.0 / IDLE_MS;
+    char message[160];
+    snprintf(message, sizeof(message),
+             "%-9s idle %lu min: %lu GETs (%.2f/min): device %lu, routines %lu, events %lu; telemetry POSTs %lu",
+             name, IDLE_MS / 60000, gets, perMinute, deviceGets - device0, routineGets - routines0,
+             eventGets - events0, posts - posts0);
+    TEST_MESSAGE(message);
+    return perMinute;
+}
+
+}
+
+void setUp(void) {
+    MockHal::reset();
+    logSetLevel(LOG_LEVEL_NONE);
+}
+
+void tearDown(void) {
+}
+
+void test_push_against_polling(void) {
+    server.setHandler(&backend);
+    if (!server.start(5000)) {
+        TEST_IGNORE_MESSAGE("port 5000 is in use");
+    }
+
+    // The device keeps running after the test, so it is never deleted
+    DeviceManager<PushHal>* device = new DeviceManager<PushHal>();
+    device->setServerIP("127.0.0.1");
+    device->setup();
+    TEST_ASSERT_TRUE(runUntil(*device, 60000, []() { return (bool)streamOpen; }));
+    run(*device, 30000);
+
+    Latency pushed = measureLatency(*device, "push");
+    double pushedIdle = measureIdle(*device, "push");
+
+    // The backend drops the stream and no longer offers it
+    pushEnabled = false;
+    {
+        std::lock_guard<std::mutex> lock(eventsMutex);
+        eventsChanged.notify_all();
+    }
+    TEST_ASSERT_TRUE(runUntil(*device, 60000, []() { return !streamOpen; }));
+    run(*device, 60000);
+
+    Latency polled = measureLatency(*device, "polling");
+    double polledIdle = measureIdle(*device, "polling");
+
+    // A change arrives well inside one poll interval, and an idle device
+    // makes a fraction of the requests
+    TEST_ASSERT_EQUAL(0, pushed.missed);
+    TEST_ASSERT_EQUAL(0, polled.missed);
+    TEST_ASSERT_TRUE(pushed.p90 < 1000);
+    TEST_ASSERT_TRUE(polled.max <= POLL_MS + 1000);
+    TEST_ASSERT_TRUE(pushed.median * 5 < polled.median);
+    TEST_ASSERT_TRUE(pushedIdle * 10 < polledIdle);
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    // Before the clock is first read
+    char scale[8];
+    snprintf(scale, sizeof(scale), "%d", TIME_SCALE);
+    setenv("CHAKIY_TIME_SCALE", scale, 1);
+    UNITY_BEGIN();
+    RUN_TEST(test_push_against_polling);
+    return UNITY_END();
+}
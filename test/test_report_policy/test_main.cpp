@@ -0,0 +1,191 @@
+// Trace-driven simulation of ReportPolicy: a day of 5 s readings for a
+// steady room, a day with the dehumidifier cycling and a turbulent room,
+// fed through SensorPipeline with sensor noise as the control task does.
+// Prints messages against the fixed cadence, reports by reason, the longest
+// silence and how far the last reported value trails the current one.
+//
+//   pio test -e native -f test_report_policy -v
+
+#include <unity.h>
+#include <math.h>
+#include "TestRoutines.h"
+#include "ReportPolicy.h"
+#include "SensorPipeline.h"
+
+namespace {
+
+const int DAY_SAMPLES = 24 * 60 * 12;
+const unsigned long SAMPLE_MS = 5000;
+
+enum Room { STEADY, DEHUMIDIFIER, TURBULENT };
+
+struct TraceResult {
+    ReportStats stats;
+    unsigned long longestSilenceMs;
+    int switches;                 // Times the device switched on or off
+    int switchesReported;         // ...and the reading at the switch was reported
+    double meanTemperatureLag;    // |current - last reported|, averaged
+    double meanHumidityLag;
+};
+
+// Standard normal, Box-Muller
+float gaussian(TestRandom& random) {
+    float u1 = (random.next(1 << 20) + 1.0f) / ((1 << 20) + 2.0f);
+    float u2 = (random.next(1 << 20) + 1.0f) / ((1 << 20) + 2.0f);
+    return sqrtf(-2 * logf(u1)) * cosf(6.2831853f * u2);
+}
+
+// Runs one day of room through the pipeline and policy
+TraceResult runTrace(Room room, ReportPolicy& policy) {
+    TestRandom random(11);
+    SensorPipeline pipeline;
+    TraceResult result = {};
+    float humidity = 60.0f;
+    bool on = false;
+    int ica = 40;
+    unsigned long lastReport = 0;
+    float reportedTemperature = 0;
+    float reportedHumidity = 0;
+    int accepted = 0;
+
+    for (int i = 0; i < DAY_SAMPLES; i++) {
+        unsigned long now = i * SAMPLE_MS;
+        float dayPhase = i / (float)DAY_SAMPLES * 6.2831853f;
+        float temperature = 22.0f + (room == STEADY ? 0.3f : 2.5f) * sinf(dayPhase);
+        bool wasOn = on;
+        if (room != STEADY) {
+            // Half an hour of dehumidifying every four hours, then the room
+            // creeps back towards 62 %RH
+            if (i % 2880 == 0) on = true;
+            if (i % 2880 == 360) on = false;
+            humidity += on ? -0.08f : 0.02f * (62.0f - humidity) / 5;
+            if (i % 500 == 0) ica += (int)random.next(7) - 3;
+        }
+        if (room == TURBULENT && i % 720 < 60) {
+            // A door left open: five minutes of swings every hour
+            temperature += 1.5f * sinf(i / 6.0f);
+            humidity += 0.5f * sinf(i / 4.0f);
+        }
+        bool switched = on != wasOn;
+        result.switches += switched;
+
+        float temperatureRead = temperature + 0.1f * gaussian(random);
+        float humidityRead = humidity + 0.3f * gaussian(random);
+        if (!pipeline.addReading(temperatureRead, humidityRead)) {
+            continue;
+        }
+        TelemetrySample sample = {};
+        sample.timestamp = now;
+        sample.temperature = pipeline.getTemperature().mean;
+        sample.humidity = pipeline.getHumidity().mean;
+        sample.ica = ica;
+        sample.deviceOn = on;
+        if (policy.shouldReport(sample)) {
+            if (now - lastReport > result.longestSilenceMs) result.longestSilenceMs = now - lastReport;
+            lastReport = now;
+            reportedTemperature = sample.temperature;
+            reportedHumidity = sample.humidity;
+            result.switchesReported += switched;
+        }
+        result.meanTemperatureLag += fabsf(sample.temperature - reportedTemperature);
+        result.meanHumidityLag += fabsf(sample.humidity - reportedHumidity);
+        accepted++;
+    }
+    result.stats = policy.getStats();
+    result.meanTemperatureLag /= accepted;
+    result.meanHumidityLag /= accepted;
+    return result;
+}
+
+void print(const char* name, const TraceResult& result) {
+    char message[224];
+    snprintf(message, sizeof(message),
+             "%-12s %5lu of %5lu readings sent (%.1f%% fewer): change %lu, state %lu, heartbeat %lu, "
+             "deferred %lu; longest silence %lu s; mean lag %.2f C %.2f %%RH", name, result.stats.reported,
+             result.stats.samples, 100.0 * (1 - (double)result.stats.reported / result.stats.samples),
+             result.stats.changed, result.stats.stateChanges, result.stats.heartbeats, result.stats.deferred,
+             result.longestSilenceMs / 1000, result.meanTemperatureLag, result.meanHumidityLag);
+    TEST_MESSAGE(message);
+}
+
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+void test_simulated_days(void) {
+    const struct {
+        Room room;
+        const char* name;
+    } rooms[] = {
+        { STEADY, "steady" },
+        { DEHUMIDIFIER, "dehumidifier" },
+        { TURBULENT, "turbulent" },
+    };
+    unsigned long reported[3];
+    for (int r = 0; r < 3; r++) {
+        ReportPolicy policy;
+        TraceResult result = runTrace(rooms[r].room, policy);
+        print(rooms[r].name, result);
+        reported[r] = result.stats.reported;
+
+        // Every switch goes out with the reading that saw it, nothing stays
+        // quiet past the heartbeat, and the server's copy trails by less
+        // than a deadband on average
+        const ReportSettings& settings = policy.getSettings();
+        TEST_ASSERT_EQUAL(result.switches, result.switchesReported);
+        TEST_ASSERT_TRUE(result.longestSilenceMs <= settings.heartbeatMs);
+        TEST_ASSERT_TRUE(result.meanTemperatureLag < settings.temperatureDeadband);
+        TEST_ASSERT_TRUE(result.meanHumidityLag < settings.humidityDeadband);
+        TEST_ASSERT_TRUE(result.stats.reported < result.stats.samples / 10);
+    }
+
+    // The more the room moves, the more is sent
+    TEST_ASSERT_TRUE(reported[0] < reported[1]);
+    TEST_ASSERT_TRUE(reported[1] < reported[2]);
+}
+
+void test_deadbands_trade_messages_for_lag(void) {
+    const float scales[] = { 0.5f, 1.0f, 2.0f };
+    unsigned long reported[3];
+    double lag[3];
+    for (int s = 0; s < 3; s++) {
+        ReportPolicy policy;
+        ReportSettings settings = policy.getSettings();
+        settings.temperatureDeadband *= scales[s];
+        settings.humidityDeadband *= scales[s];
+        policy.configure(settings);
+        TraceResult result = runTrace(DEHUMIDIFIER, policy);
+
+        char name[24];
+        snprintf(name, sizeof(name), "deadbands x%.1f", scales[s]);
+        print(name, result);
+        reported[s] = result.stats.reported;
+        lag[s] = result.meanTemperatureLag;
+    }
+    TEST_ASSERT_TRUE(reported[0] > reported[1] && reported[1] > reported[2]);
+    TEST_ASSERT_TRUE(lag[0] < lag[1] && lag[1] < lag[2]);
+}
+
+void test_disabled_policy_sends_every_reading(void) {
+    // REPORT:OFF, the fixed cadence
+    ReportPolicy policy;
+    policy.setEnabled(false);
+    TraceResult result = runTrace(TURBULENT, policy);
+    print("off", result);
+    TEST_ASSERT_EQUAL_UINT32(result.stats.samples, result.stats.reported);
+    TEST_ASSERT_EQUAL_UINT32(SAMPLE_MS, result.longestSilenceMs);
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_simulated_days);
+    RUN_TEST(test_deadbands_trade_messages_for_lag);
+    RUN_TEST(test_disabled_policy_sends_every_reading);
+    return UNITY_END();
+}
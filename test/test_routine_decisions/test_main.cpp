@@ -0,0 +1,216 @@
+// checkActiveRoutines, with its cached decisions, bands and schedule index,
+// against a plain linear scan of every routine on every check. A seeded
+// random walk moves the clock, the readings, the safety limits, the manual
+// state and the routine table; after every check each zone must be in the
+// state the scan gives.
+//
+//   pio test -e native -f test_routine_decisions -v
+
+#include <unity.h>
+#include <string.h>
+#include "MockHal.h"
+#include "TestRoutines.h"
+#include "StateManagerImpl.h"
+#include "Log.h"
+
+namespace {
+
+typedef StateManager<MockHal> States;
+
+const int ZONES = 3;
+const int ROUTINE_IDS = 60;         // Ids drawn from 1..ROUTINE_IDS, so updates replace some
+
+const char* const conditions[] = {
+    "60",
+    "humidity > 60 ~ 3",
+    "humidity < 45 ~ 2",
+    "temperature >= 18 && (ica < 50 || !(humidity <= 40))",
+    "ica > 12",
+    "temperature < 20 || humidity > 70",
+    "humidity >= 55 && humidity <= 65",
+    "temperature > 26 ~ 1",
+};
+const int CONDITION_COUNT = sizeof(conditions) / sizeof(conditions[0]);
+
+States* states;
+
+// What checkActiveRoutines did before anything was cached: for each zone
+// in range, the first routine of that zone, in table order, whose day, time
+// window and condition all hold, with hysteresis for the one already
+// driving it
+struct LinearScan {
+    int32_t activeId[ZONES];
+
+    void reset() {
+        for (int zone = 0; zone < ZONES; zone++) {
+            activeId[zone] = -1;
+        }
+    }
+
+    int decide(int zone, bool timeKnown, int weekday, int minute) {
+        ZoneStates<States::MAX_ZONES>& zones = states->getZones();
+        bool inRange = zones.temperature[zone] >= zones.Temp_min_device[zone] &&
+                       zones.temperature[zone] <= zones.Temp_max_device[zone] &&
+                       zones.humidity[zone] >= zones.humidity_min_device[zone] &&
+                       zones.humidity[zone] <= zones.humidity_max_device[zone];
+        int decision = -1;
+        if (timeKnown && inRange) {
+            float inputs[INPUT_COUNT];
+            inputs[INPUT_TEMPERATURE] = zones.temperature[zone];
+            inputs[INPUT_HUMIDITY] = zones.humidity[zone];
+            inputs[INPUT_ICA] = zones.ICA[zone];
+            const Routine* routines = states->getRoutines();
+            for (int i = 0; i < states->getRoutineCount() && decision < 0; i++) {
+                const Routine& routine = routines[i];
+                if (routine.zone != zone || !states->isDayInRoutine(routine, weekday) ||
+                    !states->isTimeInRange(minute, routine.startMinute, routine.endMinute)) {
+                    continue;
+                }
+                bool active = activeId[zone] >= 0 && routine.id == activeId[zone];
+                if (conditionEvaluate(states->getRoutineCondition(i), inputs, active)) {
+                    decision = i;
+                }
+            }
+        }
+        activeId[zone] = decision >= 0 ? states->getRoutines()[decision].id : -1;
+        return decision;
+    }
+};
+
+LinearScan scan;
+
+Routine randomRoutine(TestRandom& random, RoutineCondition& condition, char* name) {
+    char payload[256];
+    int start = random.next(24 * 60);
+    int end = random.next(3) == 0 ? (start + 1 + random.next(120)) % (24 * 60) : random.next(24 * 60);
+    formatRoutineData(payload, sizeof(payload), 1 + random.next(ROUTINE_IDS), conditions[random.next(CONDITION_COUNT)],
+                      random.next(2), start, end, (uint8_t)(1 + random.next(127)));
+    Routine routine;
+    TEST_ASSERT_TRUE(routineParseData(payload, strlen(payload), routine, condition, name));
+    routine.zone = random.next(ZONES);
+    return routine;
+}
+
+// Replaces, adds or removes a few routines and publishes the new table
+void updateRoutines(TestRandom& random, int changes) {
+    states->releaseRoutines();
+    RoutineSet<States::MAX_ROUTINES>* set = states->beginRoutineUpdate();
+    TEST_ASSERT_TRUE(set != nullptr);
+    for (int i = 0; i < changes; i++) {
+        if (random.next(4) == 0) {
+            set->remove(1 + random.next(ROUTINE_IDS));
+            continue;
+        }
+        RoutineCondition condition;
+        char name[ROUTINE_NAME_LENGTH];
+        Routine routine = randomRoutine(random, condition, name);
+        set->upsert(routine, condition, name);
+    }
+    states->publishRoutines();
+    states->acquireRoutines();
+}
+
+// Readings drift, sometimes land exactly on a condition's constant and now
+// and then jump
+float step(TestRandom& random, float value, float low, float high, float drift) {
+    switch (random.next(20)) {
+    case 0:
+        return low + random.next((int)(high - low) + 1);
+    case 1:
+        return 60.0f;
+    default:
+        value += ((int)random.next(5) - 2) * drift;
+        return value < low ? low : value > high ? high : value;
+    }
+}
+
+}
+
+void setUp(void) {
+    MockHal::reset();
+    logSetLevel(LOG_LEVEL_NONE);
+    states = new States();
+    for (int zone = 1; zone < ZONES; zone++) {
+        states->addZone();
+    }
+    scan.reset();
+}
+
+void tearDown(void) {
+    delete states;
+}
+
+void test_matches_linear_scan(void) {
+    const long STEPS = 200000;
+    TestRandom random(20);
+    float temperature[ZONES];
+    float humidity[ZONES];
+    for (int zone = 0; zone < ZONES; zone++) {
+        temperature[zone] = 22.0f;
+        humidity[zone] = 55.0f;
+        states->updateDeviceConfiguration(zone, 0, 500, 5, 35, 20, 90);
+    }
+    MockClock::setLocalTime(1, 8, 0);
+    states->acquireRoutines();
+    updateRoutines(random, 40);
+
+    long switches = 0;
+    for (long i = 0; i < STEPS; i++) {
+        // Mostly the routine check's 10 s cadence, sometimes a jump
+        MockClock::advance(random.next(50) == 0 ? random.next(3 * 24 * 3600) * 1000UL : 10000);
+        if (random.next(5000) == 0) MockClock::synced = !MockClock::synced;
+        if (random.next(2000) == 0) updateRoutines(random, 1 + random.next(8));
+
+        for (int zone = 0; zone < ZONES; zone++) {
+            temperature[zone] = step(random, temperature[zone], 0, 40, 0.1f);
+            humidity[zone] = step(random, humidity[zone], 10, 100, 0.2f);
+            states->updateSensorData(zone, temperature[zone], humidity[zone]);
+            if (random.next(3000) == 0) {
+                states->updateDeviceConfiguration(zone, 0, 500, 5 + random.next(10), 30 + random.next(10),
+                                                  20 + random.next(20), 80 + random.next(20));
+            }
+            if (random.next(1000) == 0) {
+                states->getZones().estado_device_original[zone] = !states->getZones().estado_device_original[zone];
+            }
+        }
+
+        states->checkActiveRoutines();
+
+        struct tm now;
+        bool timeKnown = MockClock::localTime(&now);
+        ZoneStates<States::MAX_ZONES>& zones = states->getZones();
+        for (int zone = 0; zone < ZONES; zone++) {
+            int expected = scan.decide(zone, timeKnown, now.tm_wday, now.tm_hour * 60 + now.tm_min);
+            bool on = expected >= 0 || zones.estado_device_original[zone];
+            const char* type = expected < 0 ? (on ? "Deshumidificador" : "")
+                             : (states->getRoutines()[expected].flags & ROUTINE_DRY) ? "Deshumidificador"
+                                                                                     : "Humidificador";
+            if (zones.estado_device[zone] != on || strcmp(zones.active_device_type[zone], type) != 0) {
+                char message[160];
+                snprintf(message, sizeof(message), "step %ld zone %d: %s \"%s\", the scan gives routine #%d, %s \"%s\"",
+                         i, zone, zones.estado_device[zone] ? "on" : "off", zones.active_device_type[zone],
+                         expected + 1, on ? "on" : "off", type);
+                TEST_FAIL_MESSAGE(message);
+            }
+            switches += expected >= 0;
+        }
+    }
+
+    const RoutineCheckStats& stats = states->getRoutineCheckStats();
+    char message[160];
+    snprintf(message, sizeof(message),
+             "%ld checks, %d zones: %lu evaluated, %lu answered from cache, %lu conditions, %ld zone-checks under a routine",
+             STEPS, ZONES, stats.zonesEvaluated, stats.zonesSkipped, stats.conditionsEvaluated, switches);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_GREATER_THAN(0, (long)stats.zonesSkipped);
+    TEST_ASSERT_GREATER_THAN(STEPS / 100, switches);
+    states->releaseRoutines();
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_matches_linear_scan);
+    return UNITY_END();
+}
@@ -0,0 +1,91 @@
+// JsonArrayStream on routine lists as the backend sends them: elements too
+// large for the buffer are counted as skipped, and lists of 10, 100 and
+// 1000 routines arriving in TCP-segment-sized pieces are split into every
+// element with one element's worth of buffer.
+//
+//   pio test -e native -f test_routine_json -v
+
+#include <unity.h>
+#include <stdio.h>
+#include <string>
+#include "JsonArrayStream.h"
+#include "TestRoutines.h"
+
+namespace {
+
+// The list as the backend sends it
+std::string makeList(int count) {
+    TestRandom random(count);
+    std::string list = "[";
+    for (int i = 0; i < count; i++) {
+        char condition[16];
+        snprintf(condition, sizeof(condition), "%d", 40 + (int)random.next(41));
+        char routineData[256];
+        formatRoutineData(routineData, sizeof(routineData), i + 1, condition, random.next(2), 480, 1200, 0x3e);
+        char element[512];
+        snprintf(element, sizeof(element),
+                 "%s{\"id\": %d, \"iot_device_id\": \"PruebaOtraVes\", \"routine_data\": \"%s\", "
+                 "\"created_at\": \"2024-06-10T10:00:00Z\"}", i > 0 ? ", " : "", i + 1, routineData);
+        list += element;
+    }
+    return list + "]";
+}
+
+void countElement(void* context, const char* element, size_t length) {
+    (void)element;
+    (void)length;
+    (*static_cast<int*>(context))++;
+}
+
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+void test_oversized_element_is_counted_as_skipped(void) {
+    std::string big(JsonArrayStream::ELEMENT_BUFFER + 100, 'x');
+    std::string list = "[{\"id\": 1}, {\"id\": 2, \"note\": \"" + big + "\"}, {\"id\": 3}]";
+    int delivered = 0;
+    JsonArrayStream stream;
+    stream.begin(&countElement, &delivered);
+    TEST_ASSERT_TRUE(stream.feed(list.data(), list.size()));
+
+    // Complete, but not every element reached the callback: the sync must
+    // not take it for the whole list
+    TEST_ASSERT_TRUE(stream.isComplete());
+    TEST_ASSERT_EQUAL(3, (int)stream.getElements());
+    TEST_ASSERT_EQUAL(1, (int)stream.getSkipped());
+    TEST_ASSERT_EQUAL(2, delivered);
+}
+
+void test_list_sizes_split_in_segments(void) {
+    // Fed in TCP-segment-sized pieces, as the body arrives: every routine
+    // is delivered, and the buffer is one element whatever the list length
+    const int sizes[] = { 10, 100, 1000 };
+    for (int s = 0; s < 3; s++) {
+        std::string list = makeList(sizes[s]);
+        int delivered = 0;
+        JsonArrayStream stream;
+        stream.begin(&countElement, &delivered);
+        for (size_t offset = 0; offset < list.size(); offset += 1460) {
+            size_t length = list.size() - offset < 1460 ? list.size() - offset : 1460;
+            TEST_ASSERT_TRUE(stream.feed(list.data() + offset, length));
+        }
+        TEST_ASSERT_TRUE(stream.isComplete());
+        TEST_ASSERT_EQUAL(sizes[s], delivered);
+        TEST_ASSERT_EQUAL(0, (int)stream.getSkipped());
+        TEST_ASSERT_TRUE(stream.getMaxElement() < JsonArrayStream::ELEMENT_BUFFER);
+    }
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_oversized_element_is_counted_as_skipped);
+    RUN_TEST(test_list_sizes_split_in_segments);
+    return UNITY_END();
+}
@@ -0,0 +1,227 @@
+// routineParseData against a corpus of payloads the backend sends or could
+// send, mutations of it fed without a terminator in buffers sized exactly
+// to the payload (build with -fsanitize=address,undefined to catch any read
+// past the end), and routines per second for each payload shape.
+//
+//   pio test -e native -f test_routine_parser -v
+
+#include <unity.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include "Routine.h"
+#include "TestRoutines.h"
+
+namespace {
+
+struct GoodPayload {
+    const char* data;
+    int32_t id;
+    const char* name;
+    uint8_t flags;
+    uint16_t startMinute;
+    uint16_t endMinute;
+    uint8_t dayMask;
+    const char* ubication;
+};
+
+// Fuzz seeds that parse, with what they must parse to
+const GoodPayload good[] = {
+    { "{'id': 7, 'name': 'Noche', 'condition': '60', 'isDry': True, 'startTime': '22:00', "
+      "'endTime': '06:00', 'days': ['MONDAY', 'FRIDAY']}",
+      7, "Noche", ROUTINE_DRY, 22 * 60, 6 * 60, 0x22, "" },
+    { "{\"id\": 8, \"name\": \"It's\", \"condition\": \"humidity > 55.5 ~ 2\", \"isDry\": false, "
+      "\"startTime\": \"08:00:00\", \"endTime\": \"09:30\", \"days\": [], \"extra\": {'a': [1, {'b': None}]}}",
+      8, "It's", 0, 8 * 60, 9 * 60 + 30, 0x00, "" },
+    { "{'days': ['SUNDAY', 'SATURDAY', 'NOSUCHDAY'], 'endTime': '23:59', 'startTime': '00:00', "
+      "'isDry': False, 'condition': 'temperature >= 18 && (ica < 50 || !(humidity <= 40))', "
+      "'name': 'Un nombre bastante mas largo que el campo', 'id': 123456, 'ubication': 'Sala'}",
+      123456, "Un nombre bastante mas ", 0, 0, 23 * 60 + 59, 0x41, "Sala" },
+    { "  { 'id' : -1 , 'name' : '' , 'condition' : '40' , 'isDry' : True , 'startTime' : '07:05' , "
+      "'endTime' : '07:06' , 'days' : [ 'TUESDAY' ] , 'ubication' : None }  ",
+      -1, "", ROUTINE_DRY, 7 * 60 + 5, 7 * 60 + 6, 0x04, "" },
+};
+
+// Fuzz seeds that must be refused
+const char* const bad[] = {
+    "",
+    "{",
+    "{}",
+    "{'id': 7,}",
+    // 'days' missing
+    "{'id': 7, 'name': 'Noche', 'condition': '60', 'isDry': True, 'startTime': '22:00', 'endTime': '06:00'}",
+    "{'id': x7, 'name': 'Noche', 'condition': '60', 'isDry': True, 'startTime': '22:00', "
+    "'endTime': '06:00', 'days': []}",
+    "{'id': 7, 'name': 'Noche', 'condition': '60', 'isDry': Maybe, 'startTime': '22:00', "
+    "'endTime': '06:00', 'days': []}",
+    // Times are HH:MM
+    "{'id': 7, 'name': 'Noche', 'condition': '60', 'isDry': True, 'startTime': '7:00', "
+    "'endTime': '08:00', 'days': []}",
+    "{'id': 7, 'name': 'Noche', 'condition': '60', 'isDry': True, 'startTime': '25:00', "
+    "'endTime': '06:00', 'days': []}",
+    "{'id': 7, 'name': 'Noche', 'condition': 'humidity >', 'isDry': True, 'startTime': '22:00', "
+    "'endTime': '06:00', 'days': []}",
+    "{'id': 7, 'name': 'Noche, 'condition': '60', 'isDry': True, 'startTime': '22:00', "
+    "'endTime': '06:00', 'days': []}",
+    "{'id': 7, 'name': 'Noche', 'condition': '60', 'isDry': True, 'startTime': '22:00', "
+    "'endTime': '06:00', 'days': ['MONDAY'",
+    "{'id': 7, 'name': 'Noche', 'condition': '60', 'isDry': True, 'startTime': '22:00', "
+    "'endTime': '06:00', 'days': [], 'ubication': 3}",
+};
+
+const int GOOD_COUNT = sizeof(good) / sizeof(good[0]);
+const int BAD_COUNT = sizeof(bad) / sizeof(bad[0]);
+
+// Parses a copy of payload in a heap block of exactly its size, so nothing
+// after the last byte is readable
+bool parseExact(const std::string& payload, Routine& routine, char* name, char* ubication) {
+    char* buffer = static_cast<char*>(malloc(payload.empty() ? 1 : payload.size()));
+    memcpy(buffer, payload.data(), payload.size());
+    RoutineCondition condition;
+    bool parsed = routineParseData(buffer, payload.size(), routine, condition, name, ubication);
+    free(buffer);
+    if (parsed) {
+        TEST_ASSERT_TRUE(condition.length > 0 && condition.length <= CONDITION_CODE_LENGTH);
+    }
+    return parsed;
+}
+
+// One to four erasures, inserted syntax characters or random bytes
+std::string mutate(const char* seed, TestRandom& random) {
+    static const char syntax[] = "{}[]'\",: \\aT0";
+    std::string payload = seed;
+    int mutations = 1 + random.next(4);
+    for (int m = 0; m < mutations; m++) {
+        size_t at = payload.empty() ? 0 : random.next(payload.size());
+        switch (random.next(3)) {
+        case 0:
+            if (!payload.empty()) payload.erase(at, 1 + random.next(8));
+            break;
+        case 1:
+            payload.insert(at, 1, syntax[random.next(sizeof(syntax) - 1)]);
+            break;
+        default:
+            if (!payload.empty()) payload[at] = (char)random.next(256);
+            break;
+        }
+    }
+    return payload;
+}
+
+double nanosSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+void test_corpus_parses_as_expected(void) {
+    for (int i = 0; i < GOOD_COUNT; i++) {
+        Routine routine;
+        char name[ROUTINE_NAME_LENGTH];
+        char ubication[UBICATION_LENGTH];
+        TEST_ASSERT_TRUE(parseExact(good[i].data, routine, name, ubication));
+        TEST_ASSERT_EQUAL(good[i].id, routine.id);
+        TEST_ASSERT_EQUAL_STRING(good[i].name, name);
+        TEST_ASSERT_EQUAL(good[i].flags, routine.flags & ROUTINE_DRY);
+        TEST_ASSERT_EQUAL(good[i].startMinute, routine.startMinute);
+        TEST_ASSERT_EQUAL(good[i].endMinute, routine.endMinute);
+        TEST_ASSERT_EQUAL(good[i].dayMask, routine.dayMask);
+        TEST_ASSERT_EQUAL_STRING(good[i].ubication, ubication);
+    }
+    for (int i = 0; i < BAD_COUNT; i++) {
+        Routine routine;
+        char name[ROUTINE_NAME_LENGTH];
+        char ubication[UBICATION_LENGTH];
+        TEST_ASSERT_FALSE(parseExact(bad[i], routine, name, ubication));
+    }
+}
+
+void test_truncated_payloads_never_read_past_the_end(void) {
+    // Every prefix of every seed, the way a cut-off body would arrive
+    for (int i = 0; i < GOOD_COUNT; i++) {
+        std::string payload = good[i].data;
+        for (size_t length = 0; length < payload.size(); length++) {
+            Routine routine;
+            char name[ROUTINE_NAME_LENGTH];
+            char ubication[UBICATION_LENGTH];
+            if (parseExact(payload.substr(0, length), routine, name, ubication)) {
+                TEST_ASSERT_TRUE(strlen(name) < ROUTINE_NAME_LENGTH);
+                TEST_ASSERT_TRUE(strlen(ubication) < UBICATION_LENGTH);
+            }
+        }
+    }
+}
+
+void test_mutated_corpus(void) {
+    const long iterations = 200000;
+    TestRandom random(12);
+    long accepted = 0;
+    for (long i = 0; i < iterations; i++) {
+        const char* seed = random.next(4) ? good[random.next(GOOD_COUNT)].data : bad[random.next(BAD_COUNT)];
+        Routine routine;
+        char name[ROUTINE_NAME_LENGTH];
+        char ubication[UBICATION_LENGTH];
+        if (parseExact(mutate(seed, random), routine, name, ubication)) {
+            accepted++;
+            TEST_ASSERT_TRUE(strlen(name) < ROUTINE_NAME_LENGTH);
+            TEST_ASSERT_TRUE(strlen(ubication) < UBICATION_LENGTH);
+            TEST_ASSERT_TRUE(routine.startMinute < 24 * 60 && routine.endMinute < 24 * 60);
+            TEST_ASSERT_TRUE(routine.dayMask < 0x80);
+        }
+    }
+    char message[96];
+    snprintf(message, sizeof(message), "%ld mutated payloads, %ld still parsed", iterations, accepted);
+    TEST_MESSAGE(message);
+}
+
+void test_benchmark_routines_per_second(void) {
+    char generated[256];
+    formatRoutineData(generated, sizeof(generated), 42, "humidity > 60 ~ 3", true, 480, 1200, 0x3e);
+    struct Shape {
+        const char* name;
+        const char* payload;
+    };
+    const Shape shapes[] = {
+        { "python dict", good[0].data },
+        { "json, unknown keys", good[1].data },
+        { "long condition", good[2].data },
+        { "as the backend formats it", generated },
+    };
+    for (size_t s = 0; s < sizeof(shapes) / sizeof(shapes[0]); s++) {
+        const long passes = 200000;
+        size_t length = strlen(shapes[s].payload);
+        Routine routine;
+        RoutineCondition condition;
+        char name[ROUTINE_NAME_LENGTH];
+        long parsed = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (long i = 0; i < passes; i++) {
+            parsed += routineParseData(shapes[s].payload, length, routine, condition, name);
+        }
+        double nanos = nanosSince(start);
+        TEST_ASSERT_EQUAL(passes, parsed);
+
+        char message[128];
+        snprintf(message, sizeof(message), "%-26s %3u bytes: %.0f routines/s, %.0f MB/s on the host",
+                 shapes[s].name, (unsigned)length, passes / (nanos / 1e9), passes * length / (nanos / 1e3));
+        TEST_MESSAGE(message);
+    }
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_corpus_parses_as_expected);
+    RUN_TEST(test_truncated_payloads_never_read_past_the_end);
+    RUN_TEST(test_mutated_corpus);
+    RUN_TEST(test_benchmark_routines_per_second);
+    return UNITY_END();
+}
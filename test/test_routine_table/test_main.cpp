@@ -0,0 +1,240 @@
+// RoutineTable with a writer and a reader on their own threads, as the
+// network and control tasks use it. The writer stamps every routine of a
+// set with the set's version while building it, now and then abandons one
+// halfway, and records how many routines each published version holds.
+// The reader checks each set it acquires while holding it for a while:
+// one stamp throughout, the count recorded for that version, no abandoned
+// version, unique ids, and versions that never go backwards.
+//
+//   pio test -e native -f test_routine_table -v
+
+#include <unity.h>
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include "RoutineTable.h"
+#include "TestRoutines.h"
+
+namespace {
+
+const int N = 32;
+const uint32_t VERSIONS = 50000;
+const int ABANDONED = -1;
+
+RoutineTable<N>* table;
+std::atomic<int> expectedCount[VERSIONS + 1];
+std::atomic<bool> writerDone(false);
+
+struct Counts {
+    unsigned long published;
+    unsigned long abandoned;
+    unsigned long deferred;         // beginUpdate() refused: the reader was on the spare set
+    unsigned long acquired;
+    unsigned long versionsSeen;
+};
+
+Counts counts;
+
+// Every field a reader could see torn carries the version
+void stamp(Routine& routine, char* name, uint32_t version) {
+    routine.startMinute = version % 1440;
+    routine.endMinute = (version / 1440) % 1440;
+    routine.dayMask = version & 0x7f;
+    routine.zone = version & 0xff;
+    snprintf(name, ROUTINE_NAME_LENGTH, "v%lu", (unsigned long)version);
+}
+
+uint32_t versionOf(const Routine& routine) {
+    return routine.startMinute + routine.endMinute * 1440u;
+}
+
+void writer() {
+    TestRandom random(23);
+    RoutineCondition condition = {};
+    for (uint32_t version = 1; version <= VERSIONS; version++) {
+        RoutineSet<N>* next;
+        while ((next = table->beginUpdate()) == nullptr) {
+            counts.deferred++;
+            std::this_thread::yield();
+        }
+
+        // Id 0 stays, so a published set is never empty; a few others come
+        // and go, and every one left is restamped
+        Routine sentinel = {};
+        char sentinelName[ROUTINE_NAME_LENGTH];
+        stamp(sentinel, sentinelName, version);
+        next->upsert(sentinel, condition, sentinelName);
+        for (int change = random.next(4); change > 0; change--) {
+            int32_t id = 1 + random.next(N + N / 2);
+            if (random.next(3) == 0) {
+                next->remove(id);
+            } else {
+                Routine routine = {};
+                char name[ROUTINE_NAME_LENGTH];
+                routine.id = id;
+                stamp(routine, name, version);
+                next->upsert(routine, condition, name);
+            }
+        }
+        bool abandon = random.next(10) == 0;
+        int restamp = abandon ? next->count / 2 : next->count;
+        for (int i = 0; i < restamp; i++) {
+            stamp(next->routines[i], next->names[i], version);
+        }
+
+        if (abandon) {
+            expectedCount[version].store(ABANDONED);
+            table->abandon();
+            counts.abandoned++;
+        } else {
+            expectedCount[version].store(next->count);
+            table->publish();
+            counts.published++;
+        }
+        // The network task waits on sockets between updates; this also lets
+        // the reader run on a single core
+        if (random.next(2) == 0) std::this_thread::yield();
+    }
+    writerDone = true;
+}
+
+// Returns an empty string if the set is consistent, or what is wrong
+std::string check(const RoutineSet<N>& set, uint32_t& lastVersion) {
+    char problem[128];
+    int count = set.count;
+    if (count == 0) {
+        return lastVersion == 0 ? "" : "empty set after a published one";
+    }
+    uint32_t version = versionOf(set.routines[0]);
+    int expected = expectedCount[version].load();
+    if (expected == ABANDONED) {
+        snprintf(problem, sizeof(problem), "abandoned version %lu seen", (unsigned long)version);
+        return problem;
+    }
+    if (expected != count) {
+        snprintf(problem, sizeof(problem), "version %lu: %d routines, %d published", (unsigned long)version, count,
+                 expected);
+        return problem;
+    }
+    if (version < lastVersion) {
+        snprintf(problem, sizeof(problem), "version %lu after %lu", (unsigned long)version, (unsigned long)lastVersion);
+        return problem;
+    }
+    char name[ROUTINE_NAME_LENGTH];
+    Routine model = {};
+    stamp(model, name, version);
+    for (int i = 0; i < count; i++) {
+        const Routine& routine = set.routines[i];
+        if (versionOf(routine) != version || routine.dayMask != model.dayMask || routine.zone != model.zone ||
+            strcmp(set.names[i], name) != 0) {
+            snprintf(problem, sizeof(problem), "version %lu: routine %d is from %lu (%s)", (unsigned long)version, i,
+                     (unsigned long)versionOf(routine), set.names[i]);
+            return problem;
+        }
+        for (int j = 0; j < i; j++) {
+            if (set.routines[j].id == routine.id) {
+                snprintf(problem, sizeof(problem), "version %lu: id %ld twice", (unsigned long)version,
+                         (long)routine.id);
+                return problem;
+            }
+        }
+    }
+    counts.versionsSeen += version != lastVersion;
+    lastVersion = version;
+    return "";
+}
+
+}
+
+void setUp(void) {
+    table = new RoutineTable<N>();
+    for (uint32_t i = 0; i <= VERSIONS; i++) {
+        expectedCount[i].store(0);
+    }
+    writerDone = false;
+    counts = Counts();
+}
+
+void tearDown(void) {
+    delete table;
+}
+
+void test_concurrent_writer_and_reader(void) {
+    auto start = std::chrono::steady_clock::now();
+    std::thread writing(writer);
+
+    // The control loop: acquire, use the set for a while, release
+    TestRandom random(29);
+    uint32_t lastVersion = 0;
+    std::string problem;
+    while (!writerDone && problem.empty()) {
+        uint32_t held = table->acquire();
+        const RoutineSet<N>& set = table->read(held);
+        problem = check(set, lastVersion);
+        for (int spin = random.next(200); spin > 0 && problem.empty(); spin--) {
+            // Still the same set, however long it is held
+            uint32_t before = lastVersion;
+            problem = check(set, lastVersion);
+            if (problem.empty() && lastVersion != before) problem = "set changed while held";
+            // Held across a switch to the writer, as a long job would
+            if (random.next(64) == 0) std::this_thread::yield();
+        }
+        table->release();
+        counts.acquired++;
+        if (random.next(4) == 0) std::this_thread::yield();
+    }
+    writerDone = true;
+    writing.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // And the last one published is the one read at the end
+    if (problem.empty()) {
+        problem = check(table->read(table->acquire()), lastVersion);
+        table->release();
+    }
+
+    char message[200];
+    snprintf(message, sizeof(message),
+             "%.2f s: %lu sets published, %lu abandoned, %lu updates deferred; %lu acquisitions saw %lu versions",
+             seconds, counts.published, counts.abandoned, counts.deferred, counts.acquired, counts.versionsSeen);
+    TEST_MESSAGE(message);
+    if (!problem.empty()) {
+        TEST_FAIL_MESSAGE(problem.c_str());
+    }
+    TEST_ASSERT_EQUAL_UINT32(VERSIONS, counts.published + counts.abandoned);
+    TEST_ASSERT_GREATER_THAN(0, (long)counts.versionsSeen);
+}
+
+void test_writer_waits_for_the_reader(void) {
+    // The reader on the initial set: the first update builds in the other
+    // buffer, the second would overwrite the one still held
+    uint32_t held = table->acquire();
+    RoutineSet<N>* next = table->beginUpdate();
+    TEST_ASSERT_TRUE(next != nullptr);
+    next->count = 0;
+    table->publish();
+    TEST_ASSERT_TRUE(table->beginUpdate() == nullptr);
+    TEST_ASSERT_TRUE(table->getUpdate() == nullptr);
+
+    table->release();
+    TEST_ASSERT_TRUE(table->beginUpdate() != nullptr);
+    table->abandon();
+
+    // Acquiring again takes the newer set, so the writer is free
+    held = table->acquire();
+    TEST_ASSERT_TRUE(&table->read(held) == &table->getPublished());
+    TEST_ASSERT_TRUE(table->beginUpdate() != nullptr);
+    table->abandon();
+    table->release();
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_writer_waits_for_the_reader);
+    RUN_TEST(test_concurrent_writer_and_reader);
+    return UNITY_END();
+}
@@ -0,0 +1,189 @@
+// ScheduleIndex against the linear day/time check it replaces, and its cost
+// with thousands of routines.
+//
+//   pio test -e native -f test_schedule_index -v
+
+#include <unity.h>
+#include <chrono>
+#include "ScheduleIndex.h"
+#include "TestRoutines.h"
+
+namespace {
+
+const int ROUTINES = 4000;
+const int WEEK = ScheduleIndex<ROUTINES>::MINUTES_PER_WEEK;
+const int DAY = ScheduleIndex<ROUTINES>::MINUTES_PER_DAY;
+
+Routine routines[ROUTINES];
+ScheduleIndex<ROUTINES>* scheduleIndex;
+
+// StateManager's checks before the index: the routine's day, then its time
+// window, wrapping past midnight when it starts after it ends
+bool linearCandidate(const Routine& routine, int minuteOfWeek) {
+    int weekday = minuteOfWeek / DAY;
+    int minute = minuteOfWeek % DAY;
+    if (!(routine.dayMask & (1 << weekday))) return false;
+    if (routine.startMinute <= routine.endMinute) {
+        return minute >= routine.startMinute && minute <= routine.endMinute;
+    }
+    return minute >= routine.startMinute || minute <= routine.endMinute;
+}
+
+void makeRoutines(int count, uint32_t seed) {
+    TestRandom random(seed);
+    for (int i = 0; i < count; i++) {
+        Routine& routine = routines[i];
+        routine.id = i + 1;
+        // A third of them overnight, some a single minute or the whole day
+        routine.startMinute = random.next(DAY);
+        routine.endMinute = random.next(4) == 0 ? routine.startMinute : random.next(DAY);
+        if (random.next(10) == 0) {
+            routine.startMinute = 0;
+            routine.endMinute = DAY - 1;
+        }
+        routine.dayMask = random.next(128);
+        routine.flags = ROUTINE_ACTIVE;
+        routine.zone = 0;
+    }
+}
+
+double nanosSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+}
+
+void setUp(void) {
+    scheduleIndex = new ScheduleIndex<ROUTINES>();
+}
+
+void tearDown(void) {
+    delete scheduleIndex;
+}
+
+void test_matches_linear_scan_over_a_week(void) {
+    const int count = 300;
+    makeRoutines(count, 11);
+    scheduleIndex->build(routines, count);
+
+    for (int minute = 0; minute < WEEK; minute++) {
+        scheduleIndex->advanceTo(minute);
+        for (int r = 0; r < count; r++) {
+            if (scheduleIndex->isCandidate(r) != linearCandidate(routines[r], minute)) {
+                char message[96];
+                snprintf(message, sizeof(message), "routine %d at minute %d", r, minute);
+                TEST_FAIL_MESSAGE(message);
+            }
+        }
+    }
+}
+
+void test_matches_linear_scan_after_jumps(void) {
+    // NTP syncs, week wraps and clocks set back
+    const int count = 200;
+    makeRoutines(count, 23);
+    scheduleIndex->build(routines, count);
+
+    TestRandom random(5);
+    for (int jump = 0; jump < 5000; jump++) {
+        int minute = random.next(WEEK);
+        scheduleIndex->advanceTo(minute);
+        int expected = 0;
+        for (int r = 0; r < count; r++) {
+            bool candidate = linearCandidate(routines[r], minute);
+            expected += candidate;
+            TEST_ASSERT_EQUAL(candidate, scheduleIndex->isCandidate(r));
+        }
+        TEST_ASSERT_EQUAL(expected, scheduleIndex->getCandidateCount());
+    }
+}
+
+void test_next_schedule_change_is_never_late(void) {
+    // Until the minute it reports, the candidate set stays as it is
+    const int count = 50;
+    makeRoutines(count, 31);
+    scheduleIndex->build(routines, count);
+
+    TestRandom random(9);
+    for (int query = 0; query < 500; query++) {
+        int from = random.next(WEEK);
+        int change = scheduleIndex->nextScheduleChange(from);
+        TEST_ASSERT_TRUE(change >= 0 && change < WEEK);
+        int steps = (change - from + WEEK) % WEEK;
+        if (steps == 0) steps = WEEK;
+        for (int step = 1; step < steps; step++) {
+            int minute = (from + step) % WEEK;
+            for (int r = 0; r < count; r++) {
+                TEST_ASSERT_EQUAL(linearCandidate(routines[r], from), linearCandidate(routines[r], minute));
+            }
+        }
+    }
+
+    scheduleIndex->build(routines, 0);
+    TEST_ASSERT_EQUAL(-1, scheduleIndex->nextScheduleChange(0));
+}
+
+void test_benchmark_thousands_of_routines(void) {
+    makeRoutines(ROUTINES, 47);
+    char message[128];
+
+    auto start = std::chrono::steady_clock::now();
+    scheduleIndex->build(routines, ROUTINES);
+    snprintf(message, sizeof(message), "build, %d routines: %.2f ms (%d events)", ROUTINES, nanosSince(start) / 1e6,
+             scheduleIndex->getEventCount());
+    TEST_MESSAGE(message);
+
+    // A week of minute ticks: keeping the set current, then walking it as
+    // the routine check does, against testing every routine
+    start = std::chrono::steady_clock::now();
+    for (int minute = 0; minute < WEEK; minute++) {
+        scheduleIndex->advanceTo(minute);
+    }
+    double advanced = nanosSince(start);
+
+    long candidates = 0;
+    start = std::chrono::steady_clock::now();
+    for (int minute = 0; minute < WEEK; minute++) {
+        scheduleIndex->advanceTo(minute);
+        for (int r = scheduleIndex->nextCandidate(0); r >= 0; r = scheduleIndex->nextCandidate(r + 1)) {
+            candidates++;
+        }
+    }
+    double indexed = nanosSince(start);
+
+    long linear = 0;
+    start = std::chrono::steady_clock::now();
+    for (int minute = 0; minute < WEEK; minute++) {
+        for (int r = 0; r < ROUTINES; r++) {
+            linear += linearCandidate(routines[r], minute);
+        }
+    }
+    double scanned = nanosSince(start);
+    TEST_ASSERT_EQUAL(linear, candidates);
+
+    snprintf(message, sizeof(message), "per minute: advance %.0f ns, advance and walk %.0f ns, linear scan %.0f ns "
+             "(%ld candidates)", advanced / WEEK, indexed / WEEK, scanned / WEEK, candidates / WEEK);
+    TEST_MESSAGE(message);
+
+    const int queries = 100000;
+    TestRandom random(3);
+    long sum = 0;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < queries; i++) {
+        sum += scheduleIndex->nextScheduleChange(random.next(WEEK));
+    }
+    snprintf(message, sizeof(message), "nextScheduleChange: %.0f ns", nanosSince(start) / queries);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_GREATER_THAN(0, sum);
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_matches_linear_scan_over_a_week);
+    RUN_TEST(test_matches_linear_scan_after_jumps);
+    RUN_TEST(test_next_schedule_change_is_never_late);
+    RUN_TEST(test_benchmark_thousands_of_routines);
+    return UNITY_END();
+}
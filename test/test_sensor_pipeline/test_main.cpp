@@ -0,0 +1,255 @@
+// SensorPipeline against a simulated DHT22: the median-of-5 glitch filter,
+// the window of 6 behind the means, the early readings checked once there
+// is a median, a step change getting through, and the window while it is
+// still empty, in the pipeline and in STATS / STATS:JSON, and STATS:JSON
+// with readings printf cannot write as JSON.
+//
+//   pio test -e native -f test_sensor_pipeline -v
+
+#include <unity.h>
+#include <math.h>
+#include <float.h>
+#include <string>
+#include "MockHal.h"
+#include "TestRoutines.h"
+#include "SensorPipeline.h"
+#include "DeviceManagerImpl.h"
+#include "Log.h"
+
+namespace {
+
+// A room drifting slowly, read with the DHT22's noise, an occasional
+// glitch far off the real value and an occasional failed read
+struct SimulatedSensor {
+    TestRandom random;
+    float temperature = 24.0f;
+    float humidity = 55.0f;
+    int glitchPercent;
+    int failurePercent;
+
+    SimulatedSensor(uint32_t seed, int glitches, int failures)
+        : random(seed), glitchPercent(glitches), failurePercent(failures) {}
+
+    float noise(float amplitude) {
+        return ((int)random.next(201) - 100) * amplitude / 100;
+    }
+
+    // 0 read, 1 glitch, 2 failure
+    int read(float& temperatureValue, float& humidityValue) {
+        temperature += noise(0.02f);
+        humidity += noise(0.05f);
+        temperatureValue = temperature + noise(0.1f);
+        humidityValue = humidity + noise(0.5f);
+        int roll = random.next(100);
+        if (roll < failurePercent) {
+            temperatureValue = NAN;
+            return 2;
+        }
+        if (roll < failurePercent + glitchPercent) {
+            if (random.next(2)) {
+                temperatureValue += (random.next(2) ? 1 : -1) * (8 + noise(4.0f));
+            } else {
+                humidityValue += (random.next(2) ? 1 : -1) * (30 + noise(10.0f));
+            }
+            return 1;
+        }
+        return 0;
+    }
+};
+
+bool failingSensor(int pin, float& temperature, float& humidity) {
+    (void)pin;
+    (void)temperature;
+    (void)humidity;
+    return false;
+}
+
+// Not NaN, so the pipeline takes it; nothing else the sensor can return
+// is longer in printf's %.2f
+bool extremeSensor(int pin, float& temperature, float& humidity) {
+    (void)pin;
+    temperature = INFINITY;
+    humidity = FLT_MAX;
+    return true;
+}
+
+void addSteady(SensorPipeline& pipeline, float temperature, float humidity, int count) {
+    for (int i = 0; i < count; i++) {
+        pipeline.addReading(temperature, humidity);
+    }
+}
+
+}
+
+void setUp(void) {
+    MockHal::reset();
+    logSetLevel(LOG_LEVEL_NONE);
+}
+
+void tearDown(void) {
+}
+
+void test_empty_window(void) {
+    SensorPipeline pipeline;
+    TEST_ASSERT_FALSE(pipeline.hasData());
+    TEST_ASSERT_EQUAL(0, pipeline.getSampleCount());
+
+    // Failed reads are counted but never fill the window
+    for (int i = 0; i < 10; i++) {
+        pipeline.addFailure();
+    }
+    TEST_ASSERT_FALSE(pipeline.addReading(NAN, 55.0f));
+    TEST_ASSERT_FALSE(pipeline.hasData());
+    TEST_ASSERT_EQUAL_UINT32(11, pipeline.getStats().failures);
+    TEST_ASSERT_EQUAL_UINT32(11, pipeline.getStats().maxConsecutiveFailures);
+
+    SensorWindow temperature = pipeline.getTemperature();
+    TEST_ASSERT_TRUE(temperature.min == 0 && temperature.mean == 0 && temperature.max == 0);
+    TEST_ASSERT_TRUE(pipeline.addReading(24.0f, 55.0f));
+    TEST_ASSERT_TRUE(pipeline.hasData());
+    TEST_ASSERT_EQUAL_UINT32(0, pipeline.getStats().consecutiveFailures);
+}
+
+void test_window_keeps_the_last_six(void) {
+    SensorPipeline pipeline;
+    for (int i = 0; i < 10; i++) {
+        TEST_ASSERT_TRUE(pipeline.addReading(20.0f + i * 0.1f, 50.0f + i));
+    }
+    TEST_ASSERT_EQUAL(SensorPipeline::AGGREGATE_WINDOW, pipeline.getSampleCount());
+    SensorWindow temperature = pipeline.getTemperature();
+    SensorWindow humidity = pipeline.getHumidity();
+    TEST_ASSERT_TRUE(fabsf(temperature.min - 20.4f) < 0.001f);
+    TEST_ASSERT_TRUE(fabsf(temperature.max - 20.9f) < 0.001f);
+    TEST_ASSERT_TRUE(fabsf(temperature.mean - 20.65f) < 0.001f);
+    TEST_ASSERT_TRUE(fabsf(humidity.mean - 56.5f) < 0.001f);
+}
+
+void test_single_glitch_is_rejected(void) {
+    SensorPipeline pipeline;
+    addSteady(pipeline, 24.0f, 55.0f, 8);
+    TEST_ASSERT_FALSE(pipeline.addReading(35.0f, 55.0f));
+    TEST_ASSERT_FALSE(pipeline.addReading(24.0f, 90.0f));
+    TEST_ASSERT_EQUAL_UINT32(2, pipeline.getStats().outliers);
+    TEST_ASSERT_TRUE(pipeline.getTemperature().max == 24.0f);
+    TEST_ASSERT_TRUE(pipeline.getHumidity().max == 55.0f);
+}
+
+void test_step_change_gets_through(void) {
+    SensorPipeline pipeline;
+    addSteady(pipeline, 24.0f, 55.0f, 8);
+
+    // Rejected until it makes up most of the median window
+    int accepted = -1;
+    for (int i = 0; i < SensorPipeline::MEDIAN_WINDOW && accepted < 0; i++) {
+        if (pipeline.addReading(28.0f, 55.0f)) accepted = i;
+    }
+    TEST_ASSERT_EQUAL(2, accepted);
+
+    // The old level leaves the window after six accepted readings
+    addSteady(pipeline, 28.0f, 55.0f, SensorPipeline::AGGREGATE_WINDOW - 1);
+    TEST_ASSERT_TRUE(pipeline.getTemperature().min == 28.0f);
+}
+
+void test_early_glitch_is_dropped_at_the_first_median(void) {
+    SensorPipeline pipeline;
+    TEST_ASSERT_TRUE(pipeline.addReading(50.0f, 55.0f));
+    TEST_ASSERT_TRUE(pipeline.addReading(24.0f, 55.0f));
+    TEST_ASSERT_TRUE(pipeline.addReading(24.2f, 55.0f));
+    TEST_ASSERT_EQUAL(2, pipeline.getSampleCount());
+    TEST_ASSERT_EQUAL_UINT32(1, pipeline.getStats().outliers);
+    TEST_ASSERT_TRUE(pipeline.getTemperature().max < 25.0f);
+}
+
+void test_simulated_sensor(void) {
+    SimulatedSensor sensor(17, 2, 3);
+    SensorPipeline pipeline;
+    const int READINGS = 20000;
+    int glitches = 0, glitchesAccepted = 0, failures = 0, goodRejected = 0;
+    float worstError = 0;
+    for (int i = 0; i < READINGS; i++) {
+        float temperature, humidity;
+        int kind = sensor.read(temperature, humidity);
+        bool accepted = pipeline.addReading(temperature, humidity);
+        glitches += kind == 1;
+        glitchesAccepted += kind == 1 && accepted;
+        failures += kind == 2;
+        goodRejected += kind == 0 && !accepted;
+        if (pipeline.hasData() && i > SensorPipeline::AGGREGATE_WINDOW) {
+            float error = fabsf(pipeline.getTemperature().mean - sensor.temperature);
+            if (error > worstError) worstError = error;
+        }
+    }
+    const SensorStats& stats = pipeline.getStats();
+
+    char message[160];
+    snprintf(message, sizeof(message),
+             "%d readings: %d glitches, %d let through; %d failures; %d good readings rejected; "
+             "worst temperature mean error %.2f C", READINGS, glitches, glitchesAccepted, failures, goodRejected,
+             worstError);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_EQUAL(0, glitchesAccepted);
+    TEST_ASSERT_EQUAL_UINT32(failures, stats.failures);
+    TEST_ASSERT_EQUAL_UINT32(READINGS, stats.reads);
+    TEST_ASSERT_TRUE(goodRejected < READINGS / 1000);
+    TEST_ASSERT_TRUE(worstError < 0.5f);
+}
+
+void test_stats_with_empty_window(void) {
+    MockSensor::source = &failingSensor;
+    DeviceManager<MockHal>* device = new DeviceManager<MockHal>();
+    device->setup();
+    for (int i = 0; i < 100; i++) {
+        device->loop();
+    }
+    TEST_ASSERT_GREATER_THAN(0, (long)MockSensor::reads);
+
+    // No made-up zeros, and the line stays valid JSON
+    MockConsole& console = MockHal::console();
+    console.output.clear();
+    console.input.push_back("STATS:JSON");
+    device->processSerialCommands();
+    TEST_ASSERT_TRUE(console.output.find("\"window\":0,\"temperature\":null,\"humidity\":null}}") != std::string::npos);
+    TEST_ASSERT_TRUE(console.output.find("nan") == std::string::npos);
+
+    console.output.clear();
+    console.input.push_back("STATS");
+    device->processSerialCommands();
+    TEST_ASSERT_TRUE(console.output.find("ventana=0 sin lecturas validas") != std::string::npos);
+    delete device;
+}
+
+void test_stats_json_with_extreme_readings(void) {
+    MockSensor::source = &extremeSensor;
+    DeviceManager<MockHal>* device = new DeviceManager<MockHal>();
+    device->setup();
+    for (int i = 0; i < 100; i++) {
+        device->loop();
+    }
+
+    // Infinities become null, and the longest numbers still fit
+    MockConsole& console = MockHal::console();
+    console.output.clear();
+    console.input.push_back("STATS:JSON");
+    device->processSerialCommands();
+    TEST_ASSERT_TRUE(console.output.find("\"temperature\":{\"min\":null,\"mean\":null,\"max\":null}") != std::string::npos);
+    TEST_ASSERT_TRUE(console.output.find("\"humidity\":{\"min\":340282346638528859811704183484516925440.00,") != std::string::npos);
+    TEST_ASSERT_TRUE(console.output.find("inf") == std::string::npos);
+    TEST_ASSERT_TRUE(console.output.find("nan") == std::string::npos);
+    TEST_ASSERT_TRUE(console.output.find("}}}\n") != std::string::npos);
+    delete device;
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_empty_window);
+    RUN_TEST(test_window_keeps_the_last_six);
+    RUN_TEST(test_single_glitch_is_rejected);
+    RUN_TEST(test_step_change_gets_through);
+    RUN_TEST(test_early_glitch_is_dropped_at_the_first_median);
+    RUN_TEST(test_simulated_sensor);
+    RUN_TEST(test_stats_with_empty_window);
+    RUN_TEST(test_stats_json_with_extreme_readings);
+    return UNITY_END();
+}
@@ -0,0 +1,145 @@
+// Snapshot with a writer and a reader on their own threads, as the network
+// task's stats and the control task's printers use it. The writer fills
+// every field of each copy with its version; the reader checks that a copy
+// it holds is whole, stays put while held, and never goes backwards.
+//
+//   pio test -e native -f test_snapshot -v
+
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include "Snapshot.h"
+#include "TestRoutines.h"
+
+namespace {
+
+const uint32_t VERSIONS = 200000;
+
+struct Stats {
+    uint32_t version;
+    unsigned long counters[32];
+    char name[16];
+};
+
+Snapshot<Stats>* snapshot;
+std::atomic<bool> writerDone(false);
+unsigned long skipped;
+
+void writer() {
+    TestRandom random(5);
+    for (uint32_t version = 1; version <= VERSIONS; version++) {
+        Stats* stats = snapshot->beginUpdate();
+        if (stats == nullptr) {
+            skipped++;
+        } else {
+            stats->version = version;
+            for (int i = 0; i < 32; i++) {
+                stats->counters[i] = version + i;
+            }
+            snprintf(stats->name, sizeof(stats->name), "v%lu", (unsigned long)version);
+            snapshot->publish();
+        }
+        if (random.next(2) == 0) std::this_thread::yield();
+    }
+    writerDone = true;
+}
+
+// Returns an empty string if the copy is whole, or what is wrong
+std::string check(const Stats& stats) {
+    // Before the first publish everything is zero
+    char problem[96];
+    char name[16] = "";
+    if (stats.version > 0) {
+        snprintf(name, sizeof(name), "v%lu", (unsigned long)stats.version);
+    }
+    for (int i = 0; i < 32; i++) {
+        unsigned long expected = stats.version > 0 ? stats.version + i : 0;
+        if (stats.counters[i] != expected || strcmp(stats.name, name) != 0) {
+            snprintf(problem, sizeof(problem), "version %lu: counter %d is %lu, name %s", (unsigned long)stats.version,
+                     i, stats.counters[i], stats.name);
+            return problem;
+        }
+    }
+    return "";
+}
+
+}
+
+void setUp(void) {
+    snapshot = new Snapshot<Stats>();
+    writerDone = false;
+    skipped = 0;
+}
+
+void tearDown(void) {
+    delete snapshot;
+}
+
+void test_reader_before_the_first_publish_sees_zeros(void) {
+    const Stats& stats = snapshot->read(snapshot->acquire());
+    TEST_ASSERT_EQUAL_UINT32(0, stats.version);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.counters[31]);
+    TEST_ASSERT_EQUAL_STRING("", stats.name);
+    snapshot->release();
+}
+
+void test_writer_skips_while_the_reader_holds_the_spare(void) {
+    uint32_t held = snapshot->acquire();
+    TEST_ASSERT_TRUE(snapshot->beginUpdate() != nullptr);
+    snapshot->publish();
+    TEST_ASSERT_TRUE(snapshot->beginUpdate() == nullptr);
+    snapshot->release();
+    TEST_ASSERT_TRUE(snapshot->beginUpdate() != nullptr);
+    held = snapshot->acquire();
+    TEST_ASSERT_TRUE(&snapshot->read(held) != snapshot->beginUpdate());
+    snapshot->release();
+}
+
+void test_concurrent_writer_and_reader(void) {
+    std::thread writing(writer);
+    TestRandom random(7);
+    uint32_t lastVersion = 0;
+    unsigned long acquired = 0;
+    std::string problem;
+    while (!writerDone && problem.empty()) {
+        uint32_t held = snapshot->acquire();
+        const Stats& stats = snapshot->read(held);
+        uint32_t version = stats.version;
+        if (version < lastVersion) {
+            problem = "went backwards";
+        }
+        for (int spin = random.next(50); spin > 0 && problem.empty(); spin--) {
+            problem = check(stats);
+            if (problem.empty() && stats.version != version) problem = "changed while held";
+            if (random.next(16) == 0) std::this_thread::yield();
+        }
+        lastVersion = version;
+        snapshot->release();
+        acquired++;
+        if (random.next(4) == 0) std::this_thread::yield();
+    }
+    writerDone = true;
+    writing.join();
+
+    char message[128];
+    snprintf(message, sizeof(message), "%lu copies published, %lu skipped; %lu acquisitions, last saw version %lu",
+             VERSIONS - skipped, skipped, acquired, (unsigned long)lastVersion);
+    TEST_MESSAGE(message);
+    if (!problem.empty()) {
+        TEST_FAIL_MESSAGE(problem.c_str());
+    }
+    TEST_ASSERT_GREATER_THAN(0, (long)lastVersion);
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_reader_before_the_first_publish_sees_zeros);
+    RUN_TEST(test_writer_skips_while_the_reader_holds_the_spare);
+    RUN_TEST(test_concurrent_writer_and_reader);
+    return UNITY_END();
+}
@@ -0,0 +1,142 @@
+// The queues between the control and network tasks, both full at once.
+// The network task runs on its own thread with the clock 200 times faster,
+// polling a backend that answers every zone with an error, while the
+// control loop is held back until the update queue is full. Then the
+// control task sends more commands than its queue holds: neither side may
+// wait for the other, so loop() must still return, and once it runs again
+// the latest command of each kind reaches the network task.
+//
+//   pio test -e native -f test_task_queues -v
+
+#include <unity.h>
+#include <stdlib.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include "MockHal.h"
+#include "HttpStandIn.h"
+#include "DeviceManagerImpl.h"
+#include "TelemetryLogImpl.h"
+#include "Log.h"
+
+namespace {
+
+struct QueueHal : MockHal {
+    using Clock = NativeClock;
+    using Tasks = NativeTasks;
+};
+
+const int TIME_SCALE = 200;
+const unsigned long HELD_MS = 2 * 60000;
+const int COMMANDS = 12;                        // Three times commandQueue's capacity
+
+HttpStandIn server;
+
+// Every zone's device info fails, so each poll publishes a status per zone
+std::string backend(const HttpStandInRequest& request) {
+    if (request.method == "POST") {
+        return HttpStandIn::response(201, "{}");
+    }
+    if (request.path.find("get-dehumidifier") != std::string::npos) {
+        return HttpStandIn::response(500, "");
+    }
+    if (request.path.find("/events") != std::string::npos) {
+        return HttpStandIn::response(404, "");
+    }
+    return HttpStandIn::response(200, "[]");
+}
+
+// Runs the control loop for ms of simulated time
+void run(DeviceManager<QueueHal>& device, unsigned long ms) {
+    unsigned long start = NativeClock::millis();
+    while (NativeClock::millis() - start < ms) {
+        device.loop();
+    }
+}
+
+// The number printed after label in the last JOBS output
+unsigned long printed(const std::string& output, const char* label) {
+    size_t at = output.rfind(label);
+    return at == std::string::npos ? (unsigned long)-1 : strtoul(output.c_str() + at + strlen(label), nullptr, 10);
+}
+
+}
+
+void setUp(void) {
+    MockHal::reset();
+    logSetLevel(LOG_LEVEL_NONE);
+}
+
+void tearDown(void) {
+}
+
+void test_full_queues_do_not_block_either_task(void) {
+    server.setHandler(&backend);
+    if (!server.start(5000)) {
+        TEST_IGNORE_MESSAGE("port 5000 is in use");
+    }
+
+    // The device keeps running after the test, so it is never deleted
+    DeviceManager<QueueHal>* device = new DeviceManager<QueueHal>();
+    char deviceId[16];
+    for (int zone = 1; zone < 16; zone++) {
+        snprintf(deviceId, sizeof(deviceId), "Zona%02d", zone);
+        TEST_ASSERT_EQUAL(zone, device->addZone(deviceId, "", 40 + zone, 20 + zone));
+    }
+    device->setServerIP("127.0.0.1");
+    device->setup();
+
+    // The control loop stalls, as a long job would, while the network task
+    // keeps polling and publishing
+    NativeClock::delay(HELD_MS);
+    TEST_ASSERT_TRUE(server.requests > 32);
+
+    // Commands on a thread, so a control task stuck on a full queue fails
+    // the test instead of hanging it
+    std::atomic<bool> returned(false);
+    std::thread control([device, &returned]() {
+        for (int i = 1; i <= COMMANDS; i++) {
+            device->setTelemetryBatch(i, 1000 * i);
+            device->setTelemetryEncoding(i % 2 ? TELEMETRY_CBOR : TELEMETRY_JSON);
+            device->setServerIP("127.0.0.1");
+        }
+        device->loop();
+        returned = true;
+    });
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (!returned && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    if (!returned) {
+        control.detach();
+        TEST_FAIL_MESSAGE("loop() did not return with both queues full");
+    }
+    control.join();
+
+    // Both queues drain and the latest command of each kind is applied
+    run(*device, 10000);
+    MockHal::console().input.push_back("JOBS");
+    run(*device, 1000);
+    const std::string& output = MockHal::console().output;
+    char message[160];
+    snprintf(message, sizeof(message), "%lu requests; coalesced %lu commands and %lu updates",
+             (unsigned long)server.requests, printed(output, "comandos="), printed(output, "actualizaciones="));
+    TEST_MESSAGE(message);
+    TEST_ASSERT_TRUE(printed(output, "comandos=") > 0);
+    TEST_ASSERT_TRUE(printed(output, "actualizaciones=") > 0);
+    TEST_ASSERT_EQUAL_UINT32(COMMANDS, printed(output, "lote="));
+    TEST_ASSERT_EQUAL_UINT32(1000 * COMMANDS, printed(output, " intervalo="));
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    // Before the clock is first read
+    char scale[8];
+    snprintf(scale, sizeof(scale), "%d", TIME_SCALE);
+    setenv("CHAKIY_TIME_SCALE", scale, 1);
+    UNITY_BEGIN();
+    RUN_TEST(test_full_queues_do_not_block_either_task);
+    return UNITY_END();
+}
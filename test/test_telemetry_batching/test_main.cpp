@@ -0,0 +1,135 @@
+// Telemetry upload cost per batch size: requests per second and bytes on
+// the wire per reading, as the stand-in server receives them. The network
+// task runs on its own thread and the clock runs 200 times faster, so each
+// measured 10 simulated minutes of 5 s readings takes 3 s.
+//
+//   pio test -e native -f test_telemetry_batching -v
+
+#include <unity.h>
+#include <stdlib.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "MockHal.h"
+#include "HttpStandIn.h"
+#include "DeviceManagerImpl.h"
+#include "Log.h"
+
+namespace {
+
+// The mock HAL with the host's clock and threads
+struct BatchingHal : MockHal {
+    using Clock = NativeClock;
+    using Tasks = NativeTasks;
+};
+
+const unsigned long WINDOW_MS = 10 * 60 * 1000UL;
+
+HttpStandIn server;
+std::atomic<unsigned long> uploads(0);
+std::atomic<unsigned long> samples(0);
+std::atomic<unsigned long> bytes(0);
+
+// Each record carries a timestamp except the single-reading form
+unsigned long countRecords(const std::string& body) {
+    unsigned long count = 0;
+    for (size_t at = body.find("timestamp"); at != std::string::npos; at = body.find("timestamp", at + 1)) {
+        count++;
+    }
+    return count > 0 ? count : 1;
+}
+
+std::string backend(const HttpStandInRequest& request) {
+    if (request.method != "POST") {
+        return HttpStandIn::response(404, "");
+    }
+    uploads++;
+    samples += countRecords(request.body);
+    bytes += request.headers.size() + 4 + request.body.size();
+    return HttpStandIn::response(200, "{}");
+}
+
+// Runs the control loop for ms of simulated time
+void run(DeviceManager<BatchingHal>& device, unsigned long ms) {
+    unsigned long start = NativeClock::millis();
+    while (NativeClock::millis() - start < ms) {
+        device.loop();
+    }
+}
+
+}
+
+void setUp(void) {
+    MockHal::reset();
+    logSetLevel(LOG_LEVEL_NONE);
+}
+
+void tearDown(void) {
+}
+
+void test_batch_sizes(void) {
+    server.setHandler(&backend);
+    if (!server.start(5000)) {
+        TEST_IGNORE_MESSAGE("port 5000 is in use");
+    }
+
+    // Every reading is uploaded, so only the batching differs. The device
+    // keeps running after the test, so it is never deleted.
+    DeviceManager<BatchingHal>* device = new DeviceManager<BatchingHal>();
+    device->setServerIP("127.0.0.1");
+    device->setReportByException(false);
+    device->setup();
+
+    struct Case {
+        size_t batch;
+        TelemetryEncoding encoding;
+        const char* name;
+    };
+    const Case cases[] = {
+        { 1, TELEMETRY_JSON, "json" },
+        { 4, TELEMETRY_JSON, "json" },
+        { 8, TELEMETRY_JSON, "json" },
+        { 16, TELEMETRY_JSON, "json" },
+        { 16, TELEMETRY_CBOR, "cbor" },
+    };
+    double bytesPerSample[5];
+    for (int i = 0; i < 5; i++) {
+        device->setTelemetryBatch(cases[i].batch, WINDOW_MS);
+        device->setTelemetryEncoding(cases[i].encoding);
+        // One full batch to flush what the previous setting left behind
+        run(*device, cases[i].batch * 5000 + 2000);
+
+        unsigned long uploadsBefore = uploads, samplesBefore = samples, bytesBefore = bytes;
+        run(*device, WINDOW_MS);
+        unsigned long windowUploads = uploads - uploadsBefore;
+        unsigned long windowSamples = samples - samplesBefore;
+        bytesPerSample[i] = windowSamples ? (double)(bytes - bytesBefore) / windowSamples : 0;
+
+        char message[160];
+        snprintf(message, sizeof(message), "batch %2u %s: %3lu requests, %3lu readings, %.4f requests/s, %.1f bytes/reading",
+                 (unsigned)cases[i].batch, cases[i].name, windowUploads, windowSamples,
+                 windowUploads * 1000.0 / WINDOW_MS, bytesPerSample[i]);
+        TEST_MESSAGE(message);
+
+        // One reading every 5 s, never more than the batch size per request.
+        // Sixteen JSON records do not fit the request buffer, so those go out
+        // as two requests of eight.
+        TEST_ASSERT_TRUE(windowSamples >= WINDOW_MS / 5000 - cases[i].batch - 1);
+        TEST_ASSERT_TRUE(windowUploads * cases[i].batch + cases[i].batch >= windowSamples);
+    }
+
+    // The HTTP head dominates single readings; batching spreads it
+    TEST_ASSERT_TRUE(bytesPerSample[1] < bytesPerSample[0] * 0.6);
+    TEST_ASSERT_TRUE(bytesPerSample[2] < bytesPerSample[1]);
+    TEST_ASSERT_TRUE(bytesPerSample[4] < bytesPerSample[3]);
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    // Before the clock is first read
+    setenv("CHAKIY_TIME_SCALE", "200", 1);
+    UNITY_BEGIN();
+    RUN_TEST(test_batch_sizes);
+    return UNITY_END();
+}
@@ -0,0 +1,167 @@
+// Record timestamps and zones as the stand-in server receives them: logged
+// readings for a zone that is no longer configured are dropped and counted,
+// readings wait for NTP instead of going out stamped 1970, go out without a
+// timestamp if too many pile up first, and carry real ones once the clock
+// is set. The network task runs on its own thread and the clock runs 200
+// times faster.
+//
+//   pio test -e native -f test_telemetry_clock -v
+
+#include <unity.h>
+#include <stdlib.h>
+#include <atomic>
+#include <string>
+#include "MockHal.h"
+#include "HttpStandIn.h"
+#include "DeviceManagerImpl.h"
+#include "TelemetryLogImpl.h"
+#include "Log.h"
+
+namespace {
+
+// The host's clock, with NTP sync under the test's control
+struct HeldClock : NativeClock {
+    static inline std::atomic<bool> synced{false};
+
+    static bool localTime(struct tm* info) {
+        return synced && NativeClock::localTime(info);
+    }
+};
+
+struct ClockHal : MockHal {
+    using Clock = HeldClock;
+    using Tasks = NativeTasks;
+};
+
+const time_t LOGGED_AT = 1718013600;
+const unsigned long EARLIEST = 1600000000;     // Anything before is a clock that was never set
+
+HttpStandIn server;
+std::atomic<unsigned long> records(0);
+std::atomic<unsigned long> stamped(0);
+std::atomic<unsigned long> badStamps(0);
+std::atomic<unsigned long> loggedRecords(0);
+
+std::string backend(const HttpStandInRequest& request) {
+    if (request.method != "POST") {
+        return HttpStandIn::response(404, "");
+    }
+    const std::string& body = request.body;
+    for (size_t at = body.find("\"temperature\""); at != std::string::npos; at = body.find("\"temperature\"", at + 1)) {
+        records++;
+    }
+    for (size_t at = body.find("\"timestamp\":"); at != std::string::npos; at = body.find("\"timestamp\":", at + 1)) {
+        unsigned long timestamp = strtoul(body.c_str() + at + 12, nullptr, 10);
+        stamped++;
+        if (timestamp < EARLIEST) badStamps++;
+        if (timestamp >= (unsigned long)LOGGED_AT && timestamp < (unsigned long)LOGGED_AT + 1000) loggedRecords++;
+    }
+    return HttpStandIn::response(200, "{}");
+}
+
+void resetCounts() {
+    records = 0;
+    stamped = 0;
+    badStamps = 0;
+    loggedRecords = 0;
+}
+
+// Runs the control loop for ms of simulated time, or until done
+template <typename Done>
+bool runUntil(DeviceManager<ClockHal>& device, unsigned long ms, Done done) {
+    unsigned long start = NativeClock::millis();
+    while (NativeClock::millis() - start < ms) {
+        device.loop();
+        if (done()) return true;
+    }
+    return false;
+}
+
+void run(DeviceManager<ClockHal>& device, unsigned long ms) {
+    runUntil(device, ms, []() { return false; });
+}
+
+std::string jobs(DeviceManager<ClockHal>& device) {
+    MockConsole& console = MockHal::console();
+    console.output.clear();
+    console.input.push_back("JOBS");
+    device.processSerialCommands();
+    return console.output;
+}
+
+}
+
+void setUp(void) {
+    MockHal::reset();
+    logSetLevel(LOG_LEVEL_NONE);
+}
+
+void tearDown(void) {
+}
+
+void test_records_wait_for_the_clock(void) {
+    server.setHandler(&backend);
+    if (!server.start(5000)) {
+        TEST_IGNORE_MESSAGE("port 5000 is in use");
+    }
+
+    // A previous boot logged six readings for zone 0 and four for a zone
+    // this configuration does not have
+    {
+        TelemetryLog<ClockHal> log;
+        log.begin();
+        for (int i = 0; i < 10; i++) {
+            TelemetryRecord record = {};
+            record.timestamp = LOGGED_AT + i * 5;
+            record.temperature = 24.0f;
+            record.humidity = 55.0f;
+            record.zone = i % 5 < 3 ? 0 : 5;
+            log.append(record);
+        }
+    }
+
+    // The device keeps running after the test, so it is never deleted
+    DeviceManager<ClockHal>* device = new DeviceManager<ClockHal>();
+    device->setServerIP("127.0.0.1");
+    device->setReportByException(false);
+    device->setTelemetryBatch(4, 30000);
+    device->setup();
+
+    // The log is replayed without waiting for the clock, minus zone 5
+    TEST_ASSERT_TRUE(runUntil(*device, 60000, []() { return loggedRecords >= 6; }));
+    run(*device, 20000);
+    TEST_ASSERT_EQUAL_UINT32(6, loggedRecords);
+    TEST_ASSERT_EQUAL_UINT32(6, records);
+    TEST_ASSERT_TRUE(jobs(*device).find("zona desconocida=4") != std::string::npos);
+
+    // Fresh readings are held until CLOCK_HOLD_SAMPLES pile up, then go
+    // out unstamped rather than stamped 1970
+    resetCounts();
+    TEST_ASSERT_TRUE(runUntil(*device, 5 * 60000, []() { return records >= 16; }));
+    run(*device, 5000);
+    TEST_ASSERT_EQUAL_UINT32(0, stamped);
+    TEST_ASSERT_TRUE(jobs(*device).find("sin hora NTP=0") == std::string::npos);
+
+    // Once NTP sets the clock, everything carries a real timestamp
+    HeldClock::synced = true;
+    run(*device, 60000);
+    resetCounts();
+    run(*device, 3 * 60000);
+    char message[96];
+    snprintf(message, sizeof(message), "after sync: %lu records, %lu stamped, %lu before 2020",
+             (unsigned long)records, (unsigned long)stamped, (unsigned long)badStamps);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_TRUE(records >= 3 * 60 / 5 - 8);
+    TEST_ASSERT_EQUAL_UINT32(records, stamped);
+    TEST_ASSERT_EQUAL_UINT32(0, badStamps);
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    // Before the clock is first read
+    setenv("CHAKIY_TIME_SCALE", "200", 1);
+    UNITY_BEGIN();
+    RUN_TEST(test_records_wait_for_the_clock);
+    return UNITY_END();
+}
@@ -0,0 +1,223 @@
+// TelemetryLog on the mock flash: surviving a reset, oldest-first eviction,
+// CRC-damaged and torn records, failing storage, and what it costs in
+// bytes written and replay time.
+//
+//   pio test -e native -f test_telemetry_log -v
+
+#include <unity.h>
+#include <chrono>
+#include "MockHal.h"
+#include "TelemetryLogImpl.h"
+#include "Log.h"
+
+namespace {
+
+typedef TelemetryLog<MockHal> Log;
+
+const uint32_t SEGMENT = Log::SEGMENT_RECORDS;
+
+bool appendReadings(Log& log, uint32_t first, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        TelemetryRecord record = {};
+        record.timestamp = 1718013600 + (first + i) * 5;
+        record.temperature = 24.0f;
+        record.humidity = 55.0f;
+        record.ica = (int16_t)((first + i) % 100);
+        if (!log.append(record)) return false;
+    }
+    return true;
+}
+
+// Delivers everything pending in batches, checking the timestamps run on
+// from expectFirst; returns how many were delivered
+uint32_t drain(Log& log, uint32_t expectFirst, size_t batch = 16) {
+    TelemetryRecord records[64];
+    uint32_t delivered = 0;
+    uint32_t next;
+    for (;;) {
+        size_t count = log.peek(records, batch, next);
+        if (count == 0) break;
+        for (size_t i = 0; i < count; i++) {
+            TEST_ASSERT_EQUAL_UINT32(1718013600 + (expectFirst + delivered + i) * 5, records[i].timestamp);
+        }
+        delivered += count;
+        log.acknowledge(next);
+    }
+    return delivered;
+}
+
+double nanosSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+}
+
+void setUp(void) {
+    MockHal::reset();
+    logSetLevel(LOG_LEVEL_NONE);
+}
+
+void tearDown(void) {
+}
+
+void test_pending_records_survive_a_reset(void) {
+    {
+        Log log;
+        TEST_ASSERT_TRUE(log.begin());
+        TEST_ASSERT_TRUE(appendReadings(log, 0, 100));
+        TelemetryRecord records[30];
+        uint32_t next;
+        TEST_ASSERT_EQUAL(30, log.peek(records, 30, next));
+        log.acknowledge(next);
+        TEST_ASSERT_EQUAL_UINT32(70, log.getPending());
+    }
+
+    // A new boot finds the same 70, and numbering carries on after them
+    Log log;
+    TEST_ASSERT_TRUE(log.begin());
+    TEST_ASSERT_EQUAL_UINT32(70, log.getPending());
+    TEST_ASSERT_TRUE(appendReadings(log, 100, 10));
+    TEST_ASSERT_EQUAL_UINT32(80, drain(log, 30));
+    TEST_ASSERT_TRUE(log.isEmpty());
+    TEST_ASSERT_EQUAL(0, (int)log.getStats().corrupt);
+}
+
+void test_a_full_log_evicts_oldest_first(void) {
+    Log log;
+    log.begin();
+    uint32_t total = Log::CAPACITY + 100;
+    TEST_ASSERT_TRUE(appendReadings(log, 0, total));
+
+    // Whole segments go, so what is left is the newest readings, in order
+    uint32_t pending = log.getPending();
+    TEST_ASSERT_TRUE(pending <= Log::CAPACITY && pending > Log::CAPACITY - SEGMENT);
+    TEST_ASSERT_EQUAL_UINT32(total - pending, log.getStats().evicted);
+    TEST_ASSERT_EQUAL_UINT32(pending, drain(log, total - pending));
+    TEST_ASSERT_TRUE(MockStorage::files.size() <= Log::SEGMENT_COUNT + 1);
+}
+
+void test_damaged_record_skips_the_rest_of_its_segment(void) {
+    {
+        Log log;
+        log.begin();
+        appendReadings(log, 0, 2 * SEGMENT + 10);
+    }
+    // A bit flips in the sixth record of the second segment
+    MockStorage::files["/tlm1.log"][5 * sizeof(TelemetryRecord) + 9] ^= 0x10;
+
+    Log log;
+    log.begin();
+    TelemetryRecord records[SEGMENT];
+    uint32_t next;
+    uint32_t delivered = 0;
+    uint32_t expected = 0;
+    for (;;) {
+        size_t count = log.peek(records, SEGMENT, next);
+        if (count == 0) break;
+        for (size_t i = 0; i < count; i++) {
+            // Nothing damaged is ever handed out
+            if (expected == SEGMENT + 5) expected = 2 * SEGMENT;
+            TEST_ASSERT_EQUAL_UINT32(expected, records[i].sequence);
+            expected++;
+        }
+        delivered += count;
+        log.acknowledge(next);
+    }
+    TEST_ASSERT_EQUAL_UINT32(SEGMENT + 5 + 10, delivered);
+    TEST_ASSERT_EQUAL(SEGMENT - 5, (int)log.getStats().corrupt);
+    TEST_ASSERT_TRUE(log.isEmpty());
+}
+
+void test_torn_tail_is_not_appended_to(void) {
+    {
+        Log log;
+        log.begin();
+        appendReadings(log, 0, 20);
+    }
+    // Power lost in the middle of a write
+    std::vector<uint8_t>& segment = MockStorage::files["/tlm0.log"];
+    segment.resize(segment.size() + 7, 0xAB);
+
+    Log log;
+    log.begin();
+    TEST_ASSERT_EQUAL(1, (int)log.getStats().corrupt);
+    TEST_ASSERT_TRUE(appendReadings(log, 20, 5));
+
+    // The 20 intact records, then the new ones from the next segment
+    TelemetryRecord records[32];
+    uint32_t next;
+    TEST_ASSERT_EQUAL(20, log.peek(records, 32, next));
+    log.acknowledge(next);
+    TEST_ASSERT_EQUAL(5, log.peek(records, 32, next));
+    TEST_ASSERT_EQUAL_UINT32(SEGMENT, records[0].sequence);
+    TEST_ASSERT_EQUAL_UINT32(1718013600 + 20 * 5, records[0].timestamp);
+}
+
+void test_failing_storage_is_reported(void) {
+    MockStorage::failing = true;
+    Log log;
+    TEST_ASSERT_FALSE(log.begin());
+    TEST_ASSERT_FALSE(log.isAvailable());
+    TEST_ASSERT_FALSE(appendReadings(log, 0, 1));
+    TelemetryRecord record;
+    uint32_t next;
+    TEST_ASSERT_EQUAL(0, log.peek(&record, 1, next));
+}
+
+void test_benchmark_write_amplification_and_replay(void) {
+    char message[128];
+
+    // Steady outage-and-recovery traffic: readings appended one by one,
+    // delivered in batches of 16 as the server answers
+    {
+        Log log;
+        log.begin();
+        for (uint32_t i = 0; i < 10000; i += 16) {
+            appendReadings(log, i, 16);
+            drain(log, i);
+        }
+        const TelemetryLogStats& stats = log.getStats();
+        snprintf(message, sizeof(message), "write amplification, batches of 16: %.3f (%lu record bytes, %lu written)",
+                 (double)MockStorage::bytesWritten / stats.recordBytes, stats.recordBytes, MockStorage::bytesWritten);
+        TEST_MESSAGE(message);
+        TEST_ASSERT_EQUAL_UINT32(stats.flashBytes, MockStorage::bytesWritten);
+        TEST_ASSERT_TRUE(MockStorage::bytesWritten < stats.recordBytes * 3 / 2);
+    }
+
+    // A full log replayed after a long outage, in the upload's batch sizes:
+    // one storage read per segment a batch touches
+    const size_t batches[] = { 1, 16, 64 };
+    for (size_t b = 0; b < 3; b++) {
+        const int rounds = 50;
+        double nanos = 0;
+        unsigned long reads = 0;
+        for (int round = 0; round < rounds; round++) {
+            MockStorage::clear();
+            Log log;
+            log.begin();
+            appendReadings(log, 0, Log::CAPACITY);
+            unsigned long readsBefore = MockStorage::reads;
+            auto start = std::chrono::steady_clock::now();
+            TEST_ASSERT_EQUAL_UINT32(Log::CAPACITY, drain(log, 0, batches[b]));
+            nanos += nanosSince(start);
+            reads += MockStorage::reads - readsBefore;
+        }
+        double records = (double)rounds * Log::CAPACITY;
+        snprintf(message, sizeof(message), "replay, batches of %u: %.0f records/s on the host, %.3f reads/record",
+                 (unsigned)batches[b], records / (nanos / 1e9), reads / records);
+        TEST_MESSAGE(message);
+    }
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_pending_records_survive_a_reset);
+    RUN_TEST(test_a_full_log_evicts_oldest_first);
+    RUN_TEST(test_damaged_record_skips_the_rest_of_its_segment);
+    RUN_TEST(test_torn_tail_is_not_appended_to);
+    RUN_TEST(test_failing_storage_is_reported);
+    RUN_TEST(test_benchmark_write_amplification_and_replay);
+    return UNITY_END();
+}
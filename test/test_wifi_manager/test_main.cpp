@@ -0,0 +1,232 @@
+// WifiManager and Backoff on the mock clock and network: an attempt that
+// times out waits a jittered delay from the upper half of its step, the
+// steps double up to RETRY_MAX and go back to RETRY_MIN once connected, a
+// dropped link is retried at once with the outage recorded, and a seed
+// always gives the same delays.
+//
+//   pio test -e native -f test_wifi_manager -v
+
+#include <unity.h>
+#include <stdio.h>
+#include <vector>
+#include "MockHal.h"
+#include "WifiManagerImpl.h"
+#include "Log.h"
+
+namespace {
+
+typedef WifiManager<MockHal> Wifi;
+
+const unsigned long CONNECT_TIMEOUT = Wifi::CONNECT_TIMEOUT;
+const unsigned long RETRY_MIN = Wifi::RETRY_MIN;
+const unsigned long RETRY_MAX = Wifi::RETRY_MAX;
+
+// Upper bound of the delay after the given number of failures in a row
+unsigned long stepAfter(int failures) {
+    unsigned long step = RETRY_MIN;
+    for (int i = 1; i < failures; i++) {
+        step = step < RETRY_MAX / 2 ? step * 2 : RETRY_MAX;
+    }
+    return step;
+}
+
+// Lets the attempt in progress time out and returns the delay it waits,
+// leaving the clock at the retry
+unsigned long failAttempt(Wifi& wifi) {
+    TEST_ASSERT_EQUAL(Wifi::CONNECTING, wifi.getState());
+    MockClock::advance(CONNECT_TIMEOUT - 1);
+    TEST_ASSERT_EQUAL(Wifi::NONE, wifi.step());
+    TEST_ASSERT_EQUAL(Wifi::CONNECTING, wifi.getState());
+    MockClock::advance(1);
+    TEST_ASSERT_EQUAL(Wifi::NONE, wifi.step());
+    TEST_ASSERT_EQUAL(Wifi::WAITING, wifi.getState());
+    unsigned long delay = wifi.getRetryAt() - MockClock::now;
+
+    // Nothing is started before the retry is due
+    unsigned long begins = MockNetwork::begins;
+    MockClock::advance(delay - 1);
+    wifi.step();
+    TEST_ASSERT_EQUAL(Wifi::WAITING, wifi.getState());
+    TEST_ASSERT_EQUAL_UINT32(begins, MockNetwork::begins);
+    MockClock::advance(1);
+    wifi.step();
+    TEST_ASSERT_EQUAL(Wifi::CONNECTING, wifi.getState());
+    TEST_ASSERT_EQUAL_UINT32(begins + 1, MockNetwork::begins);
+    return delay;
+}
+
+void checkDelay(unsigned long delay, int failures) {
+    unsigned long step = stepAfter(failures);
+    char message[80];
+    snprintf(message, sizeof(message), "failure %d: %lu ms, step %lu ms", failures, delay, step);
+    TEST_ASSERT_TRUE_MESSAGE(delay >= step / 2 && delay <= step, message);
+}
+
+// Starts a manager on an unreachable network, through its first attempt
+void startOffline(Wifi& wifi) {
+    MockNetwork::connected = false;
+    wifi.begin("Casa", "secreta");
+    TEST_ASSERT_EQUAL(Wifi::WAITING, wifi.getState());
+    wifi.step();
+    TEST_ASSERT_EQUAL(Wifi::CONNECTING, wifi.getState());
+}
+
+// The delays of a manager failing failures times in a row
+std::vector<unsigned long> failureDelays(uint32_t seed, int failures) {
+    MockHal::reset();
+    MockNetwork::seed = seed;
+    std::vector<unsigned long> delays;
+    Wifi wifi;
+    startOffline(wifi);
+    for (int i = 0; i < failures; i++) {
+        delays.push_back(failAttempt(wifi));
+    }
+    return delays;
+}
+
+}
+
+void setUp(void) {
+    MockHal::reset();
+    logSetLevel(LOG_LEVEL_NONE);
+}
+
+void tearDown(void) {
+}
+
+void test_timeout_waits_within_the_jitter(void) {
+    Wifi wifi;
+    TEST_ASSERT_EQUAL(Wifi::IDLE, wifi.getState());
+    TEST_ASSERT_EQUAL(Wifi::NONE, wifi.step());
+    TEST_ASSERT_EQUAL_UINT32(0, MockNetwork::begins);
+
+    startOffline(wifi);
+    TEST_ASSERT_EQUAL_UINT32(1, MockNetwork::begins);
+    TEST_ASSERT_EQUAL_UINT32(1, wifi.getStats().attempts);
+
+    unsigned long delay = failAttempt(wifi);
+    checkDelay(delay, 1);
+    TEST_ASSERT_EQUAL_UINT32(1, wifi.getStats().failures);
+    TEST_ASSERT_EQUAL_UINT32(2, wifi.getStats().attempts);
+    TEST_ASSERT_FALSE(wifi.isOnline());
+}
+
+void test_delays_double_up_to_the_cap(void) {
+    Wifi wifi;
+    startOffline(wifi);
+    const int FAILURES = 12;
+    for (int failures = 1; failures <= FAILURES; failures++) {
+        checkDelay(failAttempt(wifi), failures);
+    }
+    TEST_ASSERT_EQUAL_UINT32(RETRY_MAX, stepAfter(FAILURES));
+    TEST_ASSERT_EQUAL_UINT32(FAILURES, wifi.getStats().failures);
+    TEST_ASSERT_EQUAL_UINT32(0, wifi.getStats().connects);
+}
+
+void test_connect_resets_the_backoff(void) {
+    Wifi wifi;
+    startOffline(wifi);
+    for (int failures = 1; failures <= 6; failures++) {
+        failAttempt(wifi);
+    }
+
+    // The seventh attempt gets through
+    MockClock::advance(3000);
+    MockNetwork::connected = true;
+    TEST_ASSERT_EQUAL(Wifi::CONNECTED, wifi.step());
+    TEST_ASSERT_TRUE(wifi.isOnline());
+    TEST_ASSERT_EQUAL_UINT32(1, wifi.getStats().connects);
+    TEST_ASSERT_EQUAL_UINT32(0, wifi.getStats().longestOutageMs);
+
+    // The next failure backs off from RETRY_MIN again
+    MockClock::advance(60000);
+    MockNetwork::connected = false;
+    TEST_ASSERT_EQUAL(Wifi::DISCONNECTED, wifi.step());
+    checkDelay(failAttempt(wifi), 1);
+    checkDelay(failAttempt(wifi), 2);
+}
+
+void test_drop_retries_at_once_and_records_the_outage(void) {
+    Wifi wifi;
+    wifi.begin("Casa", "secreta");
+    wifi.step();
+    TEST_ASSERT_EQUAL(Wifi::CONNECTED, wifi.step());
+
+    MockClock::advance(60000);
+    TEST_ASSERT_EQUAL_UINT32(60000, wifi.getConnectedMs());
+    unsigned long begins = MockNetwork::begins;
+    MockNetwork::connected = false;
+    unsigned long droppedAt = MockClock::now;
+    TEST_ASSERT_EQUAL(Wifi::DISCONNECTED, wifi.step());
+    TEST_ASSERT_EQUAL(Wifi::CONNECTING, wifi.getState());
+    TEST_ASSERT_EQUAL_UINT32(begins + 1, MockNetwork::begins);
+    TEST_ASSERT_EQUAL_UINT32(1, wifi.getStats().drops);
+    TEST_ASSERT_EQUAL_UINT32(60000, wifi.getStats().connectedMs);
+
+    // Two failed attempts, then back a little into the third
+    failAttempt(wifi);
+    failAttempt(wifi);
+    MockClock::advance(500);
+    MockNetwork::connected = true;
+    TEST_ASSERT_EQUAL(Wifi::CONNECTED, wifi.step());
+    unsigned long outage = MockClock::now - droppedAt;
+    TEST_ASSERT_EQUAL_UINT32(outage, wifi.getStats().longestOutageMs);
+    TEST_ASSERT_EQUAL_UINT32(60000, wifi.getConnectedMs());
+
+    // A shorter outage leaves the longest alone
+    MockClock::advance(10000);
+    MockNetwork::connected = false;
+    TEST_ASSERT_EQUAL(Wifi::DISCONNECTED, wifi.step());
+    MockClock::advance(1000);
+    MockNetwork::connected = true;
+    TEST_ASSERT_EQUAL(Wifi::CONNECTED, wifi.step());
+    TEST_ASSERT_EQUAL_UINT32(outage, wifi.getStats().longestOutageMs);
+    TEST_ASSERT_EQUAL_UINT32(2, wifi.getStats().drops);
+    TEST_ASSERT_EQUAL_UINT32(70000, wifi.getConnectedMs());
+}
+
+void test_same_seed_same_delays(void) {
+    Backoff first(RETRY_MIN, RETRY_MAX);
+    Backoff second(RETRY_MIN, RETRY_MAX);
+    Backoff other(RETRY_MIN, RETRY_MAX);
+    Backoff unseeded(RETRY_MIN, RETRY_MAX);
+    first.seed(42);
+    second.seed(42);
+    other.seed(43);
+    int differing = 0;
+    for (int i = 0; i < 20; i++) {
+        unsigned long delay = first.next();
+        TEST_ASSERT_EQUAL_UINT32(delay, second.next());
+        if (other.next() != delay) differing++;
+    }
+    TEST_ASSERT_TRUE(differing > 10);
+
+    // A zero seed, which xorshift cannot use, falls back to the default
+    Backoff zero(RETRY_MIN, RETRY_MAX);
+    zero.seed(0);
+    for (int i = 0; i < 20; i++) {
+        TEST_ASSERT_EQUAL_UINT32(unseeded.next(), zero.next());
+    }
+
+    // The manager seeds from the network's random(), once per begin()
+    std::vector<unsigned long> delays = failureDelays(42, 8);
+    TEST_ASSERT_TRUE(delays == failureDelays(42, 8));
+    TEST_ASSERT_FALSE(delays == failureDelays(43, 8));
+    Backoff expected(RETRY_MIN, RETRY_MAX);
+    expected.seed(42);
+    for (unsigned long delay : delays) {
+        TEST_ASSERT_EQUAL_UINT32(expected.next(), delay);
+    }
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_timeout_waits_within_the_jitter);
+    RUN_TEST(test_delays_double_up_to_the_cap);
+    RUN_TEST(test_connect_resets_the_backoff);
+    RUN_TEST(test_drop_retries_at_once_and_records_the_outage);
+    RUN_TEST(test_same_seed_same_delays);
+    return UNITY_END();
+}